@@ -0,0 +1,102 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "allocCounter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace topicMonitor
+{
+
+#ifdef TOPIC_MONITOR_COUNT_ALLOCATIONS
+
+static std::atomic<uint64_t> allocCount_s(0);
+
+bool AllocCounter::isEnabled(void) { return true; }
+
+uint64_t
+AllocCounter::getCount(void)
+{
+    return allocCount_s.load(std::memory_order_relaxed);
+}
+
+static void*
+countedAlloc(std::size_t size)
+{
+    allocCount_s.fetch_add(1, std::memory_order_relaxed);
+
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) { throw std::bad_alloc(); }
+    return p;
+}
+
+#else
+
+bool AllocCounter::isEnabled(void) { return false; }
+
+uint64_t AllocCounter::getCount(void) { return 0; }
+
+#endif /* TOPIC_MONITOR_COUNT_ALLOCATIONS */
+
+} /* namespace topicMonitor */
+
+#ifdef TOPIC_MONITOR_COUNT_ALLOCATIONS
+
+// Replacements for the global allocation functions. The array and nothrow
+// forms are routed through the same counter.
+//
+void* operator new(std::size_t size)
+{
+    return topicMonitor::countedAlloc(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return topicMonitor::countedAlloc(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return topicMonitor::countedAlloc(size); }
+    catch (...) { return nullptr; }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return topicMonitor::countedAlloc(size); }
+    catch (...) { return nullptr; }
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+#endif /* TOPIC_MONITOR_COUNT_ALLOCATIONS */
@@ -26,53 +26,27 @@
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 //******************************************************************************
-#ifndef _TOPIC_MONITOR_QUEUE_HPP_
-#define _TOPIC_MONITOR_QUEUE_HPP_
+#ifndef _TOPIC_MONITOR_ALLOC_COUNTER_HPP_
+#define _TOPIC_MONITOR_ALLOC_COUNTER_HPP_
 
-#include <condition_variable>
-#include <mutex>
-#include <queue>
-
-#include "common.hpp"
+#include <cstdint>
 
 namespace topicMonitor
 {
 
-template <class T>
-class ThreadSafeQueue
+// Counts heap allocations made through the global operator new. Counting is
+// only compiled in when building with -DCOUNT_ALLOCATIONS=ON, otherwise
+// isEnabled() returns false and getCount() always returns 0.
+//
+// This is used to check that the per-message path does not allocate.
+//
+class AllocCounter
 {
 public:
-    ThreadSafeQueue(void) {}
-    ~ThreadSafeQueue(void) {}
-
-    void push(T entry_p)
-    {
-        std::unique_lock<std::mutex> lock(mutex_m);
-        queue_m.push(entry_p);
-        lock.unlock();
-        cond_m.notify_one();
-    }
-
-    T pop(void)
-    {
-        std::unique_lock<std::mutex> lock(mutex_m);
-
-        while (queue_m.empty())
-        {
-            cond_m.wait(lock);
-        }
-
-        T entry_p = queue_m.front();
-        queue_m.pop();
-        return entry_p;
-    }
-
-private:
-    std::queue<T>           queue_m;
-    std::mutex              mutex_m;
-    std::condition_variable cond_m;
+    static bool isEnabled(void);
+    static uint64_t getCount(void);
 };
 
 } /* namespace topicMonitor */
 
-#endif /* _TOPIC_MONITOR_QUEUE_HPP_ */
+#endif /* _TOPIC_MONITOR_ALLOC_COUNTER_HPP_ */
@@ -0,0 +1,230 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+//
+// Measures the cost of dispatching a message to a script's onMessage()
+// function, comparing the original by-name dispatch (string-keyed env table
+// lookup, then lua_getfield() on the registry and the env) against the
+// dispatch of MonitoringWorker::handleWorkTypeMessageReceived(): the
+// subscription's SubscriptionHandle looked up by topic id, and its cached
+// registry references called with the payload passed as a LuaBuffer and a
+// LuaMessage. Both paths read the payload of the same solClient message.
+//
+// Usage: lua-dispatch-benchmark [messages]
+//
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <lua5.2/lua.hpp>
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "luaBuffer.hpp"
+#include "luaMessage.hpp"
+#include "monitoringWorker.hpp"
+#include "utils.hpp"
+
+using namespace topicMonitor;
+
+typedef std::chrono::steady_clock BenchClock;
+
+static const char* const TOPIC  = "sensors/building-7/floor-3/temperature";
+static const char* const ENV    = "temperature.lua";
+static const char* const SCRIPT =
+    "count = 0\n"
+    "function onMessage(msg) count = count + 1 end\n";
+
+// Mirrors utils::lua::loadFileInEnv() for an in-memory script
+//
+static void
+loadScriptInEnv(lua_State* L, const char* script_p, const char* env_p)
+{
+    if (luaL_loadstring(L, script_p) != LUA_OK)
+    {
+        fprintf(stderr, "Could not load script: %s\n", lua_tostring(L, -1));
+        exit(-1);
+    }
+
+    lua_newtable(L);
+    lua_newtable(L);
+    lua_getglobal(L, "_G");
+    lua_setfield(L, -2, "__index");
+    lua_setmetatable(L, -2);
+    lua_setfield(L, LUA_REGISTRYINDEX, env_p);
+    lua_getfield(L, LUA_REGISTRYINDEX, env_p);
+    lua_setupvalue(L, -2, 1);
+    if (lua_pcall(L, 0, 0, 0) != LUA_OK)
+    {
+        fprintf(stderr, "Could not run script: %s\n", lua_tostring(L, -1));
+        exit(-1);
+    }
+}
+
+// The dispatch path before subscription handles were introduced
+//
+static double
+benchmarkByName(lua_State* L, uint64_t messages, solClient_opaqueMsg_pt msg_p)
+{
+    std::unordered_map<std::string, std::string> envTable;
+    envTable[TOPIC] = ENV;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (uint64_t i=0; i<messages; i++)
+    {
+        // The topic arrives as a const char* from the message destination
+        //
+        const char* topic_p = TOPIC;
+        if (envTable.find(topic_p) == envTable.end()) { exit(-1); }
+        std::string env = envTable[topic_p];
+
+        const char* data_p;
+        size_t size;
+        if (utils::getPayload(msg_p, data_p, size) != returnCode_t::SUCCESS)
+        {
+            exit(-1);
+        }
+        std::string data(data_p, size);
+
+        lua_getfield(L, LUA_REGISTRYINDEX, env.c_str());
+        lua_getfield(L, -1, "onMessage");
+        lua_pushstring(L, data.c_str());
+        if (lua_pcall(L, 1, 0, 0) != LUA_OK) { exit(-1); }
+        lua_pop(L, 1); // env table
+    }
+    BenchClock::duration elapsed = BenchClock::now() - start;
+
+    return std::chrono::duration<double, std::nano>(elapsed).count()
+               / messages;
+}
+
+// The dispatch path of MonitoringWorker, through the SubscriptionHandle of
+// the topic id the message was queued with
+//
+static double
+benchmarkByHandle(lua_State* L, uint64_t messages, solClient_opaqueMsg_pt msg_p)
+{
+    MonitoringWorker::SubscriptionHandle handle;
+    handle.topicId = 7;
+    handle.topic = TOPIC;
+    handle.envRef = utils::lua::refEnv(L, ENV);
+    handle.messageFuncRef = utils::lua::refFuncInEnv(L, handle.envRef,
+                                                     "onMessage");
+    lua_pushstring(L, TOPIC);
+    handle.subscriptionRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    std::vector<MonitoringWorker::SubscriptionHandle*> handlesById(
+        handle.topicId + 1, nullptr);
+    handlesById[handle.topicId] = &handle;
+
+    LuaBuffer* payload_p = LuaBuffer::create(L);
+    LuaMessage* message_p = LuaMessage::create(L);
+
+    BenchClock::time_point start = BenchClock::now();
+    for (uint64_t i=0; i<messages; i++)
+    {
+        topicId_t topicId = handle.topicId;
+        if (topicId >= handlesById.size()) { exit(-1); }
+        MonitoringWorker::SubscriptionHandle* handle_p = handlesById[topicId];
+        if (handle_p == nullptr) { exit(-1); }
+
+        const char* data_p;
+        size_t size;
+        if (utils::getPayload(msg_p, data_p, size) != returnCode_t::SUCCESS)
+        {
+            exit(-1);
+        }
+
+        payload_p->set(data_p, size);
+        message_p->set(msg_p);
+        if (utils::lua::callMessageFunc(L,
+                                        handle_p->messageFuncRef,
+                                        payload_p->getRef(),
+                                        handle_p->subscriptionRef,
+                                        message_p->getRef())
+                != returnCode_t::SUCCESS)
+        {
+            exit(-1);
+        }
+        payload_p->invalidate();
+        message_p->invalidate();
+    }
+    BenchClock::duration elapsed = BenchClock::now() - start;
+
+    utils::lua::unref(L, handle.subscriptionRef);
+    utils::lua::unref(L, handle.messageFuncRef);
+    utils::lua::unref(L, handle.envRef);
+
+    return std::chrono::duration<double, std::nano>(elapsed).count()
+               / messages;
+}
+
+int
+main(int argc, char* argv[])
+{
+    uint64_t messages = (argc > 1)?strtoull(argv[1], nullptr, 10):5000000;
+    const char* data_p = "{\"celsius\": 21.5, \"sensor\": \"7-3-12\"}";
+
+    solClient_opaqueMsg_pt msg_p = nullptr;
+    if (solClient_initialize(SOLCLIENT_LOG_DEFAULT_FILTER, nullptr)
+                != SOLCLIENT_OK
+            || solClient_msg_alloc(&msg_p) != SOLCLIENT_OK
+            || solClient_msg_setBinaryAttachment(msg_p, data_p,
+                                                 strlen(data_p))
+                   != SOLCLIENT_OK)
+    {
+        fprintf(stderr, "Could not create message\n");
+        return -1;
+    }
+
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+    LuaBuffer::registerType(L);
+    LuaMessage::registerType(L);
+    loadScriptInEnv(L, SCRIPT, ENV);
+
+    // Warm up both paths
+    //
+    benchmarkByName(L, messages / 10, msg_p);
+    benchmarkByHandle(L, messages / 10, msg_p);
+
+    double byName = benchmarkByName(L, messages, msg_p);
+    double byHandle = benchmarkByHandle(L, messages, msg_p);
+
+    printf("messages:            %llu\n", (unsigned long long)messages);
+    printf("dispatch by name:    %8.1f ns/message\n", byName);
+    printf("dispatch by handle:  %8.1f ns/message\n", byHandle);
+    printf("speedup:             %8.2fx\n", byName / byHandle);
+
+    lua_close(L);
+    solClient_msg_free(&msg_p);
+    return 0;
+}
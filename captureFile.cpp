@@ -0,0 +1,441 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "captureFile.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log.hpp"
+#include "utils.hpp"
+
+namespace topicMonitor
+{
+
+static const char CAPTURE_MAGIC[8] = { 'T', 'M', 'C', 'A', 'P', 'T', 'U', 'R' };
+
+static size_t
+alignRecord(size_t size)
+{
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+CaptureWriter::CaptureWriter(void) :
+    fd_m(-1),
+    base_mp(nullptr),
+    mappedSize_m(0),
+    offset_m(0),
+    records_m(0)
+{
+}
+
+CaptureWriter::~CaptureWriter(void)
+{
+    close();
+}
+
+returnCode_t
+CaptureWriter::open(const std::string& filename)
+{
+    if (fd_m != -1) { return returnCode_t::FAILURE; }
+
+    fd_m = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_m == -1)
+    {
+        LOG(ERROR, "Could not open capture file '" << filename << "' ("
+                   << strerror(errno) << ")");
+        return returnCode_t::FAILURE;
+    }
+
+    filename_m = filename;
+    if (grow(sizeof(CaptureFileHeader)) != returnCode_t::SUCCESS)
+    {
+        close();
+        return returnCode_t::FAILURE;
+    }
+
+    CaptureFileHeader* header_p = (CaptureFileHeader*)base_mp;
+    memcpy(header_p->magic, CAPTURE_MAGIC, sizeof(header_p->magic));
+    header_p->version = CaptureFileHeader::VERSION;
+    header_p->reserved = 0;
+    offset_m = sizeof(CaptureFileHeader);
+
+    LOG(INFO, "Capturing messages to '" << filename << "'");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+CaptureWriter::close(void)
+{
+    if (fd_m == -1) { return returnCode_t::NOTHING_TO_DO; }
+
+    returnCode_t rc = returnCode_t::SUCCESS;
+
+    if (base_mp != nullptr) { munmap(base_mp, mappedSize_m); }
+    if (ftruncate(fd_m, offset_m) != 0) { rc = returnCode_t::FAILURE; }
+    ::close(fd_m);
+
+    LOG(INFO, "Captured " << records_m << " messages to '" << filename_m
+              << "'");
+
+    fd_m = -1;
+    base_mp = nullptr;
+    mappedSize_m = 0;
+    offset_m = 0;
+    records_m = 0;
+    return rc;
+}
+
+returnCode_t
+CaptureWriter::grow(size_t minSize)
+{
+    size_t size = mappedSize_m;
+    while (size < minSize) { size += GROW_SIZE; }
+
+    // The new space reads as zeroes, which ends the records
+    //
+    if (ftruncate(fd_m, size) != 0)
+    {
+        LOG(ERROR, "Could not grow capture file (" << strerror(errno) << ")");
+        return returnCode_t::FAILURE;
+    }
+
+    if (base_mp != nullptr) { munmap(base_mp, mappedSize_m); }
+
+    void* base_p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        fd_m, 0);
+    if (base_p == MAP_FAILED)
+    {
+        LOG(ERROR, "Could not map capture file (" << strerror(errno) << ")");
+        base_mp = nullptr;
+        mappedSize_m = 0;
+        return returnCode_t::FAILURE;
+    }
+
+    base_mp = (char*)base_p;
+    mappedSize_m = size;
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+getCaptureFields(solClient_opaqueMsg_pt msg_p,
+                 int64_t rcvTimestamp,
+                 CaptureFields& fields)
+{
+    solClient_destination_t dest;
+    if (solClient_msg_getDestination(msg_p, &dest, sizeof(dest))
+            != SOLCLIENT_OK)
+    {
+        return returnCode_t::FAILURE;
+    }
+
+    const char* payload_p;
+    size_t payloadLength;
+    if (utils::getPayload(msg_p, payload_p, payloadLength)
+            != returnCode_t::SUCCESS)
+    {
+        return returnCode_t::FAILURE;
+    }
+
+    CaptureRecordHeader& header = fields.header;
+    header.flags = 0;
+    header.rcvTimestamp = rcvTimestamp;
+    header.senderTimestamp = 0;
+    header.sequenceNumber = 0;
+
+    solClient_int64_t value;
+    if (solClient_msg_getSenderTimestamp(msg_p, &value) == SOLCLIENT_OK)
+    {
+        header.flags |= CaptureRecordHeader::HAS_SENDER_TIMESTAMP;
+        header.senderTimestamp = value;
+    }
+    if (solClient_msg_getSequenceNumber(msg_p, &value) == SOLCLIENT_OK)
+    {
+        header.flags |= CaptureRecordHeader::HAS_SEQUENCE_NUMBER;
+        header.sequenceNumber = value;
+    }
+
+    const char* correlationId_p = "";
+    if (solClient_msg_getCorrelationId(msg_p, &correlationId_p)
+            == SOLCLIENT_OK)
+    {
+        header.flags |= CaptureRecordHeader::HAS_CORRELATION_ID;
+    }
+    else
+    {
+        correlationId_p = "";
+    }
+
+    size_t topicLength = strlen(dest.dest);
+    size_t correlationIdLength = strlen(correlationId_p);
+    if (topicLength > UINT16_MAX || correlationIdLength > UINT16_MAX
+            || payloadLength > UINT32_MAX)
+    {
+        return returnCode_t::FAILURE;
+    }
+
+    header.topicLength = topicLength;
+    header.correlationIdLength = correlationIdLength;
+    header.payloadLength = payloadLength;
+    header.size = alignRecord(sizeof(header) + topicLength + 1
+                              + correlationIdLength + 1 + payloadLength);
+
+    fields.topic_p = dest.dest;
+    fields.correlationId_p = correlationId_p;
+    fields.payload_p = payload_p;
+    return returnCode_t::SUCCESS;
+}
+
+void
+writeCaptureRecord(char* record_p, const CaptureFields& fields)
+{
+    const CaptureRecordHeader& header = fields.header;
+
+    memcpy(record_p, &header, sizeof(header));
+    ((CaptureRecordHeader*)record_p)->size = 0;
+
+    char* data_p = record_p + sizeof(header);
+    memcpy(data_p, fields.topic_p, header.topicLength + 1);
+    data_p += header.topicLength + 1;
+    memcpy(data_p, fields.correlationId_p, header.correlationIdLength + 1);
+    data_p += header.correlationIdLength + 1;
+    memcpy(data_p, fields.payload_p, header.payloadLength);
+
+    __atomic_store_n(&((CaptureRecordHeader*)record_p)->size,
+                     header.size,
+                     __ATOMIC_RELEASE);
+}
+
+bool
+readCaptureRecord(const char* record_p,
+                  size_t available,
+                  CaptureRecord& record)
+{
+    if (available < sizeof(CaptureRecordHeader)) { return false; }
+
+    const CaptureRecordHeader* header_p =
+        (const CaptureRecordHeader*)record_p;
+
+    // A record must hold its header and fields and fit in what is left;
+    // anything else is the end of the records, or of a capture that was cut
+    // short
+    //
+    size_t fieldsSize = sizeof(*header_p) + header_p->topicLength + 1
+                        + header_p->correlationIdLength + 1
+                        + header_p->payloadLength;
+    if (header_p->size == 0 || header_p->size < fieldsSize
+            || header_p->size > available)
+    {
+        return false;
+    }
+
+    record.header_p = header_p;
+    record.topic_p = (const char*)(header_p + 1);
+    record.correlationId_p = record.topic_p + header_p->topicLength + 1;
+    record.payload_p = record.correlationId_p
+                       + header_p->correlationIdLength + 1;
+    return true;
+}
+
+solClient_opaqueMsg_pt
+createCaptureMessage(const CaptureRecord& record)
+{
+    const CaptureRecordHeader& header = *record.header_p;
+
+    solClient_opaqueMsg_pt msg_p = nullptr;
+    if (solClient_msg_alloc(&msg_p) != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "Could not allocate message for captured record");
+        return nullptr;
+    }
+
+    solClient_destination_t dest;
+    dest.destType = SOLCLIENT_TOPIC_DESTINATION;
+    dest.dest = record.topic_p;
+
+    int64_t senderTimestamp =
+        (header.flags & CaptureRecordHeader::HAS_SENDER_TIMESTAMP)
+        ? header.senderTimestamp : header.rcvTimestamp;
+
+    if (solClient_msg_setDestination(msg_p, &dest, sizeof(dest))
+                != SOLCLIENT_OK
+            || solClient_msg_setBinaryAttachment(msg_p,
+                                                 record.payload_p,
+                                                 header.payloadLength)
+                   != SOLCLIENT_OK
+            || solClient_msg_setSenderTimestamp(msg_p, senderTimestamp)
+                   != SOLCLIENT_OK
+            || ((header.flags & CaptureRecordHeader::HAS_SEQUENCE_NUMBER)
+                && solClient_msg_setSequenceNumber(msg_p,
+                                                   header.sequenceNumber)
+                       != SOLCLIENT_OK)
+            || ((header.flags & CaptureRecordHeader::HAS_CORRELATION_ID)
+                && solClient_msg_setCorrelationId(msg_p,
+                                                  record.correlationId_p)
+                       != SOLCLIENT_OK))
+    {
+        LOG(ERROR, "Could not build message for captured topic '"
+                   << record.topic_p << "'");
+        solClient_msg_free(&msg_p);
+        return nullptr;
+    }
+
+    return msg_p;
+}
+
+returnCode_t
+CaptureWriter::append(solClient_opaqueMsg_pt msg_p, int64_t rcvTimestamp)
+{
+    if (base_mp == nullptr) { return returnCode_t::FAILURE; }
+
+    CaptureFields fields;
+    if (getCaptureFields(msg_p, rcvTimestamp, fields) != returnCode_t::SUCCESS)
+    {
+        return returnCode_t::FAILURE;
+    }
+
+    // Room is also kept for the size of the next record, which must read as
+    // zero
+    //
+    size_t end = offset_m + fields.header.size + sizeof(uint32_t);
+    if (end > mappedSize_m && grow(end) != returnCode_t::SUCCESS)
+    {
+        return returnCode_t::FAILURE;
+    }
+
+    writeCaptureRecord(base_mp + offset_m, fields);
+
+    offset_m += fields.header.size;
+    records_m++;
+    return returnCode_t::SUCCESS;
+}
+
+CaptureReader::CaptureReader(void) :
+    fd_m(-1),
+    base_mp(nullptr),
+    size_m(0),
+    offset_m(0)
+{
+}
+
+CaptureReader::~CaptureReader(void)
+{
+    close();
+}
+
+returnCode_t
+CaptureReader::open(const std::string& filename)
+{
+    struct stat st;
+    const CaptureFileHeader* header_p;
+    void* base_p;
+
+    if (fd_m != -1) { return returnCode_t::FAILURE; }
+
+    fd_m = ::open(filename.c_str(), O_RDONLY);
+    if (fd_m == -1)
+    {
+        LOG(ERROR, "Could not open capture file '" << filename << "' ("
+                   << strerror(errno) << ")");
+        return returnCode_t::FAILURE;
+    }
+
+    if (fstat(fd_m, &st) != 0 || (size_t)st.st_size < sizeof(*header_p))
+    {
+        LOG(ERROR, "Capture file '" << filename << "' is too short");
+        goto cleanup;
+    }
+
+    base_p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd_m, 0);
+    if (base_p == MAP_FAILED)
+    {
+        LOG(ERROR, "Could not map capture file '" << filename << "' ("
+                   << strerror(errno) << ")");
+        goto cleanup;
+    }
+
+    base_mp = (const char*)base_p;
+    size_m = st.st_size;
+
+    header_p = (const CaptureFileHeader*)base_mp;
+    if (memcmp(header_p->magic, CAPTURE_MAGIC, sizeof(header_p->magic)) != 0
+            || header_p->version != CaptureFileHeader::VERSION)
+    {
+        LOG(ERROR, "'" << filename << "' is not a capture file");
+        goto cleanup;
+    }
+
+    // Records are read in order, so let the kernel read ahead
+    //
+    madvise(base_p, size_m, MADV_SEQUENTIAL);
+
+    offset_m = sizeof(*header_p);
+    return returnCode_t::SUCCESS;
+
+cleanup:
+    close();
+    return returnCode_t::FAILURE;
+}
+
+void
+CaptureReader::close(void)
+{
+    if (base_mp != nullptr) { munmap((void*)base_mp, size_m); }
+    if (fd_m != -1) { ::close(fd_m); }
+
+    fd_m = -1;
+    base_mp = nullptr;
+    size_m = 0;
+    offset_m = 0;
+}
+
+void
+CaptureReader::rewind(void)
+{
+    if (base_mp != nullptr) { offset_m = sizeof(CaptureFileHeader); }
+}
+
+bool
+CaptureReader::next(CaptureRecord& record)
+{
+    if (base_mp == nullptr || offset_m > size_m) { return false; }
+
+    if (!readCaptureRecord(base_mp + offset_m, size_m - offset_m, record))
+    {
+        return false;
+    }
+
+    offset_m += record.header_p->size;
+    return true;
+}
+
+} /* namespace topicMonitor */
@@ -0,0 +1,190 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_CAPTURE_FILE_HPP_
+#define _TOPIC_MONITOR_CAPTURE_FILE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+#include <string>
+
+#include "common.hpp"
+
+namespace topicMonitor
+{
+
+// A capture file is an append-only log of received messages, written and
+// read through a memory mapping. It starts with a CaptureFileHeader followed
+// by records, each a CaptureRecordHeader followed by the NUL-terminated topic,
+// the NUL-terminated correlation id and the payload, padded to a multiple of
+// 8 bytes. A record with a size of 0 ends the file, so a capture cut short by
+// a crash stays readable up to its last complete record.
+//
+struct CaptureFileHeader
+{
+    static const uint32_t VERSION = 1;
+
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct CaptureRecordHeader
+{
+    // Set in flags for the optional header fields the message carried
+    //
+    static const uint32_t HAS_SENDER_TIMESTAMP = 1 << 0;
+    static const uint32_t HAS_SEQUENCE_NUMBER  = 1 << 1;
+    static const uint32_t HAS_CORRELATION_ID   = 1 << 2;
+
+    uint32_t size;
+    uint16_t topicLength;
+    uint16_t correlationIdLength;
+    uint32_t payloadLength;
+    uint32_t flags;
+    int64_t  rcvTimestamp;
+    int64_t  senderTimestamp;
+    uint64_t sequenceNumber;
+};
+
+// A record read from a capture file. The pointers refer to the mapping and
+// are valid until the reader is closed.
+//
+struct CaptureRecord
+{
+    const CaptureRecordHeader* header_p;
+    const char*                topic_p;
+    const char*                correlationId_p;
+    const char*                payload_p;
+};
+
+// The fields of a message as recorded, pointing into the message. The size
+// in the header is the size of the whole record.
+//
+struct CaptureFields
+{
+    CaptureRecordHeader header;
+    const char*         topic_p;
+    const char*         correlationId_p;
+    const char*         payload_p;
+};
+
+// Gets the fields of a message to record, with rcvTimestamp, the wall clock
+// time in milliseconds it was received at
+//
+returnCode_t getCaptureFields(solClient_opaqueMsg_pt msg_p,
+                              int64_t rcvTimestamp,
+                              CaptureFields& fields);
+
+// Writes a record at record_p, which must have room for its size. The size
+// is written last, so a record is only visible once complete.
+//
+void writeCaptureRecord(char* record_p, const CaptureFields& fields);
+
+// Reads the record at record_p, with available bytes left to read. Returns
+// false if there is no complete record, as at the end of the records.
+//
+bool readCaptureRecord(const char* record_p,
+                       size_t available,
+                       CaptureRecord& record);
+
+// Builds a message out of a record; the caller owns it. Returns nullptr on
+// failure.
+//
+solClient_opaqueMsg_pt createCaptureMessage(const CaptureRecord& record);
+
+// Appends messages to a capture file. The file is grown in chunks and
+// truncated to the records written when closed. Not thread safe; messages are
+// captured by the single thread receiving them.
+//
+class CaptureWriter
+{
+public:
+    CaptureWriter(void);
+    ~CaptureWriter(void);
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    returnCode_t open(const std::string& filename);
+    returnCode_t close(void);
+
+    // Records the message with rcvTimestamp, the wall clock time in
+    // milliseconds it was received at
+    //
+    returnCode_t append(solClient_opaqueMsg_pt msg_p, int64_t rcvTimestamp);
+
+    uint64_t getRecords(void) const { return records_m; }
+
+private:
+    static const size_t GROW_SIZE = 64 * 1024 * 1024;
+
+    returnCode_t grow(size_t minSize);
+
+    int         fd_m;
+    char*       base_mp;
+    size_t      mappedSize_m;
+    size_t      offset_m;
+    uint64_t    records_m;
+    std::string filename_m;
+};
+
+// Reads the records of a capture file in order
+//
+class CaptureReader
+{
+public:
+    CaptureReader(void);
+    ~CaptureReader(void);
+
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+    returnCode_t open(const std::string& filename);
+    void close(void);
+
+    // Returns false at the end of the file
+    //
+    bool next(CaptureRecord& record);
+
+    // Starts over from the first record
+    //
+    void rewind(void);
+
+private:
+    int         fd_m;
+    const char* base_mp;
+    size_t      size_m;
+    size_t      offset_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_CAPTURE_FILE_HPP_ */
@@ -0,0 +1,87 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "clock.hpp"
+
+#include "config.hpp"
+#include "log.hpp"
+#include "utils.hpp"
+
+namespace topicMonitor
+{
+
+Clock* Clock::instance_mps = nullptr;
+
+Clock::Clock(void) :
+    virtual_m(Config::instance()->getVirtualClock()),
+    virtualTime_m(0)
+{
+    if (virtual_m) { LOG(INFO, "Using virtual clock"); }
+}
+
+uint64_t
+Clock::now(void) const
+{
+    if (virtual_m) { return virtualTime_m.load(std::memory_order_acquire); }
+    return utils::getMonotonicTimeMs();
+}
+
+bool
+Clock::advanceTo(uint64_t time)
+{
+    // Several sessions may advance it at once; only one of them sees a given
+    // tick boundary crossed
+    //
+    uint64_t current = virtualTime_m.load(std::memory_order_relaxed);
+    do
+    {
+        if (time <= current) { return false; }
+    }
+    while (!virtualTime_m.compare_exchange_weak(current, time,
+                                                std::memory_order_release,
+                                                std::memory_order_relaxed));
+
+    return time / VIRTUAL_TICK_INTERVAL != current / VIRTUAL_TICK_INTERVAL;
+}
+
+bool
+Clock::getMessageTime(solClient_opaqueMsg_pt msg_p, uint64_t& time)
+{
+    solClient_int64_t timestamp;
+    if (solClient_msg_getSenderTimestamp(msg_p, &timestamp) == SOLCLIENT_OK
+            || solClient_msg_getRcvTimestamp(msg_p, &timestamp)
+                   == SOLCLIENT_OK)
+    {
+        time = timestamp;
+        return true;
+    }
+
+    return false;
+}
+
+} /* namespace topicMonitor */
@@ -0,0 +1,100 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_CLOCK_HPP_
+#define _TOPIC_MONITOR_CLOCK_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+
+namespace topicMonitor
+{
+
+// The time base, in milliseconds, of everything time-driven in the engine:
+// timeout wheels, batch deadlines, timer ticks and the time scripts see
+// through timer.now().
+//
+// By default the clock follows CLOCK_MONOTONIC. With virtualClock set in
+// config.lua, it is a virtual clock instead, which only moves when the message
+// source advances it: every received message advances it to the message's
+// timestamp. The context timer is then ignored, and timer ticks are generated
+// from message timestamps instead, in order with the messages. Hours of
+// recorded traffic, and the timers they drive, then run as fast as the CPU
+// allows, with the same results every time. Virtual time is 0 until the
+// first message, whose timestamp the timeouts added before it count from.
+//
+class Clock
+{
+public:
+    // Interval between timer ticks generated from virtual time
+    //
+    static const uint64_t VIRTUAL_TICK_INTERVAL = 1000;
+
+    static Clock* instance(void)
+    {
+        if (instance_mps == nullptr)
+        {
+            instance_mps = new Clock();
+        }
+
+        return instance_mps;
+    }
+    ~Clock(void) {}
+
+    bool isVirtual(void) const { return virtual_m; }
+
+    // Current time in milliseconds. May be called from any thread.
+    //
+    uint64_t now(void) const;
+
+    // Moves virtual time forward to time; virtual time never goes backwards.
+    // Returns true if this crossed a multiple of VIRTUAL_TICK_INTERVAL, i.e.
+    // a timer tick is due. Time is only reproducible when messages come from
+    // a single thread.
+    //
+    bool advanceTo(uint64_t time);
+
+    // Gets the timestamp of a message in milliseconds: its sender timestamp
+    // if it has one, otherwise its receive timestamp. Returns false if it has
+    // neither.
+    //
+    static bool getMessageTime(solClient_opaqueMsg_pt msg_p, uint64_t& time);
+
+private:
+    Clock(void);
+
+    static Clock*         instance_mps;
+    bool                  virtual_m;
+    std::atomic<uint64_t> virtualTime_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_CLOCK_HPP_ */
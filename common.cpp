@@ -49,11 +49,15 @@ std::string workTypeToString(workType_t workType)
 {
     switch (workType)
     {
-        case workType_t::MESSAGE_RECEIVED: return "MESSAGE_RECEIVED";
-        case workType_t::SUBSCRIBE:        return "SUBSCRIBE";
-        case workType_t::UNSUBSCRIBE:      return "UNSUBSCRIBE";
-        case workType_t::TIMER_TICK:       return "TIMER_TICK";
-        case workType_t::TIMEOUT:          return "TIMEOUT";
+        case workType_t::MESSAGE_RECEIVED:  return "MESSAGE_RECEIVED";
+        case workType_t::SUBSCRIBE:         return "SUBSCRIBE";
+        case workType_t::UNSUBSCRIBE:       return "UNSUBSCRIBE";
+        case workType_t::TIMER_TICK:        return "TIMER_TICK";
+        case workType_t::SESSION_DOWN:      return "SESSION_DOWN";
+        case workType_t::SESSION_UP:        return "SESSION_UP";
+        case workType_t::MESSAGE_CONFLATED: return "MESSAGE_CONFLATED";
+        case workType_t::QUEUE_STAMP:       return "QUEUE_STAMP";
+        case workType_t::SPILL_STARTED:     return "SPILL_STARTED";
     }
 
     // Control flow should never reach here
@@ -35,14 +35,22 @@
 #include <string>
 #include <vector>
 
-#include "threadSafeQueue.hpp"
+#include "mpscRingBuffer.hpp"
 
 namespace topicMonitor
 {
 
 const size_t MAX_FILENAME_SIZE = 127;
+const size_t MAX_QUEUE_NAME_SIZE = 250;
 const char* const LUA_MESSAGE_FUNC = "onMessage";
 const char* const LUA_TIMER_FUNC   = "onTimer";
+const char* const LUA_BATCH_FUNC   = "onBatch";
+const char* const LUA_SESSION_DOWN_FUNC = "onSessionDown";
+const char* const LUA_SESSION_UP_FUNC   = "onSessionUp";
+
+// Maximum number of work entries MonitoringThread dequeues at once
+//
+const size_t WORK_QUEUE_DRAIN_SIZE = 64;
 
 typedef enum class returnCode
 {
@@ -53,21 +61,71 @@ typedef enum class returnCode
 
 std::string returnCodeToString(returnCode_t returnCode);
 
-typedef enum class workType
+// One byte, so that a WorkEntry stays 16 bytes
+//
+typedef enum class workType : uint8_t
 {
     MESSAGE_RECEIVED,
     SUBSCRIBE,
     UNSUBSCRIBE,
     TIMER_TICK,
-    TIMEOUT,
+    SESSION_DOWN,
+    SESSION_UP,
+    MESSAGE_CONFLATED,
+    QUEUE_STAMP,
+    SPILL_STARTED,
 } workType_t;
 
 std::string workTypeToString(workType_t workType);
 
+typedef uint32_t topicId_t;
+const topicId_t INVALID_TOPIC_ID = UINT32_MAX;
+
+// The priority of a subscription's messages; see WorkLanes
+//
+enum class priority_t
+{
+    HIGH,
+    NORMAL,
+    LOW
+};
+
+// How the messages of a subscription are queued to its worker
+//
+struct QueueingInfo
+{
+    priority_t priority;
+    bool       spill;
+    bool       conflate;
+};
+
+// How a subscription sheds load while its worker is shedding (see
+// LoadShedder): it handles only 1 in sample of its messages, skips those older
+// than maxAgeMs by their sender timestamp (0 for no bound), or skips all of
+// them
+//
+struct ShedPolicy
+{
+    ShedPolicy(void) : sample(1), maxAgeMs(0), skip(false) {}
+
+    bool isSet(void) const { return sample > 1 || maxAgeMs != 0 || skip; }
+
+    uint32_t sample;
+    uint32_t maxAgeMs;
+    bool     skip;
+};
+
 class SubscriptionInfo
 {
 public:
-    SubscriptionInfo(void) : timeout_m(0) {}
+    SubscriptionInfo(void) :
+        timeout_m(0),
+        maxUnacked_m(0),
+        probeIntervalMs_m(0),
+        probeTimeoutMs_m(0),
+        conflate_m(false),
+        priority_m(priority_t::NORMAL),
+        spill_m(false) {}
     ~SubscriptionInfo(void) {}
 
     bool setTopic(std::string topic)
@@ -89,92 +147,292 @@ public:
     void setTimeout(uint32_t timeout) { timeout_m = timeout; }
     uint32_t getTimeout(void) const { return timeout_m; }
 
+    // A subscription with a queue consumes the queue through a guaranteed
+    // flow instead of subscribing to its topic. Messages are acknowledged once
+    // the script has handled them, and at most maxUnacked of them (0 for the
+    // default) are in flight at once.
+    //
+    bool setQueue(std::string queue)
+    {
+        if (queue.length() > MAX_QUEUE_NAME_SIZE) { return false; }
+        queue_m = queue;
+        return true;
+    }
+    std::string getQueue(void) const { return queue_m; }
+    bool isGuaranteed(void) const { return !queue_m.empty(); }
+
+    void setMaxUnacked(uint32_t maxUnacked) { maxUnacked_m = maxUnacked; }
+    uint32_t getMaxUnacked(void) const { return maxUnacked_m; }
+
+    // A probe subscription publishes a probe to probeTopic (its own topic if
+    // empty) every intervalMs and measures how long the echo takes to arrive
+    // on its topic; see Probe. Echoes later than timeoutMs are counted lost.
+    //
+    bool setProbe(std::string probeTopic,
+                  uint32_t intervalMs,
+                  uint32_t timeoutMs)
+    {
+        if (probeTopic.length() > SOLCLIENT_BUFINFO_MAX_TOPIC_SIZE) { return false; }
+        probeTopic_m = probeTopic;
+        probeIntervalMs_m = intervalMs;
+        probeTimeoutMs_m = timeoutMs;
+        return true;
+    }
+    std::string getProbeTopic(void) const
+        { return probeTopic_m.empty() ? topic_m : probeTopic_m; }
+    uint32_t getProbeIntervalMs(void) const { return probeIntervalMs_m; }
+    uint32_t getProbeTimeoutMs(void) const { return probeTimeoutMs_m; }
+    bool isProbe(void) const { return probeIntervalMs_m != 0; }
+
+    // A conflated subscription keeps at most one message per topic waiting
+    // for its worker, the latest; see Conflator
+    //
+    void setConflate(bool conflate) { conflate_m = conflate; }
+    bool isConflated(void) const { return conflate_m; }
+
+    void setPriority(priority_t priority) { priority_m = priority; }
+    priority_t getPriority(void) const { return priority_m; }
+
+    // The messages of a spilled subscription are never dropped; once its
+    // worker is behind, they overflow to disk instead (see SpillBuffer)
+    //
+    void setSpill(bool spill) { spill_m = spill; }
+    bool isSpilled(void) const { return spill_m; }
+
+    void setShedPolicy(const ShedPolicy& shed) { shed_m = shed; }
+    const ShedPolicy& getShedPolicy(void) const { return shed_m; }
+
+    QueueingInfo getQueueingInfo(void) const
+    {
+        QueueingInfo queueing;
+        queueing.priority = priority_m;
+        queueing.spill = spill_m;
+        queueing.conflate = conflate_m;
+        return queueing;
+    }
+
 private:
     std::string topic_m;
     std::string filename_m;
     uint32_t    timeout_m;
+    std::string queue_m;
+    uint32_t    maxUnacked_m;
+    std::string probeTopic_m;
+    uint32_t    probeIntervalMs_m;
+    uint32_t    probeTimeoutMs_m;
+    bool        conflate_m;
+    priority_t  priority_m;
+    bool        spill_m;
+    ShedPolicy  shed_m;
+};
+
+// A message of a guaranteed subscription to acknowledge, by the id of the
+// subscription and the message's id in its flow
+//
+struct AckEntry
+{
+    topicId_t         topicId;
+    solClient_msgId_t msgId;
 };
 typedef std::vector<SubscriptionInfo> SubscriptionInfoList;
 
-// TODO (BTO): Consider using a pool allocator to allocate these objects
+struct ConflationSlot;
+
+// A work entry is a small tagged value rather than a heap-allocated object.
+// Work entries are copied directly into the slots of the work queue, so
+// enqueueing a message or timer tick does not allocate.
+//
+// Subscriptions are referred to by the topicId_t assigned by
+// SubscriptionRegistry, which keeps the (rarely needed) strings out of the
+// entry. For MESSAGE_RECEIVED, it is the id of the subscription the message
+// matched; for SESSION_DOWN and SESSION_UP, the id of a subscription served by
+// the session that went down or came back.
+//
+// A MESSAGE_CONFLATED entry does not carry its message; it refers to the
+// ConflationSlot that holds the latest message of its topic, which the worker
+// takes once it gets to the entry.
 //
 class WorkEntry
 {
 public:
-    WorkEntry(workType_t type) : type_m(type) {}
-    virtual ~WorkEntry(void) {}
+    WorkEntry(void) :
+        type_m(workType_t::MESSAGE_RECEIVED),
+        droppable_m(false),
+        topicId_m(INVALID_TOPIC_ID),
+        msg_mp(nullptr) {}
+
+    // A droppable message may be dropped by the worker when it dequeues it
+    // while overloaded; see overloadPolicy_t::DROP_OLDEST
+    //
+    static WorkEntry messageReceived(solClient_opaqueMsg_pt msg_p,
+                                     topicId_t topicId,
+                                     bool droppable = false)
+    {
+        WorkEntry entry(workType_t::MESSAGE_RECEIVED, topicId);
+        entry.msg_mp = msg_p;
+        entry.droppable_m = droppable;
+        return entry;
+    }
 
-    void setType(workType_t type) { type_m = type; }
-    workType_t getType(void) const { return type_m; }
+    static WorkEntry messageConflated(ConflationSlot* slot_p,
+                                      topicId_t topicId)
+    {
+        WorkEntry entry(workType_t::MESSAGE_CONFLATED, topicId);
+        entry.slot_mp = slot_p;
+        return entry;
+    }
 
-private:
-    workType_t type_m;
-};
+    static WorkEntry subscribe(topicId_t topicId)
+    {
+        return WorkEntry(workType_t::SUBSCRIBE, topicId);
+    }
 
-class WorkEntryMessageReceived : public WorkEntry
-{
-public:
-    WorkEntryMessageReceived(void) : WorkEntry(workType_t::MESSAGE_RECEIVED) {}
-    ~WorkEntryMessageReceived(void) { solClient_msg_free(&msg_mp); }
+    static WorkEntry unsubscribe(topicId_t topicId)
+    {
+        return WorkEntry(workType_t::UNSUBSCRIBE, topicId);
+    }
 
-    void setMsg(solClient_opaqueMsg_pt msg_p) { msg_mp = msg_p; }
-    solClient_opaqueMsg_pt getMsg(void) const { return msg_mp; }
+    // time is the virtual time the tick advances to; see Clock. It is unused
+    // with the monotonic clock.
+    //
+    static WorkEntry timerTick(uint64_t time = 0)
+    {
+        WorkEntry entry(workType_t::TIMER_TICK, INVALID_TOPIC_ID);
+        entry.time_m = time;
+        return entry;
+    }
 
-private:
-    solClient_opaqueMsg_pt msg_mp;
-};
+    // The session serving partition, out of partitions, was lost. A single
+    // entry per worker stands for every subscription of the partition, so
+    // the control lane never fills up with them.
+    //
+    static WorkEntry sessionDown(uint32_t partition, uint32_t partitions)
+    {
+        WorkEntry entry(workType_t::SESSION_DOWN, INVALID_TOPIC_ID);
+        entry.session_m.outage = 0;
+        entry.session_m.partition = partition;
+        entry.session_m.partitions = partitions;
+        return entry;
+    }
 
-class WorkEntrySubscribe : public WorkEntry
-{
-public:
-    WorkEntrySubscribe(void) : WorkEntry(workType_t::SUBSCRIBE) {}
-    ~WorkEntrySubscribe(void) {}
+    // Marks the time, in microseconds of the steady clock, an entry was
+    // queued, to measure the queueing delay of a lane; see WorkLanes
+    //
+    static WorkEntry queueStamp(uint64_t time)
+    {
+        WorkEntry entry(workType_t::QUEUE_STAMP, INVALID_TOPIC_ID);
+        entry.time_m = time;
+        return entry;
+    }
 
-    void setSubscriptionInfo(SubscriptionInfo info) { info_m = info; }
-    const SubscriptionInfo& getSubscriptionInfo(void) const { return info_m; }
+    // Marks the point of the lane from which the worker's messages of
+    // spilled subscriptions are on disk, until it has read them all back
+    //
+    static WorkEntry spillStarted(uint32_t lane)
+    {
+        WorkEntry entry(workType_t::SPILL_STARTED, INVALID_TOPIC_ID);
+        entry.lane_m = lane;
+        return entry;
+    }
 
-private:
-    SubscriptionInfo info_m;
-};
+    // The session serving partition, out of partitions, is back; outage is
+    // how long it was down, in milliseconds
+    //
+    static WorkEntry sessionUp(uint32_t partition,
+                               uint32_t partitions,
+                               uint64_t outage)
+    {
+        WorkEntry entry(workType_t::SESSION_UP, INVALID_TOPIC_ID);
+        entry.session_m.outage = outage < UINT32_MAX ? outage : UINT32_MAX;
+        entry.session_m.partition = partition;
+        entry.session_m.partitions = partitions;
+        return entry;
+    }
 
-class WorkEntryUnsubscribe : public WorkEntry
-{
-public:
-    WorkEntryUnsubscribe(void) : WorkEntry(workType_t::UNSUBSCRIBE) {}
-    ~WorkEntryUnsubscribe(void) {}
+    workType_t getType(void) const { return type_m; }
 
-    void setSubscriptionInfo(SubscriptionInfo info) { info_m = info; }
-    const SubscriptionInfo& getSubscriptionInfo(void) const { return info_m; }
+    // Not valid for TIMER_TICK, QUEUE_STAMP, SPILL_STARTED, SESSION_DOWN and
+    // SESSION_UP
+    //
+    topicId_t getTopicId(void) const { return topicId_m; }
 
-private:
-    SubscriptionInfo info_m;
-};
+    // Only valid for MESSAGE_RECEIVED
+    //
+    solClient_opaqueMsg_pt getMsg(void) const { return msg_mp; }
+    bool isDroppable(void) const { return droppable_m; }
 
-class WorkEntryTimerTick : public WorkEntry
-{
-public:
-    WorkEntryTimerTick(void) : WorkEntry(workType_t::TIMER_TICK) {}
-    ~WorkEntryTimerTick(void) {}
-};
+    // Only valid for MESSAGE_CONFLATED
+    //
+    ConflationSlot* getSlot(void) const { return slot_mp; }
 
-class WorkEntryTimeout : public WorkEntry
-{
-public:
-    WorkEntryTimeout(void) : WorkEntry(workType_t::TIMEOUT) {}
-    ~WorkEntryTimeout(void) {}
+    // Only valid for TIMER_TICK and QUEUE_STAMP
+    //
+    uint64_t getTime(void) const { return time_m; }
 
-    void setTopic(std::string topic) { topic_m = topic; }
-    std::string getTopic(void) const { return topic_m; }
+    // Only valid for SPILL_STARTED
+    //
+    uint32_t getLane(void) const { return lane_m; }
 
-    void setTimeout(uint32_t timeout) { timeout_m = timeout; }
-    uint32_t getTimeout(void) const { return timeout_m; }
+    // Only valid for SESSION_DOWN and SESSION_UP
+    //
+    uint32_t getPartition(void) const { return session_m.partition; }
+    uint32_t getPartitions(void) const { return session_m.partitions; }
+
+    // Only valid for SESSION_UP
+    //
+    uint64_t getOutage(void) const { return session_m.outage; }
+
+    // Transfers ownership of the message to the caller; release() will no
+    // longer free it. Only valid for MESSAGE_RECEIVED.
+    //
+    solClient_opaqueMsg_pt takeMsg(void)
+    {
+        solClient_opaqueMsg_pt msg_p = msg_mp;
+        msg_mp = nullptr;
+        return msg_p;
+    }
+
+    // Frees any resource owned by the entry. Must be called exactly once by
+    // the consumer when it is done with the entry.
+    //
+    void release(void)
+    {
+        if (type_m == workType_t::MESSAGE_RECEIVED && msg_mp != nullptr)
+        {
+            solClient_msg_free(&msg_mp);
+        }
+    }
 
 private:
-    std::string topic_m;
-    uint32_t    timeout_m;
+    // Packed to fit the union, so an entry stays 16 bytes
+    //
+    struct SessionEvent
+    {
+        uint32_t outage;
+        uint16_t partition;
+        uint16_t partitions;
+    };
+
+    WorkEntry(workType_t type, topicId_t topicId) :
+        type_m(type),
+        droppable_m(false),
+        topicId_m(topicId),
+        msg_mp(nullptr) {}
+
+    workType_t                 type_m;
+    bool                       droppable_m;
+    topicId_t                  topicId_m;
+    union
+    {
+        solClient_opaqueMsg_pt msg_mp;
+        ConflationSlot*        slot_mp;
+        uint64_t               time_m;
+        uint32_t               lane_m;
+        SessionEvent           session_m;
+    };
 };
 
-typedef ThreadSafeQueue<WorkEntry*> WorkQueue;
+typedef MpscRingBuffer<WorkEntry> WorkQueue;
 
 } /* namespace topicMonitor */
 
@@ -0,0 +1,486 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "config.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <lua5.2/lua.hpp>
+
+#include "log.hpp"
+
+namespace topicMonitor
+{
+
+Config* Config::instance_mps = nullptr;
+
+// Reads the value at the top of the stack as a positive integer
+//
+static bool
+getPositiveInteger(lua_State* L, const char* key_p, uint32_t& value)
+{
+    if (!lua_isnumber(L, -1) || lua_tonumber(L, -1) < 1)
+    {
+        LOG(ERROR, "config invalid format (" << key_p
+                   << " value not a positive integer)");
+        return false;
+    }
+
+    value = lua_tonumber(L, -1);
+    return true;
+}
+
+// Reads the value at the top of the stack as a non-negative integer
+//
+static bool
+getNonNegativeInteger(lua_State* L, const char* key_p, uint32_t& value)
+{
+    if (!lua_isnumber(L, -1) || lua_tonumber(L, -1) < 0)
+    {
+        LOG(ERROR, "config invalid format (" << key_p
+                   << " value not a non-negative integer)");
+        return false;
+    }
+
+    value = lua_tonumber(L, -1);
+    return true;
+}
+
+// Reads the value at the top of the stack as a boolean
+//
+static bool
+getBoolean(lua_State* L, const char* key_p, bool& value)
+{
+    if (!lua_isboolean(L, -1))
+    {
+        LOG(ERROR, "config invalid format (" << key_p
+                   << " value not a boolean)");
+        return false;
+    }
+
+    value = lua_toboolean(L, -1);
+    return true;
+}
+
+// Reads the value at the top of the stack, a table of topic to weight, as the
+// topics the mock transport generates messages on
+//
+static bool
+parseMockTopics(lua_State* L, const char* key_p, MockTopicList& topics)
+{
+    if (!lua_istable(L, -1))
+    {
+        LOG(ERROR, "config invalid format (" << key_p
+                   << " value not a table)");
+        return false;
+    }
+
+    lua_pushnil(L);
+    while (lua_next(L, -2) != 0)
+    {
+        // Checked with lua_type() because lua_tostring() would convert a
+        // numeric key in place and confuse lua_next()
+        //
+        if (lua_type(L, -2) != LUA_TSTRING)
+        {
+            LOG(ERROR, "config invalid format (" << key_p
+                       << " key not string)");
+            return false;
+        }
+
+        MockTopic topic;
+        topic.topic = lua_tostring(L, -2);
+        if (!getPositiveInteger(L, key_p, topic.weight)) { return false; }
+        topics.push_back(topic);
+
+        lua_pop(L, 1); // Pop 'value'... keep 'key' for next iteration
+    }
+
+    return true;
+}
+
+// Reads the value at the top of the stack, the mock transport's settings:
+//
+// mock = {
+//     rate        = <messages per second:int>, (optional, default 0)
+//     payloadSize = <bytes:int>,               (optional, default 64)
+//     topics      = { [<topic:string>] = <weight:int>, ... },
+// }
+//
+static bool
+parseMockConfig(lua_State* L, const char* key_p, MockConfig& mock)
+{
+    if (!lua_istable(L, -1))
+    {
+        LOG(ERROR, "config invalid format (" << key_p
+                   << " value not a table)");
+        return false;
+    }
+
+    // On failure, the stack is left as is; the caller closes the state
+    //
+    lua_pushnil(L);
+    while (lua_next(L, -2) != 0)
+    {
+        if (lua_type(L, -2) != LUA_TSTRING)
+        {
+            LOG(ERROR, "config invalid format (" << key_p
+                       << " key not string)");
+            return false;
+        }
+
+        const char* mockKey_p = lua_tostring(L, -2);
+        if (strcmp(mockKey_p, "rate") == 0)
+        {
+            if (!getNonNegativeInteger(L, mockKey_p, mock.rate))
+                return false;
+        }
+        else if (strcmp(mockKey_p, "payloadSize") == 0)
+        {
+            if (!getNonNegativeInteger(L, mockKey_p, mock.payloadSize))
+                return false;
+        }
+        else if (strcmp(mockKey_p, "topics") == 0)
+        {
+            if (!parseMockTopics(L, mockKey_p, mock.topics))
+                return false;
+        }
+        else
+        {
+            LOG(ERROR, "config invalid format (unknown key '" << key_p
+                       << "." << mockKey_p << "')");
+            return false;
+        }
+
+        lua_pop(L, 1); // Pop 'value'... keep 'key' for next iteration
+    }
+
+    return true;
+}
+
+// Reads the value at the top of the stack as a non-empty string
+//
+static bool
+getString(lua_State* L, const char* key_p, std::string& value)
+{
+    if (lua_type(L, -1) != LUA_TSTRING || lua_rawlen(L, -1) == 0)
+    {
+        LOG(ERROR, "config invalid format (" << key_p
+                   << " value not a non-empty string)");
+        return false;
+    }
+
+    value = lua_tostring(L, -1);
+    return true;
+}
+
+// Reads the value at the top of the stack, the replay transport's settings:
+//
+// replay = {
+//     file  = <filename:string>,
+//     speed = <multiplier:number>, (optional, default 1, 0 for full speed)
+// }
+//
+static bool
+parseReplayConfig(lua_State* L, const char* key_p, ReplayConfig& replay)
+{
+    if (!lua_istable(L, -1))
+    {
+        LOG(ERROR, "config invalid format (" << key_p
+                   << " value not a table)");
+        return false;
+    }
+
+    // On failure, the stack is left as is; the caller closes the state
+    //
+    lua_pushnil(L);
+    while (lua_next(L, -2) != 0)
+    {
+        if (lua_type(L, -2) != LUA_TSTRING)
+        {
+            LOG(ERROR, "config invalid format (" << key_p
+                       << " key not string)");
+            return false;
+        }
+
+        const char* replayKey_p = lua_tostring(L, -2);
+        if (strcmp(replayKey_p, "file") == 0)
+        {
+            if (!getString(L, replayKey_p, replay.filename))
+                return false;
+        }
+        else if (strcmp(replayKey_p, "speed") == 0)
+        {
+            if (!lua_isnumber(L, -1) || lua_tonumber(L, -1) < 0)
+            {
+                LOG(ERROR, "config invalid format (" << replayKey_p
+                           << " value not a non-negative number)");
+                return false;
+            }
+            replay.speed = lua_tonumber(L, -1);
+        }
+        else
+        {
+            LOG(ERROR, "config invalid format (unknown key '" << key_p
+                       << "." << replayKey_p << "')");
+            return false;
+        }
+
+        lua_pop(L, 1); // Pop 'value'... keep 'key' for next iteration
+    }
+
+    if (replay.filename.empty())
+    {
+        LOG(ERROR, "config invalid format (" << key_p << ".file not set)");
+        return false;
+    }
+
+    return true;
+}
+
+// TODO (BTO): Maybe use a smart pointer with a Deleter FunctionObject here to
+//             clean up the lua_State once it goes out of scope?
+returnCode_t
+Config::load(std::string filename)
+{
+    // The configuration file is optional
+    //
+    if (!std::ifstream(filename).good())
+    {
+        LOG(INFO, "No " << filename << " found, using default configuration");
+        return returnCode_t::NOTHING_TO_DO;
+    }
+
+    // Opens a new lua state
+    //
+    lua_State* L = luaL_newstate();
+    if (L == nullptr)
+    {
+        LOG(ERROR, "Could not allocate lua state");
+        return returnCode_t::FAILURE;
+    }
+
+    // Load config file
+    //
+    luaopen_base(L);
+    if (luaL_dofile(L, filename.c_str()) != 0)
+    {
+        LOG(ERROR, "Could not load " << filename);
+        goto cleanup;
+    }
+
+    // Push global table config from lua file onto the stack
+    //
+    lua_getglobal(L, "config");
+    if (!lua_istable(L, -1))
+    {
+        LOG(ERROR, "config invalid format");
+        goto cleanup;
+    }
+
+    lua_pushnil(L);
+    while (lua_next(L, -2) != 0)
+    {
+        // All keys in this table should be strings
+        //
+        if (!lua_isstring(L, -2))
+        {
+            LOG(ERROR, "config invalid format (key not string)");
+            goto cleanup;
+        }
+
+        const char* key_p = lua_tostring(L, -2);
+        if (strcmp(key_p, "workerThreads") == 0)
+        {
+            if (!getPositiveInteger(L, key_p, workerThreads_m))
+                goto cleanup;
+        }
+        else if (strcmp(key_p, "batchMaxMessages") == 0)
+        {
+            if (!getPositiveInteger(L, key_p, batchMaxMessages_m))
+                goto cleanup;
+        }
+        else if (strcmp(key_p, "batchMaxWaitMs") == 0)
+        {
+            if (!getNonNegativeInteger(L, key_p, batchMaxWaitMs_m))
+                goto cleanup;
+        }
+        else if (strcmp(key_p, "virtualClock") == 0)
+        {
+            if (!getBoolean(L, key_p, virtualClock_m))
+                goto cleanup;
+        }
+        else if (strcmp(key_p, "transport") == 0)
+        {
+            const char* transport_p = lua_isstring(L, -1)
+                                      ? lua_tostring(L, -1) : "";
+            if (strcmp(transport_p, "solclient") == 0)
+            {
+                transport_m = transportType_t::SOLCLIENT;
+            }
+            else if (strcmp(transport_p, "mock") == 0)
+            {
+                transport_m = transportType_t::MOCK;
+            }
+            else if (strcmp(transport_p, "replay") == 0)
+            {
+                transport_m = transportType_t::REPLAY;
+            }
+            else
+            {
+                LOG(ERROR, "config invalid format (transport value not "
+                           "\"solclient\", \"mock\" or \"replay\")");
+                goto cleanup;
+            }
+        }
+        else if (strcmp(key_p, "mock") == 0)
+        {
+            if (!parseMockConfig(L, key_p, mock_m))
+                goto cleanup;
+        }
+        else if (strcmp(key_p, "replay") == 0)
+        {
+            if (!parseReplayConfig(L, key_p, replay_m))
+                goto cleanup;
+        }
+        else if (strcmp(key_p, "capture") == 0)
+        {
+            if (!getString(L, key_p, captureFilename_m))
+                goto cleanup;
+        }
+        else if (strcmp(key_p, "publishPoolSize") == 0)
+        {
+            if (!getPositiveInteger(L, key_p, publishPoolSize_m))
+                goto cleanup;
+        }
+        else if (strcmp(key_p, "publishQueueSize") == 0)
+        {
+            if (!getPositiveInteger(L, key_p, publishQueueSize_m))
+                goto cleanup;
+        }
+        else if (strcmp(key_p, "workQueueSize") == 0)
+        {
+            if (!getPositiveInteger(L, key_p, workQueueSize_m))
+                goto cleanup;
+        }
+        else if (strcmp(key_p, "workQueueMaxBytes") == 0)
+        {
+            if (!getNonNegativeInteger(L, key_p, workQueueMaxBytes_m))
+                goto cleanup;
+        }
+        else if (strcmp(key_p, "overloadPolicy") == 0)
+        {
+            const char* policy_p = lua_isstring(L, -1)
+                                   ? lua_tostring(L, -1) : "";
+            if (strcmp(policy_p, "block") == 0)
+            {
+                overloadPolicy_m = overloadPolicy_t::BLOCK;
+            }
+            else if (strcmp(policy_p, "dropNewest") == 0)
+            {
+                overloadPolicy_m = overloadPolicy_t::DROP_NEWEST;
+            }
+            else if (strcmp(policy_p, "dropOldest") == 0)
+            {
+                overloadPolicy_m = overloadPolicy_t::DROP_OLDEST;
+            }
+            else
+            {
+                LOG(ERROR, "config invalid format (overloadPolicy value not "
+                           "\"block\", \"dropNewest\" or \"dropOldest\")");
+                goto cleanup;
+            }
+        }
+        else if (strcmp(key_p, "laneScheduling") == 0)
+        {
+            const char* scheduling_p = lua_isstring(L, -1)
+                                       ? lua_tostring(L, -1) : "";
+            if (strcmp(scheduling_p, "weighted") == 0)
+            {
+                laneScheduling_m = laneScheduling_t::WEIGHTED;
+            }
+            else if (strcmp(scheduling_p, "strict") == 0)
+            {
+                laneScheduling_m = laneScheduling_t::STRICT;
+            }
+            else
+            {
+                LOG(ERROR, "config invalid format (laneScheduling value not "
+                           "\"weighted\" or \"strict\")");
+                goto cleanup;
+            }
+        }
+        else if (strcmp(key_p, "spillDirectory") == 0)
+        {
+            if (!getString(L, key_p, spillDirectory_m))
+                goto cleanup;
+        }
+        else if (strcmp(key_p, "spillHighWater") == 0)
+        {
+            if (!getPositiveInteger(L, key_p, spillHighWater_m))
+                goto cleanup;
+        }
+        else if (strcmp(key_p, "spillSegmentSize") == 0)
+        {
+            if (!getPositiveInteger(L, key_p, spillSegmentSize_m))
+                goto cleanup;
+        }
+        else if (strcmp(key_p, "shedLatencyTargetMs") == 0)
+        {
+            if (!getNonNegativeInteger(L, key_p, shedLatencyTargetMs_m))
+                goto cleanup;
+        }
+        else
+        {
+            LOG(ERROR, "config invalid format (unknown key '" << key_p
+                       << "')");
+            goto cleanup;
+        }
+
+        lua_pop(L, 1); // Pop 'value'... keep 'key' for next iteration
+    }
+
+    lua_pop(L, 1); // Pop global table config
+    lua_close(L);
+
+    if (transport_m == transportType_t::REPLAY && replay_m.filename.empty())
+    {
+        LOG(ERROR, "config invalid format (transport \"replay\" needs a "
+                   "replay table)");
+        return returnCode_t::FAILURE;
+    }
+
+    LOG(INFO, "Loaded " << filename);
+    return returnCode_t::SUCCESS;
+
+cleanup:
+    lua_close(L);
+    return returnCode_t::FAILURE;
+}
+
+} /* namespace topicMonitor */
@@ -0,0 +1,237 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_CONFIG_HPP_
+#define _TOPIC_MONITOR_CONFIG_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+
+namespace topicMonitor
+{
+
+// Process-wide settings loaded from config.lua. The file is optional; any
+// setting that is not present keeps its default value.
+//
+// config.lua defines a single global table:
+//
+// config = {
+//     workerThreads    = <count:int>,    (optional, default 1)
+//     batchMaxMessages = <count:int>,    (optional, default 100)
+//     batchMaxWaitMs   = <ms:int>,       (optional, default 0)
+//     virtualClock     = <bool>,         (optional, default false)
+//     transport        = "solclient" | "mock" | "replay",
+//                                        (optional, default solclient)
+//     mock             = <table>,        (optional, see MockConfig)
+//     replay           = <table>,        (optional, see ReplayConfig)
+//     capture          = <filename:string>, (optional)
+//     publishPoolSize  = <count:int>,    (optional, default 1024)
+//     publishQueueSize = <count:int>,    (optional, default 16384)
+//     workQueueSize    = <count:int>,    (optional, default 65536)
+//     workQueueMaxBytes = <bytes:int>,   (optional, default 0)
+//     overloadPolicy   = "block" | "dropNewest" | "dropOldest",
+//                                        (optional, default block)
+//     laneScheduling   = "weighted" | "strict", (optional, default weighted)
+//     spillDirectory   = <path:string>,  (optional)
+//     spillHighWater   = <count:int>,    (optional, default 16384)
+//     spillSegmentSize = <bytes:int>,    (optional, default 64MB)
+//     shedLatencyTargetMs = <ms:int>,    (optional, default 0)
+// }
+//
+// batchMaxMessages and batchMaxWaitMs bound how many messages are coalesced
+// into a single onBatch() call, and how long the first message of a batch may
+// wait for more to arrive. With a wait of 0, only messages that are already
+// queued are coalesced.
+//
+// virtualClock makes time follow message timestamps instead of the system's
+// monotonic clock; see Clock.
+//
+// transport selects where messages come from; see Transport. The mock and
+// replay transports need no broker or credentials.lua. capture records the
+// messages received from the broker to a file the replay transport can read;
+// see CaptureWriter.
+//
+// publishPoolSize is the number of messages each worker keeps for scripts to
+// publish, and publishQueueSize how many published messages may wait to be
+// sent; see Publisher.
+//
+// workQueueSize and workQueueMaxBytes bound the messages queued to each worker,
+// by count and by total payload size (0 for no limit on size). When a worker
+// is full, overloadPolicy decides what happens to a new message: block the
+// transport until there is room, drop it, or drop the oldest queued message.
+// Control entries are never dropped. See MonitoringWorker::pushMessage().
+//
+enum class overloadPolicy_t
+{
+    BLOCK,
+    DROP_NEWEST,
+    DROP_OLDEST
+};
+
+// Once a worker has spillHighWater messages queued, the messages of spilled
+// subscriptions overflow to segment files of spillSegmentSize bytes in
+// spillDirectory until it has caught up; see SpillBuffer.
+//
+// laneScheduling decides how a worker shares its time between the lanes of
+// high, normal and low priority messages; see WorkLanes.
+//
+// Once messages wait longer than shedLatencyTargetMs in the lanes of a worker,
+// it sheds load by the shed policies of its subscriptions until it has caught
+// up; see LoadShedder. 0 disables shedding, as does the virtual clock, so
+// replays stay deterministic.
+//
+enum class laneScheduling_t
+{
+    WEIGHTED,
+    STRICT
+};
+
+enum class transportType_t
+{
+    SOLCLIENT,
+    MOCK,
+    REPLAY
+};
+
+struct MockTopic
+{
+    MockTopic(void) : weight(1) {}
+
+    std::string topic;
+    uint32_t    weight;
+};
+typedef std::vector<MockTopic> MockTopicList;
+
+// Settings of the mock transport. It generates rate messages per second with
+// payloads of payloadSize bytes, on topics picked at random in proportion to
+// their weight. With a rate of 0, it only delivers messages that are injected
+// or published.
+//
+struct MockConfig
+{
+    MockConfig(void) : rate(0), payloadSize(64) {}
+
+    uint32_t      rate;
+    uint32_t      payloadSize;
+    MockTopicList topics;
+};
+
+// Settings of the replay transport: the capture file to replay, and how fast
+// relative to the time it was captured over, with 0 for as fast as possible
+//
+struct ReplayConfig
+{
+    ReplayConfig(void) : speed(1) {}
+
+    std::string filename;
+    double      speed;
+};
+
+class Config
+{
+public:
+    static Config* instance(void)
+    {
+        if (instance_mps == nullptr)
+        {
+            instance_mps = new Config();
+        }
+
+        return instance_mps;
+    }
+    ~Config(void) {}
+
+    returnCode_t load(std::string filename);
+
+    uint32_t getWorkerThreads(void) const { return workerThreads_m; }
+    uint32_t getBatchMaxMessages(void) const { return batchMaxMessages_m; }
+    uint32_t getBatchMaxWaitMs(void) const { return batchMaxWaitMs_m; }
+    bool getVirtualClock(void) const { return virtualClock_m; }
+    transportType_t getTransport(void) const { return transport_m; }
+    const MockConfig& getMockConfig(void) const { return mock_m; }
+    const ReplayConfig& getReplayConfig(void) const { return replay_m; }
+    const std::string& getCaptureFilename(void) const
+        { return captureFilename_m; }
+    uint32_t getPublishPoolSize(void) const { return publishPoolSize_m; }
+    uint32_t getPublishQueueSize(void) const { return publishQueueSize_m; }
+    uint32_t getWorkQueueSize(void) const { return workQueueSize_m; }
+    uint32_t getWorkQueueMaxBytes(void) const { return workQueueMaxBytes_m; }
+    overloadPolicy_t getOverloadPolicy(void) const { return overloadPolicy_m; }
+    laneScheduling_t getLaneScheduling(void) const { return laneScheduling_m; }
+    std::string getSpillDirectory(void) const { return spillDirectory_m; }
+    uint32_t getSpillHighWater(void) const { return spillHighWater_m; }
+    uint32_t getSpillSegmentSize(void) const { return spillSegmentSize_m; }
+    uint32_t getShedLatencyTargetMs(void) const
+        { return shedLatencyTargetMs_m; }
+
+private:
+    Config(void) :
+        workerThreads_m(1),
+        batchMaxMessages_m(100),
+        batchMaxWaitMs_m(0),
+        virtualClock_m(false),
+        transport_m(transportType_t::SOLCLIENT),
+        publishPoolSize_m(1024),
+        publishQueueSize_m(16384),
+        workQueueSize_m(65536),
+        workQueueMaxBytes_m(0),
+        overloadPolicy_m(overloadPolicy_t::BLOCK),
+        laneScheduling_m(laneScheduling_t::WEIGHTED),
+        spillHighWater_m(16384),
+        spillSegmentSize_m(64 * 1024 * 1024),
+        shedLatencyTargetMs_m(0)
+    {
+    }
+
+    static Config* instance_mps;
+    uint32_t       workerThreads_m;
+    uint32_t       batchMaxMessages_m;
+    uint32_t       batchMaxWaitMs_m;
+    bool           virtualClock_m;
+    transportType_t transport_m;
+    MockConfig     mock_m;
+    ReplayConfig   replay_m;
+    std::string    captureFilename_m;
+    uint32_t       publishPoolSize_m;
+    uint32_t       publishQueueSize_m;
+    uint32_t       workQueueSize_m;
+    uint32_t       workQueueMaxBytes_m;
+    overloadPolicy_t overloadPolicy_m;
+    laneScheduling_t laneScheduling_m;
+    std::string    spillDirectory_m;
+    uint32_t       spillHighWater_m;
+    uint32_t       spillSegmentSize_m;
+    uint32_t       shedLatencyTargetMs_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_CONFIG_HPP_ */
@@ -0,0 +1,216 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "conflator.hpp"
+
+#include "log.hpp"
+
+namespace topicMonitor
+{
+
+Conflator* Conflator::instance_mps = nullptr;
+
+void
+Conflator::lockAll(void)
+{
+    for (size_t i=0; i<SHARDS; i++)
+    {
+        shards_m[i].mutex.lock();
+    }
+}
+
+void
+Conflator::unlockAll(void)
+{
+    for (size_t i=SHARDS; i>0; i--)
+    {
+        shards_m[i - 1].mutex.unlock();
+    }
+}
+
+void
+Conflator::add(topicId_t topicId)
+{
+    lockAll();
+
+    if (topicId >= tables_m.size()) { tables_m.resize(topicId + 1, nullptr); }
+    if (tables_m[topicId] == nullptr) { tables_m[topicId] = new SlotMap(); }
+
+    unlockAll();
+}
+
+void
+Conflator::remove(topicId_t topicId)
+{
+    lockAll();
+
+    if (topicId >= tables_m.size() || tables_m[topicId] == nullptr)
+    {
+        unlockAll();
+        return;
+    }
+
+    // A slot with an entry in the work queue is freed by take() instead
+    //
+    for (auto& pair : *tables_m[topicId])
+    {
+        ConflationSlot* slot_p = pair.second;
+        if (slot_p->msg_p != nullptr) { solClient_msg_free(&slot_p->msg_p); }
+
+        if (slot_p->queued) { slot_p->removed = true; }
+        else                { delete slot_p; }
+    }
+
+    delete tables_m[topicId];
+    tables_m[topicId] = nullptr;
+
+    unlockAll();
+}
+
+bool
+Conflator::offer(topicId_t topicId,
+                 const char* topic_p,
+                 solClient_opaqueMsg_pt msg_p,
+                 ConflationSlot*& slot_p)
+{
+    Shard& shard = getShard(topicId);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    if (topicId >= tables_m.size() || tables_m[topicId] == nullptr)
+    {
+        return false;
+    }
+    SlotMap& slots = *tables_m[topicId];
+
+    shard.key.assign(topic_p);
+    auto it = slots.find(shard.key);
+    if (it == slots.end())
+    {
+        ConflationSlot* newSlot_p = new ConflationSlot();
+        newSlot_p->topicId = topicId;
+        newSlot_p->topic = shard.key;
+        newSlot_p->msg_p = nullptr;
+        newSlot_p->queued = false;
+        newSlot_p->removed = false;
+        newSlot_p->conflated = 0;
+        newSlot_p->lastReportConflated = 0;
+        newSlot_p->offered = false;
+        it = slots.emplace(shard.key, newSlot_p).first;
+    }
+    ConflationSlot* found_p = it->second;
+
+    if (found_p->msg_p != nullptr)
+    {
+        solClient_msg_free(&found_p->msg_p);
+        found_p->conflated++;
+    }
+    found_p->msg_p = msg_p;
+    found_p->offered = true;
+
+    if (found_p->queued)
+    {
+        slot_p = nullptr;
+    }
+    else
+    {
+        found_p->queued = true;
+        slot_p = found_p;
+    }
+
+    return true;
+}
+
+solClient_opaqueMsg_pt
+Conflator::take(ConflationSlot* slot_p)
+{
+    std::lock_guard<std::mutex> lock(getShard(slot_p->topicId).mutex);
+
+    if (slot_p->removed)
+    {
+        delete slot_p;
+        return nullptr;
+    }
+
+    solClient_opaqueMsg_pt msg_p = slot_p->msg_p;
+    slot_p->msg_p = nullptr;
+    slot_p->queued = false;
+    return msg_p;
+}
+
+void
+Conflator::reportStatistics(void)
+{
+    uint64_t evicted = 0;
+
+    for (size_t i=0; i<SHARDS; i++)
+    {
+        std::lock_guard<std::mutex> lock(shards_m[i].mutex);
+
+        for (topicId_t topicId=i; topicId<tables_m.size(); topicId+=SHARDS)
+        {
+            SlotMap* slots_p = tables_m[topicId];
+            if (slots_p == nullptr) { continue; }
+
+            for (auto it=slots_p->begin(); it!=slots_p->end(); )
+            {
+                ConflationSlot* slot_p = it->second;
+                uint64_t delta = slot_p->conflated
+                                 - slot_p->lastReportConflated;
+                if (delta != 0)
+                {
+                    LOG(INFO, "Conflated " << delta << " messages on topic '"
+                              << slot_p->topic << "' (subscription "
+                              << slot_p->topicId << ")");
+                    slot_p->lastReportConflated = slot_p->conflated;
+                }
+
+                // A slot with no message waiting and none offered since the
+                // last report is freed; the topic gets a new one if it
+                // becomes active again
+                //
+                if (!slot_p->offered && !slot_p->queued)
+                {
+                    delete slot_p;
+                    it = slots_p->erase(it);
+                    evicted++;
+                    continue;
+                }
+
+                slot_p->offered = false;
+                ++it;
+            }
+        }
+    }
+
+    if (evicted != 0)
+    {
+        LOG(INFO, "Freed " << evicted << " idle conflation slots");
+    }
+}
+
+} /* namespace topicMonitor */
@@ -0,0 +1,167 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_CONFLATOR_HPP_
+#define _TOPIC_MONITOR_CONFLATOR_HPP_
+
+#include <mutex>
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hpp"
+#include "mpscRingBuffer.hpp"
+
+namespace topicMonitor
+{
+
+// The message waiting for the worker of a conflated subscription on one
+// topic. A newer message on the topic replaces it in place.
+//
+struct ConflationSlot
+{
+    topicId_t              topicId;
+    std::string            topic;
+    solClient_opaqueMsg_pt msg_p;
+
+    // Whether a MESSAGE_CONFLATED entry for the slot is in the work queue,
+    // and whether the subscription was removed meanwhile
+    //
+    bool                   queued;
+    bool                   removed;
+
+    // Messages replaced before the worker got to them
+    //
+    uint64_t               conflated;
+    uint64_t               lastReportConflated;
+
+    // Whether a message was offered since the last report. An idle slot is
+    // freed when reported, so a wildcard subscription only keeps slots for
+    // the topics it still receives.
+    //
+    bool                   offered;
+};
+
+// This class keeps the latest message per topic of every conflated
+// subscription (see SubscriptionInfo::setConflate()). Instead of queueing
+// every message of a conflated subscription to its worker, the ingest path
+// offers it here: it replaces any older message of its topic still waiting,
+// and only a message on an idle topic queues a MESSAGE_CONFLATED entry. A
+// worker that falls behind so never has more than one message per topic of
+// the subscription waiting, the latest, however long the backlog.
+//
+// A wildcard subscription is conflated per topic it receives, not as a
+// whole. Slots idle for a whole report interval are freed.
+//
+// Subscriptions are spread over SHARDS locks by topicId, so ingest threads
+// offering messages of different subscriptions, and the workers taking them,
+// do not contend. Subscriptions are only ever added or removed on the (rare)
+// control path, which takes every lock. Only messages of subscriptions whose
+// QueueingInfo says they are conflated are offered.
+//
+class Conflator
+{
+public:
+    static Conflator* instance(void)
+    {
+        if (instance_mps == nullptr)
+        {
+            instance_mps = new Conflator();
+        }
+
+        return instance_mps;
+    }
+    ~Conflator(void) {}
+
+    void add(topicId_t topicId);
+
+    // Frees the messages waiting for the subscription
+    //
+    void remove(topicId_t topicId);
+
+    // Returns false if the subscription is not conflated and the caller keeps
+    // ownership of the message. Otherwise takes ownership and, if the topic
+    // had no MESSAGE_CONFLATED entry queued, sets slot_p to the slot the
+    // caller must queue one for; else sets it to nullptr.
+    //
+    bool offer(topicId_t topicId,
+               const char* topic_p,
+               solClient_opaqueMsg_pt msg_p,
+               ConflationSlot*& slot_p);
+
+    // Transfers ownership of the latest message of the slot to the caller,
+    // once its MESSAGE_CONFLATED entry is handled. Returns nullptr if the
+    // subscription was removed meanwhile.
+    //
+    solClient_opaqueMsg_pt take(ConflationSlot* slot_p);
+
+    // Logs how many messages were conflated per topic since the last call
+    //
+    void reportStatistics(void);
+
+private:
+    typedef std::unordered_map<std::string, ConflationSlot*> SlotMap;
+
+    static const size_t SHARDS = 64;
+
+    // Padded to a cache line of its own, so that shards do not false-share
+    //
+    struct Shard
+    {
+        std::mutex  mutex;
+
+        // Reused to look up the slot of a topic without allocating
+        //
+        std::string key;
+        char        pad[CACHE_LINE_SIZE];
+    };
+
+    Conflator(void) {}
+
+    Shard& getShard(topicId_t topicId) { return shards_m[topicId % SHARDS]; }
+
+    // Taken in order around changes to tables_m, which every shard reads
+    //
+    void lockAll(void);
+    void unlockAll(void);
+
+    static Conflator*     instance_mps;
+    Shard                 shards_m[SHARDS];
+
+    // The slots of every conflated subscription by topic, indexed by
+    // topicId_t, nullptr for others. An entry is guarded by the lock of its
+    // shard.
+    //
+    std::vector<SlotMap*> tables_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_CONFLATOR_HPP_ */
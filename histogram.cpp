@@ -0,0 +1,159 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "histogram.hpp"
+
+#include <cmath>
+
+namespace topicMonitor
+{
+
+Histogram::Histogram(void) :
+    count_m(0)
+{
+    for (size_t i=0; i<BUCKET_COUNT; i++)
+    {
+        buckets_m[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t
+Histogram::getIndex(uint64_t value)
+{
+    if (value > MAX_VALUE) { value = MAX_VALUE; }
+    if (value < SUB_BUCKET_COUNT) { return value; }
+
+    // The group of the value's power of two, counted from 1 above the exact
+    // buckets, and its bucket within the group
+    //
+    uint32_t msb = 63 - __builtin_clzll(value);
+    uint32_t shift = msb - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKET_COUNT
+           + ((value >> shift) - SUB_BUCKET_COUNT);
+}
+
+uint64_t
+Histogram::getValue(size_t index)
+{
+    if (index < SUB_BUCKET_COUNT) { return index; }
+
+    uint32_t shift = index / SUB_BUCKET_COUNT - 1;
+    uint64_t low = (uint64_t)(SUB_BUCKET_COUNT + index % SUB_BUCKET_COUNT)
+                   << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+void
+Histogram::record(uint64_t value)
+{
+    // Only one thread records, so a relaxed load and store is enough
+    //
+    std::atomic<uint64_t>& bucket = buckets_m[getIndex(value)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_relaxed);
+    count_m.store(count_m.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+}
+
+uint64_t
+Histogram::getMin(void) const
+{
+    for (size_t i=0; i<BUCKET_COUNT; i++)
+    {
+        if (buckets_m[i].load(std::memory_order_relaxed) != 0)
+        {
+            return getValue(i);
+        }
+    }
+
+    return 0;
+}
+
+uint64_t
+Histogram::getMax(void) const
+{
+    for (size_t i=BUCKET_COUNT; i>0; i--)
+    {
+        if (buckets_m[i - 1].load(std::memory_order_relaxed) != 0)
+        {
+            return getValue(i - 1);
+        }
+    }
+
+    return 0;
+}
+
+uint64_t
+Histogram::getPercentile(double percentile, const Histogram* base_p) const
+{
+    // Buckets are read once each, so the total is taken from them rather
+    // than from count_m, which may have moved on meanwhile
+    //
+    uint64_t counts[BUCKET_COUNT];
+    uint64_t total = 0;
+    for (size_t i=0; i<BUCKET_COUNT; i++)
+    {
+        counts[i] = buckets_m[i].load(std::memory_order_relaxed);
+        if (base_p != nullptr)
+        {
+            counts[i] -= base_p->buckets_m[i].load(std::memory_order_relaxed);
+        }
+        total += counts[i];
+    }
+
+    if (total == 0) { return 0; }
+
+    if (percentile < 0.0)   { percentile = 0.0; }
+    if (percentile > 100.0) { percentile = 100.0; }
+
+    uint64_t rank = std::ceil(percentile / 100.0 * total);
+    if (rank == 0) { rank = 1; }
+
+    uint64_t seen = 0;
+    for (size_t i=0; i<BUCKET_COUNT; i++)
+    {
+        seen += counts[i];
+        if (seen >= rank) { return getValue(i); }
+    }
+
+    return MAX_VALUE;
+}
+
+void
+Histogram::copyFrom(const Histogram& other)
+{
+    for (size_t i=0; i<BUCKET_COUNT; i++)
+    {
+        buckets_m[i].store(other.buckets_m[i].load(std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+    }
+    count_m.store(other.count_m.load(std::memory_order_relaxed),
+                  std::memory_order_relaxed);
+}
+
+} /* namespace topicMonitor */
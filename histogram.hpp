@@ -0,0 +1,97 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_HISTOGRAM_HPP_
+#define _TOPIC_MONITOR_HISTOGRAM_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace topicMonitor
+{
+
+// A histogram of integer values with a bounded relative error, in the manner
+// of HdrHistogram: values below 2^SUB_BUCKET_BITS are counted exactly, and
+// every power of two above is split into 2^SUB_BUCKET_BITS linear buckets, so
+// a recorded value is known to within 1/2^SUB_BUCKET_BITS (about 3%). Values
+// above MAX_VALUE are counted as MAX_VALUE.
+//
+// Recording is constant time and never allocates. Only one thread may record,
+// but any thread may read the histogram meanwhile; a reader sees each count
+// as of some point of the recording.
+//
+class Histogram
+{
+public:
+    static const uint32_t SUB_BUCKET_BITS = 5;
+    static const uint32_t MAX_VALUE_BITS  = 40;
+    static const uint64_t MAX_VALUE = ((uint64_t)1 << MAX_VALUE_BITS) - 1;
+
+    Histogram(void);
+
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    void record(uint64_t value);
+
+    uint64_t getCount(void) const
+        { return count_m.load(std::memory_order_relaxed); }
+    uint64_t getMin(void) const;
+    uint64_t getMax(void) const;
+
+    // The value below which percentile percent of the recorded values fall,
+    // to within the histogram's precision, or 0 if none was recorded. With a
+    // base, only the values recorded since base was copied are counted.
+    //
+    uint64_t getPercentile(double percentile,
+                           const Histogram* base_p = nullptr) const;
+
+    // Makes this a copy of other, e.g. to serve as the base of a later
+    // getPercentile()
+    //
+    void copyFrom(const Histogram& other);
+
+private:
+    static const uint32_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static const size_t   BUCKET_COUNT =
+        (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    static size_t getIndex(uint64_t value);
+
+    // The highest value counted in the bucket
+    //
+    static uint64_t getValue(size_t index);
+
+    std::atomic<uint64_t> buckets_m[BUCKET_COUNT];
+    std::atomic<uint64_t> count_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_HISTOGRAM_HPP_ */
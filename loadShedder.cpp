@@ -0,0 +1,96 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "loadShedder.hpp"
+
+#include <chrono>
+
+namespace topicMonitor
+{
+
+LoadShedder::LoadShedder(uint32_t targetMs) :
+    targetUs_m((uint64_t)targetMs * 1000),
+    shedding_m(false),
+    startedAt_m(0),
+    stoppedAt_m(0),
+    recoveringSince_m(0),
+    peakDelay_m(0)
+{
+}
+
+uint64_t
+LoadShedder::nowUs(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool
+LoadShedder::update(uint64_t delayUs)
+{
+    if (!shedding_m)
+    {
+        if (delayUs <= targetUs_m) { return false; }
+
+        shedding_m = true;
+        startedAt_m = nowUs();
+        recoveringSince_m = 0;
+        peakDelay_m = delayUs;
+        return true;
+    }
+
+    if (delayUs > peakDelay_m) { peakDelay_m = delayUs; }
+
+    // Any delay over half the target restarts the recovery
+    //
+    if (delayUs >= targetUs_m / 2)
+    {
+        recoveringSince_m = 0;
+        return false;
+    }
+
+    uint64_t now = nowUs();
+    if (recoveringSince_m == 0)
+    {
+        recoveringSince_m = now;
+        return false;
+    }
+    if (now - recoveringSince_m < RECOVERY_US) { return false; }
+
+    shedding_m = false;
+    stoppedAt_m = now;
+    return true;
+}
+
+uint64_t
+LoadShedder::getSheddingTime(void) const
+{
+    return (shedding_m ? nowUs() : stoppedAt_m) - startedAt_m;
+}
+
+} /* namespace topicMonitor */
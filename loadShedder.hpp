@@ -0,0 +1,92 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_LOAD_SHEDDER_HPP_
+#define _TOPIC_MONITOR_LOAD_SHEDDER_HPP_
+
+#include <cstdint>
+
+namespace topicMonitor
+{
+
+// This class decides when a MonitoringWorker sheds load, from the queueing
+// delay of its message lanes (see WorkLanes::getMessageDelay()), which the
+// worker passes to update() after every drain.
+//
+// Shedding starts as soon as the delay passes the target, and stops once the
+// delay has stayed under half the target for RECOVERY_US, so a worker that
+// only just keeps up with a burst does not go in and out of shedding on every
+// drain. While the worker sheds, each subscription drops messages by its own
+// ShedPolicy; this class only decides when.
+//
+// A LoadShedder is only ever used by the thread of its worker.
+//
+class LoadShedder
+{
+public:
+    // How long the delay must stay under half the target before shedding
+    // stops, in microseconds
+    //
+    static const uint64_t RECOVERY_US = 1000000;
+
+    // A target of 0 disables shedding
+    //
+    explicit LoadShedder(uint32_t targetMs);
+    ~LoadShedder(void) {}
+
+    bool isEnabled(void) const { return targetUs_m != 0; }
+    bool isShedding(void) const { return shedding_m; }
+
+    // Takes the current queueing delay in microseconds. Returns true if this
+    // started or stopped shedding.
+    //
+    bool update(uint64_t delayUs);
+
+    // The longest delay seen since shedding last started, and for how long,
+    // in microseconds, it has been or was shedding
+    //
+    uint64_t getPeakDelay(void) const { return peakDelay_m; }
+    uint64_t getSheddingTime(void) const;
+
+private:
+    static uint64_t nowUs(void);
+
+    uint64_t targetUs_m;
+    bool     shedding_m;
+    uint64_t startedAt_m;
+    uint64_t stoppedAt_m;
+
+    // When the delay went under half the target, 0 while it is not
+    //
+    uint64_t recoveringSince_m;
+    uint64_t peakDelay_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_LOAD_SHEDDER_HPP_ */
@@ -0,0 +1,208 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "luaBuffer.hpp"
+
+#include <new>
+
+namespace topicMonitor
+{
+
+static const char* const METATABLE_NAME = "topicMonitor.buffer";
+
+// Converts a string.sub()-style position to a 1-based offset; negative
+// positions count from the end
+//
+static lua_Integer
+relativePosition(lua_Integer position, size_t size)
+{
+    if (position >= 0) { return position; }
+    if ((size_t)-position > size) { return 0; }
+    return (lua_Integer)size + position + 1;
+}
+
+void
+LuaBuffer::registerType(lua_State* L)
+{
+    static const luaL_Reg methods[] =
+    {
+        { "tostring", luaToString },
+        { "sub",      luaSub },
+        { "byte",     luaByte },
+        { "len",      luaLen },
+        { nullptr,    nullptr }
+    };
+
+    static const luaL_Reg metamethods[] =
+    {
+        { "__tostring", luaToString },
+        { "__len",      luaLen },
+        { "__concat",   luaConcat },
+        { nullptr,      nullptr }
+    };
+
+    luaL_newmetatable(L, METATABLE_NAME);
+    luaL_setfuncs(L, metamethods, 0);
+    luaL_newlib(L, methods);
+    lua_setfield(L, -2, "__index");
+
+    // Hide the metatable from getmetatable()
+    //
+    lua_pushboolean(L, 0);
+    lua_setfield(L, -2, "__metatable");
+    lua_pop(L, 1);
+}
+
+LuaBuffer*
+LuaBuffer::create(lua_State* L)
+{
+    // LuaBuffer is trivially destructible, so the userdata needs no __gc
+    //
+    LuaBuffer* buffer_p = new (lua_newuserdata(L, sizeof(LuaBuffer)))
+                              LuaBuffer();
+    luaL_setmetatable(L, METATABLE_NAME);
+    buffer_p->ref_m = luaL_ref(L, LUA_REGISTRYINDEX);
+    return buffer_p;
+}
+
+LuaBuffer*
+LuaBuffer::check(lua_State* L, int index)
+{
+    LuaBuffer* buffer_p = (LuaBuffer*)luaL_checkudata(L, index,
+                                                      METATABLE_NAME);
+    if (!buffer_p->valid_m)
+    {
+        luaL_error(L, "payload buffer used after its callback returned");
+    }
+
+    return buffer_p;
+}
+
+LuaBuffer*
+LuaBuffer::test(lua_State* L, int index)
+{
+    if (luaL_testudata(L, index, METATABLE_NAME) == nullptr) { return nullptr; }
+
+    return check(L, index);
+}
+
+int
+LuaBuffer::luaToString(lua_State* L)
+{
+    LuaBuffer* buffer_p = check(L, 1);
+    lua_pushlstring(L, buffer_p->data_mp, buffer_p->size_m);
+    return 1;
+}
+
+int
+LuaBuffer::luaSub(lua_State* L)
+{
+    LuaBuffer* buffer_p = check(L, 1);
+    size_t size = buffer_p->size_m;
+
+    lua_Integer start = relativePosition(luaL_checkinteger(L, 2), size);
+    lua_Integer end = relativePosition(luaL_optinteger(L, 3, -1), size);
+    if (start < 1) { start = 1; }
+    if (end > (lua_Integer)size) { end = size; }
+
+    if (start > end)
+    {
+        lua_pushliteral(L, "");
+    }
+    else
+    {
+        lua_pushlstring(L, buffer_p->data_mp + start - 1, end - start + 1);
+    }
+
+    return 1;
+}
+
+int
+LuaBuffer::luaByte(lua_State* L)
+{
+    LuaBuffer* buffer_p = check(L, 1);
+    size_t size = buffer_p->size_m;
+
+    lua_Integer start = relativePosition(luaL_optinteger(L, 2, 1), size);
+    lua_Integer end = relativePosition(luaL_optinteger(L, 3, start), size);
+    if (start < 1) { start = 1; }
+    if (end > (lua_Integer)size) { end = size; }
+    if (start > end) { return 0; }
+
+    int count = end - start + 1;
+    if (!lua_checkstack(L, count))
+    {
+        return luaL_error(L, "byte range too large");
+    }
+
+    const unsigned char* data_p = (const unsigned char*)buffer_p->data_mp;
+    for (lua_Integer i=start; i<=end; i++)
+    {
+        lua_pushinteger(L, data_p[i - 1]);
+    }
+
+    return count;
+}
+
+int
+LuaBuffer::luaLen(lua_State* L)
+{
+    lua_pushinteger(L, check(L, 1)->size_m);
+    return 1;
+}
+
+int
+LuaBuffer::luaConcat(lua_State* L)
+{
+    // Either operand may be the buffer; the other must be a string or number
+    //
+    const char* parts[2];
+    size_t sizes[2];
+    for (int i=0; i<2; i++)
+    {
+        if (lua_type(L, i + 1) == LUA_TUSERDATA)
+        {
+            LuaBuffer* buffer_p = check(L, i + 1);
+            parts[i] = buffer_p->data_mp;
+            sizes[i] = buffer_p->size_m;
+        }
+        else
+        {
+            parts[i] = luaL_checklstring(L, i + 1, &sizes[i]);
+        }
+    }
+
+    luaL_Buffer result;
+    luaL_buffinit(L, &result);
+    luaL_addlstring(&result, parts[0], sizes[0]);
+    luaL_addlstring(&result, parts[1], sizes[1]);
+    luaL_pushresult(&result);
+    return 1;
+}
+
+} /* namespace topicMonitor */
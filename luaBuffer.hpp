@@ -0,0 +1,105 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_LUA_BUFFER_HPP_
+#define _TOPIC_MONITOR_LUA_BUFFER_HPP_
+
+#include <cstddef>
+#include <lua5.2/lua.hpp>
+
+namespace topicMonitor
+{
+
+// A LuaBuffer is a read-only view of a message payload, exposed to scripts as
+// a userdata so that the payload is not copied into a Lua string unless the
+// script asks for it. Payloads may contain arbitrary bytes.
+//
+// From Lua, a buffer supports:
+//
+// * buf:tostring() / tostring(buf): copies the whole payload into a string
+// * buf:sub(i [, j]): copies bytes i to j into a string, as string.sub()
+// * buf:byte([i [, j]]): returns bytes i to j as integers, as string.byte()
+// * buf:len() / #buf: the payload size in bytes
+// * buf .. s / s .. buf: concatenation with a string or number
+//
+// A buffer refers to the message's memory, which is freed once the message has
+// been handled. Buffers are therefore created once per lua_State and reused:
+// the worker points a buffer at a payload before calling the script and
+// invalidates it when the call returns, after which any access raises a Lua
+// error instead of reading freed memory.
+//
+class LuaBuffer
+{
+public:
+    // Registers the buffer metatable; must be called once per lua_State
+    // before any buffer is created
+    //
+    static void registerType(lua_State* L);
+
+    // Creates a buffer owned by L and anchors it in the registry, so it lives
+    // until L is closed
+    //
+    static LuaBuffer* create(lua_State* L);
+
+    void set(const char* data_p, size_t size)
+        { data_mp = data_p; size_m = size; valid_m = true; }
+    void invalidate(void) { data_mp = nullptr; size_m = 0; valid_m = false; }
+
+    // Registry reference to the userdata, for lua_rawgeti()
+    //
+    int getRef(void) const { return ref_m; }
+
+    // Returns the buffer at index, or nullptr if the value is not a buffer.
+    // Raises a Lua error if the buffer was invalidated.
+    //
+    static LuaBuffer* test(lua_State* L, int index);
+
+    const char* getData(void) const { return data_mp; }
+    size_t getSize(void) const { return size_m; }
+
+private:
+    LuaBuffer(void) : data_mp(nullptr), size_m(0), valid_m(false),
+                      ref_m(LUA_NOREF) {}
+
+    static LuaBuffer* check(lua_State* L, int index);
+
+    static int luaToString(lua_State* L);
+    static int luaSub(lua_State* L);
+    static int luaByte(lua_State* L);
+    static int luaLen(lua_State* L);
+    static int luaConcat(lua_State* L);
+
+    const char* data_mp;
+    size_t      size_m;
+    bool        valid_m;
+    int         ref_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_LUA_BUFFER_HPP_ */
@@ -0,0 +1,247 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "luaMessage.hpp"
+
+#include <new>
+
+namespace topicMonitor
+{
+
+static const char* const METATABLE_NAME = "topicMonitor.message";
+
+// Pushes the string returned by a solClient_msg_get*() string accessor, or
+// nil if the message does not carry it
+//
+static int
+pushStringField(lua_State* L,
+                solClient_returnCode_t rc,
+                const char* string_p)
+{
+    if (rc == SOLCLIENT_OK) { lua_pushstring(L, string_p); }
+    else { lua_pushnil(L); }
+    return 1;
+}
+
+static int
+pushInt64Field(lua_State* L, solClient_returnCode_t rc, solClient_int64_t value)
+{
+    if (rc == SOLCLIENT_OK) { lua_pushinteger(L, value); }
+    else { lua_pushnil(L); }
+    return 1;
+}
+
+void
+LuaMessage::registerType(lua_State* L)
+{
+    static const luaL_Reg methods[] =
+    {
+        { "topic",                luaTopic },
+        { "senderTimestamp",      luaSenderTimestamp },
+        { "rcvTimestamp",         luaRcvTimestamp },
+        { "seq",                  luaSeq },
+        { "correlationId",        luaCorrelationId },
+        { "applicationMessageId", luaApplicationMessageId },
+        { "senderId",             luaSenderId },
+        { "redelivered",          luaRedelivered },
+        { "prop",                 luaProp },
+        { nullptr,                nullptr }
+    };
+
+    luaL_newmetatable(L, METATABLE_NAME);
+    luaL_newlib(L, methods);
+    lua_setfield(L, -2, "__index");
+
+    // Hide the metatable from getmetatable()
+    //
+    lua_pushboolean(L, 0);
+    lua_setfield(L, -2, "__metatable");
+    lua_pop(L, 1);
+}
+
+LuaMessage*
+LuaMessage::create(lua_State* L)
+{
+    // LuaMessage is trivially destructible, so the userdata needs no __gc
+    //
+    LuaMessage* message_p = new (lua_newuserdata(L, sizeof(LuaMessage)))
+                                LuaMessage();
+    luaL_setmetatable(L, METATABLE_NAME);
+    message_p->ref_m = luaL_ref(L, LUA_REGISTRYINDEX);
+    return message_p;
+}
+
+void
+LuaMessage::invalidate(void)
+{
+    if (propertyMap_mp != nullptr)
+    {
+        solClient_container_closeMapStream(&propertyMap_mp);
+        propertyMap_mp = nullptr;
+    }
+
+    msg_mp = nullptr;
+}
+
+LuaMessage*
+LuaMessage::check(lua_State* L)
+{
+    LuaMessage* message_p = (LuaMessage*)luaL_checkudata(L, 1,
+                                                         METATABLE_NAME);
+    if (message_p->msg_mp == nullptr)
+    {
+        luaL_error(L, "message used after its callback returned");
+    }
+
+    return message_p;
+}
+
+int
+LuaMessage::luaTopic(lua_State* L)
+{
+    solClient_destination_t dest;
+    solClient_returnCode_t rc = solClient_msg_getDestination(
+                                    check(L)->msg_mp, &dest, sizeof(dest));
+    return pushStringField(L, rc, dest.dest);
+}
+
+int
+LuaMessage::luaSenderTimestamp(lua_State* L)
+{
+    solClient_int64_t timestamp;
+    solClient_returnCode_t rc = solClient_msg_getSenderTimestamp(
+                                    check(L)->msg_mp, &timestamp);
+    return pushInt64Field(L, rc, timestamp);
+}
+
+int
+LuaMessage::luaRcvTimestamp(lua_State* L)
+{
+    solClient_int64_t timestamp;
+    solClient_returnCode_t rc = solClient_msg_getRcvTimestamp(
+                                    check(L)->msg_mp, &timestamp);
+    return pushInt64Field(L, rc, timestamp);
+}
+
+int
+LuaMessage::luaSeq(lua_State* L)
+{
+    solClient_int64_t seq;
+    solClient_returnCode_t rc = solClient_msg_getSequenceNumber(
+                                    check(L)->msg_mp, &seq);
+    return pushInt64Field(L, rc, seq);
+}
+
+int
+LuaMessage::luaCorrelationId(lua_State* L)
+{
+    const char* id_p;
+    solClient_returnCode_t rc = solClient_msg_getCorrelationId(
+                                    check(L)->msg_mp, &id_p);
+    return pushStringField(L, rc, id_p);
+}
+
+int
+LuaMessage::luaApplicationMessageId(lua_State* L)
+{
+    const char* id_p;
+    solClient_returnCode_t rc = solClient_msg_getApplicationMessageId(
+                                    check(L)->msg_mp, &id_p);
+    return pushStringField(L, rc, id_p);
+}
+
+int
+LuaMessage::luaSenderId(lua_State* L)
+{
+    const char* id_p;
+    solClient_returnCode_t rc = solClient_msg_getSenderId(
+                                    check(L)->msg_mp, &id_p);
+    return pushStringField(L, rc, id_p);
+}
+
+int
+LuaMessage::luaRedelivered(lua_State* L)
+{
+    lua_pushboolean(L, solClient_msg_isRedelivered(check(L)->msg_mp));
+    return 1;
+}
+
+int
+LuaMessage::luaProp(lua_State* L)
+{
+    LuaMessage* message_p = check(L);
+    const char* name_p = luaL_checkstring(L, 2);
+
+    if (message_p->propertyMap_mp == nullptr
+            && solClient_msg_getUserPropertyMap(message_p->msg_mp,
+                                                &message_p->propertyMap_mp)
+                   != SOLCLIENT_OK)
+    {
+        message_p->propertyMap_mp = nullptr;
+        lua_pushnil(L);
+        return 1;
+    }
+
+    solClient_field_t field;
+    if (solClient_container_getField(message_p->propertyMap_mp,
+                                     &field, sizeof(field), name_p)
+            != SOLCLIENT_OK)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    switch (field.type)
+    {
+    case SOLCLIENT_BOOL:      lua_pushboolean(L, field.value.boolean); break;
+    case SOLCLIENT_UINT8:     lua_pushinteger(L, field.value.uint8); break;
+    case SOLCLIENT_INT8:      lua_pushinteger(L, field.value.int8); break;
+    case SOLCLIENT_UINT16:    lua_pushinteger(L, field.value.uint16); break;
+    case SOLCLIENT_INT16:     lua_pushinteger(L, field.value.int16); break;
+    case SOLCLIENT_UINT32:    lua_pushinteger(L, field.value.uint32); break;
+    case SOLCLIENT_INT32:     lua_pushinteger(L, field.value.int32); break;
+    case SOLCLIENT_UINT64:    lua_pushnumber(L, field.value.uint64); break;
+    case SOLCLIENT_INT64:     lua_pushinteger(L, field.value.int64); break;
+    case SOLCLIENT_WCHAR:     lua_pushinteger(L, field.value.wchar); break;
+    case SOLCLIENT_FLOAT:     lua_pushnumber(L, field.value.float32); break;
+    case SOLCLIENT_DOUBLE:    lua_pushnumber(L, field.value.float64); break;
+    case SOLCLIENT_STRING:    lua_pushstring(L, field.value.string); break;
+    case SOLCLIENT_BYTEARRAY:
+        lua_pushlstring(L, (const char*)field.value.bytearray, field.length);
+        break;
+    default:
+        // Nested maps and streams, destinations and nulls are not supported
+        //
+        lua_pushnil(L);
+        break;
+    }
+
+    return 1;
+}
+
+} /* namespace topicMonitor */
@@ -0,0 +1,101 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_LUA_MESSAGE_HPP_
+#define _TOPIC_MONITOR_LUA_MESSAGE_HPP_
+
+#include <lua5.2/lua.hpp>
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+
+namespace topicMonitor
+{
+
+// A LuaMessage exposes the headers and user properties of a message to
+// scripts. Every accessor reads its field from the message only when the
+// script calls it, so fields a script never reads cost nothing:
+//
+// * msg:topic(): the destination topic
+// * msg:senderTimestamp() / msg:rcvTimestamp(): milliseconds since the epoch
+// * msg:seq(): the sender sequence number
+// * msg:correlationId(), msg:applicationMessageId(), msg:senderId()
+// * msg:redelivered(): true if the message was redelivered
+// * msg:prop(name): the user property called name
+//
+// Accessors return nil if the message does not carry the field.
+//
+// Like LuaBuffer, message objects are created once per lua_State, pointed at
+// a message before a script is called and invalidated when it returns.
+//
+class LuaMessage
+{
+public:
+    // Registers the message metatable; must be called once per lua_State
+    // before any message object is created
+    //
+    static void registerType(lua_State* L);
+
+    // Creates a message object owned by L and anchors it in the registry, so
+    // it lives until L is closed
+    //
+    static LuaMessage* create(lua_State* L);
+
+    void set(solClient_opaqueMsg_pt msg_p) { msg_mp = msg_p; }
+    void invalidate(void);
+
+    // Registry reference to the userdata, for lua_rawgeti()
+    //
+    int getRef(void) const { return ref_m; }
+
+private:
+    LuaMessage(void) : msg_mp(nullptr), propertyMap_mp(nullptr),
+                       ref_m(LUA_NOREF) {}
+
+    static LuaMessage* check(lua_State* L);
+
+    static int luaTopic(lua_State* L);
+    static int luaSenderTimestamp(lua_State* L);
+    static int luaRcvTimestamp(lua_State* L);
+    static int luaSeq(lua_State* L);
+    static int luaCorrelationId(lua_State* L);
+    static int luaApplicationMessageId(lua_State* L);
+    static int luaSenderId(lua_State* L);
+    static int luaRedelivered(lua_State* L);
+    static int luaProp(lua_State* L);
+
+    solClient_opaqueMsg_pt       msg_mp;
+
+    // Opened on the first call to prop() and closed by invalidate()
+    //
+    solClient_opaqueContainer_pt propertyMap_mp;
+    int                          ref_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_LUA_MESSAGE_HPP_ */
@@ -33,75 +33,156 @@
 #include <lua5.2/lua.hpp>
 
 #include "common.hpp"
+#include "config.hpp"
 #include "log.hpp"
 #include "monitoringThread.hpp"
-#include "solClientThread.hpp"
-#include "threadSafeQueue.hpp"
+#include "mpscRingBuffer.hpp"
+#include "publisher.hpp"
+#include "subscriptionRegistry.hpp"
+#include "transport.hpp"
 #include "utils.hpp"
 
 namespace topicMonitor
 {
 
-// TODO (BTO): Maybe use a smart pointer with a Deleter FunctionObject here to
-//             clean up the lua_State once it goes out of scope?
 returnCode_t
-createAndStartSolClientThread()
+createAndStartTransport(void)
 {
     returnCode_t rc;
 
-    // Create and initialize SolClientThread
+    // Create and initialize the transport selected in config.lua
     //
-    SolClientThread* thread_p = SolClientThread::instance();
+    Transport* transport_p = Transport::instance();
 
-    std::string host;
-    std::string vpn;
-    std::string username;
-    std::string password;
+    // Connect to message broker
+    //
+    rc = transport_p->connect();
+    if (rc != returnCode_t::SUCCESS) { return returnCode_t::FAILURE; }
 
-    // Opens a new lua state and load credentials.lua
+    // Start context timer
     //
-    lua_State* L = luaL_newstate();
-    luaopen_base(L);
-    if (luaL_dofile(L, "credentials.lua") != 0)
+    rc = transport_p->startTimer();
+    if (rc != returnCode_t::SUCCESS) { return returnCode_t::FAILURE; }
+
+    return returnCode_t::SUCCESS;
+}
+
+// Reads the probe settings of a subscription from the table at the top of the
+// stack:
+//
+// { intervalMs = <ms:int>,
+//   timeoutMs  = <ms:int>,       (optional, default 5 * intervalMs)
+//   topic      = <topic:string>  (optional, default the subscription topic) }
+//
+static bool
+getProbeInfo(lua_State* L, SubscriptionInfo& info)
+{
+    uint32_t intervalMs = 0;
+    uint32_t timeoutMs = 0;
+    std::string topic;
+
+    lua_getfield(L, -1, "intervalMs");
+    if (!lua_isnumber(L, -1) || lua_tonumber(L, -1) < 1)
     {
-        LOG(ERROR, "Could load credentials.lua");
-        goto cleanup;
+        LOG(ERROR, "subscriptionTable invalid format (probe intervalMs not a positive integer)");
+        lua_pop(L, 1);
+        return false;
     }
+    intervalMs = lua_tonumber(L, -1);
+    lua_pop(L, 1);
 
-    // Extract credentials from credentials.lua
-    //
-    // TODO (BTO): Proper error output if file is malformed
-    //
-    host = utils::lua::getStringValueFromSymbol(L, "host");
-    if (host.empty()) { goto cleanup; }
-    vpn = utils::lua::getStringValueFromSymbol(L, "vpn");
-    if (vpn.empty()) { goto cleanup; }
-    username = utils::lua::getStringValueFromSymbol(L, "username");
-    if (username.empty()) { goto cleanup; }
-    password = utils::lua::getStringValueFromSymbol(L, "password");
-    if (password.empty()) { goto cleanup; }
-
-    // Create session
-    //
-    rc = thread_p->createSession(host, vpn, username, password);
-    if (rc != returnCode_t::SUCCESS) { goto cleanup; }
+    lua_getfield(L, -1, "timeoutMs");
+    if (!lua_isnil(L, -1))
+    {
+        if (!lua_isnumber(L, -1) || lua_tonumber(L, -1) < 1)
+        {
+            LOG(ERROR, "subscriptionTable invalid format (probe timeoutMs not a positive integer)");
+            lua_pop(L, 1);
+            return false;
+        }
+        timeoutMs = lua_tonumber(L, -1);
+    }
+    else
+    {
+        timeoutMs = 5 * intervalMs;
+    }
+    lua_pop(L, 1);
 
-    // Connect to message broker
-    //
-    rc = thread_p->connectSession();
-    if (rc != returnCode_t::SUCCESS) { goto cleanup; }
+    lua_getfield(L, -1, "topic");
+    if (!lua_isnil(L, -1))
+    {
+        if (lua_type(L, -1) != LUA_TSTRING)
+        {
+            LOG(ERROR, "subscriptionTable invalid format (probe topic not string)");
+            lua_pop(L, 1);
+            return false;
+        }
+        topic = lua_tostring(L, -1);
+    }
+    lua_pop(L, 1);
 
-    // Start context timer
-    //
-    rc = thread_p->startTimer();
-    if (rc != returnCode_t::SUCCESS) { goto cleanup; }
+    if (!info.setProbe(topic, intervalMs, timeoutMs))
+    {
+        LOG(ERROR, "probe topic too long");
+        return false;
+    }
 
-    lua_close(L);
-    return returnCode_t::SUCCESS;
+    return true;
+}
 
-cleanup:
-    lua_close(L);
-    return returnCode_t::FAILURE;
+// Reads the shed policy of a subscription from the table at the top of the
+// stack; see ShedPolicy:
+//
+// { sample   = <count:int>,  (optional, default 1)
+//   maxAgeMs = <ms:int>,     (optional, default 0)
+//   skip     = <bool>        (optional, default false) }
+//
+static bool
+getShedPolicy(lua_State* L, SubscriptionInfo& info)
+{
+    ShedPolicy shed;
+
+    lua_getfield(L, -1, "sample");
+    if (!lua_isnil(L, -1))
+    {
+        if (!lua_isnumber(L, -1) || lua_tonumber(L, -1) < 1)
+        {
+            LOG(ERROR, "subscriptionTable invalid format (shed sample not a positive integer)");
+            lua_pop(L, 1);
+            return false;
+        }
+        shed.sample = lua_tonumber(L, -1);
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, -1, "maxAgeMs");
+    if (!lua_isnil(L, -1))
+    {
+        if (!lua_isnumber(L, -1) || lua_tonumber(L, -1) < 1)
+        {
+            LOG(ERROR, "subscriptionTable invalid format (shed maxAgeMs not a positive integer)");
+            lua_pop(L, 1);
+            return false;
+        }
+        shed.maxAgeMs = lua_tonumber(L, -1);
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, -1, "skip");
+    if (!lua_isnil(L, -1))
+    {
+        if (!lua_isboolean(L, -1))
+        {
+            LOG(ERROR, "subscriptionTable invalid format (shed skip not boolean)");
+            lua_pop(L, 1);
+            return false;
+        }
+        shed.skip = lua_toboolean(L, -1);
+    }
+    lua_pop(L, 1);
+
+    info.setShedPolicy(shed);
+    return true;
 }
 
 // TODO (BTO): Maybe use a smart pointer with a Deleter FunctionObject here to
@@ -145,8 +226,18 @@ getSubscriptionInfoList(SubscriptionInfoList& subscriptions)
     // value: table { 
     //          key: "filename", value: <filename:string>,
     //          key: "timer", value: <seconds:int>,        (optional)
+    //          key: "queue", value: <queue:string>,       (optional)
+    //          key: "maxUnacked", value: <count:int>,     (optional)
+    //          key: "probe", value: <table>,              (optional)
+    //          key: "conflate", value: <boolean>,         (optional)
+    //          key: "priority", value: "high" | "normal" | "low", (optional)
+    //          key: "spill", value: <boolean>,            (optional)
+    //          key: "shed", value: <table>,               (optional)
     //        }
     //
+    // The filename may only be left out of a probe entry; see getProbeInfo().
+    // The shed table is read by getShedPolicy().
+    //
     lua_pushnil(L);
     while (lua_next(L, -2) != 0)
     {
@@ -181,8 +272,9 @@ getSubscriptionInfoList(SubscriptionInfoList& subscriptions)
                 goto cleanup;
             }
 
-            // The key can either be "filename" or "timer", get the value of
-            // these keys
+            // The key can be "filename", "timer", "queue", "maxUnacked",
+            // "probe", "conflate", "priority", "spill" or "shed", get the
+            // value of these keys
             //
             const char* key_p = lua_tostring(L, -2);
             if (strcmp(key_p, "filename") == 0)
@@ -210,6 +302,86 @@ getSubscriptionInfoList(SubscriptionInfoList& subscriptions)
                 uint32_t timeout = lua_tonumber(L, -1);
                 info.setTimeout(timeout);
             }
+            else if (strcmp(key_p, "queue") == 0)
+            {
+                if (!lua_isstring(L, -1))
+                {
+                    LOG(ERROR, "subscriptionTable invalid format (queue value not string)");
+                    goto cleanup;
+                }
+                if (!info.setQueue(lua_tostring(L, -1)))
+                {
+                    LOG(ERROR, "queue name too long");
+                    goto cleanup;
+                }
+            }
+            else if (strcmp(key_p, "maxUnacked") == 0)
+            {
+                if (!lua_isnumber(L, -1) || lua_tonumber(L, -1) < 1)
+                {
+                    LOG(ERROR, "subscriptionTable invalid format (maxUnacked value not a positive integer)");
+                    goto cleanup;
+                }
+                info.setMaxUnacked(lua_tonumber(L, -1));
+            }
+            else if (strcmp(key_p, "probe") == 0)
+            {
+                if (!lua_istable(L, -1))
+                {
+                    LOG(ERROR, "subscriptionTable invalid format (probe value not table)");
+                    goto cleanup;
+                }
+                if (!getProbeInfo(L, info)) { goto cleanup; }
+            }
+            else if (strcmp(key_p, "conflate") == 0)
+            {
+                if (!lua_isboolean(L, -1))
+                {
+                    LOG(ERROR, "subscriptionTable invalid format (conflate value not boolean)");
+                    goto cleanup;
+                }
+                info.setConflate(lua_toboolean(L, -1));
+            }
+            else if (strcmp(key_p, "priority") == 0)
+            {
+                const char* priority_p = lua_isstring(L, -1)
+                                         ? lua_tostring(L, -1) : "";
+                if (strcmp(priority_p, "high") == 0)
+                {
+                    info.setPriority(priority_t::HIGH);
+                }
+                else if (strcmp(priority_p, "normal") == 0)
+                {
+                    info.setPriority(priority_t::NORMAL);
+                }
+                else if (strcmp(priority_p, "low") == 0)
+                {
+                    info.setPriority(priority_t::LOW);
+                }
+                else
+                {
+                    LOG(ERROR, "subscriptionTable invalid format (priority value not \"high\", \"normal\" or \"low\")");
+                    goto cleanup;
+                }
+            }
+            else if (strcmp(key_p, "spill") == 0)
+            {
+                if (!lua_isboolean(L, -1))
+                {
+                    LOG(ERROR, "subscriptionTable invalid format (spill value not boolean)");
+                    goto cleanup;
+                }
+                info.setSpill(lua_toboolean(L, -1));
+            }
+            else if (strcmp(key_p, "shed") == 0)
+            {
+                if (!lua_istable(L, -1))
+                {
+                    LOG(ERROR, "subscriptionTable invalid format (shed value not table)");
+                    goto cleanup;
+                }
+                if (!getShedPolicy(L, info)) { goto cleanup; }
+            }
             else
             {
                 LOG(ERROR, "subscriptionTable invalid format (unknown key)");
@@ -219,12 +391,51 @@ getSubscriptionInfoList(SubscriptionInfoList& subscriptions)
             lua_pop(L, 1); // Pop 'value'... keep 'key' for next iteration
         }
 
-        if (!seenFile)
+        if (!seenFile && !info.isProbe())
         {
             LOG(ERROR, "subscriptionTable invalid format (filename not seen)");
             goto cleanup;
         }
 
+        if (info.isProbe() && info.isGuaranteed())
+        {
+            LOG(ERROR, "subscriptionTable invalid format (probe on a queue)");
+            goto cleanup;
+        }
+
+        // Guaranteed messages must all be acknowledged, and probe echoes
+        // must not be replaced by other messages on the topic
+        //
+        if (info.isConflated() && (info.isGuaranteed() || info.isProbe()))
+        {
+            LOG(ERROR, "subscriptionTable invalid format (conflate on a queue or probe)");
+            goto cleanup;
+        }
+
+        // A queue already keeps its backlog on the broker
+        //
+        if (info.isSpilled() && (info.isGuaranteed() || info.isConflated()))
+        {
+            LOG(ERROR, "subscriptionTable invalid format (spill on a queue or conflated topic)");
+            goto cleanup;
+        }
+        if (info.isSpilled() && Config::instance()->getSpillDirectory().empty())
+        {
+            LOG(ERROR, "spill set for topic '" << topic_p
+                       << "' without spillDirectory in config");
+            goto cleanup;
+        }
+
+        // Shedding loses messages, which a queue or a spilled subscription
+        // is there to keep
+        //
+        if (info.getShedPolicy().isSet()
+                && (info.isGuaranteed() || info.isSpilled()))
+        {
+            LOG(ERROR, "subscriptionTable invalid format (shed on a queue or spilled topic)");
+            goto cleanup;
+        }
+
         subscriptions.push_back(info);
 
         lua_pop(L, 1); // Pop 'value'... keep 'key' for next iteration
@@ -245,27 +456,17 @@ subscribeToMonitoredTopics(void)
     LOG(INFO, "Subscribing to monitored topics");
     returnCode_t rc;
 
-    SolClientThread* thread_p = SolClientThread::instance();
-
     // Get subscription list
     //
     SubscriptionInfoList subscriptions;
     rc = getSubscriptionInfoList(subscriptions);
     if (rc != returnCode_t::SUCCESS) { return returnCode_t::FAILURE; }
 
-    // Subscribe to each topic on the subscription list
+    // Subscribe to each topic on the subscription list. Requests are sent
+    // back to back, each subscription going live when the broker confirms
+    // it, so this does not wait for round trips to the broker.
     //
-    for (auto it = subscriptions.begin(); it < subscriptions.end(); it++)
-    {
-        rc = thread_p->topicSubscribe(it->getTopic());
-        if (rc != returnCode_t::SUCCESS) { continue; }
-
-        // Create a work entry and enqueue it to MonitoringThread's work queue
-        //
-        WorkEntrySubscribe* entry_p = new WorkEntrySubscribe();
-        entry_p->setSubscriptionInfo(*it);
-        MonitoringThread::instance()->getWorkQueue()->push(entry_p);
-    }
+    MonitoringThread::instance()->addSubscriptions(subscriptions);
 
     return returnCode_t::SUCCESS;
 }
@@ -275,11 +476,11 @@ unsubscribeFromMonitoredTopics(void)
 {
     returnCode_t rc;
 
-    SolClientThread* thread_p = SolClientThread::instance();
+    Transport* transport_p = Transport::instance();
 
     // TODO (BTO): Unsubscribe from each topic.
     //
-    rc = thread_p->topicUnsubscribe("temperature");
+    rc = transport_p->topicUnsubscribe("temperature");
     if (rc != returnCode_t::SUCCESS) { return returnCode_t::FAILURE; }
 
     return returnCode_t::SUCCESS;
@@ -290,13 +491,21 @@ createAndStartMonitoringThread(void)
 {
     returnCode_t rc;
 
-    // Create and initialize MonitoringThread
-    //
     MonitoringThread* thread_p = MonitoringThread::instance();
 
+    // Start the worker threads before subscribing so that messages received
+    // during subscription are consumed instead of filling the work queues.
+    //
+    rc = thread_p->start();
+    if (rc != returnCode_t::SUCCESS) { return returnCode_t::FAILURE; }
+
+    // Scripts may publish as soon as they are loaded
+    //
+    Publisher::instance()->start();
+
     // Subscribe to all monitored topics. This must be called after
     // MonitoringThread is created because it will push work entries on the
-    // work queue of MonitoringThread.
+    // work queues of its workers.
     //
     if (subscribeToMonitoredTopics() != returnCode_t::SUCCESS)
     {
@@ -306,7 +515,7 @@ createAndStartMonitoringThread(void)
 
     // Do main loop
     //
-    rc = thread_p->start();
+    rc = thread_p->run();
     if (rc != returnCode_t::SUCCESS) { return returnCode_t::FAILURE; }
 
     // Unsubscribe from all monitored topics.
@@ -317,7 +526,7 @@ createAndStartMonitoringThread(void)
         return returnCode_t::FAILURE;
     }
 
-    rc = SolClientThread::instance()->stopTimer();
+    rc = Transport::instance()->stopTimer();
     if (rc != returnCode_t::SUCCESS) { return returnCode_t::FAILURE; }
 
     return returnCode_t::SUCCESS;
@@ -337,9 +546,20 @@ main(int argc, char* argv[])
     //Logger::init(std::cout, Logger::logLevel_t::WARN);
     //Logger::init(std::cout, Logger::logLevel_t::ERROR);
 
-    if (createAndStartSolClientThread() != returnCode_t::SUCCESS)
+    if (Config::instance()->load("config.lua") == returnCode_t::FAILURE)
+    {
+        LOG(ERROR, "Could not load config.lua");
+        return -1;
+    }
+
+    // Create and initialize MonitoringThread before the transport, which
+    // pushes work entries to it from its own thread.
+    //
+    MonitoringThread::instance();
+
+    if (createAndStartTransport() != returnCode_t::SUCCESS)
     {
-        LOG(ERROR, "Could not create and start SolClientThread");
+        LOG(ERROR, "Could not create and start transport");
         return -1;
     }
 
@@ -0,0 +1,304 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "mockTransport.hpp"
+
+#include <chrono>
+
+#include "log.hpp"
+#include "monitoringThread.hpp"
+
+namespace topicMonitor
+{
+
+MockTransport::MockTransport(void) :
+    config_m(Config::instance()->getMockConfig()),
+    payload_m(config_m.payloadSize),
+    sequence_m(0),
+    delivered_m(0),
+    lastReportDelivered_m(0),
+    connected_m(false),
+    timerStarted_m(false)
+{
+    // solClient is still needed to allocate messages
+    //
+    if (solClient_initialize(SOLCLIENT_LOG_DEFAULT_FILTER, nullptr)
+            != SOLCLIENT_OK)
+        LOG(FATAL, "solClient initialization failed");
+
+    std::vector<uint32_t> weights;
+    for (const MockTopic& topic : config_m.topics)
+    {
+        weights.push_back(topic.weight);
+    }
+    topicDistribution_m = std::discrete_distribution<size_t>(weights.begin(),
+                                                             weights.end());
+
+    // A recognizable payload rather than zeroes
+    //
+    for (size_t i=0; i<payload_m.size(); i++)
+    {
+        payload_m[i] = 'a' + i % 26;
+    }
+
+    LOG(INFO, "mockTransport created (" << config_m.rate << " msg/s on "
+              << config_m.topics.size() << " topic(s))");
+}
+
+MockTransport::~MockTransport(void)
+{
+    disconnect();
+
+    if (solClient_cleanup() != SOLCLIENT_OK)
+        LOG(FATAL, "solClient cleanup failed");
+}
+
+returnCode_t
+MockTransport::connect(void)
+{
+    if (connected_m.exchange(true)) { return returnCode_t::NOTHING_TO_DO; }
+
+    thread_m = std::thread(&MockTransport::run, this);
+
+    LOG(INFO, "mockTransport connected");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+MockTransport::disconnect(void)
+{
+    if (!connected_m.exchange(false)) { return returnCode_t::NOTHING_TO_DO; }
+
+    if (thread_m.joinable()) { thread_m.join(); }
+
+    LOG(INFO, "mockTransport disconnected");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+MockTransport::topicSubscribe(std::string topic)
+{
+    LOG(INFO, "mockTransport subscribed to topic '" << topic << "'");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+MockTransport::topicUnsubscribe(std::string topic)
+{
+    LOG(INFO, "mockTransport unsubscribed from topic '" << topic << "'");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+MockTransport::topicSubscribeAsync(std::string topic, topicId_t topicId)
+{
+    // There is no broker to wait for
+    //
+    MonitoringThread::instance()->confirmSubscription(topicId, true);
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+MockTransport::startTimer(void)
+{
+    if (timerStarted_m.exchange(true)) { return returnCode_t::NOTHING_TO_DO; }
+
+    LOG(INFO, "mockTransport timer started");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+MockTransport::stopTimer(void)
+{
+    if (!timerStarted_m.exchange(false)) { return returnCode_t::NOTHING_TO_DO; }
+
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+MockTransport::publish(solClient_opaqueMsg_pt msg_p)
+{
+    // The caller keeps the original, the copy is delivered
+    //
+    solClient_opaqueMsg_pt dup_p;
+    if (solClient_msg_dup(msg_p, &dup_p) != SOLCLIENT_OK)
+    {
+        LOG(WARN, "mockTransport could not publish message");
+        return returnCode_t::FAILURE;
+    }
+
+    deliver(dup_p);
+    return returnCode_t::SUCCESS;
+}
+
+void
+MockTransport::reportStatistics(void)
+{
+    uint64_t delivered = getMessagesDelivered();
+    LOG(INFO, "mockTransport delivered " << delivered - lastReportDelivered_m
+              << " messages");
+    lastReportDelivered_m = delivered;
+}
+
+returnCode_t
+MockTransport::inject(const std::string& topic,
+                      const void* payload_p,
+                      uint32_t size,
+                      int64_t timestamp)
+{
+    solClient_opaqueMsg_pt msg_p = createMessage(topic, payload_p, size,
+                                                 timestamp);
+    if (msg_p == nullptr) { return returnCode_t::FAILURE; }
+
+    deliver(msg_p);
+    return returnCode_t::SUCCESS;
+}
+
+solClient_opaqueMsg_pt
+MockTransport::createMessage(const std::string& topic,
+                             const void* payload_p,
+                             uint32_t size,
+                             int64_t timestamp)
+{
+    solClient_opaqueMsg_pt msg_p = nullptr;
+    if (solClient_msg_alloc(&msg_p) != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "mockTransport could not allocate message");
+        return nullptr;
+    }
+
+    solClient_destination_t dest;
+    dest.destType = SOLCLIENT_TOPIC_DESTINATION;
+    dest.dest = topic.c_str();
+
+    // Timestamps are wall clock time, as set by a publisher
+    //
+    if (timestamp == 0)
+    {
+        timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    if (solClient_msg_setDestination(msg_p, &dest, sizeof(dest))
+                != SOLCLIENT_OK
+            || solClient_msg_setBinaryAttachment(msg_p, payload_p, size)
+                   != SOLCLIENT_OK
+            || solClient_msg_setSenderTimestamp(msg_p, timestamp)
+                   != SOLCLIENT_OK
+            || solClient_msg_setSequenceNumber(msg_p, ++sequence_m)
+                   != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "mockTransport could not build message for topic '"
+                   << topic << "'");
+        solClient_msg_free(&msg_p);
+        return nullptr;
+    }
+
+    return msg_p;
+}
+
+void
+MockTransport::deliver(solClient_opaqueMsg_pt msg_p)
+{
+    delivered_m.fetch_add(1, std::memory_order_relaxed);
+
+    // Like the solClient rx callback, keep ownership of messages that match
+    // no subscription
+    //
+    if (!MonitoringThread::instance()->pushMessage(msg_p))
+    {
+        solClient_msg_free(&msg_p);
+    }
+}
+
+void
+MockTransport::generate(void)
+{
+    const std::string& topic =
+        config_m.topics[topicDistribution_m(random_m)].topic;
+
+    solClient_opaqueMsg_pt msg_p = createMessage(topic,
+                                                 payload_m.data(),
+                                                 payload_m.size(),
+                                                 0);
+    if (msg_p != nullptr) { deliver(msg_p); }
+}
+
+void
+MockTransport::run(void)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point nextTick = start + std::chrono::seconds(1);
+    uint64_t generated = 0;
+    bool generating = config_m.rate != 0 && !config_m.topics.empty();
+
+    while (connected_m.load(std::memory_order_relaxed))
+    {
+        Clock::time_point now = Clock::now();
+
+        if (now >= nextTick)
+        {
+            if (timerStarted_m.load(std::memory_order_relaxed))
+            {
+                MonitoringThread::instance()->pushTimerTick();
+            }
+            nextTick += std::chrono::seconds(1);
+        }
+
+        // Messages are generated in bursts to catch up with the rate, so
+        // rates above 1000 messages per second are not bound by the sleep
+        // granularity
+        //
+        uint64_t due = 0;
+        if (generating)
+        {
+            uint64_t elapsedUs =
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    now - start).count();
+            due = elapsedUs / 1000000 * config_m.rate
+                  + elapsedUs % 1000000 * config_m.rate / 1000000;
+        }
+
+        uint32_t burst = 0;
+        while (generated < due && burst < MAX_BURST)
+        {
+            generate();
+            generated++;
+            burst++;
+        }
+
+        if (generated >= due)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+} /* namespace topicMonitor */
@@ -0,0 +1,126 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_MOCK_TRANSPORT_HPP_
+#define _TOPIC_MONITOR_MOCK_TRANSPORT_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "config.hpp"
+#include "transport.hpp"
+
+namespace topicMonitor
+{
+
+// An in-process Transport for load testing and benchmarking the pipeline
+// without a broker. While connected, its thread generates messages as set by
+// MockConfig and pushes a timer tick every second once the timer is started.
+// Messages may also be injected directly, and published messages are looped
+// back as if the session were subscribed to their topic.
+//
+// Messages are real solClient messages, with a topic, a binary attachment,
+// a sender timestamp and a sequence number, so scripts see them exactly as
+// they would from a broker. Every message is delivered, subscribed or not;
+// MonitoringThread drops those matching no subscription.
+//
+class MockTransport : public Transport
+{
+public:
+    ~MockTransport(void);
+
+    returnCode_t connect(void) override;
+    returnCode_t disconnect(void) override;
+
+    returnCode_t topicSubscribe(std::string topic) override;
+    returnCode_t topicUnsubscribe(std::string topic) override;
+    returnCode_t topicSubscribeAsync(std::string topic,
+                                     topicId_t topicId) override;
+
+    returnCode_t startTimer(void) override;
+    returnCode_t stopTimer(void) override;
+
+    returnCode_t publish(solClient_opaqueMsg_pt msg_p) override;
+
+    void reportStatistics(void) override;
+
+    // Delivers a message with the given topic and payload, and a sender
+    // timestamp of timestamp milliseconds since the epoch, or of the current
+    // time if 0. With the virtual clock, messages must be delivered from a
+    // single thread, so injecting while generating is not supported then.
+    //
+    returnCode_t inject(const std::string& topic,
+                        const void* payload_p,
+                        uint32_t size,
+                        int64_t timestamp = 0);
+
+    // Number of messages delivered so far; may be read from any thread
+    //
+    uint64_t getMessagesDelivered(void) const
+        { return delivered_m.load(std::memory_order_relaxed); }
+
+private:
+    friend class Transport;
+
+    // Upper bound on messages generated between two checks of the timer, so
+    // ticks keep flowing when generation cannot keep up with the rate
+    //
+    static const uint32_t MAX_BURST = 1024;
+
+    MockTransport(void);
+
+    void run(void);
+    void generate(void);
+    solClient_opaqueMsg_pt createMessage(const std::string& topic,
+                                         const void* payload_p,
+                                         uint32_t size,
+                                         int64_t timestamp);
+    void deliver(solClient_opaqueMsg_pt msg_p);
+
+    MockConfig                            config_m;
+    std::vector<char>                     payload_m;
+    std::mt19937                          random_m;
+    std::discrete_distribution<size_t>    topicDistribution_m;
+    std::atomic<uint64_t>                 sequence_m;
+    std::atomic<uint64_t>                 delivered_m;
+    uint64_t                              lastReportDelivered_m;
+    std::atomic<bool>                     connected_m;
+    std::atomic<bool>                     timerStarted_m;
+    std::thread                           thread_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_MOCK_TRANSPORT_HPP_ */
@@ -28,8 +28,19 @@
 //******************************************************************************
 #include "monitoringThread.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "allocCounter.hpp"
+#include "clock.hpp"
+#include "config.hpp"
+#include "conflator.hpp"
 #include "log.hpp"
-#include "solClientThread.hpp"
+#include "probe.hpp"
+#include "publisher.hpp"
+#include "subscriptionRegistry.hpp"
+#include "transport.hpp"
 #include "utils.hpp"
 
 namespace topicMonitor
@@ -37,218 +48,503 @@ namespace topicMonitor
 
 MonitoringThread* MonitoringThread::instance_mps = nullptr;
 
-MonitoringThread::MonitoringThread(void)
+// Maximum number of subscriptions a single message is delivered to
+//
+static const size_t MAX_SUBSCRIPTION_MATCHES = 32;
+
+// Interval between statistics reports
+//
+static const std::chrono::seconds REPORT_INTERVAL(60);
+
+MonitoringThread::MonitoringThread(void) :
+    lastReportMessages_m(0),
+    lastReportAllocs_m(0),
+    lastReportThroughput_m(0),
+    lastReportTimeouts_m(0),
+    lastReportLateness_m(0),
+    pendingSubscriptions_m(0),
+    liveSubscriptions_m(0),
+    failedSubscriptions_m(0)
 {
-    luaState_mp = luaL_newstate();
-    if (luaState_mp == nullptr)
-        LOG(FATAL, "Could not create lua state");
+    uint32_t workerCount = Config::instance()->getWorkerThreads();
+    for (uint32_t i=0; i<workerCount; i++)
+    {
+        workers_m.push_back(new MonitoringWorker(i));
+    }
 
-    // Makes all libraries available to lua.
-    //
-    // TODO (BTO): May want to look into only making a subset of libraries
-    //             available to lua.
-    //
-    luaL_openlibs(luaState_mp);
+    LOG(INFO, "monitoringThread created " << workerCount << " worker(s)");
 }
 
 MonitoringThread::~MonitoringThread(void)
 {
-    lua_close(luaState_mp);
+    for (MonitoringWorker* worker_p : workers_m)
+    {
+        delete worker_p;
+    }
 }
 
-void
-MonitoringThread::handleWorkTypeMessageReceived(
-    WorkEntryMessageReceived* entry_p)
+bool
+MonitoringThread::pushMessage(solClient_opaqueMsg_pt msg_p,
+                              uint32_t partition,
+                              uint32_t partitions)
 {
-    solClient_returnCode_t rc;
-    solClient_opaqueMsg_pt msg_p = entry_p->getMsg();
+    if (Clock::instance()->isVirtual()) { advanceVirtualTime(msg_p); }
 
     solClient_destination_t dest;
-    rc = solClient_msg_getDestination(msg_p, &dest, sizeof(dest));
-    if (rc != SOLCLIENT_OK)
+    if (solClient_msg_getDestination(msg_p, &dest, sizeof(dest)) != SOLCLIENT_OK)
     {
         LOG(ERROR, "Could not get message topic");
-        return;
+        return false;
     }
 
-    const char* topic_p = dest.dest;
-    if (envTable_m.find(topic_p) == envTable_m.end())
+    topicId_t ids[MAX_SUBSCRIPTION_MATCHES];
+    QueueingInfo queueing[MAX_SUBSCRIPTION_MATCHES];
+    size_t count = SubscriptionRegistry::instance()->match(
+                       dest.dest, ids, queueing, MAX_SUBSCRIPTION_MATCHES,
+                       partition, partitions);
+    if (count == 0)
     {
-        LOG(ERROR, "Topic '" << topic_p << "' not found in table");
-        return;
+        LOG(DEBUG, "Topic '" << dest.dest << "' matches no subscription");
+        return false;
     }
-    const char* env_p = envTable_m[topic_p].c_str();
 
-    const char* data_p;
-    rc = solClient_msg_getBinaryAttachmentString(msg_p, &data_p);
-    if (rc != SOLCLIENT_OK)
+    // A message matching several subscriptions is handed to each of their
+    // workers; all but the first get their own copy.
+    //
+    for (size_t i=1; i<count; i++)
     {
-        LOG(ERROR, "Could not get message payload");
-        return;
+        solClient_opaqueMsg_pt dup_p;
+        if (solClient_msg_dup(msg_p, &dup_p) != SOLCLIENT_OK)
+        {
+            LOG(ERROR, "Could not duplicate message for topic '" << dest.dest
+                       << "'");
+            continue;
+        }
+
+        if (!pushMatched(dup_p, ids[i], queueing[i], dest.dest))
+        {
+            solClient_msg_free(&dup_p);
+        }
     }
 
-    if (utils::lua::callMessageFunc(luaState_mp, env_p, data_p)
-            != returnCode_t::SUCCESS)
+    return pushMatched(msg_p, ids[0], queueing[0], dest.dest);
+}
+
+bool
+MonitoringThread::pushMatched(solClient_opaqueMsg_pt msg_p,
+                              topicId_t topicId,
+                              const QueueingInfo& queueing,
+                              const char* topic_p)
+{
+    MonitoringWorker* worker_p = getWorkerForSubscription(topicId);
+
+    // A conflated message waits in its topic's slot instead, and is only
+    // queued if the topic has no message waiting already. Those entries are
+    // bounded by the number of topics, so they are never dropped.
+    //
+    ConflationSlot* slot_p;
+    if (queueing.conflate
+            && Conflator::instance()->offer(topicId, topic_p, msg_p, slot_p))
     {
-        const char* errorMsg_p = lua_tostring(luaState_mp, -1);
-        LOG(ERROR, LUA_MESSAGE_FUNC << "() failed with error \"" << errorMsg_p
-                   << "\"");
-        lua_pop(luaState_mp, 1);
-        return;
+        if (slot_p != nullptr)
+        {
+            worker_p->pushConflated(slot_p, topicId, queueing.priority);
+        }
+        return true;
     }
+
+    return worker_p->pushMessage(msg_p, topicId, queueing.priority, true,
+                                 queueing.spill);
+}
+
+void
+MonitoringThread::pushFlowMessage(solClient_opaqueMsg_pt msg_p,
+                                  topicId_t topicId,
+                                  priority_t priority)
+{
+    if (Clock::instance()->isVirtual()) { advanceVirtualTime(msg_p); }
+
+    getWorkerForSubscription(topicId)->pushMessage(msg_p, topicId, priority,
+                                                   false);
 }
 
 void
-MonitoringThread::handleWorkTypeSubscribe(WorkEntrySubscribe* entry_p)
+MonitoringThread::pushSubscribe(topicId_t topicId)
 {
-    returnCode_t rc;
+    getWorkerForSubscription(topicId)->pushControl(
+        WorkEntry::subscribe(topicId));
+}
+
+void
+MonitoringThread::pushUnsubscribe(topicId_t topicId)
+{
+    getWorkerForSubscription(topicId)->pushControl(
+        WorkEntry::unsubscribe(topicId));
+}
 
-    const SubscriptionInfo& info = entry_p->getSubscriptionInfo();
+returnCode_t
+MonitoringThread::addSubscription(const SubscriptionInfo& info)
+{
+    return requestSubscription(registerSubscription(info), info);
+}
 
-    // Loads lua file into lua state
+returnCode_t
+MonitoringThread::addSubscriptions(const SubscriptionInfoList& infos)
+{
+    // Matching every subscription takes a single snapshot of the registry,
+    // published before any of them is requested
     //
-    rc = utils::lua::loadFileInEnv(luaState_mp,
-                                   info.getFilename(),
-                                   info.getFilename());
-    if (rc == returnCode_t::FAILURE)
+    std::vector<topicId_t> topicIds;
+    topicIds.reserve(infos.size());
+
+    SubscriptionRegistry::instance()->beginBatch();
+    for (const SubscriptionInfo& info : infos)
     {
-        const char* error_p = lua_tostring(luaState_mp, -1);
-        LOG(WARN, "Could not load " << info.getFilename() << ", error = \""
-                  << error_p << "\"");
-        lua_pop(luaState_mp, 1);
-        goto unsubscribe;
+        topicIds.push_back(registerSubscription(info));
     }
+    SubscriptionRegistry::instance()->endBatch();
 
-    // Check for existence of message function
-    //
-    if (!utils::lua::isFuncInEnv(luaState_mp,
-                                 info.getFilename(),
-                                 LUA_MESSAGE_FUNC))
+    returnCode_t rc = returnCode_t::SUCCESS;
+    for (size_t i=0; i<infos.size(); i++)
     {
-        LOG(WARN, "No " << LUA_MESSAGE_FUNC << "() function found in "
-                  << info.getFilename());
-        goto unsubscribe;
+        if (requestSubscription(topicIds[i], infos[i])
+                != returnCode_t::SUCCESS)
+        {
+            rc = returnCode_t::FAILURE;
+        }
     }
 
-    // Check for existence of timer function
+    return rc;
+}
+
+topicId_t
+MonitoringThread::registerSubscription(const SubscriptionInfo& info)
+{
+    // The subscription is matched, and its script loaded, from now on;
+    // messages only start to arrive once the broker has it
     //
-    if (info.getTimeout() && !utils::lua::isFuncInEnv(luaState_mp,
-                                                      info.getFilename(),
-                                                      LUA_TIMER_FUNC))
+    topicId_t topicId = SubscriptionRegistry::instance()->add(info);
+    if (info.isConflated()) { Conflator::instance()->add(topicId); }
+    pushSubscribe(topicId);
+
+    {
+        std::lock_guard<std::mutex> lock(subscribeMutex_m);
+        if (pendingSubscriptions_m++ == 0)
+        {
+            subscribeStart_m = std::chrono::steady_clock::now();
+            liveSubscriptions_m = 0;
+            failedSubscriptions_m = 0;
+        }
+    }
+
+    return topicId;
+}
+
+returnCode_t
+MonitoringThread::requestSubscription(topicId_t topicId,
+                                      const SubscriptionInfo& info)
+{
+    if (info.isGuaranteed())
     {
-        LOG(WARN, "No " << LUA_TIMER_FUNC << "() function found in "
-                  << info.getFilename());
-        goto unsubscribe;
+        returnCode_t rc = Transport::instance()->queueBind(
+                              info.getQueue(), topicId, info.getMaxUnacked());
+
+        // The worker may have failed to set up the subscription while the
+        // bind was waiting for the broker, too early to unbind the flow
+        //
+        if (rc == returnCode_t::SUCCESS
+                && !SubscriptionRegistry::instance()->isActive(topicId))
+        {
+            Transport::instance()->queueUnbind(topicId);
+            rc = returnCode_t::FAILURE;
+        }
+        confirmSubscription(topicId, rc == returnCode_t::SUCCESS);
+        return rc;
     }
 
-    if (info.getTimeout())
+    if (Transport::instance()->topicSubscribeAsync(info.getTopic(), topicId)
+            != returnCode_t::SUCCESS)
     {
-        timeoutWheel_m.add(info.getTopic(), info.getTimeout());
+        confirmSubscription(topicId, false);
+        return returnCode_t::FAILURE;
     }
 
-    // Update table with subscription if everything goes well
+    return returnCode_t::SUCCESS;
+}
+
+void
+MonitoringThread::confirmSubscription(topicId_t topicId, bool ok)
+{
+    if (!ok)
+    {
+        SubscriptionInfo info;
+        SubscriptionRegistry::instance()->get(topicId, info);
+        LOG(WARN, "Subscription to topic '" << info.getTopic()
+                  << "' failed");
+
+        SubscriptionRegistry::instance()->remove(topicId);
+        Conflator::instance()->remove(topicId);
+        pushUnsubscribe(topicId);
+    }
+
+    std::lock_guard<std::mutex> lock(subscribeMutex_m);
+
+    if (pendingSubscriptions_m == 0) { return; }
+
+    ok ? liveSubscriptions_m++ : failedSubscriptions_m++;
+    if (--pendingSubscriptions_m != 0) { return; }
+
+    std::chrono::milliseconds elapsed =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - subscribeStart_m);
+    LOG(INFO, liveSubscriptions_m << " subscription(s) live, "
+              << failedSubscriptions_m << " failed, in " << elapsed.count()
+              << "ms");
+}
+
+void
+MonitoringThread::advanceVirtualTime(solClient_opaqueMsg_pt msg_p)
+{
+    uint64_t time;
+    if (!Clock::getMessageTime(msg_p, time)) { return; }
+
+    // Ticks are queued ahead of the message and never coalesced, so every
+    // worker sees time advance at the same point of its message stream on
+    // every run
     //
-    envTable_m[info.getTopic()] = info.getFilename();
-    LOG(INFO, "monitoringThread subscribed to topic '" << info.getTopic()
-              << "'");
-    return;
+    if (Clock::instance()->advanceTo(time))
+    {
+        for (MonitoringWorker* worker_p : workers_m)
+        {
+            worker_p->pushControl(WorkEntry::timerTick(time));
+        }
+    }
+}
+
+void
+MonitoringThread::pushTimerTick(void)
+{
+    // With the virtual clock, ticks come from message timestamps instead
+    //
+    if (Clock::instance()->isVirtual()) { return; }
 
-unsubscribe:
-    // Unsubscribe from topic
+    // Every worker has its own TimeoutWheel
     //
-    SolClientThread::instance()->topicUnsubscribe(info.getTopic());
-    return;
+    for (MonitoringWorker* worker_p : workers_m)
+    {
+        worker_p->pushTimerTick();
+    }
 }
 
 void
-MonitoringThread::handleWorkTypeUnsubscribe(WorkEntryUnsubscribe* entry_p)
+MonitoringThread::pushSessionDown(uint32_t partition, uint32_t partitions)
 {
-    LOG(WARN, __FUNCTION__ << "() unimplemented");
+    // One entry per worker, which finds the subscriptions of the partition
+    // itself; the caller is the context thread, which must not wait for room
+    // in a control lane
+    //
+    for (MonitoringWorker* worker_p : workers_m)
+    {
+        worker_p->pushControl(WorkEntry::sessionDown(partition, partitions));
+    }
 }
 
 void
-MonitoringThread::handleWorkTypeTimerTick(WorkEntryTimerTick* entry_p)
+MonitoringThread::pushSessionUp(uint64_t outage,
+                                uint32_t partition,
+                                uint32_t partitions)
 {
-    timeoutWheel_m.tick();
+    for (MonitoringWorker* worker_p : workers_m)
+    {
+        worker_p->pushControl(WorkEntry::sessionUp(partition, partitions,
+                                                   outage));
+    }
+}
+
+returnCode_t
+MonitoringThread::start(void)
+{
+    for (MonitoringWorker* worker_p : workers_m)
+    {
+        worker_p->start();
+    }
+
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+MonitoringThread::run(void)
+{
+    // The workers never stop under normal operation; this thread reports
+    // statistics meanwhile.
+    //
+    for (;;)
+    {
+        std::this_thread::sleep_for(REPORT_INTERVAL);
+        reportThroughput();
+        Transport::instance()->reportStatistics();
+        Publisher::instance()->reportStatistics();
+        Probe::reportAll();
+        Conflator::instance()->reportStatistics();
+        reportTimeouts();
+        reportOverload();
+        reportLanes();
+        reportSpill();
+        reportShedding();
+        if (AllocCounter::isEnabled()) { reportAllocations(); }
+    }
+
+    return returnCode_t::SUCCESS;
 }
 
 void
-MonitoringThread::handleWorkTypeTimeout(WorkEntryTimeout* entry_p)
+MonitoringThread::reportThroughput(void)
 {
-    std::string topic = entry_p->getTopic();
+    uint64_t messages = 0;
+    for (MonitoringWorker* worker_p : workers_m)
+    {
+        messages += worker_p->getMessagesHandled();
+    }
 
-    LOG(INFO, "Executing timer function for topic '" << topic << "'");
+    uint64_t deltaMessages = messages - lastReportThroughput_m;
+    LOG(INFO, "Handled " << deltaMessages << " messages ("
+              << (double)deltaMessages / REPORT_INTERVAL.count()
+              << " per second)");
+
+    lastReportThroughput_m = messages;
+}
 
-    if (envTable_m.find(topic) == envTable_m.end())
+void
+MonitoringThread::reportTimeouts(void)
+{
+    uint64_t expired = 0;
+    uint64_t latenessTotal = 0;
+    uint64_t latenessMax = 0;
+    for (MonitoringWorker* worker_p : workers_m)
     {
-        LOG(ERROR, "Topic '" << topic << "' not found in table");
-        return;
+        expired += worker_p->getTimeoutsExpired();
+        latenessTotal += worker_p->getTimeoutLatenessTotal();
+        latenessMax = std::max(latenessMax, worker_p->takeTimeoutLatenessMax());
     }
-    const char* env_p = envTable_m[topic].c_str();
 
-    if (utils::lua::callTimerFunc(luaState_mp, env_p)
-            != returnCode_t::SUCCESS)
+    uint64_t deltaExpired = expired - lastReportTimeouts_m;
+    uint64_t deltaLateness = latenessTotal - lastReportLateness_m;
+    if (deltaExpired != 0)
     {
-        const char* errorMsg_p = lua_tostring(luaState_mp, -1);
-        LOG(ERROR, LUA_TIMER_FUNC << "() failed with error \"" << errorMsg_p
-                   << "\"");
-        lua_pop(luaState_mp, 1);
-        return;
+        LOG(INFO, "Expired " << deltaExpired << " timeouts, lateness average "
+                  << (double)deltaLateness / deltaExpired << "ms, max "
+                  << latenessMax << "ms");
     }
 
-    timeoutWheel_m.add(topic, entry_p->getTimeout());
+    lastReportTimeouts_m = expired;
+    lastReportLateness_m = latenessTotal;
 }
 
-// TODO (BTO): Consider using a worker thread pool to dispatch MESSAGE_RECEIVED
-//             work items, taking special care to not schedule messages on the
-//             same topic to two different worker threads at the same time and
-//             preserve ordering.
-//
-returnCode_t
-MonitoringThread::start(void)
+void
+MonitoringThread::reportOverload(void)
 {
-    WorkEntry* entry_p = nullptr;
+    uint64_t droppedNewest = 0;
+    uint64_t droppedOldest = 0;
+    uint64_t blockedPushes = 0;
+    uint64_t queuedMax = 0;
+    for (MonitoringWorker* worker_p : workers_m)
+    {
+        droppedNewest += worker_p->takeDroppedNewest();
+        droppedOldest += worker_p->takeDroppedOldest();
+        blockedPushes += worker_p->takeBlockedPushes();
+        queuedMax = std::max(queuedMax, worker_p->getQueuedMessages());
+    }
 
-    for (;;entry_p = nullptr)
+    if (droppedNewest != 0 || droppedOldest != 0 || blockedPushes != 0)
     {
-        entry_p = workQueue_m.pop();
-        if (entry_p == nullptr)
-            LOG(FATAL, "NULL work entry received");
+        LOG(WARN, "Workers overloaded: dropped " << droppedNewest
+                  << " new and " << droppedOldest << " queued messages, "
+                  << blockedPushes << " pushes blocked, deepest queue "
+                  << queuedMax << " messages");
+    }
+}
 
-        LOG(DEBUG, "Handling work entry of type '"
-                   << workTypeToString(entry_p->getType()) << "'");
+void
+MonitoringThread::reportLanes(void)
+{
+    for (MonitoringWorker* worker_p : workers_m)
+    {
+        worker_p->reportLanes();
+    }
+}
 
-        switch (entry_p->getType())
-        {
-        case workType_t::MESSAGE_RECEIVED:
-            handleWorkTypeMessageReceived(
-                static_cast<WorkEntryMessageReceived*>(entry_p));
-            break;
-        case workType_t::SUBSCRIBE:
-            handleWorkTypeSubscribe(
-                static_cast<WorkEntrySubscribe*>(entry_p));
-            break;
-        case workType_t::UNSUBSCRIBE:
-            handleWorkTypeUnsubscribe(
-                static_cast<WorkEntryUnsubscribe*>(entry_p));
-            break;
-        case workType_t::TIMER_TICK:
-            handleWorkTypeTimerTick(
-                static_cast<WorkEntryTimerTick*>(entry_p));
-            break;
-        case workType_t::TIMEOUT:
-            handleWorkTypeTimeout(
-                static_cast<WorkEntryTimeout*>(entry_p));
-            break;
-        default:
-            LOG(ERROR, "Unknown work type received in work entry.");
-            return returnCode_t::FAILURE;
-        }
+void
+MonitoringThread::reportSpill(void)
+{
+    uint64_t spilled = 0;
+    uint64_t spilledBytes = 0;
+    uint64_t readBack = 0;
+    uint64_t failures = 0;
+    uint64_t backlog = 0;
+    for (MonitoringWorker* worker_p : workers_m)
+    {
+        spilled += worker_p->takeSpilledMessages();
+        spilledBytes += worker_p->takeSpilledBytes();
+        readBack += worker_p->takeReadBackMessages();
+        failures += worker_p->takeSpillFailures();
+        backlog += worker_p->getSpillBacklog();
+    }
 
-        delete entry_p;
+    if (spilled != 0 || readBack != 0 || failures != 0 || backlog != 0)
+    {
+        LOG(INFO, "Spilled " << spilled << " messages (" << spilledBytes
+                  << " bytes) to disk, read back " << readBack << " ("
+                  << (double)readBack / REPORT_INTERVAL.count()
+                  << " per second), " << backlog << " on disk");
     }
+    if (failures != 0)
+    {
+        LOG(ERROR, "Dropped " << failures
+                   << " messages that could not be spilled to disk");
+    }
+}
 
-    return returnCode_t::SUCCESS;
+void
+MonitoringThread::reportShedding(void)
+{
+    uint64_t sampled = 0;
+    uint64_t stale = 0;
+    uint64_t skipped = 0;
+    for (MonitoringWorker* worker_p : workers_m)
+    {
+        sampled += worker_p->takeShedSampled();
+        stale += worker_p->takeShedStale();
+        skipped += worker_p->takeShedSkipped();
+    }
+
+    if (sampled != 0 || stale != 0 || skipped != 0)
+    {
+        LOG(WARN, "Shed " << sampled + stale + skipped << " messages ("
+                  << sampled << " sampled out, " << stale << " stale, "
+                  << skipped << " skipped) to keep up");
+    }
+}
+
+void
+MonitoringThread::reportAllocations(void)
+{
+    uint64_t messages = 0;
+    for (MonitoringWorker* worker_p : workers_m)
+    {
+        messages += worker_p->getMessagesHandled();
+    }
+
+    uint64_t allocs = AllocCounter::getCount();
+    uint64_t deltaAllocs = allocs - lastReportAllocs_m;
+    uint64_t deltaMessages = messages - lastReportMessages_m;
+
+    LOG(INFO, "Handled " << deltaMessages << " messages with " << deltaAllocs
+              << " heap allocations (" << (deltaMessages
+                  ? (double)deltaAllocs / deltaMessages : 0.0)
+              << " per message)");
+
+    lastReportAllocs_m = allocs;
+    lastReportMessages_m = messages;
 }
 
 } /* namespace topicMonitor */
@@ -29,23 +29,32 @@
 #ifndef _TOPIC_MONITOR_MONITORING_THREAD_HPP_
 #define _TOPIC_MONITOR_MONITORING_THREAD_HPP_
 
-#include <lua5.2/lua.hpp>
+#include <chrono>
+#include <mutex>
 #include <solclient/solClient.h>
 #include <solclient/solClientMsg.h>
-#include <string>
-#include <unordered_map>
+#include <vector>
 
 #include "common.hpp"
-#include "timeoutWheel.hpp"
+#include "monitoringWorker.hpp"
 
 namespace topicMonitor
 {
 
+// MonitoringThread owns the pool of MonitoringWorkers and routes work entries
+// to them. Every subscription is assigned to a worker by its topicId_t, so all
+// work for a subscription (its messages, subscription and timeouts) is handled
+// by the same worker, in order.
+//
+// Received messages are matched against all active subscriptions, including
+// wildcard subscriptions, and handed to the worker of every subscription that
+// matches; for a conflated subscription, through the Conflator.
+//
+// The push*() methods may be called from any thread.
+//
 class MonitoringThread
 {
 public:
-    typedef std::unordered_map<std::string, std::string> LuaEnvTable;
-
     static MonitoringThread* instance(void)
     {
         if (instance_mps == nullptr)
@@ -57,24 +66,121 @@ public:
     }
     ~MonitoringThread(void);
 
-    WorkQueue* getWorkQueue(void) { return &workQueue_m; }
+    // Returns true if ownership of the message was taken, false if it matched
+    // no subscription, or its worker was overloaded and dropped it, and the
+    // caller keeps ownership. With the virtual clock,
+    // this also advances time to the message's timestamp, so messages must be
+    // pushed from a single thread.
+    //
+    // A transport receiving on several sessions passes the partition of the
+    // session, out of partitions, so only the subscriptions of that partition
+    // get the message; see SubscriptionRegistry::getPartition().
+    //
+    bool pushMessage(solClient_opaqueMsg_pt msg_p,
+                     uint32_t partition = 0,
+                     uint32_t partitions = 1);
+    // Hands a message of a guaranteed subscription's flow to its worker,
+    // which takes ownership of it and acknowledges it once handled. The
+    // flow carries the subscription's priority.
+    //
+    void pushFlowMessage(solClient_opaqueMsg_pt msg_p,
+                         topicId_t topicId,
+                         priority_t priority);
+    void pushSubscribe(topicId_t topicId);
+    void pushUnsubscribe(topicId_t topicId);
+    void pushTimerTick(void);
+
+    // Called by the transport when the session serving the given partition,
+    // out of partitions, is lost, and once it is back with its subscriptions
+    // restored, outage milliseconds later. The worker of every subscription
+    // of the partition is told, pauses its onTimer() meanwhile and calls the
+    // script's onSessionDown() and onSessionUp().
+    //
+    void pushSessionDown(uint32_t partition = 0, uint32_t partitions = 1);
+    void pushSessionUp(uint64_t outage,
+                       uint32_t partition = 0,
+                       uint32_t partitions = 1);
+
+    // Registers the subscription, has its worker load its script and
+    // subscribes to its topic without waiting for the broker. Many
+    // subscriptions can so be requested back to back; the time until all of
+    // them are live is logged.
+    //
+    // A guaranteed subscription binds to its queue instead, which waits for
+    // the broker.
+    //
+    returnCode_t addSubscription(const SubscriptionInfo& info);
+
+    // Adds the subscriptions as addSubscription() does, registering them all
+    // before requesting any, so that the registry publishes them at once
+    //
+    returnCode_t addSubscriptions(const SubscriptionInfoList& infos);
+
+    // Called by the transport once the broker has confirmed or rejected the
+    // subscription. A rejected subscription is removed. May be called from
+    // any thread.
+    //
+    void confirmSubscription(topicId_t topicId, bool ok);
 
+    uint32_t getWorkerCount(void) const { return workers_m.size(); }
+
+    // Starts the worker threads
+    //
     returnCode_t start(void);
 
+    // Periodically reports statistics; the worker threads never stop under
+    // normal operation, so this does not return
+    //
+    returnCode_t run(void);
+
 private:
     MonitoringThread(void);
 
-    void handleWorkTypeMessageReceived(WorkEntryMessageReceived* entry_p);
-    void handleWorkTypeSubscribe(WorkEntrySubscribe* entry_p);
-    void handleWorkTypeUnsubscribe(WorkEntryUnsubscribe* entry_p);
-    void handleWorkTypeTimerTick(WorkEntryTimerTick* entry_p);
-    void handleWorkTypeTimeout(WorkEntryTimeout* entry_p);
-
-    static MonitoringThread* instance_mps;
-    WorkQueue                workQueue_m;
-    lua_State*               luaState_mp;
-    LuaEnvTable              envTable_m;
-    TimeoutWheel             timeoutWheel_m;
+    MonitoringWorker* getWorkerForSubscription(topicId_t topicId)
+        { return workers_m[topicId % workers_m.size()]; }
+
+    void advanceVirtualTime(solClient_opaqueMsg_pt msg_p);
+
+    // The two halves of addSubscription(): registering the subscription and
+    // having its script loaded, then asking the broker for it
+    //
+    topicId_t registerSubscription(const SubscriptionInfo& info);
+    returnCode_t requestSubscription(topicId_t topicId,
+                                     const SubscriptionInfo& info);
+
+    // Hands a matched message to the worker of the subscription, as queueing
+    // says, or to the Conflator if the subscription is conflated.
+    // Returns false if the worker dropped it and the caller keeps ownership.
+    //
+    bool pushMatched(solClient_opaqueMsg_pt msg_p,
+                     topicId_t topicId,
+                     const QueueingInfo& queueing,
+                     const char* topic_p);
+
+    void reportThroughput(void);
+    void reportTimeouts(void);
+    void reportOverload(void);
+    void reportLanes(void);
+    void reportSpill(void);
+    void reportShedding(void);
+    void reportAllocations(void);
+
+    static MonitoringThread*       instance_mps;
+    std::vector<MonitoringWorker*> workers_m;
+    uint64_t                       lastReportMessages_m;
+    uint64_t                       lastReportAllocs_m;
+    uint64_t                       lastReportThroughput_m;
+    uint64_t                       lastReportTimeouts_m;
+    uint64_t                       lastReportLateness_m;
+
+    // Subscriptions requested and not yet confirmed, and the outcome of those
+    // confirmed since the first of them was requested
+    //
+    std::mutex                            subscribeMutex_m;
+    uint32_t                              pendingSubscriptions_m;
+    uint32_t                              liveSubscriptions_m;
+    uint32_t                              failedSubscriptions_m;
+    std::chrono::steady_clock::time_point subscribeStart_m;
 };
 
 } /* namespace topicMonitor */
@@ -0,0 +1,1571 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "monitoringWorker.hpp"
+
+#include <algorithm>
+#include <unistd.h>
+
+#include "config.hpp"
+#include "conflator.hpp"
+#include "log.hpp"
+#include "luaBuffer.hpp"
+#include "luaMessage.hpp"
+#include "subscriptionRegistry.hpp"
+#include "transport.hpp"
+#include "utils.hpp"
+
+namespace topicMonitor
+{
+
+// What the timeouts in the TimeoutWheel of a worker are for, kept as their
+// kind. The data of a script timer is the reference to its callback; the
+// others have none.
+//
+static const uint32_t SUBSCRIPTION_TIMER = 0;
+static const uint32_t SCRIPT_TIMER       = 1;
+static const uint32_t PROBE_TIMER        = 2;
+
+// Room kept in each message lane beyond the bound on messages, for
+// MESSAGE_CONFLATED entries and stamps and for producers racing past the bound
+// together, and the size of the control lane
+//
+static const size_t CONTROL_HEADROOM = 1024;
+static const size_t CONTROL_LANE_SIZE = 4096;
+
+// Messages read back from disk between two drains of the lanes, per lane
+//
+static const size_t SPILL_READ_SIZE = 64;
+
+// Spins before a push blocked by the overload policy yields its thread
+//
+static const uint32_t OVERLOAD_SPIN_COUNT = 4096;
+
+// The payload size counted against workQueueMaxBytes, or 0 without a bound
+// on bytes
+//
+static uint64_t
+getQueuedBytes(solClient_opaqueMsg_pt msg_p, uint32_t maxBytes)
+{
+    if (maxBytes == 0) { return 0; }
+
+    const char* data_p;
+    size_t size;
+    if (utils::getPayload(msg_p, data_p, size) != returnCode_t::SUCCESS)
+    {
+        return 0;
+    }
+
+    return size;
+}
+
+MonitoringWorker::MonitoringWorker(uint32_t index) :
+    index_m(index),
+    virtualClock_m(Clock::instance()->isVirtual()),
+    virtualStarted_m(false),
+    workQueueSize_m(Config::instance()->getWorkQueueSize()),
+    workQueueMaxBytes_m(Config::instance()->getWorkQueueMaxBytes()),
+    overloadPolicy_m(Config::instance()->getOverloadPolicy()),
+    workLanes_m(CONTROL_LANE_SIZE,
+                (overloadPolicy_m == overloadPolicy_t::DROP_OLDEST
+                     ? 2 * (size_t)workQueueSize_m : workQueueSize_m)
+                + CONTROL_HEADROOM,
+                Config::instance()->getLaneScheduling(),
+                virtualClock_m),
+    spillHighWater_m(std::min(Config::instance()->getSpillHighWater(),
+                              workQueueSize_m)),
+    spillsReading_m(0),
+    shedder_m(virtualClock_m ? 0
+                             : Config::instance()->getShedLatencyTargetMs()),
+    currentTopicId_m(INVALID_TOPIC_ID),
+    batchMaxMessages_m(Config::instance()->getBatchMaxMessages()),
+    batchMaxWaitMs_m(Config::instance()->getBatchMaxWaitMs()),
+    publishPool_m(Config::instance()->getPublishPoolSize()),
+    timeoutWheel_m(this, Clock::instance()->now()),
+    tickPending_m(false),
+    messagesHandled_m(0),
+    timeoutsExpired_m(0),
+    timeoutLatenessTotal_m(0),
+    timeoutLatenessMax_m(0),
+    queuedMessages_m(0),
+    queuedBytes_m(0),
+    droppedNewest_m(0),
+    droppedOldest_m(0),
+    blockedPushes_m(0),
+    spilledMessages_m(0),
+    spilledBytes_m(0),
+    readBackMessages_m(0),
+    spillFailures_m(0),
+    spillBacklog_m(0),
+    shedSampled_m(0),
+    shedStale_m(0),
+    shedSkipped_m(0)
+{
+    luaState_mp = luaL_newstate();
+    if (luaState_mp == nullptr)
+        LOG(FATAL, "Could not create lua state");
+
+    // Makes all libraries available to lua.
+    //
+    // TODO (BTO): May want to look into only making a subset of libraries
+    //             available to lua.
+    //
+    luaL_openlibs(luaState_mp);
+    registerTimerLib();
+    registerPublishLib();
+    registerSheddingLib();
+    Probe::registerLib(luaState_mp);
+
+    // Payloads and messages are passed to scripts through reusable objects:
+    // one for onMessage() and one per message of a full batch for onBatch()
+    //
+    LuaBuffer::registerType(luaState_mp);
+    LuaMessage::registerType(luaState_mp);
+    size_t objectCount = std::max<size_t>(batchMaxMessages_m, 1);
+    for (size_t i=0; i<objectCount; i++)
+    {
+        LuaBuffer* buffer_p = LuaBuffer::create(luaState_mp);
+        payloadBuffers_m.push_back(buffer_p);
+        payloadRefs_m.push_back(buffer_p->getRef());
+
+        LuaMessage* message_p = LuaMessage::create(luaState_mp);
+        messageObjects_m.push_back(message_p);
+        messageRefs_m.push_back(message_p->getRef());
+    }
+
+    pendingAcks_m.reserve(WORK_QUEUE_DRAIN_SIZE);
+
+    // Spilled messages would be read back after ticks queued later, which
+    // the virtual clock cannot have
+    //
+    std::string spillDirectory = Config::instance()->getSpillDirectory();
+    for (uint32_t lane=0; lane<WORK_LANE_COUNT; lane++)
+    {
+        spills_mp[lane] = nullptr;
+        if (lane == CONTROL_LANE || spillDirectory.empty() || virtualClock_m)
+        {
+            continue;
+        }
+
+        spills_mp[lane] = new Spill(
+            spillDirectory + "/topicMonitor-" + std::to_string(getpid()) + "-"
+                + std::to_string(index_m) + "-" + std::to_string(lane),
+            Config::instance()->getSpillSegmentSize());
+    }
+}
+
+MonitoringWorker::~MonitoringWorker(void)
+{
+    for (SubscriptionHandle* handle_p : handlesById_m)
+    {
+        if (handle_p != nullptr) { releaseHandle(handle_p); }
+    }
+
+    for (uint32_t lane=0; lane<WORK_LANE_COUNT; lane++)
+    {
+        delete spills_mp[lane];
+    }
+
+    lua_close(luaState_mp);
+}
+
+MonitoringWorker::SubscriptionHandle*
+MonitoringWorker::getHandle(topicId_t topicId)
+{
+    if (topicId >= handlesById_m.size()) { return nullptr; }
+    return handlesById_m[topicId];
+}
+
+void
+MonitoringWorker::releaseHandle(SubscriptionHandle* handle_p)
+{
+    for (solClient_opaqueMsg_pt msg_p : handle_p->batch)
+    {
+        solClient_msg_free(&msg_p);
+    }
+
+    delete handle_p->probe_p;
+
+    utils::lua::unref(luaState_mp, handle_p->subscriptionRef);
+    utils::lua::unref(luaState_mp, handle_p->sessionUpFuncRef);
+    utils::lua::unref(luaState_mp, handle_p->sessionDownFuncRef);
+    utils::lua::unref(luaState_mp, handle_p->batchFuncRef);
+    utils::lua::unref(luaState_mp, handle_p->timerFuncRef);
+    utils::lua::unref(luaState_mp, handle_p->messageFuncRef);
+    utils::lua::unref(luaState_mp, handle_p->envRef);
+    delete handle_p;
+}
+
+void
+MonitoringWorker::updateShedding(void)
+{
+    if (!shedder_m.update(workLanes_m.getMessageDelay())) { return; }
+
+    if (shedder_m.isShedding())
+    {
+        LOG(WARN, "Worker " << index_m << " shedding load, queue delay "
+                  << shedder_m.getPeakDelay() << "us over target "
+                  << Config::instance()->getShedLatencyTargetMs() << "ms");
+    }
+    else
+    {
+        LOG(INFO, "Worker " << index_m << " stopped shedding load after "
+                  << shedder_m.getSheddingTime() / 1000
+                  << "ms, peak queue delay " << shedder_m.getPeakDelay()
+                  << "us");
+    }
+}
+
+bool
+MonitoringWorker::shedMessage(SubscriptionHandle& handle,
+                              solClient_opaqueMsg_pt msg_p)
+{
+    const ShedPolicy& shed = handle.shed;
+
+    if (shed.skip)
+    {
+        shedSkipped_m.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Sender timestamps are wall clock times; without one, the message is
+    // only as old as its receive timestamp says
+    //
+    uint64_t time;
+    if (shed.maxAgeMs != 0 && Clock::getMessageTime(msg_p, time))
+    {
+        uint64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        if (now > time + shed.maxAgeMs)
+        {
+            shedStale_m.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    if (shed.sample > 1 && handle.shedCount++ % shed.sample != 0)
+    {
+        shedSampled_m.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    return false;
+}
+
+void
+MonitoringWorker::handleWorkTypeMessageReceived(WorkEntry& entry)
+{
+    solClient_opaqueMsg_pt msg_p = entry.getMsg();
+
+    // Timeouts due by the time of the message expire before it is handled
+    //
+    uint64_t time;
+    if (virtualClock_m && Clock::getMessageTime(msg_p, time))
+    {
+        advanceVirtualTime(time);
+    }
+
+    // Only this worker writes the counter, so a relaxed load and store is
+    // enough and avoids a locked read-modify-write on every message.
+    //
+    messagesHandled_m.store(
+        messagesHandled_m.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+
+    // The subscription may have failed to set up or been unsubscribed while
+    // the message was queued. A guaranteed message is then left
+    // unacknowledged, its flow being unbound, and the broker delivers it
+    // again on the next bind.
+    //
+    SubscriptionHandle* handle_p = getHandle(entry.getTopicId());
+    if (handle_p == nullptr)
+    {
+        LOG(DEBUG, "Topic id " << entry.getTopicId() << " not subscribed");
+        return;
+    }
+    SubscriptionHandle& handle = *handle_p;
+
+    if (handle.probe_p != nullptr)
+    {
+        const char* probeData_p;
+        size_t probeSize;
+        if (utils::getPayload(msg_p, probeData_p, probeSize)
+                    == returnCode_t::SUCCESS
+                && handle.probe_p->handleEcho(probeData_p, probeSize))
+        {
+            return;
+        }
+    }
+
+    // A probe entry may have no script
+    //
+    if (handle.messageFuncRef == LUA_NOREF && handle.batchFuncRef == LUA_NOREF)
+    {
+        return;
+    }
+
+    if (shedder_m.isShedding() && handle.shed.isSet()
+            && shedMessage(handle, msg_p))
+    {
+        return;
+    }
+
+    if (handle.batchFuncRef != LUA_NOREF)
+    {
+        // Acknowledged when the batch is flushed
+        //
+        addToBatch(handle, entry.takeMsg());
+        return;
+    }
+
+    // Sent after the drain, so only once the script has returned
+    //
+    if (handle.guaranteed) { addAck(handle, msg_p); }
+
+    const char* data_p;
+    size_t size;
+    if (utils::getPayload(msg_p, data_p, size) != returnCode_t::SUCCESS)
+    {
+        LOG(ERROR, "Could not get message payload");
+        return;
+    }
+
+    // The buffer and message object refer to the message, which is freed
+    // after this returns, so they are invalidated as soon as the script
+    // returns
+    //
+    LuaBuffer* payload_p = payloadBuffers_m[0];
+    LuaMessage* message_p = messageObjects_m[0];
+    payload_p->set(data_p, size);
+    message_p->set(msg_p);
+    currentTopicId_m = handle.topicId;
+
+    returnCode_t rc = utils::lua::callMessageFunc(luaState_mp,
+                                                  handle.messageFuncRef,
+                                                  payload_p->getRef(),
+                                                  handle.subscriptionRef,
+                                                  message_p->getRef());
+    currentTopicId_m = INVALID_TOPIC_ID;
+    payload_p->invalidate();
+    message_p->invalidate();
+
+    if (rc != returnCode_t::SUCCESS)
+    {
+        const char* errorMsg_p = lua_tostring(luaState_mp, -1);
+        LOG(ERROR, LUA_MESSAGE_FUNC << "() failed with error \"" << errorMsg_p
+                   << "\"");
+        lua_pop(luaState_mp, 1);
+        return;
+    }
+}
+
+void
+MonitoringWorker::handleWorkTypeSubscribe(const WorkEntry& entry)
+{
+    returnCode_t rc;
+
+    SubscriptionInfo info;
+    if (!SubscriptionRegistry::instance()->get(entry.getTopicId(), info))
+    {
+        LOG(ERROR, "Unknown topic id " << entry.getTopicId());
+        return;
+    }
+
+    if (getHandle(entry.getTopicId()) != nullptr)
+    {
+        LOG(WARN, "Topic '" << info.getTopic() << "' already subscribed");
+        return;
+    }
+
+    SubscriptionHandle* handle_p = new SubscriptionHandle();
+    handle_p->topicId = entry.getTopicId();
+    handle_p->topic = info.getTopic();
+    handle_p->filename = info.getFilename();
+    handle_p->timeout = info.getTimeout();
+    handle_p->guaranteed = info.isGuaranteed();
+    handle_p->partitionHash = SubscriptionRegistry::hashSubscription(info);
+    handle_p->shed = info.getShedPolicy();
+
+    // Loads lua file into lua state. The script may add timers while it is
+    // loaded. A probe entry may have no script.
+    //
+    currentTopicId_m = entry.getTopicId();
+    rc = info.getFilename().empty()
+         ? returnCode_t::NOTHING_TO_DO
+         : utils::lua::loadFileInEnv(luaState_mp,
+                                     info.getFilename(),
+                                     info.getFilename());
+    currentTopicId_m = INVALID_TOPIC_ID;
+    if (rc == returnCode_t::FAILURE)
+    {
+        const char* error_p = lua_tostring(luaState_mp, -1);
+        LOG(WARN, "Could not load " << info.getFilename() << ", error = \""
+                  << error_p << "\"");
+        lua_pop(luaState_mp, 1);
+        goto unsubscribe;
+    }
+
+    // Take references to the env table and its callbacks. The env table is
+    // referenced rather than looked up by filename on every message, so two
+    // topics sharing a script each keep their own env.
+    //
+    handle_p->envRef = utils::lua::refEnv(luaState_mp, info.getFilename());
+    handle_p->messageFuncRef = utils::lua::refFuncInEnv(luaState_mp,
+                                                        handle_p->envRef,
+                                                        LUA_MESSAGE_FUNC);
+    handle_p->timerFuncRef = utils::lua::refFuncInEnv(luaState_mp,
+                                                      handle_p->envRef,
+                                                      LUA_TIMER_FUNC);
+    handle_p->batchFuncRef = utils::lua::refFuncInEnv(luaState_mp,
+                                                      handle_p->envRef,
+                                                      LUA_BATCH_FUNC);
+    handle_p->sessionDownFuncRef = utils::lua::refFuncInEnv(
+                                       luaState_mp,
+                                       handle_p->envRef,
+                                       LUA_SESSION_DOWN_FUNC);
+    handle_p->sessionUpFuncRef = utils::lua::refFuncInEnv(
+                                     luaState_mp,
+                                     handle_p->envRef,
+                                     LUA_SESSION_UP_FUNC);
+
+    // The subscription (which may be a wildcard) is passed to the script
+    // along with every message
+    //
+    lua_pushstring(luaState_mp, handle_p->topic.c_str());
+    handle_p->subscriptionRef = luaL_ref(luaState_mp, LUA_REGISTRYINDEX);
+
+    // Check for existence of a message or batch function, which a probe does
+    // without
+    //
+    if (handle_p->messageFuncRef == LUA_NOREF
+            && handle_p->batchFuncRef == LUA_NOREF
+            && !info.isProbe())
+    {
+        LOG(WARN, "No " << LUA_MESSAGE_FUNC << "() or " << LUA_BATCH_FUNC
+                  << "() function found in " << info.getFilename());
+        goto unsubscribe;
+    }
+
+    // Check for existence of timer function
+    //
+    if (info.getTimeout() && handle_p->timerFuncRef == LUA_NOREF)
+    {
+        LOG(WARN, "No " << LUA_TIMER_FUNC << "() function found in "
+                  << info.getFilename());
+        goto unsubscribe;
+    }
+
+    if (info.getTimeout())
+    {
+        handle_p->timer = timeoutWheel_m.add(entry.getTopicId(),
+                                             info.getTimeout() * 1000,
+                                             true,
+                                             SUBSCRIPTION_TIMER,
+                                             LUA_NOREF);
+    }
+
+    if (handle_p->batchFuncRef != LUA_NOREF)
+    {
+        handle_p->batch.reserve(batchMaxMessages_m);
+    }
+
+    // Probes measure real round trips, which the virtual clock has no notion
+    // of
+    //
+    if (info.isProbe() && virtualClock_m)
+    {
+        LOG(WARN, "Probe on topic '" << info.getTopic() << "' disabled with "
+                  << "the virtual clock");
+    }
+    else if (info.isProbe())
+    {
+        handle_p->probe_p = new Probe(entry.getTopicId(), info);
+        handle_p->probeTimer = timeoutWheel_m.add(entry.getTopicId(),
+                                                  info.getProbeIntervalMs(),
+                                                  true,
+                                                  PROBE_TIMER,
+                                                  LUA_NOREF);
+    }
+
+    // Update tables with subscription if everything goes well
+    //
+    if (handlesById_m.size() <= handle_p->topicId)
+    {
+        handlesById_m.resize(handle_p->topicId + 1, nullptr);
+    }
+    handlesById_m[handle_p->topicId] = handle_p;
+
+    LOG(INFO, "monitoringWorker " << index_m << " subscribed to topic '"
+              << info.getTopic() << "'");
+    return;
+
+unsubscribe:
+    releaseHandle(handle_p);
+
+    // Stop matching messages against the subscription and unsubscribe from
+    // topic. The flow of a guaranteed subscription is unbound, rather than
+    // left to fill its window with messages no one acknowledges; those it
+    // delivered stay in the queue. If the bind is still waiting for the
+    // broker, MonitoringThread::addSubscription() unbinds it instead.
+    //
+    SubscriptionRegistry::instance()->remove(entry.getTopicId());
+    Conflator::instance()->remove(entry.getTopicId());
+    if (info.isGuaranteed())
+    {
+        Transport::instance()->queueUnbind(entry.getTopicId());
+    }
+    else
+    {
+        Transport::instance()->topicUnsubscribe(info.getTopic());
+    }
+    return;
+}
+
+void
+MonitoringWorker::handleWorkTypeUnsubscribe(const WorkEntry& entry)
+{
+    SubscriptionHandle* handle_p = getHandle(entry.getTopicId());
+    if (handle_p == nullptr)
+    {
+        LOG(WARN, "Topic id " << entry.getTopicId() << " not subscribed");
+        return;
+    }
+
+    // Deliver any batched messages before the script goes away
+    //
+    if (!handle_p->batch.empty()) { flushBatch(*handle_p); }
+
+    pendingBatches_m.erase(
+        std::remove(pendingBatches_m.begin(), pendingBatches_m.end(),
+                    handle_p),
+        pendingBatches_m.end());
+    handlesById_m[entry.getTopicId()] = nullptr;
+    timeoutWheel_m.cancel(handle_p->timer);
+    timeoutWheel_m.cancel(handle_p->probeTimer);
+
+    LOG(INFO, "monitoringWorker " << index_m << " unsubscribed from topic '"
+              << handle_p->topic << "'");
+
+    // Timers added by the script are not tracked per subscription; they find
+    // no handle when they expire and are dropped then
+    //
+    releaseHandle(handle_p);
+}
+
+bool
+MonitoringWorker::pushMessage(solClient_opaqueMsg_pt msg_p,
+                              topicId_t topicId,
+                              priority_t priority,
+                              bool droppable,
+                              bool spill)
+{
+    uint32_t lane = WorkLanes::getLane(priority);
+    Spill* spill_p = spill ? spills_mp[lane] : nullptr;
+    if (spill_p == nullptr)
+    {
+        return queueMessage(msg_p, topicId, lane, droppable);
+    }
+
+    // Whether the message is queued or spilled is decided under the lock, so
+    // no message is queued behind SPILL_STARTED while older ones are on disk
+    //
+    std::lock_guard<std::mutex> lock(spill_p->mutex);
+
+    if (!spill_p->active
+            && queuedMessages_m.load(std::memory_order_relaxed)
+                   < spillHighWater_m)
+    {
+        return queueMessage(msg_p, topicId, lane, false);
+    }
+
+    return spillMessage(*spill_p, msg_p, topicId, lane);
+}
+
+bool
+MonitoringWorker::spillMessage(Spill& spill,
+                               solClient_opaqueMsg_pt msg_p,
+                               topicId_t topicId,
+                               uint32_t lane)
+{
+    if (!spill.active)
+    {
+        spill.active = true;
+        workLanes_m.push(WorkEntry::spillStarted(lane), lane);
+    }
+
+    uint64_t bytes = getQueuedBytes(msg_p, UINT32_MAX);
+    if (spill.buffer.append(msg_p, topicId) != returnCode_t::SUCCESS)
+    {
+        spillFailures_m.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    spilledMessages_m.fetch_add(1, std::memory_order_relaxed);
+    spilledBytes_m.fetch_add(bytes, std::memory_order_relaxed);
+    spillBacklog_m.fetch_add(1, std::memory_order_relaxed);
+
+    // The buffer has its own copy
+    //
+    solClient_msg_free(&msg_p);
+    return true;
+}
+
+void
+MonitoringWorker::handleWorkTypeSpillStarted(const WorkEntry& entry)
+{
+    Spill* spill_p = spills_mp[entry.getLane()];
+    if (spill_p == nullptr || spill_p->reading) { return; }
+
+    spill_p->reading = true;
+    spillsReading_m++;
+}
+
+void
+MonitoringWorker::readSpills(void)
+{
+    solClient_opaqueMsg_pt msgs[SPILL_READ_SIZE];
+    topicId_t topicIds[SPILL_READ_SIZE];
+
+    for (uint32_t lane=0; lane<WORK_LANE_COUNT; lane++)
+    {
+        Spill* spill_p = spills_mp[lane];
+        if (spill_p == nullptr || !spill_p->reading) { continue; }
+
+        size_t count = 0;
+        {
+            std::lock_guard<std::mutex> lock(spill_p->mutex);
+
+            uint64_t records = spill_p->buffer.getRecords();
+            while (count < SPILL_READ_SIZE)
+            {
+                msgs[count] = spill_p->buffer.next(topicIds[count]);
+                if (msgs[count] == nullptr) { break; }
+                count++;
+            }
+            spillBacklog_m.fetch_sub(records - spill_p->buffer.getRecords(),
+                                     std::memory_order_relaxed);
+
+            // Producers queue to the lane again from now on; their messages
+            // are only handled after these
+            //
+            if (spill_p->buffer.empty())
+            {
+                spill_p->active = false;
+                spill_p->reading = false;
+                spillsReading_m--;
+            }
+        }
+
+        for (size_t i=0; i<count; i++)
+        {
+            WorkEntry entry = WorkEntry::messageReceived(msgs[i], topicIds[i]);
+            handleWorkTypeMessageReceived(entry);
+            entry.release();
+        }
+
+        readBackMessages_m.fetch_add(count, std::memory_order_relaxed);
+    }
+}
+
+bool
+MonitoringWorker::queueMessage(solClient_opaqueMsg_pt msg_p,
+                               topicId_t topicId,
+                               uint32_t lane,
+                               bool droppable)
+{
+    uint64_t bytes = getQueuedBytes(msg_p, workQueueMaxBytes_m);
+
+    if (droppable)
+    {
+        uint64_t messages = queuedMessages_m.load(std::memory_order_relaxed) + 1;
+        uint64_t queued = queuedBytes_m.load(std::memory_order_relaxed) + bytes;
+
+        switch (overloadPolicy_m)
+        {
+        case overloadPolicy_t::BLOCK:
+            // Holding up the caller, the transport's context thread, holds
+            // up the broker in turn
+            //
+            if (!isOverloaded(messages, queued)) { break; }
+
+            blockedPushes_m.fetch_add(1, std::memory_order_relaxed);
+            for (uint32_t spins = 0; isOverloaded(messages, queued); spins++)
+            {
+                if (spins < OVERLOAD_SPIN_COUNT) { cpuRelax(); }
+                else                             { std::this_thread::yield(); }
+
+                messages = queuedMessages_m.load(std::memory_order_relaxed) + 1;
+                queued = queuedBytes_m.load(std::memory_order_relaxed) + bytes;
+            }
+            break;
+        case overloadPolicy_t::DROP_NEWEST:
+            if (isOverloaded(messages, queued))
+            {
+                droppedNewest_m.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            break;
+        case overloadPolicy_t::DROP_OLDEST:
+            // The worker drops messages from the head of the queue until it
+            // is back within its bound, see dequeueMessage(); until it gets
+            // to them, twice the bound may be queued before the newest are
+            // dropped too
+            //
+            if (isOverloaded(messages / 2, queued / 2))
+            {
+                droppedNewest_m.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            break;
+        }
+    }
+
+    queuedMessages_m.fetch_add(1, std::memory_order_relaxed);
+    queuedBytes_m.fetch_add(bytes, std::memory_order_relaxed);
+    workLanes_m.push(WorkEntry::messageReceived(msg_p, topicId, droppable),
+                     lane);
+
+    return true;
+}
+
+bool
+MonitoringWorker::dequeueMessage(WorkEntry& entry)
+{
+    uint64_t bytes = getQueuedBytes(entry.getMsg(), workQueueMaxBytes_m);
+    uint64_t messages = queuedMessages_m.fetch_sub(
+                            1, std::memory_order_relaxed) - 1;
+    uint64_t queued = queuedBytes_m.fetch_sub(
+                          bytes, std::memory_order_relaxed) - bytes;
+
+    if (overloadPolicy_m != overloadPolicy_t::DROP_OLDEST
+            || !isOverloaded(messages, queued))
+    {
+        return false;
+    }
+
+    // Nor are those queued as not droppable: guaranteed messages, which the
+    // broker would redeliver anyway, and those of spilled subscriptions
+    //
+    if (!entry.isDroppable()) { return false; }
+
+    droppedOldest_m.store(droppedOldest_m.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+    return true;
+}
+
+void
+MonitoringWorker::handleWorkTypeMessageConflated(const WorkEntry& entry)
+{
+    solClient_opaqueMsg_pt msg_p = Conflator::instance()->take(entry.getSlot());
+    if (msg_p == nullptr) { return; }
+
+    WorkEntry message = WorkEntry::messageReceived(msg_p, entry.getTopicId());
+    handleWorkTypeMessageReceived(message);
+    message.release();
+}
+
+void
+MonitoringWorker::pushTimerTick(void)
+{
+    if (!tickPending_m.exchange(true, std::memory_order_acq_rel))
+    {
+        workLanes_m.push(WorkEntry::timerTick(), CONTROL_LANE);
+    }
+}
+
+void
+MonitoringWorker::handleWorkTypeTimerTick(const WorkEntry& entry)
+{
+    if (virtualClock_m)
+    {
+        advanceVirtualTime(entry.getTime());
+        return;
+    }
+
+    // Cleared before advancing, so a tick pushed meanwhile is not lost
+    //
+    tickPending_m.store(false, std::memory_order_release);
+    timeoutWheel_m.advance(Clock::instance()->now());
+}
+
+void
+MonitoringWorker::advanceVirtualTime(uint64_t time)
+{
+    if (!virtualStarted_m)
+    {
+        virtualStarted_m = true;
+        timeoutWheel_m.rebase(time);
+        return;
+    }
+
+    timeoutWheel_m.advance(time);
+}
+
+void
+MonitoringWorker::handleWorkTypeSessionDown(const WorkEntry& entry)
+{
+    // By index, as scripts run meanwhile
+    //
+    for (size_t i=0; i<handlesById_m.size(); i++)
+    {
+        SubscriptionHandle* handle_p = handlesById_m[i];
+        if (handle_p != nullptr
+                && handle_p->partitionHash % entry.getPartitions()
+                       == entry.getPartition())
+        {
+            handleSessionDown(*handle_p);
+        }
+    }
+}
+
+void
+MonitoringWorker::handleWorkTypeSessionUp(const WorkEntry& entry)
+{
+    for (size_t i=0; i<handlesById_m.size(); i++)
+    {
+        SubscriptionHandle* handle_p = handlesById_m[i];
+        if (handle_p != nullptr
+                && handle_p->partitionHash % entry.getPartitions()
+                       == entry.getPartition())
+        {
+            handleSessionUp(*handle_p, entry.getOutage());
+        }
+    }
+}
+
+void
+MonitoringWorker::handleSessionDown(SubscriptionHandle& handle)
+{
+    if (handle.sessionDown) { return; }
+
+    handle.sessionDown = true;
+
+    // Batched messages are delivered first. Those still queued in the
+    // message lanes are not: session events come through the control lane,
+    // which is drained ahead of them, so they reach the script after
+    // onSessionDown().
+    //
+    if (!handle.batch.empty()) { flushBatch(handle); }
+
+    if (handle.sessionDownFuncRef == LUA_NOREF) { return; }
+
+    currentTopicId_m = handle.topicId;
+    returnCode_t rc = utils::lua::callSessionDownFunc(
+                          luaState_mp,
+                          handle.sessionDownFuncRef,
+                          handle.subscriptionRef);
+    currentTopicId_m = INVALID_TOPIC_ID;
+
+    if (rc != returnCode_t::SUCCESS)
+    {
+        const char* errorMsg_p = lua_tostring(luaState_mp, -1);
+        LOG(ERROR, LUA_SESSION_DOWN_FUNC << "() failed with error \""
+                   << errorMsg_p << "\"");
+        lua_pop(luaState_mp, 1);
+    }
+}
+
+void
+MonitoringWorker::handleSessionUp(SubscriptionHandle& handle, uint64_t outage)
+{
+    if (!handle.sessionDown) { return; }
+
+    handle.sessionDown = false;
+
+    // onTimer() next runs a full period from now, so a silence check does
+    // not count the outage
+    //
+    if (handle.timeout)
+    {
+        timeoutWheel_m.cancel(handle.timer);
+        handle.timer = timeoutWheel_m.add(handle.topicId,
+                                          handle.timeout * 1000,
+                                          true,
+                                          SUBSCRIPTION_TIMER,
+                                          LUA_NOREF);
+    }
+
+    if (handle.sessionUpFuncRef == LUA_NOREF) { return; }
+
+    currentTopicId_m = handle.topicId;
+    returnCode_t rc = utils::lua::callSessionUpFunc(
+                          luaState_mp,
+                          handle.sessionUpFuncRef,
+                          handle.subscriptionRef,
+                          outage);
+    currentTopicId_m = INVALID_TOPIC_ID;
+
+    if (rc != returnCode_t::SUCCESS)
+    {
+        const char* errorMsg_p = lua_tostring(luaState_mp, -1);
+        LOG(ERROR, LUA_SESSION_UP_FUNC << "() failed with error \""
+                   << errorMsg_p << "\"");
+        lua_pop(luaState_mp, 1);
+    }
+}
+
+void
+MonitoringWorker::handleTimeout(const TimeoutEvent& event)
+{
+    // Only this worker writes the counters, so a relaxed load and store is
+    // enough
+    //
+    timeoutsExpired_m.store(
+        timeoutsExpired_m.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    timeoutLatenessTotal_m.store(
+        timeoutLatenessTotal_m.load(std::memory_order_relaxed)
+            + event.lateness,
+        std::memory_order_relaxed);
+    if (event.lateness > timeoutLatenessMax_m.load(std::memory_order_relaxed))
+    {
+        timeoutLatenessMax_m.store(event.lateness, std::memory_order_relaxed);
+    }
+
+    if (event.kind == PROBE_TIMER)
+    {
+        handleProbeTimeout(event);
+        return;
+    }
+
+    if (event.kind == SCRIPT_TIMER)
+    {
+        handleScriptTimeout(event);
+        return;
+    }
+
+    SubscriptionHandle* handle_p = getHandle(event.topicId);
+    if (handle_p == nullptr)
+    {
+        LOG(DEBUG, "Topic id " << event.topicId << " not subscribed");
+        timeoutWheel_m.cancel(event.handle);
+        return;
+    }
+
+    // Paused while the session is down; the timer is restarted when it is
+    // back
+    //
+    if (handle_p->sessionDown)
+    {
+        LOG(DEBUG, "Session of topic '" << handle_p->topic << "' down, "
+                   << LUA_TIMER_FUNC << "() skipped");
+        return;
+    }
+
+    LOG(INFO, "Executing timer function for topic '" << handle_p->topic
+              << "'");
+
+    // Deliver any batched messages first to preserve ordering
+    //
+    if (!handle_p->batch.empty()) { flushBatch(*handle_p); }
+
+    currentTopicId_m = event.topicId;
+    returnCode_t rc = utils::lua::callTimerFunc(luaState_mp,
+                                                handle_p->timerFuncRef);
+    currentTopicId_m = INVALID_TOPIC_ID;
+
+    if (rc != returnCode_t::SUCCESS)
+    {
+        const char* errorMsg_p = lua_tostring(luaState_mp, -1);
+        LOG(ERROR, LUA_TIMER_FUNC << "() failed with error \"" << errorMsg_p
+                   << "\"");
+        lua_pop(luaState_mp, 1);
+
+        // A failing onTimer() is not called again
+        //
+        timeoutWheel_m.cancel(event.handle);
+        return;
+    }
+}
+
+void
+MonitoringWorker::handleProbeTimeout(const TimeoutEvent& event)
+{
+    SubscriptionHandle* handle_p = getHandle(event.topicId);
+    if (handle_p == nullptr || handle_p->probe_p == nullptr)
+    {
+        timeoutWheel_m.cancel(event.handle);
+        return;
+    }
+
+    // A probe sent while the session is down would only be counted lost
+    //
+    if (handle_p->sessionDown) { return; }
+
+    // Probes go through the Publisher like messages published by scripts, so
+    // the round trip includes its queue
+    //
+    solClient_opaqueMsg_pt msg_p = publishPool_m.acquire();
+    if (msg_p == nullptr)
+    {
+        Publisher::instance()->countDropped();
+        return;
+    }
+
+    if (handle_p->probe_p->fill(msg_p) != returnCode_t::SUCCESS
+            || !Publisher::instance()->push(msg_p, &publishPool_m))
+    {
+        publishPool_m.putBack(msg_p);
+    }
+}
+
+void
+MonitoringWorker::handleScriptTimeout(const TimeoutEvent& event)
+{
+    SubscriptionHandle* handle_p = getHandle(event.topicId);
+    if (handle_p == nullptr)
+    {
+        // The subscription is gone; drop its timer
+        //
+        timeoutWheel_m.cancel(event.handle);
+        utils::lua::unref(luaState_mp, event.data);
+        return;
+    }
+
+    // Paused while the session is down, like onTimer(), so a silence check
+    // does not count the outage: a periodic timer skips its expiries, and a
+    // one-shot timer is put off by its timeout, keeping its id, until the
+    // session is back
+    //
+    if (handle_p->sessionDown)
+    {
+        LOG(DEBUG, "Session of topic '" << handle_p->topic << "' down, "
+                   << "timer callback put off");
+        if (!event.periodic)
+        {
+            timeoutWheel_m.reschedule(event.handle, event.timeout);
+        }
+        return;
+    }
+
+    // Deliver any batched messages first to preserve ordering
+    //
+    if (!handle_p->batch.empty()) { flushBatch(*handle_p); }
+
+    currentTopicId_m = event.topicId;
+    returnCode_t rc = utils::lua::callTimerCallback(luaState_mp,
+                                                    event.data,
+                                                    event.handle.toId());
+    currentTopicId_m = INVALID_TOPIC_ID;
+
+    if (rc != returnCode_t::SUCCESS)
+    {
+        const char* errorMsg_p = lua_tostring(luaState_mp, -1);
+        LOG(ERROR, "Timer callback for topic '" << handle_p->topic
+                   << "' failed with error \"" << errorMsg_p << "\"");
+        lua_pop(luaState_mp, 1);
+    }
+
+    // The callback of a periodic timer is unreferenced when the timer is
+    // cancelled, as is that of a one-shot timer cancelling itself
+    //
+    if (!event.periodic && timeoutWheel_m.find(event.handle) != nullptr)
+    {
+        utils::lua::unref(luaState_mp, event.data);
+    }
+}
+
+void
+MonitoringWorker::registerTimerLib(void)
+{
+    static const luaL_Reg functions[] =
+    {
+        { "after",  luaTimerAfter },
+        { "every",  luaTimerEvery },
+        { "cancel", luaTimerCancel },
+        { "now",    luaTimerNow },
+        { nullptr,  nullptr }
+    };
+
+    // The functions find this worker through their upvalue
+    //
+    luaL_newlibtable(luaState_mp, functions);
+    lua_pushlightuserdata(luaState_mp, this);
+    luaL_setfuncs(luaState_mp, functions, 1);
+    lua_setglobal(luaState_mp, "timer");
+}
+
+int
+MonitoringWorker::addScriptTimer(lua_State* L, bool periodic)
+{
+    lua_Integer timeout = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, timeout >= (periodic ? 1 : 0) && timeout <= UINT32_MAX,
+                  1, "timeout out of range");
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+    if (currentTopicId_m == INVALID_TOPIC_ID)
+    {
+        return luaL_error(L, "timer used outside of a monitoring script");
+    }
+
+    lua_pushvalue(L, 2);
+    int funcRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    TimeoutHandle handle = timeoutWheel_m.add(currentTopicId_m,
+                                              timeout,
+                                              periodic,
+                                              SCRIPT_TIMER,
+                                              funcRef);
+    lua_pushnumber(L, handle.toId());
+    return 1;
+}
+
+int
+MonitoringWorker::cancelScriptTimer(lua_State* L)
+{
+    TimeoutHandle handle = TimeoutHandle::fromId(luaL_checknumber(L, 1));
+
+    // Scripts may only cancel the timers they added themselves, not the
+    // onTimer() or probe timers of their subscription
+    //
+    const TimeoutInfo* info_p = timeoutWheel_m.find(handle);
+    if (info_p == nullptr
+            || info_p->getKind() != SCRIPT_TIMER
+            || info_p->getTopicId() != currentTopicId_m)
+    {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    // If this is a timer cancelling itself, its callback is still
+    // on the stack, so releasing the reference is safe
+    //
+    int funcRef = info_p->getData();
+    timeoutWheel_m.cancel(handle);
+    utils::lua::unref(L, funcRef);
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+int
+MonitoringWorker::luaTimerAfter(lua_State* L)
+{
+    MonitoringWorker* worker_p =
+        (MonitoringWorker*)lua_touserdata(L, lua_upvalueindex(1));
+    return worker_p->addScriptTimer(L, false);
+}
+
+int
+MonitoringWorker::luaTimerEvery(lua_State* L)
+{
+    MonitoringWorker* worker_p =
+        (MonitoringWorker*)lua_touserdata(L, lua_upvalueindex(1));
+    return worker_p->addScriptTimer(L, true);
+}
+
+int
+MonitoringWorker::luaTimerCancel(lua_State* L)
+{
+    MonitoringWorker* worker_p =
+        (MonitoringWorker*)lua_touserdata(L, lua_upvalueindex(1));
+    return worker_p->cancelScriptTimer(L);
+}
+
+int
+MonitoringWorker::luaTimerNow(lua_State* L)
+{
+    MonitoringWorker* worker_p =
+        (MonitoringWorker*)lua_touserdata(L, lua_upvalueindex(1));
+    lua_pushnumber(L, worker_p->getTime());
+    return 1;
+}
+
+void
+MonitoringWorker::registerSheddingLib(void)
+{
+    lua_pushlightuserdata(luaState_mp, this);
+    lua_pushcclosure(luaState_mp, luaShedding, 1);
+    lua_setglobal(luaState_mp, "shedding");
+}
+
+int
+MonitoringWorker::luaShedding(lua_State* L)
+{
+    MonitoringWorker* worker_p =
+        (MonitoringWorker*)lua_touserdata(L, lua_upvalueindex(1));
+
+    bool shedding = worker_p->shedder_m.isShedding();
+    lua_Integer sample = 1;
+    if (shedding)
+    {
+        SubscriptionHandle* handle_p =
+            worker_p->getHandle(worker_p->currentTopicId_m);
+        if (handle_p != nullptr)
+        {
+            sample = handle_p->shed.skip ? 0 : handle_p->shed.sample;
+        }
+    }
+
+    lua_pushboolean(L, shedding);
+    lua_pushinteger(L, sample);
+    return 2;
+}
+
+void
+MonitoringWorker::registerPublishLib(void)
+{
+    lua_pushlightuserdata(luaState_mp, this);
+    lua_pushcclosure(luaState_mp, luaPublish, 1);
+    lua_setglobal(luaState_mp, "publish");
+}
+
+int
+MonitoringWorker::publishMessage(lua_State* L)
+{
+    size_t topicSize;
+    const char* topic_p = luaL_checklstring(L, 1, &topicSize);
+    luaL_argcheck(L, topicSize != 0, 1, "empty topic");
+
+    const char* data_p;
+    size_t size;
+    LuaBuffer* buffer_p = LuaBuffer::test(L, 2);
+    if (buffer_p != nullptr)
+    {
+        data_p = buffer_p->getData();
+        size = buffer_p->getSize();
+    }
+    else
+    {
+        data_p = luaL_checklstring(L, 2, &size);
+    }
+
+    // Arguments are all checked before a message is taken from the pool,
+    // since a Lua error does not return here
+    //
+    const char* correlationId_p = nullptr;
+    if (!lua_isnoneornil(L, 3))
+    {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        lua_getfield(L, 3, "correlationId");
+        if (!lua_isnil(L, -1))
+        {
+            luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, 3,
+                          "correlationId not a string");
+            correlationId_p = lua_tostring(L, -1);
+        }
+    }
+
+    solClient_opaqueMsg_pt msg_p = publishPool_m.acquire();
+    if (msg_p == nullptr)
+    {
+        Publisher::instance()->countDropped();
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    solClient_destination_t dest;
+    dest.destType = SOLCLIENT_TOPIC_DESTINATION;
+    dest.dest = topic_p;
+
+    if (solClient_msg_setDestination(msg_p, &dest, sizeof(dest))
+                != SOLCLIENT_OK
+            || solClient_msg_setDeliveryMode(msg_p,
+                                             SOLCLIENT_DELIVERY_MODE_DIRECT)
+                   != SOLCLIENT_OK
+            || solClient_msg_setBinaryAttachment(msg_p, data_p, size)
+                   != SOLCLIENT_OK
+            || (correlationId_p != nullptr
+                && solClient_msg_setCorrelationId(msg_p, correlationId_p)
+                       != SOLCLIENT_OK))
+    {
+        publishPool_m.putBack(msg_p);
+        return luaL_error(L, "could not build message for topic '%s'",
+                          topic_p);
+    }
+
+    if (!Publisher::instance()->push(msg_p, &publishPool_m))
+    {
+        publishPool_m.putBack(msg_p);
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+int
+MonitoringWorker::luaPublish(lua_State* L)
+{
+    MonitoringWorker* worker_p =
+        (MonitoringWorker*)lua_touserdata(L, lua_upvalueindex(1));
+    return worker_p->publishMessage(L);
+}
+
+void
+MonitoringWorker::addToBatch(SubscriptionHandle& handle,
+                             solClient_opaqueMsg_pt msg_p)
+{
+    if (handle.batch.empty())
+    {
+        handle.batchDeadline = getTime() + batchMaxWaitMs_m;
+    }
+    if (!handle.batchPending)
+    {
+        handle.batchPending = true;
+        pendingBatches_m.push_back(&handle);
+    }
+
+    handle.batch.push_back(msg_p);
+
+    if (handle.batch.size() >= batchMaxMessages_m) { flushBatch(handle); }
+}
+
+void
+MonitoringWorker::flushBatch(SubscriptionHandle& handle)
+{
+    // Messages whose payload cannot be read are left out of the batch
+    //
+    size_t count = 0;
+    for (solClient_opaqueMsg_pt msg_p : handle.batch)
+    {
+        const char* data_p;
+        size_t size;
+        if (utils::getPayload(msg_p, data_p, size) != returnCode_t::SUCCESS)
+        {
+            LOG(ERROR, "Could not get message payload");
+            continue;
+        }
+
+        payloadBuffers_m[count]->set(data_p, size);
+        messageObjects_m[count]->set(msg_p);
+        count++;
+    }
+
+    currentTopicId_m = handle.topicId;
+    returnCode_t rc = utils::lua::callBatchFunc(luaState_mp,
+                                                handle.batchFuncRef,
+                                                payloadRefs_m.data(),
+                                                messageRefs_m.data(),
+                                                count,
+                                                handle.subscriptionRef);
+    currentTopicId_m = INVALID_TOPIC_ID;
+
+    for (size_t i=0; i<count; i++)
+    {
+        payloadBuffers_m[i]->invalidate();
+        messageObjects_m[i]->invalidate();
+    }
+
+    if (rc != returnCode_t::SUCCESS)
+    {
+        const char* errorMsg_p = lua_tostring(luaState_mp, -1);
+        LOG(ERROR, LUA_BATCH_FUNC << "() failed with error \"" << errorMsg_p
+                   << "\"");
+        lua_pop(luaState_mp, 1);
+    }
+
+    for (solClient_opaqueMsg_pt msg_p : handle.batch)
+    {
+        if (handle.guaranteed) { addAck(handle, msg_p); }
+        solClient_msg_free(&msg_p);
+    }
+
+    // Keeps the reserved capacity, so refilling the batch does not allocate.
+    // The entry in pendingBatches_m is removed by flushExpiredBatches().
+    //
+    handle.batch.clear();
+}
+
+void
+MonitoringWorker::flushExpiredBatches(void)
+{
+    uint64_t now = getTime();
+
+    for (SubscriptionHandle* handle_p : pendingBatches_m)
+    {
+        if (!handle_p->batch.empty() && handle_p->batchDeadline <= now)
+        {
+            flushBatch(*handle_p);
+        }
+    }
+
+    pendingBatches_m.erase(
+        std::remove_if(pendingBatches_m.begin(), pendingBatches_m.end(),
+                       [](SubscriptionHandle* handle_p)
+                       {
+                           if (!handle_p->batch.empty()) { return false; }
+                           handle_p->batchPending = false;
+                           return true;
+                       }),
+        pendingBatches_m.end());
+}
+
+void
+MonitoringWorker::addAck(const SubscriptionHandle& handle,
+                         solClient_opaqueMsg_pt msg_p)
+{
+    AckEntry ack;
+    ack.topicId = handle.topicId;
+    if (solClient_msg_getMsgId(msg_p, &ack.msgId) != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "Could not get message id on topic '" << handle.topic
+                   << "'");
+        return;
+    }
+
+    pendingAcks_m.push_back(ack);
+}
+
+void
+MonitoringWorker::sendAcks(void)
+{
+    Transport::instance()->acknowledge(pendingAcks_m.data(),
+                                       pendingAcks_m.size());
+
+    // Keeps the reserved capacity
+    //
+    pendingAcks_m.clear();
+}
+
+std::chrono::microseconds
+MonitoringWorker::getWaitTime(uint64_t now) const
+{
+    if (virtualClock_m) { return std::chrono::microseconds::max(); }
+
+    // A batch restarted after a flush by size keeps its place in
+    // pendingBatches_m with a later deadline, so they are not in deadline
+    // order
+    //
+    uint64_t deadline = timeoutWheel_m.getNextExpiry();
+    for (const SubscriptionHandle* handle_p : pendingBatches_m)
+    {
+        if (!handle_p->batch.empty())
+        {
+            deadline = std::min(deadline, handle_p->batchDeadline);
+        }
+    }
+
+    if (deadline == UINT64_MAX) { return std::chrono::microseconds::max(); }
+
+    return std::chrono::milliseconds(deadline > now ? deadline - now : 0);
+}
+
+void
+MonitoringWorker::start(void)
+{
+    thread_m = std::thread([this]()
+    {
+        if (run() != returnCode_t::SUCCESS)
+            LOG(ERROR, "monitoringWorker " << index_m << " stopped");
+    });
+}
+
+void
+MonitoringWorker::join(void)
+{
+    if (thread_m.joinable()) { thread_m.join(); }
+}
+
+returnCode_t
+MonitoringWorker::run(void)
+{
+    WorkEntry entries[WORK_QUEUE_DRAIN_SIZE];
+
+    for (;;)
+    {
+        // The wheel is advanced from the monotonic clock between every drain
+        // of the work queue, catching up on all slots since the last advance,
+        // so timeouts do not wait behind queued messages or TIMER_TICKs. The
+        // virtual clock only advances with the entries themselves.
+        //
+        uint64_t now = getTime();
+        if (!virtualClock_m) { timeoutWheel_m.advance(now); }
+
+        // Drain as many entries as are available in one go; this blocks only
+        // when the work queue is empty, and no longer than until the next
+        // batch or timeout is due.
+        //
+        size_t count;
+        std::chrono::microseconds wait = getWaitTime(now);
+        if (spillsReading_m != 0) { wait = std::chrono::microseconds(0); }
+        if (wait == std::chrono::microseconds::max())
+        {
+            count = workLanes_m.popMany(entries, WORK_QUEUE_DRAIN_SIZE);
+        }
+        else
+        {
+            count = workLanes_m.popMany(entries, WORK_QUEUE_DRAIN_SIZE, wait);
+        }
+
+        if (shedder_m.isEnabled()) { updateShedding(); }
+
+        for (size_t i=0; i<count; i++)
+        {
+            WorkEntry& entry = entries[i];
+
+            LOG(DEBUG, "Handling work entry of type '"
+                       << workTypeToString(entry.getType()) << "'");
+
+            switch (entry.getType())
+            {
+            case workType_t::MESSAGE_RECEIVED:
+                if (!dequeueMessage(entry))
+                {
+                    handleWorkTypeMessageReceived(entry);
+                }
+                break;
+            case workType_t::SUBSCRIBE:
+                handleWorkTypeSubscribe(entry);
+                break;
+            case workType_t::UNSUBSCRIBE:
+                handleWorkTypeUnsubscribe(entry);
+                break;
+            case workType_t::TIMER_TICK:
+                handleWorkTypeTimerTick(entry);
+                break;
+            case workType_t::SESSION_DOWN:
+                handleWorkTypeSessionDown(entry);
+                break;
+            case workType_t::SESSION_UP:
+                handleWorkTypeSessionUp(entry);
+                break;
+            case workType_t::MESSAGE_CONFLATED:
+                handleWorkTypeMessageConflated(entry);
+                break;
+            case workType_t::SPILL_STARTED:
+                handleWorkTypeSpillStarted(entry);
+                break;
+            default:
+                LOG(ERROR, "Unknown work type received in work entry.");
+                return returnCode_t::FAILURE;
+            }
+
+            entry.release();
+        }
+
+        if (spillsReading_m != 0) { readSpills(); }
+        if (!pendingBatches_m.empty()) { flushExpiredBatches(); }
+        if (!pendingAcks_m.empty()) { sendAcks(); }
+    }
+
+    return returnCode_t::SUCCESS;
+}
+
+} /* namespace topicMonitor */
@@ -0,0 +1,470 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_MONITORING_WORKER_HPP_
+#define _TOPIC_MONITOR_MONITORING_WORKER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <lua5.2/lua.hpp>
+#include <mutex>
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "clock.hpp"
+#include "common.hpp"
+#include "config.hpp"
+#include "loadShedder.hpp"
+#include "luaBuffer.hpp"
+#include "luaMessage.hpp"
+#include "probe.hpp"
+#include "publisher.hpp"
+#include "spillBuffer.hpp"
+#include "timeoutWheel.hpp"
+#include "utils.hpp"
+#include "workLanes.hpp"
+
+namespace topicMonitor
+{
+
+// A MonitoringWorker runs the monitoring scripts for a subset of the topics on
+// its own thread. Each worker owns its own work queue, lua_State and
+// TimeoutWheel, so workers never share any state and never need to lock.
+//
+// MonitoringThread assigns every subscription to exactly one worker, which
+// means the messages of a subscription are handled in order and never
+// concurrently.
+//
+// If a script defines onBatch(), messages for its topic are not passed to
+// onMessage() one at a time. Instead they are collected into a batch which is
+// flushed to onBatch() as one Lua array when it reaches batchMaxMessages, when
+// its first message has waited batchMaxWaitMs, or before the topic's onTimer()
+// runs so that the script always sees its messages in order.
+//
+// Messages of a guaranteed subscription are acknowledged once the script has
+// handled them, successfully or not, so a message that breaks the script is
+// not redelivered forever. The acknowledgements of a whole drain of the work
+// queue are passed to the transport at once.
+//
+// While the session serving a subscription is down, its onTimer() is not
+// called, so silence checks do not fire on an outage; the timer restarts once
+// the session is back. The timers its script added are paused the same way,
+// and its probe sends nothing. The script is told through onSessionDown() and
+// onSessionUp(), if it defines them.
+//
+// The messages queued to a worker are bounded by workQueueSize and
+// workQueueMaxBytes; see pushMessage(). Control entries are not counted and
+// are never dropped; they have a lane of their own, ahead of the lanes of the
+// messages by priority (see WorkLanes).
+//
+// Once spillHighWater messages are queued, the messages of spilled
+// subscriptions go to a SpillBuffer per lane instead, from the point a
+// SPILL_STARTED entry marks in the lane. When the worker gets to that entry
+// it has handled every message queued before, and reads the spilled messages
+// back between drains of its lanes; messages keep going to disk until it has
+// read them all, so the messages of a subscription stay in order.
+//
+// Once its messages wait longer than shedLatencyTargetMs, the worker sheds
+// load until it has caught up (see LoadShedder): the subscriptions with a
+// ShedPolicy drop their messages by it before they reach their scripts, which
+// can tell through the global shedding() function.
+//
+class MonitoringWorker : private TimeoutHandler
+{
+public:
+    // Handle to a subscription whose script has been loaded into this worker.
+    // It is created once when the SUBSCRIBE entry is handled and holds
+    // registry references (see luaL_ref) to the script's env table and
+    // callbacks, so dispatching a message is an index into handlesById_m
+    // followed by lua_rawgeti() and lua_pcall().
+    //
+    struct SubscriptionHandle
+    {
+        SubscriptionHandle(void) :
+            topicId(INVALID_TOPIC_ID),
+            timeout(0),
+            envRef(LUA_NOREF),
+            messageFuncRef(LUA_NOREF),
+            timerFuncRef(LUA_NOREF),
+            batchFuncRef(LUA_NOREF),
+            sessionDownFuncRef(LUA_NOREF),
+            sessionUpFuncRef(LUA_NOREF),
+            subscriptionRef(LUA_NOREF),
+            guaranteed(false),
+            partitionHash(0),
+            sessionDown(false),
+            probe_p(nullptr),
+            batchDeadline(0),
+            batchPending(false),
+            shedCount(0) {}
+
+        topicId_t                           topicId;
+        std::string                         topic;
+        std::string                         filename;
+        uint32_t                            timeout;
+        int                                 envRef;
+        int                                 messageFuncRef;
+        int                                 timerFuncRef;
+        int                                 batchFuncRef;
+        int                                 sessionDownFuncRef;
+        int                                 sessionUpFuncRef;
+        int                                 subscriptionRef;
+        bool                                guaranteed;
+
+        // See SubscriptionRegistry::hashSubscription(); picks the handles a
+        // session event is for
+        //
+        uint32_t                            partitionHash;
+        bool                                sessionDown;
+        Probe*                              probe_p;
+        TimeoutHandle                       timer;
+        TimeoutHandle                       probeTimer;
+        std::vector<solClient_opaqueMsg_pt> batch;
+        uint64_t                            batchDeadline;
+
+        // Set while the handle is in pendingBatches_m, which it stays in
+        // after a flush by size until flushExpiredBatches() takes it out
+        //
+        bool                                batchPending;
+        ShedPolicy                          shed;
+
+        // Messages seen while shedding, to sample 1 in shed.sample of them
+        //
+        uint32_t                            shedCount;
+    };
+
+    explicit MonitoringWorker(uint32_t index);
+    ~MonitoringWorker(void);
+
+    uint32_t getIndex(void) const { return index_m; }
+
+    // Queues a control entry, ahead of all messages. May be called from any
+    // thread.
+    //
+    void pushControl(const WorkEntry& entry)
+        { workLanes_m.push(entry, CONTROL_LANE); }
+
+    // Queues the MESSAGE_CONFLATED entry of a conflated subscription's slot.
+    // May be called from any thread.
+    //
+    void pushConflated(ConflationSlot* slot_p,
+                       topicId_t topicId,
+                       priority_t priority)
+    {
+        workLanes_m.push(WorkEntry::messageConflated(slot_p, topicId),
+                         WorkLanes::getLane(priority));
+    }
+
+    // Queues a received message, in the lane of its subscription's priority,
+    // unless the worker is over its bound and the overload policy drops it,
+    // in which case false is returned and the caller keeps ownership of the
+    // message. With the block policy, this
+    // waits for the worker to catch up instead. A message that is not
+    // droppable, such as a guaranteed message the broker already bounds with
+    // its window, is always queued. The message of a spilled subscription
+    // is never dropped, unless it cannot be written to disk. May be called
+    // from any thread.
+    //
+    bool pushMessage(solClient_opaqueMsg_pt msg_p,
+                     topicId_t topicId,
+                     priority_t priority,
+                     bool droppable = true,
+                     bool spill = false);
+
+    // Enqueues a TIMER_TICK unless one is already pending, so ticks never
+    // pile up behind messages. May be called from any thread.
+    //
+    void pushTimerTick(void);
+
+    // Number of messages handled so far; may be read from any thread
+    //
+    uint64_t getMessagesHandled(void) const
+        { return messagesHandled_m.load(std::memory_order_relaxed); }
+
+    // Number of timeouts expired so far and their total lateness in
+    // milliseconds; may be read from any thread
+    //
+    uint64_t getTimeoutsExpired(void) const
+        { return timeoutsExpired_m.load(std::memory_order_relaxed); }
+    uint64_t getTimeoutLatenessTotal(void) const
+        { return timeoutLatenessTotal_m.load(std::memory_order_relaxed); }
+
+    // Returns the maximum lateness of a timeout in milliseconds since the
+    // last call
+    //
+    uint64_t takeTimeoutLatenessMax(void)
+        { return timeoutLatenessMax_m.exchange(0, std::memory_order_relaxed); }
+
+    // Number of messages currently queued to the worker; may be read from any
+    // thread
+    //
+    uint64_t getQueuedMessages(void) const
+        { return queuedMessages_m.load(std::memory_order_relaxed); }
+
+    // Returns the number of messages dropped on arrival, dropped from the
+    // head of the queue and pushes that had to wait for room since the last
+    // call
+    //
+    uint64_t takeDroppedNewest(void)
+        { return droppedNewest_m.exchange(0, std::memory_order_relaxed); }
+    uint64_t takeDroppedOldest(void)
+        { return droppedOldest_m.exchange(0, std::memory_order_relaxed); }
+    uint64_t takeBlockedPushes(void)
+        { return blockedPushes_m.exchange(0, std::memory_order_relaxed); }
+
+    // Returns the number of messages spilled to disk and their payload
+    // bytes, the number read back and the number that could not be spilled
+    // since the last call
+    //
+    uint64_t takeSpilledMessages(void)
+        { return spilledMessages_m.exchange(0, std::memory_order_relaxed); }
+    uint64_t takeSpilledBytes(void)
+        { return spilledBytes_m.exchange(0, std::memory_order_relaxed); }
+    uint64_t takeReadBackMessages(void)
+        { return readBackMessages_m.exchange(0, std::memory_order_relaxed); }
+    uint64_t takeSpillFailures(void)
+        { return spillFailures_m.exchange(0, std::memory_order_relaxed); }
+
+    // Number of messages on disk; may be read from any thread
+    //
+    uint64_t getSpillBacklog(void) const
+        { return spillBacklog_m.load(std::memory_order_relaxed); }
+
+    // Returns the number of messages shed since the last call, by whether
+    // they were left out of a sample, too old or of a skipped subscription
+    //
+    uint64_t takeShedSampled(void)
+        { return shedSampled_m.exchange(0, std::memory_order_relaxed); }
+    uint64_t takeShedStale(void)
+        { return shedStale_m.exchange(0, std::memory_order_relaxed); }
+    uint64_t takeShedSkipped(void)
+        { return shedSkipped_m.exchange(0, std::memory_order_relaxed); }
+
+    // Logs the queueing delay of every lane since the last call; may be
+    // called from any thread
+    //
+    void reportLanes(void) { workLanes_m.report(index_m); }
+
+    void start(void);
+    void join(void);
+
+private:
+    returnCode_t run(void);
+
+    // The overflow to disk of a message lane
+    //
+    struct Spill
+    {
+        Spill(const std::string& prefix, size_t segmentSize) :
+            buffer(prefix, segmentSize),
+            active(false),
+            reading(false) {}
+
+        std::mutex  mutex;
+        SpillBuffer buffer;
+
+        // Set under the mutex from when SPILL_STARTED is queued until the
+        // worker has read the buffer back; only the worker reads it while
+        // reading is set
+        //
+        bool        active;
+        bool        reading;
+    };
+
+    bool queueMessage(solClient_opaqueMsg_pt msg_p,
+                      topicId_t topicId,
+                      uint32_t lane,
+                      bool droppable);
+    bool spillMessage(Spill& spill,
+                      solClient_opaqueMsg_pt msg_p,
+                      topicId_t topicId,
+                      uint32_t lane);
+    void handleWorkTypeSpillStarted(const WorkEntry& entry);
+
+    // Handles a batch of the messages read back from every lane spilling
+    //
+    void readSpills(void);
+
+    bool isOverloaded(uint64_t messages, uint64_t bytes) const
+    {
+        return messages > workQueueSize_m
+               || (workQueueMaxBytes_m != 0 && bytes > workQueueMaxBytes_m);
+    }
+
+    // Takes a popped message out of the queued counts; returns true if the
+    // drop oldest policy drops it instead of handling it
+    //
+    bool dequeueMessage(WorkEntry& entry);
+
+    // Updates shedder_m from the queueing delay after a drain
+    //
+    void updateShedding(void);
+
+    // Returns true if the message is to be shed by the subscription's policy
+    // while the worker is shedding
+    //
+    bool shedMessage(SubscriptionHandle& handle, solClient_opaqueMsg_pt msg_p);
+
+    void handleWorkTypeMessageReceived(WorkEntry& entry);
+    void handleWorkTypeMessageConflated(const WorkEntry& entry);
+    void handleWorkTypeSubscribe(const WorkEntry& entry);
+    void handleWorkTypeUnsubscribe(const WorkEntry& entry);
+    void handleWorkTypeTimerTick(const WorkEntry& entry);
+    // Session events stand for every subscription of a partition, which are
+    // handled in turn
+    //
+    void handleWorkTypeSessionDown(const WorkEntry& entry);
+    void handleWorkTypeSessionUp(const WorkEntry& entry);
+    void handleSessionDown(SubscriptionHandle& handle);
+    void handleSessionUp(SubscriptionHandle& handle, uint64_t outage);
+
+    // Called inline by timeoutWheel_m for every expired timeout: either a
+    // subscription's onTimer() timer or a timer added by its script
+    //
+    void handleTimeout(const TimeoutEvent& event) override;
+    void handleScriptTimeout(const TimeoutEvent& event);
+    void handleProbeTimeout(const TimeoutEvent& event);
+
+    // The timer library available to scripts as the global "timer" table:
+    // timer.after(ms, fn), timer.every(ms, fn), timer.cancel(id) and
+    // timer.now(). Timers belong to the subscription whose script added them;
+    // fn is called with the timer's id.
+    //
+    void registerTimerLib(void);
+    int addScriptTimer(lua_State* L, bool periodic);
+    int cancelScriptTimer(lua_State* L);
+    static int luaTimerAfter(lua_State* L);
+    static int luaTimerEvery(lua_State* L);
+    static int luaTimerCancel(lua_State* L);
+    static int luaTimerNow(lua_State* L);
+
+    // publish(topic, payload [, opts]), available to scripts as a global:
+    // queues a direct message to the Publisher and returns false if it could
+    // not, without ever waiting for the broker. The payload is a string or a
+    // payload buffer; opts may set correlationId.
+    //
+    void registerPublishLib(void);
+    int publishMessage(lua_State* L);
+    static int luaPublish(lua_State* L);
+
+    // shedding(), available to scripts as a global: returns whether the
+    // worker is shedding load and, for the subscription whose script calls
+    // it, 1 in how many of its messages the script sees: 1 while it sees them
+    // all, 0 while it skips them
+    //
+    void registerSheddingLib(void);
+    static int luaShedding(lua_State* L);
+
+    // The worker's current time in milliseconds. With the virtual clock, this
+    // is the time of the last message or tick it handled, not the latest time
+    // seen by the message source.
+    //
+    uint64_t getTime(void) const
+    {
+        return virtualClock_m ? timeoutWheel_m.getTime()
+                              : Clock::instance()->now();
+    }
+
+    // How long run() may block waiting for work before a batch or timeout is
+    // due, or microseconds::max() if nothing is due. With the virtual clock
+    // nothing is due until more work arrives.
+    //
+    std::chrono::microseconds getWaitTime(uint64_t now) const;
+
+    // Advances the virtual clock to the time of a message or tick. The wheel
+    // is created before any message has a time, so the first call moves it
+    // and the timeouts already added to that time rather than expiring every
+    // timeout between 0 and the first message.
+    //
+    void advanceVirtualTime(uint64_t time);
+
+    SubscriptionHandle* getHandle(topicId_t topicId);
+    void releaseHandle(SubscriptionHandle* handle_p);
+
+    void addToBatch(SubscriptionHandle& handle, solClient_opaqueMsg_pt msg_p);
+    void flushBatch(SubscriptionHandle& handle);
+    void flushExpiredBatches(void);
+
+    void addAck(const SubscriptionHandle& handle, solClient_opaqueMsg_pt msg_p);
+    void sendAcks(void);
+
+    uint32_t                         index_m;
+    bool                             virtualClock_m;
+    bool                             virtualStarted_m;
+    uint32_t                         workQueueSize_m;
+    uint32_t                         workQueueMaxBytes_m;
+    overloadPolicy_t                 overloadPolicy_m;
+    WorkLanes                        workLanes_m;
+    Spill*                           spills_mp[WORK_LANE_COUNT];
+    uint32_t                         spillHighWater_m;
+    uint32_t                         spillsReading_m;
+    LoadShedder                      shedder_m;
+    lua_State*                       luaState_mp;
+
+    // The subscription whose script is running, which timers added by the
+    // script belong to
+    //
+    topicId_t                        currentTopicId_m;
+    std::vector<SubscriptionHandle*> handlesById_m;
+    std::vector<SubscriptionHandle*> pendingBatches_m;
+    std::vector<AckEntry>            pendingAcks_m;
+    std::vector<LuaBuffer*>          payloadBuffers_m;
+    std::vector<int>                 payloadRefs_m;
+    std::vector<LuaMessage*>         messageObjects_m;
+    std::vector<int>                 messageRefs_m;
+    uint32_t                         batchMaxMessages_m;
+    uint32_t                         batchMaxWaitMs_m;
+    MessagePool                      publishPool_m;
+    TimeoutWheel                     timeoutWheel_m;
+    std::atomic<bool>                tickPending_m;
+    std::atomic<uint64_t>            messagesHandled_m;
+    std::atomic<uint64_t>            timeoutsExpired_m;
+    std::atomic<uint64_t>            timeoutLatenessTotal_m;
+    std::atomic<uint64_t>            timeoutLatenessMax_m;
+    std::atomic<uint64_t>            queuedMessages_m;
+    std::atomic<uint64_t>            queuedBytes_m;
+    std::atomic<uint64_t>            droppedNewest_m;
+    std::atomic<uint64_t>            droppedOldest_m;
+    std::atomic<uint64_t>            blockedPushes_m;
+    std::atomic<uint64_t>            spilledMessages_m;
+    std::atomic<uint64_t>            spilledBytes_m;
+    std::atomic<uint64_t>            readBackMessages_m;
+    std::atomic<uint64_t>            spillFailures_m;
+    std::atomic<uint64_t>            spillBacklog_m;
+    std::atomic<uint64_t>            shedSampled_m;
+    std::atomic<uint64_t>            shedStale_m;
+    std::atomic<uint64_t>            shedSkipped_m;
+    std::thread                      thread_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_MONITORING_WORKER_HPP_ */
@@ -0,0 +1,307 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_MPSC_RING_BUFFER_HPP_
+#define _TOPIC_MONITOR_MPSC_RING_BUFFER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace topicMonitor
+{
+
+const size_t CACHE_LINE_SIZE = 64;
+
+// Hint to the CPU that we are in a spin-wait loop
+//
+inline void cpuRelax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+// This class is a bounded lock-free multi-producer/single-consumer queue.
+//
+// The queue is an array of slots, each carrying a sequence number that tells
+// producers and the consumer whether the slot is free or holds a published
+// entry (see Dmitry Vyukov's bounded MPMC queue). Producers claim a slot with a
+// single compare-and-swap on the tail index. Since there is only ever one
+// consumer, the head index is a plain variable owned by the consumer thread.
+//
+// When the queue is empty, the consumer spins for a short while before parking
+// on a condition variable. Producers only touch the mutex when the consumer has
+// announced that it is parked, so the common case of a busy consumer never
+// takes a lock or makes a futex call.
+//
+// The capacity is rounded up to the next power of two.
+//
+template <class T>
+class MpscRingBuffer
+{
+public:
+    static const size_t DEFAULT_CAPACITY = 65536;
+    static const uint32_t SPIN_COUNT     = 4096;
+
+    explicit MpscRingBuffer(size_t capacity = DEFAULT_CAPACITY) :
+        tail_m(0),
+        head_m(0),
+        parked_m(false)
+    {
+        size_t size = 2;
+        while (size < capacity) { size <<= 1; }
+
+        mask_m = size - 1;
+        slots_mp = new Slot[size];
+        for (size_t i=0; i<size; i++)
+        {
+            slots_mp[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+    ~MpscRingBuffer(void) { delete[] slots_mp; }
+
+    MpscRingBuffer(const MpscRingBuffer&) = delete;
+    MpscRingBuffer& operator=(const MpscRingBuffer&) = delete;
+
+    // Enqueues an entry. Returns false if the queue is full.
+    //
+    // A caller that parks the consumer itself, rather than through popMany(),
+    // passes wake false and wakes it on its own; see WorkLanes.
+    //
+    bool tryPush(const T& entry, bool wake = true)
+    {
+        size_t pos = tail_m.load(std::memory_order_relaxed);
+        Slot* slot_p;
+
+        for (;;)
+        {
+            slot_p = &slots_mp[pos & mask_m];
+            size_t seq = slot_p->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+            if (diff == 0)
+            {
+                // Slot is free, try to claim it
+                //
+                if (tail_m.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // Slot still holds an entry from the previous lap; full
+                //
+                return false;
+            }
+            else
+            {
+                // Another producer claimed this slot, reload and retry
+                //
+                pos = tail_m.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot_p->value = entry;
+        slot_p->seq.store(pos + 1, std::memory_order_release);
+
+        if (wake) { wakeConsumer(); }
+        return true;
+    }
+
+    // Enqueues an entry, spinning while the queue is full. This applies
+    // backpressure to the producer instead of growing without bound.
+    //
+    // Must never be called from the consumer thread.
+    //
+    void push(const T& entry, bool wake = true)
+    {
+        for (uint32_t spins = 0; !tryPush(entry, wake); spins++)
+        {
+            if (spins < SPIN_COUNT) { cpuRelax(); }
+            else                    { std::this_thread::yield(); }
+        }
+    }
+
+    // Dequeues up to max entries without blocking. Returns the number of
+    // entries dequeued.
+    //
+    // Must only be called from the consumer thread.
+    //
+    size_t tryPopMany(T* entries_p, size_t max)
+    {
+        size_t count = 0;
+
+        size_t head = head_m.load(std::memory_order_relaxed);
+
+        while (count < max)
+        {
+            Slot* slot_p = &slots_mp[head & mask_m];
+            size_t seq = slot_p->seq.load(std::memory_order_acquire);
+            if (seq != head + 1) { break; }
+
+            entries_p[count++] = slot_p->value;
+            slot_p->seq.store(head + mask_m + 1, std::memory_order_release);
+            head++;
+        }
+
+        head_m.store(head, std::memory_order_relaxed);
+        return count;
+    }
+
+    // Dequeues up to max entries, blocking until at least one is available.
+    //
+    size_t popMany(T* entries_p, size_t max)
+    {
+        return popMany(entries_p, max, std::chrono::microseconds::max());
+    }
+
+    // Dequeues up to max entries, blocking until at least one is available or
+    // the timeout has passed. Returns 0 on timeout.
+    //
+    size_t popMany(T* entries_p, size_t max, std::chrono::microseconds timeout)
+    {
+        size_t count = tryPopMany(entries_p, max);
+        if (count != 0) { return count; }
+
+        // Spin phase: cheap if the producers are busy
+        //
+        for (uint32_t spins = 0; spins < SPIN_COUNT; spins++)
+        {
+            cpuRelax();
+            if (!empty()) { return tryPopMany(entries_p, max); }
+        }
+
+        // Park phase: announce that we are parked, then re-check for entries
+        // that were published before the announcement became visible. The
+        // fences pair with the one in wakeConsumer().
+        //
+        parked_m.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_m);
+            if (timeout == std::chrono::microseconds::max())
+            {
+                while (empty()) { cond_m.wait(lock); }
+            }
+            else
+            {
+                auto deadline = std::chrono::steady_clock::now() + timeout;
+                while (empty())
+                {
+                    if (cond_m.wait_until(lock, deadline)
+                            == std::cv_status::timeout)
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+
+        parked_m.store(false, std::memory_order_relaxed);
+
+        return tryPopMany(entries_p, max);
+    }
+
+    // Dequeues a single entry, blocking until one is available
+    //
+    T pop(void)
+    {
+        T entry;
+        popMany(&entry, 1);
+        return entry;
+    }
+
+    // Only meaningful when called from the consumer thread
+    //
+    bool empty(void) const
+    {
+        size_t head = head_m.load(std::memory_order_relaxed);
+        const Slot* slot_p = &slots_mp[head & mask_m];
+        return slot_p->seq.load(std::memory_order_acquire) != head + 1;
+    }
+
+    // Approximate number of entries in the queue
+    //
+    size_t size(void) const
+    {
+        size_t tail = tail_m.load(std::memory_order_relaxed);
+        size_t head = head_m.load(std::memory_order_relaxed);
+        return (tail > head)?(tail - head):0;
+    }
+
+    size_t capacity(void) const { return mask_m + 1; }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        T                   value;
+    };
+
+    void wakeConsumer(void)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (parked_m.load(std::memory_order_relaxed))
+        {
+            // Taking the mutex guarantees that the consumer is either waiting
+            // on the condition variable or has not yet checked empty().
+            //
+            { std::lock_guard<std::mutex> lock(mutex_m); }
+            cond_m.notify_one();
+        }
+    }
+
+    // The producer-owned and consumer-owned indices are padded onto separate
+    // cache lines so that they do not false-share. Explicit padding is used
+    // rather than alignas() since C++11 operator new ignores over-alignment.
+    //
+    Slot*                   slots_mp;
+    size_t                  mask_m;
+    char                    pad0_m[CACHE_LINE_SIZE];
+    std::atomic<size_t>     tail_m;
+    char                    pad1_m[CACHE_LINE_SIZE];
+    std::atomic<size_t>     head_m;
+    char                    pad2_m[CACHE_LINE_SIZE];
+    std::atomic<bool>       parked_m;
+    std::mutex              mutex_m;
+    std::condition_variable cond_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_MPSC_RING_BUFFER_HPP_ */
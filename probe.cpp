@@ -0,0 +1,334 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "probe.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <unistd.h>
+
+#include "log.hpp"
+
+namespace topicMonitor
+{
+
+std::mutex Probe::mutex_ms;
+std::vector<Probe*> Probe::probes_ms;
+
+// The payload of a probe. The instance tells the probes of this process, and
+// of this subscription, from others sent to the same topic.
+//
+static const char PROBE_MAGIC[8] = { 'T', 'M', 'P', 'R', 'O', 'B', 'E', '1' };
+
+struct ProbePayload
+{
+    char     magic[8];
+    uint64_t instance;
+    uint64_t seq;
+    uint64_t sentAt;
+};
+
+Probe::Probe(topicId_t topicId, const SubscriptionInfo& info) :
+    name_m(info.getTopic()),
+    topic_m(info.getProbeTopic()),
+    instance_m(((uint64_t)getpid() << 32) | topicId),
+    intervalMs_m(info.getProbeIntervalMs()),
+    timeoutUs_m((uint64_t)info.getProbeTimeoutMs() * 1000),
+    nextSeq_m(0),
+    sent_m(0),
+    received_m(0),
+    lost_m(0),
+    late_m(0),
+    lastReportSent_m(0),
+    lastReportReceived_m(0),
+    lastReportLost_m(0)
+{
+    // Enough slots for every probe that may be awaiting its echo
+    //
+    sentAt_m.assign(info.getProbeTimeoutMs() / intervalMs_m + 2, 0);
+
+    std::lock_guard<std::mutex> lock(mutex_ms);
+    probes_ms.push_back(this);
+}
+
+Probe::~Probe(void)
+{
+    std::lock_guard<std::mutex> lock(mutex_ms);
+    probes_ms.erase(std::remove(probes_ms.begin(), probes_ms.end(), this),
+                    probes_ms.end());
+}
+
+uint64_t
+Probe::nowUs(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void
+Probe::expire(uint64_t now)
+{
+    for (uint64_t& sentAt : sentAt_m)
+    {
+        if (sentAt != 0 && now - sentAt > timeoutUs_m)
+        {
+            sentAt = 0;
+            lost_m.store(lost_m.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+        }
+    }
+}
+
+returnCode_t
+Probe::fill(solClient_opaqueMsg_pt msg_p)
+{
+    uint64_t now = nowUs();
+    expire(now);
+
+    ProbePayload payload;
+    memcpy(payload.magic, PROBE_MAGIC, sizeof(payload.magic));
+    payload.instance = instance_m;
+    payload.seq = nextSeq_m;
+    payload.sentAt = now;
+
+    solClient_destination_t dest;
+    dest.destType = SOLCLIENT_TOPIC_DESTINATION;
+    dest.dest = topic_m.c_str();
+
+    if (solClient_msg_setDestination(msg_p, &dest, sizeof(dest))
+                != SOLCLIENT_OK
+            || solClient_msg_setDeliveryMode(msg_p,
+                                             SOLCLIENT_DELIVERY_MODE_DIRECT)
+                   != SOLCLIENT_OK
+            || solClient_msg_setBinaryAttachment(msg_p, &payload,
+                                                 sizeof(payload))
+                   != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "Could not build probe for topic '" << topic_m << "'");
+        return returnCode_t::FAILURE;
+    }
+
+    // A slot still in use means the timeout outlasts the slots; the older
+    // probe is counted lost
+    //
+    uint64_t& sentAt = sentAt_m[nextSeq_m % sentAt_m.size()];
+    if (sentAt != 0)
+    {
+        lost_m.store(lost_m.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+    }
+    sentAt = now;
+    nextSeq_m++;
+
+    sent_m.store(sent_m.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_relaxed);
+    return returnCode_t::SUCCESS;
+}
+
+bool
+Probe::handleEcho(const char* data_p, size_t size)
+{
+    ProbePayload payload;
+    if (size != sizeof(payload)) { return false; }
+
+    memcpy(&payload, data_p, sizeof(payload));
+    if (memcmp(payload.magic, PROBE_MAGIC, sizeof(payload.magic)) != 0)
+    {
+        return false;
+    }
+
+    // Probes of other instances are consumed but not counted
+    //
+    if (payload.instance != instance_m) { return true; }
+
+    // Echoes of probes already counted lost, or echoed twice, are late
+    //
+    uint64_t& sentAt = sentAt_m[payload.seq % sentAt_m.size()];
+    if (payload.seq >= nextSeq_m
+            || payload.seq + sentAt_m.size() < nextSeq_m
+            || sentAt != payload.sentAt)
+    {
+        late_m.store(late_m.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+        return true;
+    }
+
+    roundTrip_m.record(nowUs() - sentAt);
+    sentAt = 0;
+    received_m.store(received_m.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+    return true;
+}
+
+void
+Probe::getStats(ProbeStats& stats) const
+{
+    stats.sent = sent_m.load(std::memory_order_relaxed);
+    stats.received = received_m.load(std::memory_order_relaxed);
+    stats.lost = lost_m.load(std::memory_order_relaxed);
+    stats.late = late_m.load(std::memory_order_relaxed);
+    stats.min = roundTrip_m.getMin();
+    stats.p50 = roundTrip_m.getPercentile(50.0);
+    stats.p90 = roundTrip_m.getPercentile(90.0);
+    stats.p99 = roundTrip_m.getPercentile(99.0);
+    stats.p999 = roundTrip_m.getPercentile(99.9);
+    stats.max = roundTrip_m.getMax();
+}
+
+bool
+Probe::getStats(const std::string& name, ProbeStats& stats)
+{
+    std::lock_guard<std::mutex> lock(mutex_ms);
+
+    for (Probe* probe_p : probes_ms)
+    {
+        if (probe_p->name_m == name)
+        {
+            probe_p->getStats(stats);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+Probe::report(void)
+{
+    uint64_t sent = sent_m.load(std::memory_order_relaxed);
+    uint64_t received = received_m.load(std::memory_order_relaxed);
+    uint64_t lost = lost_m.load(std::memory_order_relaxed);
+
+    LOG(INFO, "Probe '" << name_m << "' sent " << sent - lastReportSent_m
+              << ", received " << received - lastReportReceived_m
+              << ", lost " << lost - lastReportLost_m << "; round trip p50 "
+              << roundTrip_m.getPercentile(50.0, &lastReport_m) << "us, p99 "
+              << roundTrip_m.getPercentile(99.0, &lastReport_m)
+              << "us, p99.9 "
+              << roundTrip_m.getPercentile(99.9, &lastReport_m)
+              << "us, max "
+              << roundTrip_m.getPercentile(100.0, &lastReport_m) << "us");
+
+    lastReport_m.copyFrom(roundTrip_m);
+    lastReportSent_m = sent;
+    lastReportReceived_m = received;
+    lastReportLost_m = lost;
+}
+
+void
+Probe::reportAll(void)
+{
+    std::lock_guard<std::mutex> lock(mutex_ms);
+
+    for (Probe* probe_p : probes_ms)
+    {
+        probe_p->report();
+    }
+}
+
+void
+Probe::registerLib(lua_State* L)
+{
+    static const luaL_Reg functions[] =
+    {
+        { "stats",      luaStats },
+        { "percentile", luaPercentile },
+        { nullptr,      nullptr }
+    };
+
+    luaL_newlib(L, functions);
+    lua_setglobal(L, "probe");
+}
+
+int
+Probe::luaStats(lua_State* L)
+{
+    ProbeStats stats;
+    if (!getStats(luaL_checkstring(L, 1), stats))
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    const struct { const char* name_p; uint64_t value; } fields[] =
+    {
+        { "sent",     stats.sent },
+        { "received", stats.received },
+        { "lost",     stats.lost },
+        { "late",     stats.late },
+        { "min",      stats.min },
+        { "p50",      stats.p50 },
+        { "p90",      stats.p90 },
+        { "p99",      stats.p99 },
+        { "p999",     stats.p999 },
+        { "max",      stats.max },
+    };
+
+    lua_createtable(L, 0, sizeof(fields) / sizeof(fields[0]));
+    for (const auto& field : fields)
+    {
+        lua_pushnumber(L, field.value);
+        lua_setfield(L, -2, field.name_p);
+    }
+
+    return 1;
+}
+
+int
+Probe::luaPercentile(lua_State* L)
+{
+    std::string name = luaL_checkstring(L, 1);
+    lua_Number percentile = luaL_checknumber(L, 2);
+    luaL_argcheck(L, percentile >= 0 && percentile <= 100, 2,
+                  "percentile out of range");
+
+    // The lock is released before pushing the result, which may raise a Lua
+    // error
+    //
+    bool found = false;
+    uint64_t value = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_ms);
+        for (Probe* probe_p : probes_ms)
+        {
+            if (probe_p->name_m == name)
+            {
+                value = probe_p->roundTrip_m.getPercentile(percentile);
+                found = true;
+                break;
+            }
+        }
+    }
+
+    if (found) { lua_pushnumber(L, value); }
+    else       { lua_pushnil(L); }
+    return 1;
+}
+
+} /* namespace topicMonitor */
@@ -0,0 +1,152 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_PROBE_HPP_
+#define _TOPIC_MONITOR_PROBE_HPP_
+
+#include <atomic>
+#include <lua5.2/lua.hpp>
+#include <mutex>
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+#include "histogram.hpp"
+
+namespace topicMonitor
+{
+
+// Round trip statistics of a probe, with latencies in microseconds
+//
+struct ProbeStats
+{
+    uint64_t sent;
+    uint64_t received;
+    uint64_t lost;
+    uint64_t late;
+    uint64_t min;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+};
+
+// An active round trip probe, set up by the probe key of a subscription (see
+// SubscriptionInfo::setProbe()). The subscription's worker publishes a probe
+// every interval through the Publisher, and the probe records the time until
+// it comes back on the subscription's topic, either because the subscription
+// receives its own probe topic or because a responder echoes the payload.
+//
+// A probe is only ever used by the worker that owns it; its statistics may be
+// read from any thread, by name, through getStats() or, from scripts,
+// through the global probe table:
+//
+// * probe.stats(name): a table with sent, received, lost, late, min, p50, p90,
+//   p99, p999 and max, latencies in microseconds, or nil if there is no such
+//   probe
+// * probe.percentile(name, p): the round trip latency at percentile p
+//
+class Probe
+{
+public:
+    Probe(topicId_t topicId, const SubscriptionInfo& info);
+    ~Probe(void);
+
+    Probe(const Probe&) = delete;
+    Probe& operator=(const Probe&) = delete;
+
+    uint32_t getIntervalMs(void) const { return intervalMs_m; }
+
+    // Counts the probes older than the timeout as lost, then makes msg_p the
+    // next probe
+    //
+    returnCode_t fill(solClient_opaqueMsg_pt msg_p);
+
+    // Records the round trip of a received echo. Returns false if the
+    // payload is not a probe of this process, for the script to handle.
+    //
+    bool handleEcho(const char* data_p, size_t size);
+
+    // Copies the statistics of the named probe to stats. Returns false if
+    // there is no such probe.
+    //
+    static bool getStats(const std::string& name, ProbeStats& stats);
+
+    // Logs the statistics of every probe since the last call
+    //
+    static void reportAll(void);
+
+    // Registers the global probe table; must be called once per lua_State
+    //
+    static void registerLib(lua_State* L);
+
+private:
+    static uint64_t nowUs(void);
+
+    void expire(uint64_t now);
+    void getStats(ProbeStats& stats) const;
+    void report(void);
+
+    static int luaStats(lua_State* L);
+    static int luaPercentile(lua_State* L);
+
+    std::string           name_m;
+    std::string           topic_m;
+    uint64_t              instance_m;
+    uint32_t              intervalMs_m;
+    uint64_t              timeoutUs_m;
+    uint64_t              nextSeq_m;
+
+    // Send time of the probes awaiting their echo, by sequence number modulo
+    // the size, 0 once echoed or lost
+    //
+    std::vector<uint64_t> sentAt_m;
+
+    std::atomic<uint64_t> sent_m;
+    std::atomic<uint64_t> received_m;
+    std::atomic<uint64_t> lost_m;
+    std::atomic<uint64_t> late_m;
+    Histogram             roundTrip_m;
+
+    // Only used by reportAll()
+    //
+    Histogram             lastReport_m;
+    uint64_t              lastReportSent_m;
+    uint64_t              lastReportReceived_m;
+    uint64_t              lastReportLost_m;
+
+    static std::mutex          mutex_ms;
+    static std::vector<Probe*> probes_ms;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_PROBE_HPP_ */
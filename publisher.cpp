@@ -0,0 +1,245 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "publisher.hpp"
+
+#include <chrono>
+
+#include "config.hpp"
+#include "log.hpp"
+#include "transport.hpp"
+
+namespace topicMonitor
+{
+
+MessagePool::MessagePool(size_t size) :
+    returned_m(size)
+{
+    free_m.reserve(size);
+    for (size_t i=0; i<size; i++)
+    {
+        solClient_opaqueMsg_pt msg_p;
+        if (solClient_msg_alloc(&msg_p) != SOLCLIENT_OK)
+        {
+            LOG(ERROR, "Could not allocate message " << i << " of pool");
+            break;
+        }
+        free_m.push_back(msg_p);
+    }
+}
+
+MessagePool::~MessagePool(void)
+{
+    // Messages still queued when the pool goes away are leaked rather than
+    // freed under the Publisher
+    //
+    solClient_opaqueMsg_pt msg_p;
+    while (returned_m.tryPopMany(&msg_p, 1) != 0) { free_m.push_back(msg_p); }
+
+    for (solClient_opaqueMsg_pt free_p : free_m)
+    {
+        solClient_msg_free(&free_p);
+    }
+}
+
+solClient_opaqueMsg_pt
+MessagePool::acquire(void)
+{
+    if (free_m.empty())
+    {
+        // Takes back every message sent since the pool last ran dry. free_m
+        // never holds more than the pool size, so this does not allocate.
+        //
+        solClient_opaqueMsg_pt msgs[WORK_QUEUE_DRAIN_SIZE];
+        size_t count;
+        while ((count = returned_m.tryPopMany(msgs, WORK_QUEUE_DRAIN_SIZE))
+                   != 0)
+        {
+            free_m.insert(free_m.end(), msgs, msgs + count);
+        }
+
+        if (free_m.empty()) { return nullptr; }
+    }
+
+    solClient_opaqueMsg_pt msg_p = free_m.back();
+    free_m.pop_back();
+    return msg_p;
+}
+
+void
+MessagePool::putBack(solClient_opaqueMsg_pt msg_p)
+{
+    solClient_msg_reset(msg_p);
+    free_m.push_back(msg_p);
+}
+
+void
+MessagePool::release(solClient_opaqueMsg_pt msg_p)
+{
+    // The ring holds as many messages as the pool, so this never spins
+    //
+    solClient_msg_reset(msg_p);
+    returned_m.push(msg_p);
+}
+
+Publisher* Publisher::instance_mps = nullptr;
+
+Publisher::Publisher(void) :
+    queue_m(Config::instance()->getPublishQueueSize()),
+    published_m(0),
+    failed_m(0),
+    dropped_m(0),
+    batches_m(0),
+    delayTotal_m(0),
+    delayMax_m(0),
+    lastReportPublished_m(0),
+    lastReportFailed_m(0),
+    lastReportDropped_m(0),
+    lastReportBatches_m(0),
+    lastReportDelay_m(0)
+{
+}
+
+Publisher::~Publisher(void)
+{
+    if (thread_m.joinable()) { thread_m.detach(); }
+}
+
+uint64_t
+Publisher::nowUs(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void
+Publisher::start(void)
+{
+    thread_m = std::thread([this]() { run(); });
+    LOG(INFO, "publisher started (" << queue_m.capacity()
+              << " queued messages at most)");
+}
+
+bool
+Publisher::push(solClient_opaqueMsg_pt msg_p, MessagePool* pool_p)
+{
+    Entry entry;
+    entry.msg_p = msg_p;
+    entry.pool_p = pool_p;
+    entry.queued = nowUs();
+
+    if (!queue_m.tryPush(entry))
+    {
+        countDropped();
+        return false;
+    }
+
+    return true;
+}
+
+void
+Publisher::run(void)
+{
+    Entry entries[MAX_BATCH];
+    solClient_opaqueMsg_pt msgs[MAX_BATCH];
+
+    for (;;)
+    {
+        size_t count = queue_m.popMany(entries, MAX_BATCH);
+
+        uint64_t now = nowUs();
+        uint64_t delayMax = delayMax_m.load(std::memory_order_relaxed);
+        uint64_t delayTotal = 0;
+        for (size_t i=0; i<count; i++)
+        {
+            msgs[i] = entries[i].msg_p;
+
+            uint64_t delay = now - entries[i].queued;
+            delayTotal += delay;
+            if (delay > delayMax) { delayMax = delay; }
+        }
+
+        // Blocks while the transport cannot take more; only this thread waits
+        //
+        size_t sent = Transport::instance()->publishMultiple(msgs, count);
+
+        for (size_t i=0; i<count; i++)
+        {
+            entries[i].pool_p->release(entries[i].msg_p);
+        }
+
+        // Only this thread writes the counters, except dropped_m
+        //
+        published_m.store(published_m.load(std::memory_order_relaxed) + sent,
+                          std::memory_order_relaxed);
+        failed_m.store(failed_m.load(std::memory_order_relaxed)
+                           + (count - sent),
+                       std::memory_order_relaxed);
+        batches_m.store(batches_m.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+        delayTotal_m.store(delayTotal_m.load(std::memory_order_relaxed)
+                               + delayTotal,
+                           std::memory_order_relaxed);
+        delayMax_m.store(delayMax, std::memory_order_relaxed);
+    }
+}
+
+void
+Publisher::reportStatistics(void)
+{
+    uint64_t published = published_m.load(std::memory_order_relaxed);
+    uint64_t failed = failed_m.load(std::memory_order_relaxed);
+    uint64_t dropped = dropped_m.load(std::memory_order_relaxed);
+    uint64_t batches = batches_m.load(std::memory_order_relaxed);
+    uint64_t delay = delayTotal_m.load(std::memory_order_relaxed);
+    uint64_t delayMax = delayMax_m.exchange(0, std::memory_order_relaxed);
+
+    uint64_t deltaPublished = published - lastReportPublished_m;
+    uint64_t deltaFailed = failed - lastReportFailed_m;
+    uint64_t deltaDropped = dropped - lastReportDropped_m;
+    uint64_t deltaBatches = batches - lastReportBatches_m;
+    uint64_t deltaSent = deltaPublished + deltaFailed;
+
+    if (deltaSent != 0 || deltaDropped != 0)
+    {
+        LOG(INFO, "Published " << deltaPublished << " messages in "
+                  << deltaBatches << " batches, " << deltaFailed
+                  << " failed, " << deltaDropped << " dropped; queueing "
+                  << "delay average " << (deltaSent
+                      ? (double)(delay - lastReportDelay_m) / deltaSent : 0.0)
+                  << "us, max " << delayMax << "us");
+    }
+
+    lastReportPublished_m = published;
+    lastReportFailed_m = failed;
+    lastReportDropped_m = dropped;
+    lastReportBatches_m = batches;
+    lastReportDelay_m = delay;
+}
+
+} /* namespace topicMonitor */
@@ -0,0 +1,159 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_PUBLISHER_HPP_
+#define _TOPIC_MONITOR_PUBLISHER_HPP_
+
+#include <atomic>
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "mpscRingBuffer.hpp"
+
+namespace topicMonitor
+{
+
+// A fixed set of messages owned by one worker, which scripts fill and
+// publish. Messages are allocated up front and handed back by the Publisher
+// once sent, so publishing never allocates a message.
+//
+// acquire() is only called on the owning worker's thread and release() only on
+// the Publisher's thread; the returned messages cross over through an
+// MpscRingBuffer, so neither side locks.
+//
+class MessagePool
+{
+public:
+    explicit MessagePool(size_t size);
+    ~MessagePool(void);
+
+    MessagePool(const MessagePool&) = delete;
+    MessagePool& operator=(const MessagePool&) = delete;
+
+    // Returns an empty message, or nullptr if all of them are in flight
+    //
+    solClient_opaqueMsg_pt acquire(void);
+
+    // Hands back a message that was never queued; owning worker only
+    //
+    void putBack(solClient_opaqueMsg_pt msg_p);
+
+    // Hands back a message once sent; Publisher thread only
+    //
+    void release(solClient_opaqueMsg_pt msg_p);
+
+private:
+    std::vector<solClient_opaqueMsg_pt>    free_m;
+    MpscRingBuffer<solClient_opaqueMsg_pt> returned_m;
+};
+
+// Sends the messages published by scripts, on its own thread, so a script
+// never waits for the broker.
+//
+// Workers queue messages without blocking; a message that does not fit in the
+// queue is dropped and publish() returns false to the script. The Publisher
+// thread drains the queue in batches of up to
+// SOLCLIENT_SESSION_SEND_MULTIPLE_LIMIT messages, each sent with a single
+// Transport::publishMultiple() call.
+//
+class Publisher
+{
+public:
+    static Publisher* instance(void)
+    {
+        if (instance_mps == nullptr)
+        {
+            instance_mps = new Publisher();
+        }
+
+        return instance_mps;
+    }
+    ~Publisher(void);
+
+    // Starts the Publisher thread; messages are queued but not sent before
+    //
+    void start(void);
+
+    // Queues msg_p, taken from pool_p, to be sent. Returns false, leaving the
+    // message to the caller, if the queue is full. May be called from any
+    // thread.
+    //
+    bool push(solClient_opaqueMsg_pt msg_p, MessagePool* pool_p);
+
+    // Counts a message a script could not publish since its pool was empty
+    //
+    void countDropped(void)
+        { dropped_m.fetch_add(1, std::memory_order_relaxed); }
+
+    // Called by MonitoringThread every report interval to log the publish
+    // rate and how long messages waited in the queue
+    //
+    void reportStatistics(void);
+
+private:
+    Publisher(void);
+
+    struct Entry
+    {
+        solClient_opaqueMsg_pt msg_p;
+        MessagePool*           pool_p;
+        uint64_t               queued;  // In microseconds, steady clock
+    };
+
+    static const size_t MAX_BATCH = SOLCLIENT_SESSION_SEND_MULTIPLE_LIMIT;
+
+    static uint64_t nowUs(void);
+
+    void run(void);
+
+    static Publisher*     instance_mps;
+    MpscRingBuffer<Entry> queue_m;
+    std::thread           thread_m;
+
+    // Written by the Publisher thread only, except dropped_m
+    //
+    std::atomic<uint64_t> published_m;
+    std::atomic<uint64_t> failed_m;
+    std::atomic<uint64_t> dropped_m;
+    std::atomic<uint64_t> batches_m;
+    std::atomic<uint64_t> delayTotal_m;
+    std::atomic<uint64_t> delayMax_m;
+
+    uint64_t              lastReportPublished_m;
+    uint64_t              lastReportFailed_m;
+    uint64_t              lastReportDropped_m;
+    uint64_t              lastReportBatches_m;
+    uint64_t              lastReportDelay_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_PUBLISHER_HPP_ */
@@ -0,0 +1,214 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "replayTransport.hpp"
+
+#include <algorithm>
+
+#include "log.hpp"
+#include "monitoringThread.hpp"
+
+namespace topicMonitor
+{
+
+ReplayTransport::ReplayTransport(void) :
+    config_m(Config::instance()->getReplayConfig()),
+    connected_m(false),
+    timerStarted_m(false)
+{
+    // solClient is still needed to allocate messages
+    //
+    if (solClient_initialize(SOLCLIENT_LOG_DEFAULT_FILTER, nullptr)
+            != SOLCLIENT_OK)
+        LOG(FATAL, "solClient initialization failed");
+}
+
+ReplayTransport::~ReplayTransport(void)
+{
+    disconnect();
+
+    if (solClient_cleanup() != SOLCLIENT_OK)
+        LOG(FATAL, "solClient cleanup failed");
+}
+
+returnCode_t
+ReplayTransport::connect(void)
+{
+    if (connected_m.load()) { return returnCode_t::NOTHING_TO_DO; }
+
+    if (reader_m.open(config_m.filename) != returnCode_t::SUCCESS)
+    {
+        return returnCode_t::FAILURE;
+    }
+
+    connected_m.store(true);
+    thread_m = std::thread(&ReplayTransport::run, this);
+
+    LOG(INFO, "replayTransport replaying '" << config_m.filename << "' at "
+              << (config_m.speed == 0 ? "full speed"
+                  : std::to_string(config_m.speed) + "x"));
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+ReplayTransport::disconnect(void)
+{
+    if (!connected_m.exchange(false)) { return returnCode_t::NOTHING_TO_DO; }
+
+    if (thread_m.joinable()) { thread_m.join(); }
+    reader_m.close();
+
+    LOG(INFO, "replayTransport disconnected");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+ReplayTransport::topicSubscribe(std::string topic)
+{
+    LOG(INFO, "replayTransport subscribed to topic '" << topic << "'");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+ReplayTransport::topicUnsubscribe(std::string topic)
+{
+    LOG(INFO, "replayTransport unsubscribed from topic '" << topic << "'");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+ReplayTransport::topicSubscribeAsync(std::string topic, topicId_t topicId)
+{
+    // There is no broker to wait for
+    //
+    MonitoringThread::instance()->confirmSubscription(topicId, true);
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+ReplayTransport::startTimer(void)
+{
+    if (timerStarted_m.exchange(true)) { return returnCode_t::NOTHING_TO_DO; }
+
+    LOG(INFO, "replayTransport timer started");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+ReplayTransport::stopTimer(void)
+{
+    if (!timerStarted_m.exchange(false)) { return returnCode_t::NOTHING_TO_DO; }
+
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+ReplayTransport::publish(solClient_opaqueMsg_pt msg_p)
+{
+    return returnCode_t::SUCCESS;
+}
+
+void
+ReplayTransport::pushTimerTicks(void)
+{
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+
+    while (now >= nextTick_m)
+    {
+        if (timerStarted_m.load(std::memory_order_relaxed))
+        {
+            MonitoringThread::instance()->pushTimerTick();
+        }
+        nextTick_m += std::chrono::seconds(1);
+    }
+}
+
+void
+ReplayTransport::run(void)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::time_point start = Clock::now();
+    nextTick_m = start + std::chrono::seconds(1);
+
+    uint64_t replayed = 0;
+    int64_t firstTimestamp = 0;
+
+    CaptureRecord record;
+    while (connected_m.load(std::memory_order_relaxed)
+               && reader_m.next(record))
+    {
+        // Waits until the record is due, relative to the first one
+        //
+        if (config_m.speed != 0)
+        {
+            if (replayed == 0)
+            {
+                firstTimestamp = record.header_p->rcvTimestamp;
+            }
+
+            std::chrono::microseconds offset(static_cast<int64_t>(
+                (record.header_p->rcvTimestamp - firstTimestamp) * 1000
+                    / config_m.speed));
+            Clock::time_point due = start + offset;
+
+            while (connected_m.load(std::memory_order_relaxed)
+                       && Clock::now() < due)
+            {
+                std::this_thread::sleep_until(std::min(due, nextTick_m));
+                pushTimerTicks();
+            }
+        }
+
+        solClient_opaqueMsg_pt msg_p = createCaptureMessage(record);
+        if (msg_p != nullptr
+                && !MonitoringThread::instance()->pushMessage(msg_p))
+        {
+            solClient_msg_free(&msg_p);
+        }
+
+        replayed++;
+        if ((replayed & 1023) == 0) { pushTimerTicks(); }
+    }
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start)
+                         .count();
+    LOG(INFO, "replayTransport replayed " << replayed << " messages in "
+              << seconds << "s");
+
+    // Keeps the timer going once the capture is exhausted
+    //
+    while (connected_m.load(std::memory_order_relaxed))
+    {
+        std::this_thread::sleep_until(nextTick_m);
+        pushTimerTicks();
+    }
+}
+
+} /* namespace topicMonitor */
@@ -0,0 +1,98 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_REPLAY_TRANSPORT_HPP_
+#define _TOPIC_MONITOR_REPLAY_TRANSPORT_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+#include <string>
+#include <thread>
+
+#include "captureFile.hpp"
+#include "common.hpp"
+#include "config.hpp"
+#include "transport.hpp"
+
+namespace topicMonitor
+{
+
+// A Transport that feeds the messages of a capture file (see CaptureWriter)
+// back into the pipeline, paced by their receive timestamps: in real time, at
+// ReplayConfig::speed times real time, or as fast as possible with a speed of
+// 0. Like MockTransport, it pushes a timer tick every second once the timer
+// is started.
+//
+// Timers run on the monotonic clock unless virtualClock is set, so a replay
+// faster than real time should use the virtual clock for timers to keep pace
+// with the messages. Replayed messages cannot carry a receive timestamp; a
+// message captured without a sender timestamp is given its capture time as
+// one, so the virtual clock follows the capture.
+//
+class ReplayTransport : public Transport
+{
+public:
+    ~ReplayTransport(void);
+
+    returnCode_t connect(void) override;
+    returnCode_t disconnect(void) override;
+
+    returnCode_t topicSubscribe(std::string topic) override;
+    returnCode_t topicUnsubscribe(std::string topic) override;
+    returnCode_t topicSubscribeAsync(std::string topic,
+                                     topicId_t topicId) override;
+
+    returnCode_t startTimer(void) override;
+    returnCode_t stopTimer(void) override;
+
+    // Published messages go nowhere during a replay
+    //
+    returnCode_t publish(solClient_opaqueMsg_pt msg_p) override;
+
+private:
+    friend class Transport;
+
+    ReplayTransport(void);
+
+    void run(void);
+    void pushTimerTicks(void);
+
+    ReplayConfig                          config_m;
+    CaptureReader                         reader_m;
+    std::chrono::steady_clock::time_point nextTick_m;
+    std::atomic<bool>                     connected_m;
+    std::atomic<bool>                     timerStarted_m;
+    std::thread                           thread_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_REPLAY_TRANSPORT_HPP_ */
@@ -0,0 +1,188 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "solClientFlow.hpp"
+
+#include <algorithm>
+
+#include "log.hpp"
+#include "monitoringThread.hpp"
+#include "subscriptionRegistry.hpp"
+
+namespace topicMonitor
+{
+
+const char* const SolClientFlow::ACK_THRESHOLD = "60";
+const char* const SolClientFlow::ACK_TIMER_MS  = "20";
+
+// The largest window solClient accepts
+//
+static const uint32_t MAX_WINDOW_SIZE = 255;
+
+SolClientFlow::SolClientFlow(topicId_t topicId, const std::string& queue) :
+    topicId_m(topicId),
+    priority_m(priority_t::NORMAL),
+    queue_m(queue),
+    flow_mp(nullptr),
+    messagesReceived_m(0),
+    messagesAcknowledged_m(0)
+{
+    SubscriptionInfo info;
+    if (SubscriptionRegistry::instance()->get(topicId, info))
+    {
+        priority_m = info.getPriority();
+    }
+}
+
+SolClientFlow::~SolClientFlow(void)
+{
+    if (flow_mp != nullptr && solClient_flow_destroy(&flow_mp) != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "solClient flow destruction failed for queue '" << queue_m
+                   << "'");
+    }
+}
+
+solClient_rxMsgCallback_returnCode_t
+SolClientFlow::messageReceiveCallback(solClient_opaqueFlow_pt flow_p,
+                                      solClient_opaqueMsg_pt msg_p,
+                                      void* user_p)
+{
+    SolClientFlow* flow = (SolClientFlow*)user_p;
+
+    // Only this context thread writes the counter
+    //
+    flow->messagesReceived_m.store(
+        flow->messagesReceived_m.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+
+    // The worker frees the message once it has acknowledged it
+    //
+    MonitoringThread::instance()->pushFlowMessage(msg_p, flow->topicId_m,
+                                                  flow->priority_m);
+    return SOLCLIENT_CALLBACK_TAKE_MSG;
+}
+
+void
+SolClientFlow::eventCallback(solClient_opaqueFlow_pt flow_p,
+                             solClient_flow_eventCallbackInfo_pt eventInfo_p,
+                             void* user_p)
+{
+    SolClientFlow* flow = (SolClientFlow*)user_p;
+
+    LOG(INFO, "solClient flow for queue '" << flow->queue_m << "': "
+              << solClient_flow_eventToString(eventInfo_p->flowEvent)
+              << (eventInfo_p->info_p ? " (" : "")
+              << (eventInfo_p->info_p ? eventInfo_p->info_p : "")
+              << (eventInfo_p->info_p ? ")" : ""));
+}
+
+returnCode_t
+SolClientFlow::create(solClient_opaqueSession_pt session_p,
+                      uint32_t maxUnacked)
+{
+    solClient_returnCode_t rc;
+
+    if (maxUnacked == 0) { maxUnacked = DEFAULT_MAX_UNACKED; }
+
+    solClient_flow_createFuncInfo_t flowFuncInfo =
+        SOLCLIENT_FLOW_CREATEFUNC_INITIALIZER;
+
+    flowFuncInfo.rxMsgInfo.callback_p = messageReceiveCallback;
+    flowFuncInfo.rxMsgInfo.user_p = this;
+    flowFuncInfo.eventInfo.callback_p = eventCallback;
+    flowFuncInfo.eventInfo.user_p = this;
+
+    // The window bounds how many messages are on the wire, maxUnacked how
+    // many the broker lets the flow hold without acknowledging them
+    //
+    std::string windowSize = std::to_string(std::min(maxUnacked,
+                                                     MAX_WINDOW_SIZE));
+    std::string maxUnackedValue = std::to_string(maxUnacked);
+
+    int propIndex = 0;
+    const char* flowProps[20] = {0};
+    flowProps[propIndex++] = SOLCLIENT_FLOW_PROP_BIND_BLOCKING;
+    flowProps[propIndex++] = SOLCLIENT_PROP_ENABLE_VAL;
+
+    flowProps[propIndex++] = SOLCLIENT_FLOW_PROP_BIND_ENTITY_ID;
+    flowProps[propIndex++] = SOLCLIENT_FLOW_PROP_BIND_ENTITY_QUEUE;
+
+    flowProps[propIndex++] = SOLCLIENT_FLOW_PROP_BIND_NAME;
+    flowProps[propIndex++] = queue_m.c_str();
+
+    flowProps[propIndex++] = SOLCLIENT_FLOW_PROP_ACKMODE;
+    flowProps[propIndex++] = SOLCLIENT_FLOW_PROP_ACKMODE_CLIENT;
+
+    flowProps[propIndex++] = SOLCLIENT_FLOW_PROP_WINDOWSIZE;
+    flowProps[propIndex++] = windowSize.c_str();
+
+    flowProps[propIndex++] = SOLCLIENT_FLOW_PROP_MAX_UNACKED_MESSAGES;
+    flowProps[propIndex++] = maxUnackedValue.c_str();
+
+    flowProps[propIndex++] = SOLCLIENT_FLOW_PROP_ACK_THRESHOLD;
+    flowProps[propIndex++] = ACK_THRESHOLD;
+
+    flowProps[propIndex++] = SOLCLIENT_FLOW_PROP_ACK_TIMER_MS;
+    flowProps[propIndex++] = ACK_TIMER_MS;
+
+    rc = solClient_session_createFlow(
+            (char **)flowProps,
+            session_p,
+            &flow_mp,
+            &flowFuncInfo,
+            sizeof(flowFuncInfo));
+    if (rc != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "solClient could not bind to queue '" << queue_m << "'");
+        flow_mp = nullptr;
+        return returnCode_t::FAILURE;
+    }
+
+    LOG(INFO, "solClient bound to queue '" << queue_m << "' ("
+              << maxUnacked << " unacknowledged messages at most)");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+SolClientFlow::acknowledge(solClient_msgId_t msgId)
+{
+    if (flow_mp == nullptr) { return returnCode_t::FAILURE; }
+
+    if (solClient_flow_sendAck(flow_mp, msgId) != SOLCLIENT_OK)
+    {
+        LOG(WARN, "solClient could not acknowledge message " << msgId
+                  << " on queue '" << queue_m << "'");
+        return returnCode_t::FAILURE;
+    }
+
+    messagesAcknowledged_m.fetch_add(1, std::memory_order_relaxed);
+    return returnCode_t::SUCCESS;
+}
+
+} /* namespace topicMonitor */
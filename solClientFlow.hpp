@@ -0,0 +1,105 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_SOLCLIENT_FLOW_HPP_
+#define _TOPIC_MONITOR_SOLCLIENT_FLOW_HPP_
+
+#include <atomic>
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+#include <string>
+
+#include "common.hpp"
+
+namespace topicMonitor
+{
+
+// A guaranteed flow consuming a queue on behalf of one subscription. Its
+// messages go straight to the subscription's worker, which acknowledges them
+// once the script has handled them.
+//
+// The broker sends at most maxUnacked messages the flow has not acknowledged,
+// so a slow script holds messages back in the queue rather than in memory.
+// Acknowledgements are sent by solClient in batches, once ACK_THRESHOLD
+// percent of the window is acknowledged or every ACK_TIMER_MS.
+//
+class SolClientFlow
+{
+public:
+    static const uint32_t DEFAULT_MAX_UNACKED = 1024;
+
+    SolClientFlow(topicId_t topicId, const std::string& queue);
+    ~SolClientFlow(void);
+
+    SolClientFlow(const SolClientFlow&) = delete;
+    SolClientFlow& operator=(const SolClientFlow&) = delete;
+
+    // Binds to the queue; blocks until the broker accepts or refuses
+    //
+    returnCode_t create(solClient_opaqueSession_pt session_p,
+                        uint32_t maxUnacked);
+
+    returnCode_t acknowledge(solClient_msgId_t msgId);
+
+    topicId_t getTopicId(void) const { return topicId_m; }
+    const std::string& getQueue(void) const { return queue_m; }
+
+    // Messages received and acknowledged so far; may be read from any thread
+    //
+    uint64_t getMessagesReceived(void) const
+        { return messagesReceived_m.load(std::memory_order_relaxed); }
+    uint64_t getMessagesAcknowledged(void) const
+        { return messagesAcknowledged_m.load(std::memory_order_relaxed); }
+
+private:
+    static const char* const ACK_THRESHOLD;
+    static const char* const ACK_TIMER_MS;
+
+    static solClient_rxMsgCallback_returnCode_t
+    messageReceiveCallback(solClient_opaqueFlow_pt flow_p,
+                           solClient_opaqueMsg_pt msg_p,
+                           void* user_p);
+    static void eventCallback(solClient_opaqueFlow_pt flow_p,
+                              solClient_flow_eventCallbackInfo_pt eventInfo_p,
+                              void* user_p);
+
+    topicId_t               topicId_m;
+
+    // The subscription's priority, looked up once so that its messages need
+    // no lookup
+    //
+    priority_t              priority_m;
+    std::string             queue_m;
+    solClient_opaqueFlow_pt flow_mp;
+    std::atomic<uint64_t>   messagesReceived_m;
+    std::atomic<uint64_t>   messagesAcknowledged_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_SOLCLIENT_FLOW_HPP_ */
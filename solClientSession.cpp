@@ -0,0 +1,844 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "solClientSession.hpp"
+
+#include <algorithm>
+
+#include "log.hpp"
+#include "monitoringThread.hpp"
+#include "solClientThread.hpp"
+#include "subscriptionRegistry.hpp"
+
+namespace topicMonitor
+{
+
+static const char* const CONNECT_RETRIES         = "3";
+static const char* const RECONNECT_RETRIES       = "-1"; // For ever
+static const char* const RECONNECT_RETRY_WAIT_MS = "250";
+
+// Bounds of the delay before requesting again the subscriptions that could
+// not be restored after a reconnection
+//
+static const uint32_t RETRY_MIN_MS = 250;
+static const uint32_t RETRY_MAX_MS = 30000;
+
+// Delay before a flow unbound by destroyFlow() is destroyed on the context
+// thread; any delay will do
+//
+static const uint32_t FLOW_DESTROY_DELAY_MS = 1;
+
+solClient_rxMsgCallback_returnCode_t
+SolClientSession::messageReceiveCallback(solClient_opaqueSession_pt session_p,
+                                         solClient_opaqueMsg_pt msg_p,
+                                         void* user_p)
+{
+    LOG(DEBUG, "SolClient message received callback invoked");
+
+    SolClientSession* session = (SolClientSession*)user_p;
+
+    // Only this context thread writes the counter
+    //
+    session->messagesReceived_m.store(
+        session->messagesReceived_m.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+
+    session->thread_mp->captureMessage(msg_p);
+
+    // Create a work entry and enqueue it to the work queue of the worker of
+    // every subscription of this session matching the topic. If none
+    // matches, or the overload policy drops it, the message is left to the
+    // context thread to free.
+    //
+    if (!MonitoringThread::instance()->pushMessage(
+             msg_p, session->index_m, session->thread_mp->getSessionCount()))
+    {
+        return SOLCLIENT_CALLBACK_OK;
+    }
+
+    // Taking ownership of the message away from the context thread. We are
+    // responsible for freeing the message when done processing.
+    //
+    return SOLCLIENT_CALLBACK_TAKE_MSG;
+}
+
+// Subscriptions are tagged with their topic id plus 1, so that untagged
+// events, with a null correlation pointer, are told apart, and whether they
+// are requested again after a reconnection
+//
+static void*
+toCorrelationTag(topicId_t topicId, bool resubscribe = false)
+{
+    return (void*)((static_cast<uintptr_t>(topicId) + 1) * 2 + resubscribe);
+}
+
+static topicId_t
+fromCorrelationTag(void* tag_p, bool& resubscribe)
+{
+    resubscribe = ((uintptr_t)tag_p & 1) != 0;
+    return static_cast<topicId_t>((uintptr_t)tag_p / 2 - 1);
+}
+
+void
+SolClientSession::eventCallback(
+    solClient_opaqueSession_pt session_p,
+    solClient_session_eventCallbackInfo_pt eventInfo_p,
+    void* user_p)
+{
+    LOG(DEBUG, "SolClient event callback invoked");
+
+    SolClientSession* session = (SolClientSession*)user_p;
+    topicId_t topicId;
+    bool resubscribe;
+
+    switch (eventInfo_p->sessionEvent)
+    {
+    case SOLCLIENT_SESSION_EVENT_SUBSCRIPTION_OK:
+    case SOLCLIENT_SESSION_EVENT_SUBSCRIPTION_ERROR:
+        if (eventInfo_p->sessionEvent
+                == SOLCLIENT_SESSION_EVENT_SUBSCRIPTION_ERROR)
+        {
+            LOG(WARN, "solClient session " << session->index_m
+                      << " subscription error ("
+                      << (eventInfo_p->info_p ? eventInfo_p->info_p : "")
+                      << ")");
+        }
+        if (eventInfo_p->correlation_p == nullptr) { break; }
+
+        topicId = fromCorrelationTag(eventInfo_p->correlation_p, resubscribe);
+        if (resubscribe)
+        {
+            session->handleResubscribed(
+                topicId,
+                eventInfo_p->sessionEvent
+                    == SOLCLIENT_SESSION_EVENT_SUBSCRIPTION_OK);
+            break;
+        }
+        MonitoringThread::instance()->confirmSubscription(
+            topicId,
+            eventInfo_p->sessionEvent
+                == SOLCLIENT_SESSION_EVENT_SUBSCRIPTION_OK);
+        break;
+    case SOLCLIENT_SESSION_EVENT_RECONNECTING_NOTICE:
+        LOG(WARN, "solClient session " << session->index_m
+                  << " connection lost, reconnecting ("
+                  << (eventInfo_p->info_p ? eventInfo_p->info_p : "")
+                  << ")");
+        session->handleDown();
+        break;
+    case SOLCLIENT_SESSION_EVENT_DOWN_ERROR:
+        LOG(ERROR, "solClient session " << session->index_m
+                   << " down, no longer reconnecting ("
+                   << (eventInfo_p->info_p ? eventInfo_p->info_p : "")
+                   << ")");
+        session->handleDown();
+        break;
+    case SOLCLIENT_SESSION_EVENT_RECONNECTED_NOTICE:
+        session->handleReconnected();
+        break;
+    default:
+        break;
+    }
+}
+
+void
+SolClientSession::handleDown(void)
+{
+    if (down_m) { return; }
+
+    down_m = true;
+    downSince_m = std::chrono::steady_clock::now();
+    outages_m.fetch_add(1, std::memory_order_relaxed);
+
+    // Confirmations of a resubscription interrupted by this outage are not
+    // coming; the subscriptions are all requested again on reconnection,
+    // including those still being retried
+    //
+    pendingResubscriptions_m = 0;
+    pendingRetries_m = 0;
+    retryIds_m.clear();
+    retryDelayMs_m = RETRY_MIN_MS;
+    unrestored_m.store(0, std::memory_order_relaxed);
+    if (retryTimerId_m != SOLCLIENT_CONTEXT_TIMER_ID_INVALID
+            && solClient_context_stopTimer(context_mp, &retryTimerId_m)
+                   != SOLCLIENT_OK)
+    {
+        LOG(WARN, "solClient could not stop resubscription retry timer");
+    }
+    retryTimerId_m = SOLCLIENT_CONTEXT_TIMER_ID_INVALID;
+
+    MonitoringThread::instance()->pushSessionDown(
+        index_m, thread_mp->getSessionCount());
+}
+
+void
+SolClientSession::handleReconnected(void)
+{
+    std::chrono::milliseconds elapsed =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - downSince_m);
+    LOG(INFO, "solClient session " << index_m << " reconnected in "
+              << elapsed.count() << "ms");
+
+    // The broker forgot the subscriptions with the connection. They are all
+    // requested back to back and confirmed as a batch; flows rebind on their
+    // own.
+    //
+    std::vector<topicId_t> ids;
+    SubscriptionRegistry::instance()->list(ids, index_m,
+                                           thread_mp->getSessionCount());
+
+    pendingResubscriptions_m = 0;
+    restoredSubscriptions_m = 0;
+    failedResubscriptions_m = 0;
+    for (topicId_t topicId : ids)
+    {
+        SubscriptionInfo info;
+        if (!SubscriptionRegistry::instance()->get(topicId, info)
+                || info.isGuaranteed())
+        {
+            continue;
+        }
+
+        if (requestSubscription(info.getTopic(),
+                                toCorrelationTag(topicId, true))
+                != returnCode_t::SUCCESS)
+        {
+            failedResubscriptions_m++;
+            retryIds_m.push_back(topicId);
+            continue;
+        }
+        pendingResubscriptions_m++;
+    }
+
+    if (pendingResubscriptions_m == 0) { completeRecovery(); }
+}
+
+void
+SolClientSession::handleResubscribed(topicId_t topicId, bool ok)
+{
+    // Confirmations of requests made before the last outage are stale
+    //
+    if (down_m ? pendingResubscriptions_m == 0 : pendingRetries_m == 0)
+    {
+        return;
+    }
+
+    // A refused subscription stays registered with its script loaded; the
+    // refusal may be transient, such as a resource limit on the broker
+    //
+    if (!ok) { retryIds_m.push_back(topicId); }
+
+    if (down_m)
+    {
+        if (ok) { restoredSubscriptions_m++; }
+        else    { failedResubscriptions_m++; }
+
+        if (--pendingResubscriptions_m == 0) { completeRecovery(); }
+        return;
+    }
+
+    if (ok)
+    {
+        LOG(INFO, "solClient session " << index_m << " restored subscription "
+                  << topicId << " on retry");
+    }
+
+    if (--pendingRetries_m == 0)
+    {
+        retryDelayMs_m = std::min(retryDelayMs_m * 2, RETRY_MAX_MS);
+        scheduleRetry();
+    }
+}
+
+void
+SolClientSession::scheduleRetry(void)
+{
+    unrestored_m.store(retryIds_m.size() + pendingRetries_m,
+                       std::memory_order_relaxed);
+
+    if (retryIds_m.empty() || down_m
+            || retryTimerId_m != SOLCLIENT_CONTEXT_TIMER_ID_INVALID)
+    {
+        return;
+    }
+
+    LOG(WARN, "solClient session " << index_m << " requesting "
+              << retryIds_m.size() << " subscription(s) again in "
+              << retryDelayMs_m << "ms");
+
+    if (solClient_context_startTimer(context_mp,
+                                     SOLCLIENT_CONTEXT_TIMER_ONE_SHOT,
+                                     retryDelayMs_m,
+                                     retryTimerCallback,
+                                     this,
+                                     &retryTimerId_m)
+            != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "solClient could not start resubscription retry timer");
+        retryTimerId_m = SOLCLIENT_CONTEXT_TIMER_ID_INVALID;
+    }
+}
+
+void
+SolClientSession::retryTimerCallback(solClient_opaqueContext_pt context_p,
+                                     void* user_p)
+{
+    ((SolClientSession*)user_p)->retryResubscriptions();
+}
+
+void
+SolClientSession::retryResubscriptions(void)
+{
+    retryTimerId_m = SOLCLIENT_CONTEXT_TIMER_ID_INVALID;
+    if (down_m) { return; }
+
+    std::vector<topicId_t> ids;
+    ids.swap(retryIds_m);
+
+    for (topicId_t topicId : ids)
+    {
+        // Unsubscribed meanwhile
+        //
+        SubscriptionInfo info;
+        if (!SubscriptionRegistry::instance()->isActive(topicId)
+                || !SubscriptionRegistry::instance()->get(topicId, info))
+        {
+            continue;
+        }
+
+        resubscribeRetries_m.fetch_add(1, std::memory_order_relaxed);
+        if (requestSubscription(info.getTopic(),
+                                toCorrelationTag(topicId, true))
+                != returnCode_t::SUCCESS)
+        {
+            retryIds_m.push_back(topicId);
+            continue;
+        }
+        pendingRetries_m++;
+    }
+
+    // Nothing is in flight to reschedule the rest once confirmed
+    //
+    if (pendingRetries_m == 0)
+    {
+        retryDelayMs_m = std::min(retryDelayMs_m * 2, RETRY_MAX_MS);
+        scheduleRetry();
+        return;
+    }
+
+    unrestored_m.store(retryIds_m.size() + pendingRetries_m,
+                       std::memory_order_relaxed);
+}
+
+void
+SolClientSession::completeRecovery(void)
+{
+    uint64_t recovery =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - downSince_m).count();
+
+    down_m = false;
+    recoveryTimeTotal_m.fetch_add(recovery, std::memory_order_relaxed);
+    if (recovery > recoveryTimeMax_m.load(std::memory_order_relaxed))
+    {
+        recoveryTimeMax_m.store(recovery, std::memory_order_relaxed);
+    }
+
+    LOG(INFO, "solClient session " << index_m << " recovered in " << recovery
+              << "ms (" << restoredSubscriptions_m
+              << " subscription(s) restored, " << failedResubscriptions_m
+              << " failed)");
+
+    MonitoringThread::instance()->pushSessionUp(
+        recovery, index_m, thread_mp->getSessionCount());
+
+    retryDelayMs_m = RETRY_MIN_MS;
+    scheduleRetry();
+}
+
+static void
+contextTimerCallback(solClient_opaqueContext_pt context_p, void* user_p)
+{
+    LOG(DEBUG, "SolClient timer callback invoked");
+
+    // Wake up every worker that does not already have a tick pending. Workers
+    // advance their timeout wheels from the monotonic clock on their own, so
+    // the tick only bounds how long an idle worker sleeps.
+    //
+    MonitoringThread::instance()->pushTimerTick();
+}
+
+// See Messaging API Concepts from the Solace Developer Guide:
+//
+// https://docs.solace.com/Solace-PubSub-Messaging-APIs/Developer-Guide/Core-Messaging-API-Concepts.htm
+//
+SolClientSession::SolClientSession(SolClientThread* thread_p, uint32_t index) :
+    thread_mp(thread_p),
+    index_m(index),
+    context_mp(nullptr),
+    session_mp(nullptr),
+    timerId_m(SOLCLIENT_CONTEXT_TIMER_ID_INVALID),
+    messagesReceived_m(0),
+    down_m(false),
+    pendingResubscriptions_m(0),
+    restoredSubscriptions_m(0),
+    failedResubscriptions_m(0),
+    pendingRetries_m(0),
+    retryDelayMs_m(RETRY_MIN_MS),
+    retryTimerId_m(SOLCLIENT_CONTEXT_TIMER_ID_INVALID),
+    outages_m(0),
+    recoveryTimeTotal_m(0),
+    recoveryTimeMax_m(0),
+    unrestored_m(0),
+    resubscribeRetries_m(0)
+{
+    solClient_returnCode_t rc;
+
+    // Contexts
+    //
+    // The messaging APIs use processing Contexts for organizing communication
+    // between an application and a Solace PubSub+ message broker. Contexts act
+    // as containers in which Sessions are created and Session-related events
+    // can be handled.
+    //
+    // A Context encapsulates threads that drive network I/O and message
+    // delivery notification for the Sessions and Session components associated
+    // with that Context. For the Java API, one thread is used for I/O and
+    // another for notification. For the Java RTO, C, and .NET APIs, a single
+    // thread is used for both I/O and for notification. The life cycle of a
+    // Context‑owned thread is bound to the life cycle of the Context. The
+    // Javascript and Node.js APIs are single threaded and have a single global
+    // context that is not exposed.
+    //
+    solClient_context_createFuncInfo_t contextFuncInfo =
+        SOLCLIENT_CONTEXT_CREATEFUNC_INITIALIZER;
+
+    rc = solClient_context_create(
+            SOLCLIENT_CONTEXT_PROPS_DEFAULT_WITH_CREATE_THREAD,
+            &context_mp,
+            &contextFuncInfo,
+            sizeof(contextFuncInfo));
+    if (rc != SOLCLIENT_OK)
+        LOG(FATAL, "solClient context " << index_m << " creation failed");
+
+    LOG(INFO, "solClient context " << index_m << " created");
+}
+
+SolClientSession::~SolClientSession(void)
+{
+    solClient_returnCode_t rc;
+
+    for (SolClientFlow* flow_p : flows_m)
+    {
+        delete flow_p;
+    }
+
+    if (session_mp != nullptr)
+    {
+        rc = solClient_session_destroy(&session_mp);
+        if (rc != SOLCLIENT_OK)
+            LOG(FATAL, "solClient session destruction failed");
+    }
+
+    if (context_mp != nullptr)
+    {
+        rc = solClient_context_destroy(&context_mp);
+        if (rc != SOLCLIENT_OK)
+            LOG(FATAL, "solClient context destruction failed");
+    }
+}
+
+returnCode_t
+SolClientSession::createSession(std::string host,
+                               std::string vpn,
+                               std::string username,
+                               std::string password)
+{
+    solClient_returnCode_t rc;
+
+    // Sessions
+    //
+    // When a Context is established, one or more Sessions can be created within
+    // that Context. A Session creates a single, client connection to a message
+    // broker for sending and receiving messages.
+    //
+    // A Session provides the following primary services:
+    //
+    // * client connection
+    // * update and retrieve Session properties
+    // * retrieve Session statistics
+    // * add and remove subscriptions
+    // * create destinations and endpoints
+    // * publish and receive Direct messages
+    // * publish Guaranteed messages
+    // * make requests/replies (or create Requestors for the Java API)
+    // * create Guaranteed message Flows to receive Guaranteed messages
+    // * create Browsers (for the Java and .NET APIs only)
+    // * create cache sessions
+    //
+    // When configuring a Session, the following must be provided:
+    //
+    // * Session properties to define the operating characteristics of the
+    //   client connection to the message broker.
+    // * A message callback for Direct messages that are received.
+    // * An event handling callback for events that occur for the Session
+    //   (optional for the Java API).
+    //
+    solClient_session_createFuncInfo_t sessionFuncInfo =
+        SOLCLIENT_SESSION_CREATEFUNC_INITIALIZER;
+
+    sessionFuncInfo.rxMsgInfo.callback_p = messageReceiveCallback;
+    sessionFuncInfo.rxMsgInfo.user_p = this;
+    sessionFuncInfo.eventInfo.callback_p = eventCallback;
+    sessionFuncInfo.eventInfo.user_p = this;
+
+    int propIndex = 0;
+    const char* sessionProps[20] = {0};
+    sessionProps[propIndex++] = SOLCLIENT_SESSION_PROP_HOST;
+    sessionProps[propIndex++] = host.c_str();
+
+    sessionProps[propIndex++] = SOLCLIENT_SESSION_PROP_VPN_NAME;
+    sessionProps[propIndex++] = vpn.c_str();
+
+    sessionProps[propIndex++] = SOLCLIENT_SESSION_PROP_USERNAME;
+    sessionProps[propIndex++] = username.c_str();
+
+    sessionProps[propIndex++] = SOLCLIENT_SESSION_PROP_PASSWORD;
+    sessionProps[propIndex++] = password.c_str();
+
+    // Reconnect quickly and for ever after losing the connection. Lost
+    // subscriptions are restored by handleReconnected() rather than by
+    // solClient, so their confirmations can be counted.
+    //
+    sessionProps[propIndex++] = SOLCLIENT_SESSION_PROP_CONNECT_RETRIES;
+    sessionProps[propIndex++] = CONNECT_RETRIES;
+
+    sessionProps[propIndex++] = SOLCLIENT_SESSION_PROP_RECONNECT_RETRIES;
+    sessionProps[propIndex++] = RECONNECT_RETRIES;
+
+    sessionProps[propIndex++] = SOLCLIENT_SESSION_PROP_RECONNECT_RETRY_WAIT_MS;
+    sessionProps[propIndex++] = RECONNECT_RETRY_WAIT_MS;
+
+    sessionProps[propIndex++] = SOLCLIENT_SESSION_PROP_REAPPLY_SUBSCRIPTIONS;
+    sessionProps[propIndex++] = SOLCLIENT_PROP_DISABLE_VAL;
+
+    rc = solClient_session_create(
+            (char **)sessionProps,
+            context_mp,
+            &session_mp,
+            &sessionFuncInfo,
+            sizeof(sessionFuncInfo));
+    if (rc != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "solClient session " << index_m << " creation failed");
+        return returnCode_t::FAILURE;
+    }
+
+    name_m = host + "/" + vpn;
+    LOG(INFO, "solClient session " << index_m << " created (" << name_m
+              << ")");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+SolClientSession::destroySession(void)
+{
+    if (session_mp == nullptr) { return returnCode_t::NOTHING_TO_DO; }
+
+    // Flows are destroyed before their session
+    //
+    for (SolClientFlow* flow_p : flows_m)
+    {
+        delete flow_p;
+    }
+    flows_m.clear();
+
+    if (solClient_session_destroy(&session_mp) != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "solClient session " << index_m
+                   << " destruction failed");
+        return returnCode_t::FAILURE;
+    }
+
+    LOG(INFO, "solClient session " << index_m << " destroyed");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+SolClientSession::connectSession(void)
+{
+    if (session_mp == nullptr) { return returnCode_t::FAILURE; }
+
+    std::lock_guard<std::mutex> lock(mutex_m);
+    if (solClient_session_connect(session_mp) != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "solClient session " << index_m
+                   << " connection failed");
+        return returnCode_t::FAILURE;
+    }
+
+    LOG(INFO, "solClient session " << index_m << " connected");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+SolClientSession::disconnectSession(void)
+{
+    if (session_mp == nullptr) { return returnCode_t::FAILURE; }
+
+    std::lock_guard<std::mutex> lock(mutex_m);
+    if (solClient_session_disconnect(session_mp) != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "solClient session " << index_m
+                   << " disconnection failed");
+        return returnCode_t::FAILURE;
+    }
+
+    LOG(INFO, "solClient session " << index_m << " disconnected");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+SolClientSession::topicSubscribe(std::string topic)
+{
+    solClient_returnCode_t rc;
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    rc = solClient_session_topicSubscribeExt(
+            session_mp,
+            SOLCLIENT_SUBSCRIBE_FLAGS_WAITFORCONFIRM,
+            topic.c_str());
+    if (rc != SOLCLIENT_OK)
+    {
+        LOG(WARN, "solClient could not subscribe to topic '" << topic
+                  << "'");
+        return returnCode_t::FAILURE;
+    }
+
+    LOG(INFO, "solClient session " << index_m << " subscribed to topic '"
+              << topic << "'");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+SolClientSession::topicSubscribeAsync(std::string topic, topicId_t topicId)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    return requestSubscription(topic, toCorrelationTag(topicId));
+}
+
+// Does not take mutex_m, so it may be called on the context thread: a thread
+// holding mutex_m may be waiting for the context thread to confirm a
+// subscription
+//
+returnCode_t
+SolClientSession::requestSubscription(const std::string& topic, void* tag_p)
+{
+    solClient_returnCode_t rc;
+
+    // Messages are still received through the session's callback
+    //
+    rc = solClient_session_topicSubscribeWithDispatch(
+            session_mp,
+            SOLCLIENT_SUBSCRIBE_FLAGS_REQUEST_CONFIRM,
+            topic.c_str(),
+            nullptr,
+            tag_p);
+    if (rc != SOLCLIENT_OK)
+    {
+        LOG(WARN, "solClient could not subscribe to topic '" << topic
+                  << "'");
+        return returnCode_t::FAILURE;
+    }
+
+    LOG(DEBUG, "solClient session " << index_m
+               << " requested subscription to topic '" << topic << "'");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+SolClientSession::topicUnsubscribe(std::string topic)
+{
+    solClient_returnCode_t rc;
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    rc = solClient_session_topicUnsubscribeExt(
+            session_mp,
+            SOLCLIENT_SUBSCRIBE_FLAGS_WAITFORCONFIRM,
+            topic.c_str());
+    if (rc != SOLCLIENT_OK)
+    {
+        LOG(WARN, "solClient could not unsubscribe from topic '" << topic
+                  << "'");
+        return returnCode_t::FAILURE;
+    }
+
+    LOG(INFO, "solClient session " << index_m
+              << " unsubscribed from topic '" << topic << "'");
+    return returnCode_t::SUCCESS;
+}
+
+SolClientFlow*
+SolClientSession::createFlow(std::string queue,
+                             topicId_t topicId,
+                             uint32_t maxUnacked)
+{
+    if (session_mp == nullptr) { return nullptr; }
+
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    SolClientFlow* flow_p = new SolClientFlow(topicId, queue);
+    if (flow_p->create(session_mp, maxUnacked) != returnCode_t::SUCCESS)
+    {
+        delete flow_p;
+        return nullptr;
+    }
+
+    flows_m.push_back(flow_p);
+    LOG(INFO, "solClient session " << index_m << " consuming queue '"
+              << queue << "'");
+    return flow_p;
+}
+
+returnCode_t
+SolClientSession::destroyFlow(SolClientFlow* flow_p)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    flows_m.erase(std::remove(flows_m.begin(), flows_m.end(), flow_p),
+                  flows_m.end());
+
+    solClient_context_timerId_t timerId;
+    if (context_mp == nullptr
+            || solClient_context_startTimer(context_mp,
+                                            SOLCLIENT_CONTEXT_TIMER_ONE_SHOT,
+                                            FLOW_DESTROY_DELAY_MS,
+                                            destroyFlowCallback,
+                                            flow_p,
+                                            &timerId)
+                   != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "solClient session " << index_m << " could not unbind "
+                   << "from queue '" << flow_p->getQueue() << "'");
+        flows_m.push_back(flow_p);
+        return returnCode_t::FAILURE;
+    }
+
+    LOG(INFO, "solClient session " << index_m << " unbinding from queue '"
+              << flow_p->getQueue() << "'");
+    return returnCode_t::SUCCESS;
+}
+
+void
+SolClientSession::destroyFlowCallback(solClient_opaqueContext_pt context_p,
+                                      void* user_p)
+{
+    delete (SolClientFlow*)user_p;
+}
+
+returnCode_t
+SolClientSession::publish(solClient_opaqueMsg_pt msg_p)
+{
+    if (session_mp == nullptr) { return returnCode_t::FAILURE; }
+
+    if (solClient_session_sendMsg(session_mp, msg_p) != SOLCLIENT_OK)
+    {
+        LOG(WARN, "solClient could not publish message");
+        return returnCode_t::FAILURE;
+    }
+
+    return returnCode_t::SUCCESS;
+}
+
+size_t
+SolClientSession::publishMultiple(solClient_opaqueMsg_pt* msgs_p,
+                                  size_t count)
+{
+    if (session_mp == nullptr) { return 0; }
+
+    // The session blocks while its socket is full, so everything is sent
+    // unless the session fails
+    //
+    solClient_uint32_t sent = 0;
+    if (solClient_session_sendMultipleMsg(session_mp,
+                                          msgs_p,
+                                          count,
+                                          &sent) != SOLCLIENT_OK)
+    {
+        LOG(WARN, "solClient could only publish " << sent << " of " << count
+                  << " messages");
+    }
+
+    return sent;
+}
+
+returnCode_t
+SolClientSession::startTimer(void)
+{
+    solClient_returnCode_t rc;
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    rc = solClient_context_startTimer(
+            context_mp,
+            SOLCLIENT_CONTEXT_TIMER_REPEAT,
+            1000, // Timer ticks every second
+            contextTimerCallback,
+            this,
+            &timerId_m);
+    if (rc != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "solClient could not start timer");
+        return returnCode_t::FAILURE;
+    }
+
+    LOG(INFO, "solClient timer started");
+    return returnCode_t::SUCCESS;
+}
+
+returnCode_t
+SolClientSession::stopTimer(void)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    if (timerId_m == SOLCLIENT_CONTEXT_TIMER_ID_INVALID)
+    {
+        return returnCode_t::NOTHING_TO_DO;
+    }
+
+    if (solClient_context_stopTimer(context_mp, &timerId_m) != SOLCLIENT_OK)
+    {
+        LOG(ERROR, "solClient could not stop timer");
+        return returnCode_t::FAILURE;
+    }
+
+    return returnCode_t::SUCCESS;
+}
+
+} /* namespace topicMonitor */
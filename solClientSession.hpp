@@ -0,0 +1,208 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_SOLCLIENT_SESSION_HPP_
+#define _TOPIC_MONITOR_SOLCLIENT_SESSION_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+#include "solClientFlow.hpp"
+
+namespace topicMonitor
+{
+
+class SolClientThread;
+
+// One solClient context, with its own thread, and one session in it. Messages
+// received by the session are pushed to MonitoringThread from the context
+// thread, restricted to the subscriptions of the session's partition; see
+// SolClientThread.
+//
+// When the connection is lost, the session reconnects on its own. Once it is
+// back, the session's subscriptions are all requested again at once, without
+// waiting for each confirmation, and the subscriptions' workers are told when
+// the last of them is confirmed. The time from losing the connection to then
+// is recorded as the time to recover.
+//
+// A subscription the broker refuses to restore, or that cannot be requested,
+// is not given up: it is requested again after RETRY_MIN_MS, then after
+// doubling delays up to RETRY_MAX_MS, until the broker accepts it.
+//
+class SolClientSession
+{
+public:
+    SolClientSession(SolClientThread* thread_p, uint32_t index);
+    ~SolClientSession(void);
+
+    SolClientSession(const SolClientSession&) = delete;
+    SolClientSession& operator=(const SolClientSession&) = delete;
+
+    returnCode_t createSession(std::string host,
+                               std::string vpn,
+                               std::string username,
+                               std::string password);
+    returnCode_t destroySession(void);
+
+    returnCode_t connectSession(void);
+    returnCode_t disconnectSession(void);
+
+    returnCode_t topicSubscribe(std::string topic);
+    returnCode_t topicUnsubscribe(std::string topic);
+
+    // Requests a confirmation instead of waiting for it; it arrives as a
+    // session event tagged with the topic id
+    //
+    returnCode_t topicSubscribeAsync(std::string topic, topicId_t topicId);
+
+    // Binds a flow to the queue of a guaranteed subscription; the session
+    // owns the flow, destroyed with the session
+    //
+    SolClientFlow* createFlow(std::string queue,
+                              topicId_t topicId,
+                              uint32_t maxUnacked);
+
+    // Destroys a flow created by createFlow() on the context thread, so that
+    // the caller does not wait for a context thread that may be waiting for
+    // it in turn
+    //
+    returnCode_t destroyFlow(SolClientFlow* flow_p);
+
+    returnCode_t publish(solClient_opaqueMsg_pt msg_p);
+
+    // Sends up to SOLCLIENT_SESSION_SEND_MULTIPLE_LIMIT messages in a single
+    // call and returns how many were sent
+    //
+    size_t publishMultiple(solClient_opaqueMsg_pt* msgs_p, size_t count);
+
+    returnCode_t startTimer(void);
+    returnCode_t stopTimer(void);
+
+    uint32_t getIndex(void) const { return index_m; }
+
+    // "<host>/<vpn>", for logging
+    //
+    const std::string& getName(void) const { return name_m; }
+
+    // Number of messages received so far; may be read from any thread
+    //
+    uint64_t getMessagesReceived(void) const
+        { return messagesReceived_m.load(std::memory_order_relaxed); }
+
+    // Number of outages so far and their total time to recover in
+    // milliseconds; may be read from any thread
+    //
+    uint64_t getOutages(void) const
+        { return outages_m.load(std::memory_order_relaxed); }
+    uint64_t getRecoveryTimeTotal(void) const
+        { return recoveryTimeTotal_m.load(std::memory_order_relaxed); }
+
+    // Returns the longest time to recover in milliseconds since the last call
+    //
+    uint64_t takeRecoveryTimeMax(void)
+        { return recoveryTimeMax_m.exchange(0, std::memory_order_relaxed); }
+
+    // Number of subscriptions not restored since the last outage, and of
+    // requests made so far to retry them; may be read from any thread
+    //
+    uint32_t getUnrestoredSubscriptions(void) const
+        { return unrestored_m.load(std::memory_order_relaxed); }
+    uint64_t getResubscribeRetries(void) const
+        { return resubscribeRetries_m.load(std::memory_order_relaxed); }
+
+private:
+    // The outage handlers run on the context thread
+    //
+    void handleDown(void);
+    void handleReconnected(void);
+    void handleResubscribed(topicId_t topicId, bool ok);
+    void completeRecovery(void);
+
+    // Arms the retry timer if subscriptions are waiting to be requested
+    // again, which requests them when it expires
+    //
+    void scheduleRetry(void);
+    void retryResubscriptions(void);
+    static void retryTimerCallback(solClient_opaqueContext_pt context_p,
+                                   void* user_p);
+    static void destroyFlowCallback(solClient_opaqueContext_pt context_p,
+                                    void* user_p);
+
+    returnCode_t requestSubscription(const std::string& topic, void* tag_p);
+
+    static solClient_rxMsgCallback_returnCode_t
+    messageReceiveCallback(solClient_opaqueSession_pt session_p,
+                           solClient_opaqueMsg_pt msg_p,
+                           void* user_p);
+    static void
+    eventCallback(solClient_opaqueSession_pt session_p,
+                  solClient_session_eventCallbackInfo_pt eventInfo_p,
+                  void* user_p);
+
+    SolClientThread*            thread_mp;
+    uint32_t                    index_m;
+    std::string                 name_m;
+    solClient_opaqueContext_pt  context_mp;
+    solClient_opaqueSession_pt  session_mp;
+    solClient_context_timerId_t timerId_m;
+    std::atomic<uint64_t>       messagesReceived_m;
+    std::vector<SolClientFlow*> flows_m;
+    std::mutex                  mutex_m;
+
+    // Only used on the context thread
+    //
+    bool                                  down_m;
+    std::chrono::steady_clock::time_point downSince_m;
+    uint32_t                              pendingResubscriptions_m;
+    uint32_t                              restoredSubscriptions_m;
+    uint32_t                              failedResubscriptions_m;
+
+    // Subscriptions to request again, and those requested again that the
+    // broker has not confirmed yet
+    //
+    std::vector<topicId_t>                retryIds_m;
+    uint32_t                              pendingRetries_m;
+    uint32_t                              retryDelayMs_m;
+    solClient_context_timerId_t           retryTimerId_m;
+
+    std::atomic<uint64_t>       outages_m;
+    std::atomic<uint64_t>       recoveryTimeTotal_m;
+    std::atomic<uint64_t>       recoveryTimeMax_m;
+    std::atomic<uint32_t>       unrestored_m;
+    std::atomic<uint64_t>       resubscribeRetries_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_SOLCLIENT_SESSION_HPP_ */
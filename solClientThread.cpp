@@ -28,59 +28,130 @@
 //******************************************************************************
 #include "solClientThread.hpp"
 
+#include <lua5.2/lua.hpp>
+
+#include "config.hpp"
 #include "log.hpp"
-#include "monitoringThread.hpp"
+#include "subscriptionRegistry.hpp"
+#include "utils.hpp"
 
 namespace topicMonitor
 {
 
-SolClientThread* SolClientThread::instance_mps = nullptr;
+struct Credentials
+{
+    Credentials(void) : count(1) {}
+
+    std::string host;
+    std::string vpn;
+    std::string username;
+    std::string password;
+    uint32_t    count;
+};
 
-static solClient_rxMsgCallback_returnCode_t
-sessionMessageReceiveCallback(solClient_opaqueSession_pt session_p,
-                              solClient_opaqueMsg_pt msg_p,
-                              void* user_p)
+// Reads the credentials of one session from the table at the top of the stack
+//
+static bool
+getCredentials(lua_State* L, Credentials& credentials)
 {
-    LOG(DEBUG, "SolClient message received callback invoked");
+    const char* keys[] = { "host", "vpn", "username", "password" };
+    std::string* values[] = { &credentials.host,
+                              &credentials.vpn,
+                              &credentials.username,
+                              &credentials.password };
 
-    // Create a work entry and enqueue it to MonitoringThread's work queue
-    //
-    WorkEntryMessageReceived* entry_p = new WorkEntryMessageReceived();
-    entry_p->setMsg(msg_p);
-    MonitoringThread::instance()->getWorkQueue()->push(entry_p);
+    for (size_t i=0; i<sizeof(keys)/sizeof(keys[0]); i++)
+    {
+        lua_getfield(L, -1, keys[i]);
+        if (lua_type(L, -1) != LUA_TSTRING)
+        {
+            LOG(ERROR, "credentials.lua invalid format (" << keys[i]
+                       << " not a string)");
+            lua_pop(L, 1);
+            return false;
+        }
+        *values[i] = lua_tostring(L, -1);
+        lua_pop(L, 1);
+    }
 
-    // Taking ownership of the message away from the context thread. We are
-    // responsible for freeing the message when done processing.
-    //
-    return SOLCLIENT_CALLBACK_TAKE_MSG;
-}
+    lua_getfield(L, -1, "count");
+    if (!lua_isnil(L, -1))
+    {
+        if (!lua_isnumber(L, -1) || lua_tonumber(L, -1) < 1)
+        {
+            LOG(ERROR, "credentials.lua invalid format (count not a positive "
+                       "integer)");
+            lua_pop(L, 1);
+            return false;
+        }
+        credentials.count = lua_tonumber(L, -1);
+    }
+    lua_pop(L, 1);
 
-static void
-sessionEventCallback(solClient_opaqueSession_pt session_p,
-                     solClient_session_eventCallbackInfo_pt eventInfo_p,
-                     void* user_p)
-{
-    LOG(DEBUG, "SolClient event callback invoked");
+    return true;
 }
 
-static void
-contextTimerCallback(solClient_opaqueContext_pt context_p, void* user_p)
+// TODO (BTO): Maybe use a smart pointer with a Deleter FunctionObject here to
+//             clean up the lua_State once it goes out of scope?
+static returnCode_t
+loadCredentials(std::vector<Credentials>& sessions)
 {
-    LOG(DEBUG, "SolClient timer callback invoked");
+    // Opens a new lua state and load credentials.lua
+    //
+    lua_State* L = luaL_newstate();
+    luaopen_base(L);
+    if (luaL_dofile(L, "credentials.lua") != 0)
+    {
+        LOG(ERROR, "Could load credentials.lua");
+        goto cleanup;
+    }
 
-    // Create a work entry and enqueue it to MonitoringThread's work queue
+    // Either a list of sessions, or the credentials of a single session as
+    // globals
     //
-    WorkEntryTimerTick* entry_p = new WorkEntryTimerTick();
-    MonitoringThread::instance()->getWorkQueue()->push(entry_p);
+    lua_getglobal(L, "sessions");
+    if (lua_istable(L, -1))
+    {
+        size_t count = lua_rawlen(L, -1);
+        for (size_t i=1; i<=count; i++)
+        {
+            lua_rawgeti(L, -1, i);
+            Credentials credentials;
+            if (!lua_istable(L, -1) || !getCredentials(L, credentials))
+            {
+                LOG(ERROR, "credentials.lua invalid format (session " << i
+                           << ")");
+                goto cleanup;
+            }
+            sessions.push_back(credentials);
+            lua_pop(L, 1);
+        }
+    }
+    else
+    {
+        lua_pushglobaltable(L);
+        Credentials credentials;
+        if (!getCredentials(L, credentials)) { goto cleanup; }
+        sessions.push_back(credentials);
+    }
+
+    if (sessions.empty())
+    {
+        LOG(ERROR, "credentials.lua lists no session");
+        goto cleanup;
+    }
+
+    lua_close(L);
+    return returnCode_t::SUCCESS;
+
+cleanup:
+    lua_close(L);
+    return returnCode_t::FAILURE;
 }
 
-// See Messaging API Concepts from the Solace Developer Guide:
-//
-// https://docs.solace.com/Solace-PubSub-Messaging-APIs/Developer-Guide/Core-Messaging-API-Concepts.htm
-//
 SolClientThread::SolClientThread(void) :
-    context_mp(nullptr),
-    session_mp(nullptr)
+    lastReport_m(std::chrono::steady_clock::now()),
+    capturing_m(false)
 {
     solClient_returnCode_t rc;
 
@@ -93,265 +164,346 @@ SolClientThread::SolClientThread(void) :
 
     LOG(INFO, "solClient initialized");
 
-    // Contexts
-    //
-    // The messaging APIs use processing Contexts for organizing communication
-    // between an application and a Solace PubSub+ message broker. Contexts act
-    // as containers in which Sessions are created and Session-related events
-    // can be handled.
-    //
-    // A Context encapsulates threads that drive network I/O and message
-    // delivery notification for the Sessions and Session components associated
-    // with that Context. For the Java API, one thread is used for I/O and
-    // another for notification. For the Java RTO, C, and .NET APIs, a single
-    // thread is used for both I/O and for notification. The life cycle of a
-    // Context‑owned thread is bound to the life cycle of the Context. The
-    // Javascript and Node.js APIs are single threaded and have a single global
-    // context that is not exposed.
-    //
-    solClient_context_createFuncInfo_t contextFuncInfo =
-        SOLCLIENT_CONTEXT_CREATEFUNC_INITIALIZER;
-
-    rc = solClient_context_create(
-            SOLCLIENT_CONTEXT_PROPS_DEFAULT_WITH_CREATE_THREAD,
-            &context_mp,
-            &contextFuncInfo,
-            sizeof(contextFuncInfo));
-    if (rc != SOLCLIENT_OK)
-        LOG(FATAL, "solClient context creation failed");
-
-    LOG(INFO, "solClient context created");
+    const std::string& captureFilename =
+        Config::instance()->getCaptureFilename();
+    if (!captureFilename.empty())
+    {
+        capturing_m = capture_m.open(captureFilename)
+                      == returnCode_t::SUCCESS;
+    }
 }
 
 SolClientThread::~SolClientThread(void)
 {
-    solClient_returnCode_t rc;
-
-    if (session_mp != nullptr)
-    {
-        rc = solClient_session_destroy(&session_mp);
-        if (rc != SOLCLIENT_OK)
-            LOG(FATAL, "solClient session destruction failed");
-    }
-
-    if (context_mp != nullptr)
+    for (SolClientSession* session_p : sessions_m)
     {
-        rc = solClient_context_destroy(&context_mp);
-        if (rc != SOLCLIENT_OK)
-            LOG(FATAL, "solClient context destruction failed");
+        delete session_p;
     }
 
     // solClient_cleanup() is called here because SolClientThread is only
     // destroyed at program termination.
     //
-    rc = solClient_cleanup();
-    if (rc != SOLCLIENT_OK)
+    if (solClient_cleanup() != SOLCLIENT_OK)
         LOG(FATAL, "solClient cleanup failed");
 }
 
 returnCode_t
-SolClientThread::createSession(std::string host,
-                               std::string vpn,
-                               std::string username,
-                               std::string password)
+SolClientThread::connect(void)
 {
-    solClient_returnCode_t rc;
+    if (!sessions_m.empty()) { return returnCode_t::NOTHING_TO_DO; }
 
-    // Sessions
-    //
-    // When a Context is established, one or more Sessions can be created within
-    // that Context. A Session creates a single, client connection to a message
-    // broker for sending and receiving messages.
-    //
-    // A Session provides the following primary services:
-    //
-    // * client connection
-    // * update and retrieve Session properties
-    // * retrieve Session statistics
-    // * add and remove subscriptions
-    // * create destinations and endpoints
-    // * publish and receive Direct messages
-    // * publish Guaranteed messages
-    // * make requests/replies (or create Requestors for the Java API)
-    // * create Guaranteed message Flows to receive Guaranteed messages
-    // * create Browsers (for the Java and .NET APIs only)
-    // * create cache sessions
-    //
-    // When configuring a Session, the following must be provided:
-    //
-    // * Session properties to define the operating characteristics of the
-    //   client connection to the message broker.
-    // * A message callback for Direct messages that are received.
-    // * An event handling callback for events that occur for the Session
-    //   (optional for the Java API).
-    //
-    solClient_session_createFuncInfo_t sessionFuncInfo =
-        SOLCLIENT_SESSION_CREATEFUNC_INITIALIZER;
-
-    sessionFuncInfo.rxMsgInfo.callback_p = sessionMessageReceiveCallback;
-    sessionFuncInfo.rxMsgInfo.user_p = nullptr;
-    sessionFuncInfo.eventInfo.callback_p = sessionEventCallback;
-    sessionFuncInfo.eventInfo.user_p = nullptr;
-
-    int propIndex = 0;
-    const char* sessionProps[20] = {0};
-    sessionProps[propIndex++] = SOLCLIENT_SESSION_PROP_HOST;
-    sessionProps[propIndex++] = host.c_str();
-
-    sessionProps[propIndex++] = SOLCLIENT_SESSION_PROP_VPN_NAME;
-    sessionProps[propIndex++] = vpn.c_str();
-
-    sessionProps[propIndex++] = SOLCLIENT_SESSION_PROP_USERNAME;
-    sessionProps[propIndex++] = username.c_str();
-
-    sessionProps[propIndex++] = SOLCLIENT_SESSION_PROP_PASSWORD;
-    sessionProps[propIndex++] = password.c_str();
-
-    rc = solClient_session_create(
-            (char **)sessionProps,
-            context_mp,
-            &session_mp,
-            &sessionFuncInfo,
-            sizeof(sessionFuncInfo));
-    if (rc != SOLCLIENT_OK)
+    std::vector<Credentials> credentialsList;
+    if (loadCredentials(credentialsList) != returnCode_t::SUCCESS)
     {
-        LOG(ERROR, "solClient session creation failed");
         return returnCode_t::FAILURE;
     }
 
-    LOG(INFO, "solClient session created");
+    // Every session is created before any is connected, so the partition
+    // count is final by the time messages arrive
+    //
+    for (const Credentials& credentials : credentialsList)
+    {
+        for (uint32_t i=0; i<credentials.count; i++)
+        {
+            SolClientSession* session_p =
+                new SolClientSession(this, sessions_m.size());
+            sessions_m.push_back(session_p);
+
+            if (session_p->createSession(credentials.host,
+                                         credentials.vpn,
+                                         credentials.username,
+                                         credentials.password)
+                    != returnCode_t::SUCCESS)
+            {
+                return returnCode_t::FAILURE;
+            }
+        }
+    }
+    lastReportReceived_m.assign(sessions_m.size(), 0);
+    lastReportOutages_m.assign(sessions_m.size(), 0);
+    lastReportRecovery_m.assign(sessions_m.size(), 0);
+
+    for (SolClientSession* session_p : sessions_m)
+    {
+        if (session_p->connectSession() != returnCode_t::SUCCESS)
+        {
+            return returnCode_t::FAILURE;
+        }
+    }
+
+    LOG(INFO, "solClient connected " << sessions_m.size() << " session(s)");
     return returnCode_t::SUCCESS;
 }
 
 returnCode_t
-SolClientThread::destroySession(void)
+SolClientThread::disconnect(void)
 {
-    if (session_mp == nullptr) { return returnCode_t::NOTHING_TO_DO; }
+    returnCode_t rc = returnCode_t::SUCCESS;
 
-    if (solClient_session_destroy(&session_mp) != SOLCLIENT_OK)
+    // Acknowledgements still queued by workers are dropped from now on; the
+    // broker redelivers the messages on the next bind
+    //
     {
-        LOG(ERROR, "solClient session destruction failed");
-        return returnCode_t::FAILURE;
+        std::lock_guard<std::mutex> lock(flowsMutex_m);
+        flows_m.clear();
     }
 
-    LOG(INFO, "solClient session destroyed");
-    return returnCode_t::SUCCESS;
+    for (SolClientSession* session_p : sessions_m)
+    {
+        if (session_p->disconnectSession() != returnCode_t::SUCCESS
+                || session_p->destroySession() != returnCode_t::SUCCESS)
+        {
+            rc = returnCode_t::FAILURE;
+        }
+    }
+
+    return rc;
 }
 
-returnCode_t
-SolClientThread::connectSession(void)
+SolClientSession*
+SolClientThread::getSession(const std::string& topic)
 {
-    if (session_mp == nullptr) { return returnCode_t::FAILURE; }
+    if (sessions_m.empty()) { return nullptr; }
+
+    return sessions_m[SubscriptionRegistry::getPartition(topic.c_str(),
+                                                         sessions_m.size())];
+}
 
-    std::lock_guard<std::mutex> lock(mutex_m);
-    if (solClient_session_connect(session_mp) != SOLCLIENT_OK)
+SolClientSession*
+SolClientThread::getSession(solClient_opaqueMsg_pt msg_p)
+{
+    solClient_destination_t dest;
+    if (solClient_msg_getDestination(msg_p, &dest, sizeof(dest))
+            != SOLCLIENT_OK)
     {
-        LOG(ERROR, "solClient session connection failed");
-        return returnCode_t::FAILURE;
+        return nullptr;
     }
 
-    LOG(INFO, "solClient session connected");
-    return returnCode_t::SUCCESS;
+    return getSession(dest.dest);
+}
+
+returnCode_t
+SolClientThread::topicSubscribe(std::string topic)
+{
+    SolClientSession* session_p = getSession(topic);
+    if (session_p == nullptr) { return returnCode_t::FAILURE; }
+
+    return session_p->topicSubscribe(topic);
 }
 
 returnCode_t
-SolClientThread::disconnectSession(void)
+SolClientThread::topicSubscribeAsync(std::string topic, topicId_t topicId)
 {
-    if (session_mp == nullptr) { return returnCode_t::FAILURE; }
+    SolClientSession* session_p = getSession(topic);
+    if (session_p == nullptr) { return returnCode_t::FAILURE; }
 
-    std::lock_guard<std::mutex> lock(mutex_m);
-    if (solClient_session_disconnect(session_mp) != SOLCLIENT_OK)
-    {
-        LOG(ERROR, "solClient session disconnection failed");
-        return returnCode_t::FAILURE;
-    }
+    return session_p->topicSubscribeAsync(topic, topicId);
+}
+
+returnCode_t
+SolClientThread::topicUnsubscribe(std::string topic)
+{
+    SolClientSession* session_p = getSession(topic);
+    if (session_p == nullptr) { return returnCode_t::FAILURE; }
+
+    return session_p->topicUnsubscribe(topic);
+}
+
+returnCode_t
+SolClientThread::queueBind(std::string queue,
+                           topicId_t topicId,
+                           uint32_t maxUnacked)
+{
+    SolClientSession* session_p = getSession(queue);
+    if (session_p == nullptr) { return returnCode_t::FAILURE; }
+
+    SolClientFlow* flow_p = session_p->createFlow(queue, topicId, maxUnacked);
+    if (flow_p == nullptr) { return returnCode_t::FAILURE; }
 
-    LOG(INFO, "solClient session disconnected");
+    std::lock_guard<std::mutex> lock(flowsMutex_m);
+    flows_m[topicId] = flow_p;
     return returnCode_t::SUCCESS;
 }
 
 returnCode_t
-SolClientThread::topicSubscribe(std::string topic)
+SolClientThread::queueUnbind(topicId_t topicId)
 {
-    solClient_returnCode_t rc;
-    std::lock_guard<std::mutex> lock(mutex_m);
+    // Acknowledgements for the flow are dropped from now on
+    //
+    SolClientFlow* flow_p;
+    {
+        std::lock_guard<std::mutex> lock(flowsMutex_m);
+        auto it = flows_m.find(topicId);
+        if (it == flows_m.end()) { return returnCode_t::NOTHING_TO_DO; }
+        flow_p = it->second;
+        flows_m.erase(it);
+    }
 
-    rc = solClient_session_topicSubscribeExt(
-            session_mp,
-            SOLCLIENT_SUBSCRIBE_FLAGS_WAITFORCONFIRM,
-            topic.c_str());
-    if (rc != SOLCLIENT_OK)
+    SolClientSession* session_p = getSession(flow_p->getQueue());
+    if (session_p == nullptr) { return returnCode_t::FAILURE; }
+
+    return session_p->destroyFlow(flow_p);
+}
+
+void
+SolClientThread::acknowledge(const AckEntry* acks_p, size_t count)
+{
+    // A worker acknowledges a whole drain at once, so the lock is taken once
+    // per batch rather than once per message
+    //
+    std::lock_guard<std::mutex> lock(flowsMutex_m);
+
+    SolClientFlow* flow_p = nullptr;
+    for (size_t i=0; i<count; i++)
     {
-        LOG(WARN, "solClient could not subscribe to topic '" << topic
-                  << "'");
-        return returnCode_t::FAILURE;
+        if (flow_p == nullptr || flow_p->getTopicId() != acks_p[i].topicId)
+        {
+            auto it = flows_m.find(acks_p[i].topicId);
+            if (it == flows_m.end()) { flow_p = nullptr; continue; }
+            flow_p = it->second;
+        }
+
+        flow_p->acknowledge(acks_p[i].msgId);
     }
+}
 
-    LOG(INFO, "solClient subscribed to topic '" << topic << "'");
-    return returnCode_t::SUCCESS;
+returnCode_t
+SolClientThread::startTimer(void)
+{
+    if (sessions_m.empty()) { return returnCode_t::FAILURE; }
+
+    return sessions_m[0]->startTimer();
 }
 
 returnCode_t
-SolClientThread::topicUnsubscribe(std::string topic)
+SolClientThread::stopTimer(void)
 {
-    solClient_returnCode_t rc;
-    std::lock_guard<std::mutex> lock(mutex_m);
+    if (sessions_m.empty()) { return returnCode_t::NOTHING_TO_DO; }
 
-    rc = solClient_session_topicUnsubscribeExt(
-            session_mp,
-            SOLCLIENT_SUBSCRIBE_FLAGS_WAITFORCONFIRM,
-            topic.c_str());
-    if (rc != SOLCLIENT_OK)
+    return sessions_m[0]->stopTimer();
+}
+
+returnCode_t
+SolClientThread::publish(solClient_opaqueMsg_pt msg_p)
+{
+    solClient_destination_t dest;
+    if (solClient_msg_getDestination(msg_p, &dest, sizeof(dest))
+            != SOLCLIENT_OK)
     {
-        LOG(WARN, "solClient could not unsubscribe from topic '" << topic
-                  << "'");
+        LOG(WARN, "solClient could not publish message without topic");
         return returnCode_t::FAILURE;
     }
 
-    LOG(INFO, "solClient unsubscribed from topic '" << topic << "'");
-    return returnCode_t::SUCCESS;
+    SolClientSession* session_p = getSession(dest.dest);
+    if (session_p == nullptr) { return returnCode_t::FAILURE; }
+
+    return session_p->publish(msg_p);
 }
 
-returnCode_t
-SolClientThread::startTimer(void)
+size_t
+SolClientThread::publishMultiple(solClient_opaqueMsg_pt* msgs_p, size_t count)
 {
-    solClient_returnCode_t rc;
-    std::lock_guard<std::mutex> lock(mutex_m);
-
-    rc = solClient_context_startTimer(
-            context_mp,
-            SOLCLIENT_CONTEXT_TIMER_REPEAT,
-            1000, // Timer ticks every second
-            contextTimerCallback,
-            nullptr,
-            &timerId_m);
-    if (rc != SOLCLIENT_OK)
+    if (sessions_m.size() == 1)
     {
-        LOG(ERROR, "solClient could not start timer");
-        return returnCode_t::FAILURE;
+        return sessions_m[0]->publishMultiple(msgs_p, count);
     }
 
-    LOG(INFO, "solClient timer started");
-    return returnCode_t::SUCCESS;
+    size_t sent = 0;
+    size_t start = 0;
+    while (start < count)
+    {
+        SolClientSession* session_p = getSession(msgs_p[start]);
+        if (session_p == nullptr)
+        {
+            LOG(WARN, "solClient could not publish message without topic");
+            start++;
+            continue;
+        }
+
+        size_t end = start + 1;
+        while (end < count && getSession(msgs_p[end]) == session_p) { end++; }
+
+        sent += session_p->publishMultiple(msgs_p + start, end - start);
+        start = end;
+    }
+
+    return sent;
 }
 
-returnCode_t
-SolClientThread::stopTimer(void)
+void
+SolClientThread::reportStatistics(void)
 {
-    std::lock_guard<std::mutex> lock(mutex_m);
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - lastReport_m).count();
+    lastReport_m = now;
 
-    if (timerId_m == SOLCLIENT_CONTEXT_TIMER_ID_INVALID)
+    for (SolClientSession* session_p : sessions_m)
     {
-        return returnCode_t::NOTHING_TO_DO;
+        uint64_t received = session_p->getMessagesReceived();
+        uint64_t& last = lastReportReceived_m[session_p->getIndex()];
+
+        LOG(INFO, "solClient session " << session_p->getIndex() << " ("
+                  << session_p->getName() << ") received " << received - last
+                  << " messages (" << (received - last) / seconds
+                  << " per second)");
+
+        last = received;
+
+        uint64_t outages = session_p->getOutages();
+        uint64_t recovery = session_p->getRecoveryTimeTotal();
+        uint64_t recoveryMax = session_p->takeRecoveryTimeMax();
+        uint64_t& lastOutages = lastReportOutages_m[session_p->getIndex()];
+        uint64_t& lastRecovery = lastReportRecovery_m[session_p->getIndex()];
+        if (outages != lastOutages)
+        {
+            LOG(INFO, "solClient session " << session_p->getIndex() << " had "
+                      << outages - lastOutages << " outage(s), time to "
+                      << "recover average "
+                      << (double)(recovery - lastRecovery)
+                             / (outages - lastOutages)
+                      << "ms, max " << recoveryMax << "ms");
+        }
+
+        lastOutages = outages;
+        lastRecovery = recovery;
+
+        uint32_t unrestored = session_p->getUnrestoredSubscriptions();
+        if (unrestored != 0)
+        {
+            LOG(WARN, "solClient session " << session_p->getIndex() << " has "
+                      << unrestored << " subscription(s) not restored since "
+                      << "its last outage ("
+                      << session_p->getResubscribeRetries()
+                      << " retries so far)");
+        }
     }
 
-    if (solClient_context_stopTimer(context_mp, &timerId_m) != SOLCLIENT_OK)
+    std::lock_guard<std::mutex> lock(flowsMutex_m);
+    for (const auto& entry : flows_m)
     {
-        LOG(ERROR, "solClient could not stop timer");
-        return returnCode_t::FAILURE;
+        LOG(INFO, "solClient queue '" << entry.second->getQueue()
+                  << "' received " << entry.second->getMessagesReceived()
+                  << " messages, acknowledged "
+                  << entry.second->getMessagesAcknowledged());
     }
+}
 
-    return returnCode_t::SUCCESS;
+void
+SolClientThread::captureMessage(solClient_opaqueMsg_pt msg_p)
+{
+    if (!capturing_m) { return; }
+
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    // Sessions receive on their own context threads
+    //
+    std::lock_guard<std::mutex> lock(captureMutex_m);
+    if (capture_m.append(msg_p, now) != returnCode_t::SUCCESS)
+    {
+        LOG(WARN, "Could not capture message");
+    }
 }
 
 } /* namespace topicMonitor */
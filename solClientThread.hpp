@@ -29,54 +29,120 @@
 #ifndef _TOPIC_MONITOR_SOLCLIENT_THREAD_HPP_
 #define _TOPIC_MONITOR_SOLCLIENT_THREAD_HPP_
 
+#include <chrono>
 #include <mutex>
 #include <solclient/solClient.h>
 #include <solclient/solClientMsg.h>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+#include "captureFile.hpp"
 #include "common.hpp"
+#include "solClientSession.hpp"
+#include "transport.hpp"
 
 namespace topicMonitor
 {
 
-class SolClientThread
+// The Transport to Solace brokers, through one or more SolClientSessions,
+// each with its own context thread and connection, as listed in
+// credentials.lua:
+//
+// host     = <string>,     (a single session)
+// vpn      = <string>,
+// username = <string>,
+// password = <string>,
+//
+// or:
+//
+// sessions = {
+//     { host = <string>, vpn = <string>, username = <string>,
+//       password = <string>, count = <int> (optional, default 1) },
+//     ...
+// }
+//
+// Subscriptions are partitioned across sessions by the hash of their topic
+// (see SubscriptionRegistry::getPartition()), so ingest scales with the
+// number of sessions. A session only delivers messages to the subscriptions
+// of its own partition, so a message matching subscriptions of several
+// sessions is still delivered once to each of them.
+//
+// Guaranteed subscriptions bind a SolClientFlow to their queue, on the
+// session of the queue name's partition.
+//
+class SolClientThread : public Transport
 {
 public:
-    static SolClientThread* instance(void)
-    {
-        if (instance_mps == nullptr)
-        {
-            instance_mps = new SolClientThread();
-        }
+    ~SolClientThread(void);
 
-        return instance_mps;
-    }
+    // Creates and connects the sessions listed in credentials.lua
+    //
+    returnCode_t connect(void) override;
 
-    ~SolClientThread(void);
+    // Disconnects and destroys the sessions
+    //
+    returnCode_t disconnect(void) override;
 
-    returnCode_t createSession(std::string host,
-                               std::string vpn,
-                               std::string username,
-                               std::string password);
-    returnCode_t destroySession(void);
+    returnCode_t topicSubscribe(std::string topic) override;
+    returnCode_t topicUnsubscribe(std::string topic) override;
+    returnCode_t topicSubscribeAsync(std::string topic,
+                                     topicId_t topicId) override;
 
-    returnCode_t connectSession(void);
-    returnCode_t disconnectSession(void);
+    returnCode_t queueBind(std::string queue,
+                           topicId_t topicId,
+                           uint32_t maxUnacked) override;
+    returnCode_t queueUnbind(topicId_t topicId) override;
+    void acknowledge(const AckEntry* acks_p, size_t count) override;
 
-    returnCode_t topicSubscribe(std::string topic);
-    returnCode_t topicUnsubscribe(std::string topic);
+    // The timer runs on the context of the first session
+    //
+    returnCode_t startTimer(void) override;
+    returnCode_t stopTimer(void) override;
 
-    returnCode_t startTimer(void);
-    returnCode_t stopTimer(void);
+    // Publishes through the session of the message topic's partition
+    //
+    returnCode_t publish(solClient_opaqueMsg_pt msg_p) override;
+
+    // Sends each run of consecutive messages bound to the same session with
+    // a single call, so order is kept
+    //
+    size_t publishMultiple(solClient_opaqueMsg_pt* msgs_p,
+                           size_t count) override;
+
+    // Logs the receive rate and the outages of every session since the last
+    // call, and the messages each flow has received and acknowledged
+    //
+    void reportStatistics(void) override;
+
+    uint32_t getSessionCount(void) const { return sessions_m.size(); }
+
+    // Records a received message to the capture file, if capture is set in
+    // config.lua. Called on the context threads.
+    //
+    void captureMessage(solClient_opaqueMsg_pt msg_p);
 
 private:
+    friend class Transport;
+
     SolClientThread(void);
 
-    static SolClientThread*     instance_mps;
-    solClient_opaqueContext_pt  context_mp;
-    solClient_opaqueSession_pt  session_mp;
-    solClient_context_timerId_t timerId_m;
-    std::mutex                  mutex_m;
+    SolClientSession* getSession(const std::string& topic);
+
+    // The session of the message's topic, or nullptr if it has none
+    //
+    SolClientSession* getSession(solClient_opaqueMsg_pt msg_p);
+
+    std::vector<SolClientSession*>        sessions_m;
+    std::unordered_map<topicId_t, SolClientFlow*> flows_m;
+    std::mutex                            flowsMutex_m;
+    std::vector<uint64_t>                 lastReportReceived_m;
+    std::vector<uint64_t>                 lastReportOutages_m;
+    std::vector<uint64_t>                 lastReportRecovery_m;
+    std::chrono::steady_clock::time_point lastReport_m;
+    CaptureWriter                         capture_m;
+    bool                                  capturing_m;
+    std::mutex                            captureMutex_m;
 };
 
 } /* namespace topicMonitor */
@@ -0,0 +1,236 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "spillBuffer.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "captureFile.hpp"
+#include "log.hpp"
+
+namespace topicMonitor
+{
+
+SpillBuffer::SpillBuffer(const std::string& prefix, size_t segmentSize) :
+    prefix_m(prefix),
+    segmentSize_m(segmentSize),
+    segmentCount_m(0),
+    records_m(0)
+{
+}
+
+SpillBuffer::~SpillBuffer(void)
+{
+    while (!segments_m.empty()) { removeSegment(); }
+}
+
+returnCode_t
+SpillBuffer::map(Segment& segment)
+{
+    if (segment.base_p != nullptr) { return returnCode_t::NOTHING_TO_DO; }
+
+    void* base_p = mmap(nullptr, segmentSize_m, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, segment.fd, 0);
+    if (base_p == MAP_FAILED)
+    {
+        LOG(ERROR, "Could not map spill segment (" << strerror(errno) << ")");
+        return returnCode_t::FAILURE;
+    }
+
+    segment.base_p = (char*)base_p;
+    return returnCode_t::SUCCESS;
+}
+
+void
+SpillBuffer::unmap(Segment& segment)
+{
+    if (segment.base_p == nullptr) { return; }
+
+    munmap(segment.base_p, segmentSize_m);
+    segment.base_p = nullptr;
+}
+
+returnCode_t
+SpillBuffer::addSegment(void)
+{
+    std::string filename = prefix_m + "." + std::to_string(segmentCount_m++)
+                           + ".spill";
+
+    Segment segment;
+    segment.fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    segment.base_p = nullptr;
+    segment.writeOffset = 0;
+    segment.readOffset = 0;
+    if (segment.fd == -1)
+    {
+        LOG(ERROR, "Could not open spill segment '" << filename << "' ("
+                   << strerror(errno) << ")");
+        return returnCode_t::FAILURE;
+    }
+
+    // The open descriptor keeps the file until it is closed
+    //
+    unlink(filename.c_str());
+
+    if (ftruncate(segment.fd, segmentSize_m) != 0)
+    {
+        LOG(ERROR, "Could not size spill segment '" << filename << "' ("
+                   << strerror(errno) << ")");
+        ::close(segment.fd);
+        return returnCode_t::FAILURE;
+    }
+
+    if (map(segment) != returnCode_t::SUCCESS)
+    {
+        ::close(segment.fd);
+        return returnCode_t::FAILURE;
+    }
+
+    // Only the segment being read stays mapped once full
+    //
+    if (segments_m.size() > 1) { unmap(segments_m.back()); }
+
+    segments_m.push_back(segment);
+    return returnCode_t::SUCCESS;
+}
+
+void
+SpillBuffer::removeSegment(void)
+{
+    Segment& segment = segments_m.front();
+    unmap(segment);
+    ::close(segment.fd);
+    segments_m.pop_front();
+}
+
+returnCode_t
+SpillBuffer::append(solClient_opaqueMsg_pt msg_p, topicId_t topicId)
+{
+    solClient_int64_t rcvTimestamp;
+    if (solClient_msg_getRcvTimestamp(msg_p, &rcvTimestamp) != SOLCLIENT_OK)
+    {
+        rcvTimestamp = 0;
+    }
+
+    CaptureFields fields;
+    if (getCaptureFields(msg_p, rcvTimestamp, fields) != returnCode_t::SUCCESS)
+    {
+        return returnCode_t::FAILURE;
+    }
+
+    size_t size = sizeof(SpillRecordHeader) + fields.header.size;
+    if (size > segmentSize_m) { return returnCode_t::FAILURE; }
+
+    if (segments_m.empty()
+            || segments_m.back().writeOffset + size > segmentSize_m)
+    {
+        if (addSegment() != returnCode_t::SUCCESS)
+        {
+            return returnCode_t::FAILURE;
+        }
+    }
+    Segment& segment = segments_m.back();
+
+    char* record_p = segment.base_p + segment.writeOffset;
+    SpillRecordHeader* header_p = (SpillRecordHeader*)record_p;
+    header_p->topicId = topicId;
+    header_p->reserved = 0;
+    writeCaptureRecord(record_p + sizeof(*header_p), fields);
+
+    segment.writeOffset += size;
+    records_m++;
+    return returnCode_t::SUCCESS;
+}
+
+solClient_opaqueMsg_pt
+SpillBuffer::next(topicId_t& topicId)
+{
+    while (!segments_m.empty())
+    {
+        Segment& segment = segments_m.front();
+        if (segment.readOffset == segment.writeOffset)
+        {
+            // The segment being written is kept, emptied, for what comes
+            // next; a fully read one is done with
+            //
+            if (segments_m.size() > 1)
+            {
+                removeSegment();
+                continue;
+            }
+
+            if (segment.writeOffset != 0)
+            {
+                // Drops the contents from the page cache and the disk
+                //
+                if (ftruncate(segment.fd, 0) != 0
+                        || ftruncate(segment.fd, segmentSize_m) != 0)
+                {
+                    LOG(WARN, "Could not reset spill segment ("
+                              << strerror(errno) << ")");
+                }
+                segment.writeOffset = 0;
+                segment.readOffset = 0;
+            }
+            return nullptr;
+        }
+
+        if (map(segment) == returnCode_t::FAILURE) { return nullptr; }
+
+        const char* record_p = segment.base_p + segment.readOffset;
+        const SpillRecordHeader* header_p = (const SpillRecordHeader*)record_p;
+
+        CaptureRecord record;
+        if (!readCaptureRecord(record_p + sizeof(*header_p),
+                               segment.writeOffset - segment.readOffset
+                                   - sizeof(*header_p),
+                               record))
+        {
+            LOG(ERROR, "Spill segment corrupt, dropping "
+                       << records_m << " messages");
+            while (!segments_m.empty()) { removeSegment(); }
+            records_m = 0;
+            return nullptr;
+        }
+
+        topicId = header_p->topicId;
+        segment.readOffset += sizeof(*header_p) + record.header_p->size;
+        records_m--;
+
+        solClient_opaqueMsg_pt msg_p = createCaptureMessage(record);
+        if (msg_p != nullptr) { return msg_p; }
+    }
+
+    return nullptr;
+}
+
+} /* namespace topicMonitor */
@@ -0,0 +1,118 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_SPILL_BUFFER_HPP_
+#define _TOPIC_MONITOR_SPILL_BUFFER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+#include <string>
+
+#include "common.hpp"
+
+namespace topicMonitor
+{
+
+// Precedes every record of a spill segment, which is otherwise a record of a
+// capture file (see CaptureFields)
+//
+struct SpillRecordHeader
+{
+    topicId_t topicId;
+    uint32_t  reserved;
+};
+
+// A first-in first-out buffer of messages on disk, for the overflow of a
+// worker's lane (see MonitoringWorker). Messages are appended to segment
+// files of a fixed size, written and read through memory mappings, and read
+// back in the order they were appended.
+//
+// At most the segment being written and the one being read are mapped, so
+// memory stays bounded however long the backlog; a segment is deleted as
+// soon as it has been read. The files are unlinked as soon as they are
+// created, so nothing is left behind if the process dies.
+//
+// Not thread safe; the caller locks.
+//
+class SpillBuffer
+{
+public:
+    // Segment files are named after prefix
+    //
+    SpillBuffer(const std::string& prefix, size_t segmentSize);
+    ~SpillBuffer(void);
+
+    SpillBuffer(const SpillBuffer&) = delete;
+    SpillBuffer& operator=(const SpillBuffer&) = delete;
+
+    // Copies the message to the end of the buffer; the caller keeps
+    // ownership of it
+    //
+    returnCode_t append(solClient_opaqueMsg_pt msg_p, topicId_t topicId);
+
+    // Builds a message out of the oldest record and removes the record.
+    // Returns nullptr once the buffer is empty; the caller owns the message.
+    //
+    solClient_opaqueMsg_pt next(topicId_t& topicId);
+
+    bool empty(void) const { return records_m == 0; }
+
+    // Number of records not yet read back
+    //
+    uint64_t getRecords(void) const { return records_m; }
+
+private:
+    struct Segment
+    {
+        int    fd;
+        char*  base_p;
+        size_t writeOffset;
+        size_t readOffset;
+    };
+
+    returnCode_t addSegment(void);
+    returnCode_t map(Segment& segment);
+    void unmap(Segment& segment);
+    void removeSegment(void);
+
+    std::string         prefix_m;
+    size_t              segmentSize_m;
+    uint64_t            segmentCount_m;
+    uint64_t            records_m;
+
+    // Read from the front, written at the back
+    //
+    std::deque<Segment> segments_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_SPILL_BUFFER_HPP_ */
@@ -0,0 +1,218 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "subscriptionRegistry.hpp"
+
+#include <utility>
+
+#include "log.hpp"
+
+namespace topicMonitor
+{
+
+SubscriptionRegistry* SubscriptionRegistry::instance_mps = nullptr;
+
+topicId_t
+SubscriptionRegistry::add(const SubscriptionInfo& info)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    topicId_t topicId = subscriptions_m.size();
+    subscriptions_m.push_back(info);
+    active_m.push_back(false);
+    topicHashes_m.push_back(hashSubscription(info));
+    queueing_m.push_back(info.getQueueingInfo());
+
+    // Messages of a guaranteed subscription come from its flow, not from
+    // matching its topic
+    //
+    if (info.isGuaranteed())
+    {
+        active_m[topicId] = true;
+        return topicId;
+    }
+
+    if (!TopicTrie::isValid(info.getTopic().c_str()))
+    {
+        LOG(ERROR, "Could not add topic '" << info.getTopic()
+                   << "' to the subscription trie");
+        return topicId;
+    }
+
+    active_m[topicId] = true;
+    changed_m = true;
+    publishChanges();
+    return topicId;
+}
+
+void
+SubscriptionRegistry::remove(topicId_t topicId)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    if (topicId >= subscriptions_m.size() || !active_m[topicId]) { return; }
+
+    active_m[topicId] = false;
+    if (!subscriptions_m[topicId].isGuaranteed())
+    {
+        changed_m = true;
+        publishChanges();
+    }
+}
+
+void
+SubscriptionRegistry::beginBatch(void)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    batchDepth_m++;
+}
+
+void
+SubscriptionRegistry::endBatch(void)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    if (batchDepth_m == 0) { return; }
+
+    batchDepth_m--;
+    publishChanges();
+}
+
+const SubscriptionRegistry::Snapshot&
+SubscriptionRegistry::getSnapshot(void)
+{
+    static thread_local std::shared_ptr<const Snapshot> snapshot_s;
+    static thread_local uint64_t version_s = 0;
+
+    // The version only changes with the subscriptions, so this is a read of a
+    // cache line every thread shares without writing
+    //
+    uint64_t version = version_m.load(std::memory_order_acquire);
+    if (version != version_s)
+    {
+        snapshot_s = std::atomic_load(&snapshot_m);
+        version_s = version;
+    }
+
+    return *snapshot_s;
+}
+
+void
+SubscriptionRegistry::publishChanges(void)
+{
+    if (batchDepth_m != 0 || !changed_m) { return; }
+
+    std::shared_ptr<Snapshot> snapshot_p = std::make_shared<Snapshot>();
+
+    for (topicId_t topicId=0; topicId<subscriptions_m.size(); topicId++)
+    {
+        if (active_m[topicId] && !subscriptions_m[topicId].isGuaranteed())
+        {
+            snapshot_p->trie.add(subscriptions_m[topicId].getTopic().c_str(),
+                                 topicId);
+        }
+    }
+    snapshot_p->topicHashes = topicHashes_m;
+    snapshot_p->queueing = queueing_m;
+
+    // Threads still matching against the previous snapshot keep it alive
+    // until they pick up this one
+    //
+    std::atomic_store(&snapshot_m,
+                      std::shared_ptr<const Snapshot>(std::move(snapshot_p)));
+    version_m.fetch_add(1, std::memory_order_release);
+    changed_m = false;
+}
+
+size_t
+SubscriptionRegistry::match(const char* topic_p,
+                            topicId_t* ids_p,
+                            QueueingInfo* queueing_p,
+                            size_t max,
+                            uint32_t partition,
+                            uint32_t partitions)
+{
+    const Snapshot& snapshot = getSnapshot();
+
+    size_t count = snapshot.trie.match(topic_p, ids_p, max);
+
+    // Filters in place; the partition of each subscription was hashed when
+    // it was added
+    //
+    size_t kept = 0;
+    for (size_t i=0; i<count; i++)
+    {
+        if (partitions == 1
+                || snapshot.topicHashes[ids_p[i]] % partitions == partition)
+        {
+            queueing_p[kept] = snapshot.queueing[ids_p[i]];
+            ids_p[kept++] = ids_p[i];
+        }
+    }
+
+    return kept;
+}
+
+void
+SubscriptionRegistry::list(std::vector<topicId_t>& ids,
+                           uint32_t partition,
+                           uint32_t partitions)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    for (topicId_t topicId=0; topicId<subscriptions_m.size(); topicId++)
+    {
+        if (active_m[topicId]
+                && topicHashes_m[topicId] % partitions == partition)
+        {
+            ids.push_back(topicId);
+        }
+    }
+}
+
+bool
+SubscriptionRegistry::isActive(topicId_t topicId)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    return topicId < active_m.size() && active_m[topicId];
+}
+
+bool
+SubscriptionRegistry::get(topicId_t topicId, SubscriptionInfo& info)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+
+    if (topicId >= subscriptions_m.size()) { return false; }
+
+    info = subscriptions_m[topicId];
+    return true;
+}
+
+} /* namespace topicMonitor */
@@ -0,0 +1,172 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_SUBSCRIPTION_REGISTRY_HPP_
+#define _TOPIC_MONITOR_SUBSCRIPTION_REGISTRY_HPP_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "common.hpp"
+#include "topicTrie.hpp"
+#include "utils.hpp"
+
+namespace topicMonitor
+{
+
+// This class assigns a topicId_t to every subscription so that work entries
+// can refer to a topic by a small integer instead of carrying a std::string.
+//
+// It also keeps a TopicTrie of the active subscriptions, which the ingest
+// path uses to find every subscription (including wildcard subscriptions)
+// matching the destination of a received message.
+//
+// Every session context thread matches messages at once, so match() takes no
+// lock. It reads an immutable Snapshot of the trie and of how messages are
+// queued, which each thread keeps a reference to. Adding or removing a
+// subscription, on the (rare) control path, builds and publishes a new
+// snapshot and bumps a version; a thread seeing a new version picks up the
+// current snapshot, still without the mutex, and holds on to at most one
+// outdated snapshot. Changes made between beginBatch() and endBatch(), such as
+// the subscriptions added at startup, are published as a single snapshot.
+//
+class SubscriptionRegistry
+{
+public:
+    static SubscriptionRegistry* instance(void)
+    {
+        if (instance_mps == nullptr)
+        {
+            instance_mps = new SubscriptionRegistry();
+        }
+
+        return instance_mps;
+    }
+    ~SubscriptionRegistry(void) {}
+
+    // Registers the subscription and makes it active for matching. Guaranteed
+    // subscriptions are registered but never matched.
+    //
+    topicId_t add(const SubscriptionInfo& info);
+
+    // Deactivates the subscription; its id is never reused
+    //
+    void remove(topicId_t topicId);
+
+    // Changes made from beginBatch() on are not matched until the matching
+    // endBatch() publishes them all at once. Batches may nest.
+    //
+    void beginBatch(void);
+    void endBatch(void);
+
+    bool get(topicId_t topicId, SubscriptionInfo& info);
+
+    // Whether the subscription was added and not removed since
+    //
+    bool isActive(topicId_t topicId);
+
+    // Writes the ids of up to max active subscriptions matching topic_p to
+    // ids_p, and how their messages are queued to queueing_p, and returns the
+    // number of matches. Only subscriptions whose topic is in the given partition, out
+    // of partitions, are matched.
+    //
+    size_t match(const char* topic_p,
+                 topicId_t* ids_p,
+                 QueueingInfo* queueing_p,
+                 size_t max,
+                 uint32_t partition = 0,
+                 uint32_t partitions = 1);
+
+    // Writes the ids of the active subscriptions in the given partition, out
+    // of partitions, to ids
+    //
+    void list(std::vector<topicId_t>& ids,
+              uint32_t partition = 0,
+              uint32_t partitions = 1);
+
+    // The partition, out of partitions, a subscription topic belongs to. A
+    // guaranteed subscription belongs to the partition of its queue name.
+    //
+    static uint32_t getPartition(const char* topic_p, uint32_t partitions)
+        { return utils::hashTopic(topic_p) % partitions; }
+
+    // The hash a subscription is partitioned by, that of its topic or, for a
+    // guaranteed subscription, of its queue name
+    //
+    static uint32_t hashSubscription(const SubscriptionInfo& info)
+    {
+        return utils::hashTopic(info.isGuaranteed() ? info.getQueue().c_str()
+                                                    : info.getTopic().c_str());
+    }
+
+private:
+    // What match() reads, never modified once published
+    //
+    struct Snapshot
+    {
+        TopicTrie                 trie;
+        std::vector<uint32_t>     topicHashes;
+        std::vector<QueueingInfo> queueing;
+    };
+
+    SubscriptionRegistry(void)
+        : batchDepth_m(0),
+          changed_m(false),
+          version_m(1),
+          snapshot_m(std::make_shared<Snapshot>()) {}
+
+    // The current snapshot, as seen by the calling thread
+    //
+    const Snapshot& getSnapshot(void);
+
+    // Publishes the changes unless a batch is open. Must be called with the
+    // mutex held.
+    //
+    void publishChanges(void);
+
+    static SubscriptionRegistry*            instance_mps;
+    std::mutex                              mutex_m;
+    SubscriptionInfoList                    subscriptions_m;
+    std::vector<bool>                       active_m;
+    std::vector<uint32_t>                   topicHashes_m;
+    std::vector<QueueingInfo>               queueing_m;
+    uint32_t                                batchDepth_m;
+    bool                                    changed_m;
+
+    // Bumped once snapshot_m is replaced; snapshot_m is only accessed with
+    // std::atomic_load() and std::atomic_store()
+    //
+    std::atomic<uint64_t>                   version_m;
+    std::shared_ptr<const Snapshot>         snapshot_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_SUBSCRIPTION_REGISTRY_HPP_ */
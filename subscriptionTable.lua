@@ -1,12 +1,24 @@
 -- 
 -- A table entry has the following format:
 --
--- key: <topic:string>
+-- key: <topic:string>  (may contain Solace wildcards, e.g. "sensors/*/temp", "alerts/>")
 -- value: table { 
 --          key: "filename", value: <filename:string>,
 --          key: "timer", value: <seconds:int>,        (optional)
+--          key: "queue", value: <queue:string>,       (optional)
+--          key: "maxUnacked", value: <count:int>,     (optional)
+--          key: "probe", value: <table>,              (optional)
+--          key: "conflate", value: <boolean>,         (optional)
+--          key: "priority", value: "high" | "normal" | "low", (optional)
+--          key: "spill", value: <boolean>,            (optional)
+--          key: "shed", value: <table>,               (optional)
 --        }
 --
+-- A shed table, e.g. { sample = 10, maxAgeMs = 5000, skip = false }, sets how
+-- the topic sheds load while its worker is more than shedLatencyTargetMs
+-- behind: handle 1 in sample messages, skip messages older than maxAgeMs, or
+-- skip them all.
+--
 subscriptionTable = {
     ["temperature"] = {
         ["filename"] = "temperature.lua",
@@ -0,0 +1,275 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+//
+// Drives the worker pipeline through MockTransport, without a broker:
+// subscriptions, injected messages, onMessage(), onBatch(), onTimer(),
+// script timers and published messages looped back to a subscription.
+//
+// Usage: mock-transport-test virtual|batch
+//
+// virtual: messages with chosen timestamps on the virtual clock, checked
+//          against the exact sequence of callbacks they must produce
+// batch:   batch deadlines on the real clock, with one batch flushed by size
+//          while another waits for its deadline
+//
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+#include "log.hpp"
+#include "mockTransport.hpp"
+#include "monitoringThread.hpp"
+#include "publisher.hpp"
+#include "testUtils.hpp"
+#include "transport.hpp"
+#include "utils.hpp"
+
+using namespace topicMonitor;
+
+static const int64_t START_TIME = 1700000000100LL;
+
+static MockTransport*
+start(const std::string& config)
+{
+    test::writeFile("config.lua", config);
+    if (Config::instance()->load("config.lua") != returnCode_t::SUCCESS)
+        LOG(FATAL, "Could not load config.lua");
+
+    MockTransport* transport_p =
+        static_cast<MockTransport*>(Transport::instance());
+    if (transport_p->connect() != returnCode_t::SUCCESS)
+        LOG(FATAL, "Could not connect mockTransport");
+
+    if (MonitoringThread::instance()->start() != returnCode_t::SUCCESS)
+        LOG(FATAL, "Could not start workers");
+    Publisher::instance()->start();
+
+    return transport_p;
+}
+
+static void
+subscribe(const std::string& topic,
+          const std::string& filename,
+          uint32_t timeout)
+{
+    SubscriptionInfo info;
+    info.setTopic(topic);
+    info.setFilename(filename);
+    info.setTimeout(timeout);
+    if (MonitoringThread::instance()->addSubscription(info)
+            != returnCode_t::SUCCESS)
+        LOG(FATAL, "Could not subscribe to '" << topic << "'");
+}
+
+static void
+inject(MockTransport* transport_p,
+       const std::string& topic,
+       const std::string& payload,
+       int64_t timestamp)
+{
+    if (transport_p->inject(topic, payload.data(), payload.size(), timestamp)
+            != returnCode_t::SUCCESS)
+        LOG(FATAL, "Could not inject on '" << topic << "'");
+}
+
+static std::string
+at(int64_t offset)
+{
+    return std::to_string(START_TIME + offset);
+}
+
+static void
+testVirtual(void)
+{
+    MockTransport* transport_p = start("config = {\n"
+                                       "    virtualClock = true,\n"
+                                       "    transport = 'mock',\n"
+                                       "}\n");
+
+    // Logs every callback with the virtual time it ran at. A "late" message
+    // sets a one-shot timer, an "alert" one is published to the subscription
+    // of alerts.lua.
+    //
+    test::writeFile("monitoring-scripts/orders.lua",
+        "local log = io.open('events.log', 'a')\n"
+        "\n"
+        "local function write(line)\n"
+        "    log:write(string.format('%s %d\\n', line, timer.now()))\n"
+        "    log:flush()\n"
+        "end\n"
+        "\n"
+        "function onMessage(payload, subscription, msg)\n"
+        "    local text = payload:tostring()\n"
+        "    write('message ' .. text)\n"
+        "    if text == 'late' then\n"
+        "        timer.after(1500, function() write('after') end)\n"
+        "    elseif text:sub(1, 5) == 'alert' then\n"
+        "        publish('alerts/orders', payload)\n"
+        "    end\n"
+        "end\n"
+        "\n"
+        "function onTimer()\n"
+        "    write('timer')\n"
+        "end\n");
+    test::writeFile("monitoring-scripts/alerts.lua",
+        "local log = io.open('alerts.log', 'a')\n"
+        "\n"
+        "function onMessage(payload, subscription, msg)\n"
+        "    log:write(msg:topic() .. ' ' .. payload:tostring() .. '\\n')\n"
+        "    log:flush()\n"
+        "end\n");
+
+    subscribe("orders/>", "orders.lua", 2);
+    subscribe("alerts/orders", "alerts.lua", 0);
+
+    inject(transport_p, "orders/1", "a", START_TIME);
+    inject(transport_p, "orders/2", "late", START_TIME + 1000);
+    inject(transport_p, "orders/1", "b", START_TIME + 2000);
+    inject(transport_p, "orders/3", "alert-1", START_TIME + 3000);
+    inject(transport_p, "orders/1", "c", START_TIME + 4500);
+    inject(transport_p, "other/1", "ignored", START_TIME + 4600);
+
+    // The timers due before a message run before it, at the time they were
+    // due, counted from the first message
+    //
+    std::vector<std::string> expected = {
+        "message a " + at(0),
+        "message late " + at(1000),
+        "timer " + at(2000),
+        "message b " + at(2000),
+        "after " + at(2500),
+        "message alert-1 " + at(3000),
+        "timer " + at(4000),
+        "message c " + at(4500),
+    };
+
+    TEST_CHECK(test::waitForLines("events.log", expected.size(), 10000));
+    TEST_CHECK(test::waitForLines("alerts.log", 1, 10000));
+
+    // Nothing else may show up once the messages are handled
+    //
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    TEST_CHECK(test::readLines("events.log") == expected);
+    TEST_CHECK(test::readLines("alerts.log")
+                   == std::vector<std::string>{ "alerts/orders alert-1" });
+    TEST_CHECK(transport_p->getMessagesDelivered() == 7);
+}
+
+static void
+testBatch(void)
+{
+    static const uint64_t MAX_WAIT = 1000;
+    static const uint64_t SLACK    = 250;
+
+    MockTransport* transport_p = start("config = {\n"
+                                       "    transport = 'mock',\n"
+                                       "    batchMaxMessages = 2,\n"
+                                       "    batchMaxWaitMs = 1000,\n"
+                                       "}\n");
+
+    // Logs the size of every batch and when it was flushed. The scripts
+    // define no onMessage(), which onBatch() stands in for.
+    //
+    for (const char* name_p : { "a", "b" })
+    {
+        std::string name(name_p);
+        test::writeFile("monitoring-scripts/" + name + ".lua",
+            "local log = io.open('" + name + ".log', 'a')\n"
+            "\n"
+            "function onBatch(payloads, subscription, msgs)\n"
+            "    log:write(string.format('%d %d\\n', #payloads, timer.now()))\n"
+            "    log:flush()\n"
+            "end\n");
+        subscribe("batch/" + name, name + ".lua", 0);
+    }
+
+    // a's first batch is flushed by size, but a stays busy while b waits
+    // for its deadline, which must not be put off by a's later batch
+    //
+    inject(transport_p, "batch/a", "1", 0);
+    inject(transport_p, "batch/a", "2", 0);
+    uint64_t bTime = utils::getMonotonicTimeMs();
+    inject(transport_p, "batch/b", "1", 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(800));
+    uint64_t aTime = utils::getMonotonicTimeMs();
+    inject(transport_p, "batch/a", "3", 0);
+
+    TEST_CHECK(test::waitForLines("b.log", 1, 5000));
+    TEST_CHECK(test::waitForLines("a.log", 2, 5000));
+
+    std::vector<std::string> a = test::readLines("a.log");
+    std::vector<std::string> b = test::readLines("b.log");
+    uint32_t size;
+    uint64_t time;
+
+    TEST_CHECK(b.size() == 1
+               && sscanf(b[0].c_str(), "%u %lu", &size, &time) == 2
+               && size == 1
+               && time >= bTime + MAX_WAIT
+               && time <= bTime + MAX_WAIT + SLACK);
+
+    TEST_CHECK(a.size() == 2
+               && sscanf(a[0].c_str(), "%u %lu", &size, &time) == 2
+               && size == 2
+               && time <= bTime + SLACK);
+    TEST_CHECK(a.size() == 2
+               && sscanf(a[1].c_str(), "%u %lu", &size, &time) == 2
+               && size == 1
+               && time >= aTime + MAX_WAIT
+               && time <= aTime + MAX_WAIT + SLACK);
+}
+
+int
+main(int argc, char* argv[])
+{
+    Logger::init(std::cout, Logger::logLevel_t::WARN);
+    test::enterTestDirectory();
+
+    if (argc == 2 && strcmp(argv[1], "virtual") == 0)
+    {
+        testVirtual();
+    }
+    else if (argc == 2 && strcmp(argv[1], "batch") == 0)
+    {
+        testBatch();
+    }
+    else
+    {
+        std::cerr << "Usage: " << argv[0] << " virtual|batch" << std::endl;
+        return 1;
+    }
+
+    test::finish();
+}
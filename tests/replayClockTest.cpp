@@ -0,0 +1,201 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+//
+// Replays a capture on the virtual clock and checks that subscription timers
+// count from the first message: a capture recorded at today's wall clock time
+// must not expire every timer armed before it, and each onTimer() must run
+// exactly when its interval has elapsed on the clock of the capture.
+//
+#include <cstdint>
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+#include <string>
+#include <vector>
+
+#include "captureFile.hpp"
+#include "config.hpp"
+#include "log.hpp"
+#include "monitoringThread.hpp"
+#include "testUtils.hpp"
+#include "transport.hpp"
+
+using namespace topicMonitor;
+
+// Capture start, off a tick boundary, and spacing of its messages, which
+// alternate between the two topics
+//
+static const int64_t  START_TIME = 1700000000250LL;
+static const int64_t  INTERVAL   = 500;
+static const uint32_t MESSAGES   = 53;
+
+static std::string
+getScript(const std::string& logFilename)
+{
+    return "local log = io.open('" + logFilename + "', 'a')\n"
+           "\n"
+           "function onMessage(payload, subscription, msg)\n"
+           "    log:write(string.format('message %d\\n', timer.now()))\n"
+           "    log:flush()\n"
+           "end\n"
+           "\n"
+           "function onTimer()\n"
+           "    log:write(string.format('timer %d\\n', timer.now()))\n"
+           "    log:flush()\n"
+           "end\n";
+}
+
+static void
+writeCapture(const std::string& filename)
+{
+    CaptureWriter writer;
+    if (writer.open(filename) != returnCode_t::SUCCESS)
+        LOG(FATAL, "Could not open capture '" << filename << "'");
+
+    for (uint32_t i=0; i<MESSAGES; i++)
+    {
+        int64_t timestamp = START_TIME + i * INTERVAL;
+
+        solClient_destination_t dest;
+        dest.destType = SOLCLIENT_TOPIC_DESTINATION;
+        dest.dest = (i % 2 == 0) ? "sensors/a" : "sensors/b";
+
+        solClient_opaqueMsg_pt msg_p = nullptr;
+        if (solClient_msg_alloc(&msg_p) != SOLCLIENT_OK
+                || solClient_msg_setDestination(msg_p, &dest, sizeof(dest))
+                       != SOLCLIENT_OK
+                || solClient_msg_setBinaryAttachment(msg_p, "x", 1)
+                       != SOLCLIENT_OK
+                || solClient_msg_setSenderTimestamp(msg_p, timestamp)
+                       != SOLCLIENT_OK
+                || writer.append(msg_p, timestamp) != returnCode_t::SUCCESS)
+            LOG(FATAL, "Could not capture message " << i);
+
+        solClient_msg_free(&msg_p);
+    }
+
+    writer.close();
+}
+
+// Times of the lines of a log starting with prefix
+//
+static std::vector<int64_t>
+getTimes(const std::vector<std::string>& lines, const std::string& prefix)
+{
+    std::vector<int64_t> times;
+    for (const std::string& line : lines)
+    {
+        if (line.compare(0, prefix.size(), prefix) == 0)
+        {
+            times.push_back(std::stoll(line.substr(prefix.size())));
+        }
+    }
+
+    return times;
+}
+
+static void
+checkTimers(const std::string& logFilename,
+            uint32_t timeoutMs,
+            size_t messages)
+{
+    std::vector<std::string> lines = test::readLines(logFilename);
+    std::vector<int64_t> timers = getTimes(lines, "timer ");
+    int64_t lastMessage = START_TIME + (MESSAGES - 1) * INTERVAL;
+
+    std::vector<int64_t> expected;
+    for (int64_t time=START_TIME + timeoutMs; time<=lastMessage;
+         time+=timeoutMs)
+    {
+        expected.push_back(time);
+    }
+
+    TEST_CHECK(getTimes(lines, "message ").size() == messages);
+    TEST_CHECK(timers == expected);
+    for (int64_t time : timers)
+    {
+        TEST_CHECK(time >= START_TIME + timeoutMs);
+    }
+}
+
+int
+main(int argc, char* argv[])
+{
+    Logger::init(std::cout, Logger::logLevel_t::WARN);
+    test::enterTestDirectory();
+
+    test::writeFile("config.lua",
+                    "config = {\n"
+                    "    workerThreads = 2,\n"
+                    "    virtualClock = true,\n"
+                    "    transport = 'replay',\n"
+                    "    replay = { file = 'capture.bin', speed = 0 },\n"
+                    "}\n");
+    test::writeFile("monitoring-scripts/a.lua", getScript("a.log"));
+    test::writeFile("monitoring-scripts/b.lua", getScript("b.log"));
+
+    if (Config::instance()->load("config.lua") != returnCode_t::SUCCESS)
+        LOG(FATAL, "Could not load config.lua");
+
+    // Created first, as it initializes solClient
+    //
+    Transport* transport_p = Transport::instance();
+    writeCapture("capture.bin");
+
+    MonitoringThread* thread_p = MonitoringThread::instance();
+    if (thread_p->start() != returnCode_t::SUCCESS)
+        LOG(FATAL, "Could not start workers");
+
+    // Timers of 10s and 4s, armed before the first message. The two topics
+    // go to different workers, each with its own timeout wheel.
+    //
+    SubscriptionInfo a;
+    a.setTopic("sensors/a");
+    a.setFilename("a.lua");
+    a.setTimeout(10);
+    thread_p->addSubscription(a);
+
+    SubscriptionInfo b;
+    b.setTopic("sensors/b");
+    b.setFilename("b.lua");
+    b.setTimeout(4);
+    thread_p->addSubscription(b);
+
+    if (transport_p->connect() != returnCode_t::SUCCESS)
+        LOG(FATAL, "Could not replay capture.bin");
+
+    // Messages, then the timers due by the last of them
+    //
+    TEST_CHECK(test::waitForLines("a.log", 27 + 2, 10000));
+    TEST_CHECK(test::waitForLines("b.log", 26 + 6, 10000));
+
+    checkTimers("a.log", 10000, 27);
+    checkTimers("b.log", 4000, 26);
+
+    test::finish();
+}
@@ -0,0 +1,134 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "testUtils.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace topicMonitor
+{
+namespace test
+{
+
+static uint32_t failures_s = 0;
+
+void
+enterTestDirectory(void)
+{
+    char directory[] = "/tmp/topic-monitor-test-XXXXXX";
+    if (mkdtemp(directory) == nullptr
+            || chdir(directory) != 0
+            || mkdir("monitoring-scripts", 0755) != 0)
+    {
+        std::cerr << "Could not create test directory" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::cout << "Running in " << directory << std::endl;
+}
+
+void
+writeFile(const std::string& filename, const std::string& content)
+{
+    std::ofstream file(filename, std::ios::trunc);
+    file << content;
+    if (!file)
+    {
+        std::cerr << "Could not write '" << filename << "'" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+std::vector<std::string>
+readLines(const std::string& filename)
+{
+    std::vector<std::string> lines;
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        lines.push_back(line);
+    }
+
+    return lines;
+}
+
+bool
+waitForLines(const std::string& filename, size_t count, uint32_t timeoutMs)
+{
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now()
+        + std::chrono::milliseconds(timeoutMs);
+
+    std::vector<std::string> lines;
+    while ((lines = readLines(filename)).size() < count)
+    {
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            std::cout << "Timed out waiting for " << count << " lines in '"
+                      << filename << "', got " << lines.size() << ":"
+                      << std::endl;
+            for (const std::string& line : lines)
+            {
+                std::cout << "    " << line << std::endl;
+            }
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    return true;
+}
+
+void
+check(bool passed, const char* cond_p, const char* file_p, int line)
+{
+    if (passed) { return; }
+
+    failures_s++;
+    std::cout << file_p << ":" << line << ": check failed: " << cond_p
+              << std::endl;
+}
+
+void
+finish(void)
+{
+    std::cout << (failures_s == 0 ? "PASSED" : "FAILED") << std::endl;
+    std::cout.flush();
+    std::_Exit(failures_s == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+} /* namespace test */
+} /* namespace topicMonitor */
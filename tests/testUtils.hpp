@@ -0,0 +1,78 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_TEST_UTILS_HPP_
+#define _TOPIC_MONITOR_TEST_UTILS_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Checks a condition, reporting it and failing the test without stopping it
+//
+#define TEST_CHECK(cond) \
+    topicMonitor::test::check((cond), #cond, __FILE__, __LINE__)
+
+namespace topicMonitor
+{
+namespace test
+{
+
+// The engine is made of process-wide singletons, so each test is a process
+// of its own, running the whole pipeline in a temporary directory laid out
+// like the one topic-monitor runs in.
+//
+// Creates the temporary directory, with its monitoring-scripts directory,
+// and makes it the working directory
+//
+void enterTestDirectory(void);
+
+void writeFile(const std::string& filename, const std::string& content);
+
+// Lines of a file, empty if it does not exist
+//
+std::vector<std::string> readLines(const std::string& filename);
+
+// Waits up to timeoutMs for a file to have at least count lines. Returns
+// false on timeout, after printing the lines it has.
+//
+bool waitForLines(const std::string& filename,
+                  size_t count,
+                  uint32_t timeoutMs);
+
+void check(bool passed, const char* cond_p, const char* file_p, int line);
+
+// Reports the result and exits with it. The worker threads never stop, so
+// the process exits without running destructors.
+//
+void finish(void);
+
+} /* namespace test */
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_TEST_UTILS_HPP_ */
@@ -31,96 +31,409 @@
 #include <sstream>
 
 #include "log.hpp"
-#include "monitoringThread.hpp"
 
 namespace topicMonitor
 {
 
+TimeoutInfoPool::~TimeoutInfoPool(void)
+{
+    for (TimeoutInfo* chunk_p : chunks_m)
+    {
+        delete[] chunk_p;
+    }
+}
+
+TimeoutInfo*
+TimeoutInfoPool::get(void)
+{
+    if (free_mp == nullptr) { grow(); }
+
+    TimeoutInfo* info_p = free_mp;
+    free_mp = static_cast<TimeoutInfo*>(info_p->next_mp);
+    info_p->next_mp = info_p;
+    info_p->prev_mp = info_p;
+    info_p->generation_m =
+        (info_p->generation_m + 1) & TimeoutHandle::GENERATION_MASK;
+    return info_p;
+}
+
 void
-TimeoutWheel::add(std::string topic, uint32_t timeout)
+TimeoutInfoPool::put(TimeoutInfo* info_p)
 {
-    // The timeout argument is the timeout in seconds. Convert these to a pair
-    // of minute:seconds.
+    // Invalidates all handles to the object
     //
-    uint32_t minutes = timeout / 60;
-    uint32_t seconds = timeout % 60;
+    info_p->generation_m =
+        (info_p->generation_m + 1) & TimeoutHandle::GENERATION_MASK;
 
-    // Calculate the index to insert the TimeoutInfo object by adding the
-    // seconds to the index, rolling over at 60 in necessary.
+    // Free objects are chained through next_mp
     //
-    // i.e.
+    info_p->next_mp = free_mp;
+    free_mp = info_p;
+}
+
+TimeoutInfo*
+TimeoutInfoPool::find(const TimeoutHandle& handle) const
+{
+    if (handle.index / CHUNK_SIZE >= chunks_m.size()) { return nullptr; }
+
+    TimeoutInfo* info_p =
+        &chunks_m[handle.index / CHUNK_SIZE][handle.index % CHUNK_SIZE];
+    if (info_p->generation_m != handle.generation
+            || (info_p->generation_m & 1) == 0)
+    {
+        return nullptr;
+    }
+
+    return info_p;
+}
+
+void
+TimeoutInfoPool::grow(void)
+{
+    TimeoutInfo* chunk_p = new TimeoutInfo[CHUNK_SIZE];
+    uint32_t base = chunks_m.size() * CHUNK_SIZE;
+    chunks_m.push_back(chunk_p);
+
+    // Pushed in reverse so objects are handed out in index order
     //
-    // timeout value of 6                 timeout value of 23
-    // ==================                 ===================
-    // timeout in seconds  = 6            timeout in seconds  = 23
-    // timeout in minutes  = 0            timeout in minutes  = 0
-    // current wheel index = 40           current wheel index = 58
-    // index to insert     = 46           index to insert     = 21
+    for (size_t i=CHUNK_SIZE; i-- > 0;)
+    {
+        chunk_p[i].index_m = base + i;
+        chunk_p[i].next_mp = free_mp;
+        free_mp = &chunk_p[i];
+    }
+}
+
+TimeoutHandle
+TimeoutWheel::add(topicId_t topicId,
+                  uint32_t timeout,
+                  bool periodic,
+                  uint32_t kind,
+                  int data)
+{
+    if (periodic && timeout == 0) { timeout = 1; }
+
+    TimeoutInfo* info_p = pool_m.get();
+    info_p->setTopicId(topicId);
+    info_p->setTimeout(timeout);
+    info_p->setExpiry(getTime() + timeout);
+    info_p->setKind(kind);
+    info_p->setData(data);
+    info_p->setPeriodic(periodic);
+
+    insert(info_p);
+    size_m++;
+
+    return info_p->getHandle();
+}
+
+bool
+TimeoutWheel::cancel(const TimeoutHandle& handle)
+{
+    TimeoutInfo* info_p = pool_m.find(handle);
+    if (info_p == nullptr) { return false; }
+
+    // The slot's occupied bit is left set; it is cleared when the slot is
+    // next processed
     //
-    uint32_t curWheelIndex = ticks_m % 60;
-    uint32_t indexToInsert = (curWheelIndex + seconds) % 60;
-
-    // The timeout wheel has a size of 60; tracking every second in a minute, if
-    // the timeout is longer than 60 seconds, then we keep an iterationsLeft
-    // variable to track the number of times the timeout wheel has to pass this
-    // object before it expires. In most cases, this variable is set directly to
-    // the number of minutes calculated above. However, due an implementation
-    // detail, a special case is made for when the timeout is exactly on a
-    // minute boundary (seconds is 0); we have to subtract 1 from the number of
-    // minutes.
+    info_p->unlink();
+    pool_m.put(info_p);
+    size_m--;
+    return true;
+}
+
+bool
+TimeoutWheel::reschedule(const TimeoutHandle& handle, uint32_t timeout)
+{
+    TimeoutInfo* info_p = pool_m.find(handle);
+    if (info_p == nullptr) { return false; }
+
+    if (info_p->isPeriodic() && timeout == 0) { timeout = 1; }
+
+    info_p->unlink();
+    info_p->setTimeout(timeout);
+    info_p->setExpiry(getTime() + timeout);
+    insert(info_p);
+    return true;
+}
+
+void
+TimeoutWheel::insert(TimeoutInfo* info_p)
+{
+    // A timeout that is already due goes to the next slot to be processed
+    //
+    uint64_t expiry = info_p->getExpiry();
+    if (expiry < nextTime_m) { expiry = nextTime_m; }
+
+    // Find the lowest level whose range covers the expiry. Each level covers
+    // SLOTS times the range of the one below it.
     //
     // i.e.
     //
-    // timeout value of 180               timeout value of 181
-    // ====================               ====================
-    // timeout in seconds  = 0            timeout in seconds  = 1
-    // timeout in minutes  = 3            timeout in minutes  = 3
-    // current wheel index = 40           current wheel index = 40
-    // index to insert     = 40           index to insert     = 41
-    // iterations left     = 2            iterations left     = 3
+    // timeout of 200ms           timeout of 5000ms          timeout of 1h
+    // ================           =================          =============
+    // level = 0                  level = 1                  level = 2
+    // slot  = expiry % 256       slot  = expiry / 256 %256  slot  = expiry / 65536 % 256
     //
-    uint32_t iterationsLeft = (seconds == 0)?(minutes - 1):minutes;
+    uint64_t delta = expiry - nextTime_m;
+    uint32_t level = 0;
+    while (level < LEVELS - 1 && (delta >> (SLOT_BITS * (level + 1))) != 0)
+    {
+        level++;
+    }
 
-    TimeoutInfoList& list = wheel_m[indexToInsert];
-    list.emplace_back(topic, timeout, iterationsLeft);
+    // Timeouts beyond the range of the wheel are parked in the furthest slot
+    // and re-inserted with their real expiry when it is cascaded
+    //
+    if ((delta >> (SLOT_BITS * LEVELS)) != 0)
+    {
+        expiry = nextTime_m + (1ULL << (SLOT_BITS * LEVELS)) - 1;
+    }
+
+    uint32_t slot = (expiry >> (SLOT_BITS * level)) & SLOT_MASK;
+    Level& wheel = levels_m[level];
+    wheel.slots[slot].pushBack(info_p);
+    wheel.occupied[slot / 64] |= 1ULL << (slot % 64);
 }
 
 void
-TimeoutWheel::tick(void)
+TimeoutWheel::cascade(uint32_t level)
 {
-    // Iterate through the list of TimeoutInfo objects and checks if they have
-    // expired. If they have, delete the object and notify MonitoringThread.
+    uint32_t slot = (nextTime_m >> (SLOT_BITS * level)) & SLOT_MASK;
+    Level& wheel = levels_m[level];
+
+    TimeoutLink list;
+    wheel.slots[slot].moveTo(list);
+    wheel.occupied[slot / 64] &= ~(1ULL << (slot % 64));
+
+    while (!list.empty())
+    {
+        TimeoutInfo* info_p = static_cast<TimeoutInfo*>(list.next_mp);
+        info_p->unlink();
+        insert(info_p);
+    }
+
+    // The next level is cascaded whenever this one wraps around
     //
-    TimeoutInfoList& list = wheel_m[++ticks_m % 60];
-    auto it = list.begin();
-    while (it != list.end())
+    if (slot == 0 && level + 1 < LEVELS) { cascade(level + 1); }
+}
+
+void
+TimeoutWheel::expire(uint32_t slot, uint64_t now)
+{
+    Level& wheel = levels_m[0];
+
+    // Handlers may cancel timeouts that are still on this list, which simply
+    // unlinks them
+    //
+    TimeoutLink list;
+    wheel.slots[slot].moveTo(list);
+    wheel.occupied[slot / 64] &= ~(1ULL << (slot % 64));
+
+    while (!list.empty())
     {
-        TimeoutInfo& info = *it;
+        TimeoutInfo* info_p = static_cast<TimeoutInfo*>(list.next_mp);
+        info_p->unlink();
 
-        // If there are 0 iterations left, then the timeout has expired.
-        //
-        if (info.getIterationsLeft() == 0)
+        TimeoutEvent event;
+        event.handle = info_p->getHandle();
+        event.topicId = info_p->getTopicId();
+        event.timeout = info_p->getTimeout();
+        event.kind = info_p->getKind();
+        event.data = info_p->getData();
+        event.periodic = info_p->isPeriodic();
+        event.lateness = now - info_p->getExpiry();
+
+        if (event.periodic)
         {
-            // Create a work entry and enqueue it to MonitoringThread's work
-            // queue
+            // Re-arm from the previous expiry so the period does not drift,
+            // skipping the periods that were missed entirely
             //
-            WorkEntryTimeout* entry_p = new WorkEntryTimeout();
-            entry_p->setTopic(info.getTopic());
-            entry_p->setTimeout(info.getTimeout());
-            MonitoringThread::instance()->getWorkQueue()->push(entry_p);
+            uint64_t expiry = info_p->getExpiry() + event.timeout;
+            if (expiry <= now)
+            {
+                expiry += ((now - expiry) / event.timeout + 1) * event.timeout;
+            }
+            info_p->setExpiry(expiry);
+            insert(info_p);
+        }
 
-            // Delete the object from the list
-            //
-            it = list.erase(it);
+        handler_mp->handleTimeout(event);
+
+        // A one-shot timeout is released once handled, unless the handler
+        // cancelled or rescheduled it
+        //
+        if (!event.periodic
+                && pool_m.find(event.handle) == info_p
+                && info_p->empty())
+        {
+            pool_m.put(info_p);
+            size_m--;
         }
-        else
+    }
+}
+
+void
+TimeoutWheel::rebase(uint64_t now)
+{
+    uint64_t time = getTime();
+    if (now <= time) { return; }
+
+    // Takes every timeout out of the wheel, then inserts them again with
+    // their expiries shifted
+    //
+    TimeoutLink list;
+    for (uint32_t level=0; level<LEVELS; level++)
+    {
+        Level& wheel = levels_m[level];
+        for (uint32_t slot=0; slot<SLOTS; slot++)
         {
-            // Decrement the iterations left
-            //
-            info.setIterationsLeft(info.getIterationsLeft()-1);
-            it++;
+            while (!wheel.slots[slot].empty())
+            {
+                TimeoutLink* link_p = wheel.slots[slot].next_mp;
+                link_p->unlink();
+                list.pushBack(link_p);
+            }
+        }
+        for (uint32_t word=0; word<WORDS; word++)
+        {
+            wheel.occupied[word] = 0;
+        }
+    }
+
+    nextTime_m = now + 1;
+
+    while (!list.empty())
+    {
+        TimeoutInfo* info_p = static_cast<TimeoutInfo*>(list.next_mp);
+        info_p->unlink();
+        info_p->setExpiry(info_p->getExpiry() + (now - time));
+        insert(info_p);
+    }
+}
+
+uint32_t
+TimeoutWheel::findOccupied(const Level& level, uint32_t from) const
+{
+    uint32_t word = from / 64;
+    uint64_t bits = level.occupied[word] & (~0ULL << (from % 64));
+
+    for (;;)
+    {
+        if (bits != 0) { return word * 64 + __builtin_ctzll(bits); }
+        if (++word == WORDS) { return SLOTS; }
+        bits = level.occupied[word];
+    }
+}
+
+bool
+TimeoutWheel::isEmpty(const Level& level) const
+{
+    for (uint32_t word=0; word<WORDS; word++)
+    {
+        if (level.occupied[word] != 0) { return false; }
+    }
+
+    return true;
+}
+
+uint64_t
+TimeoutWheel::getNextCascade(void) const
+{
+    // Timeouts left in level 0 belong to its next rotation
+    //
+    if (!isEmpty(levels_m[0]))
+    {
+        return ((nextTime_m >> SLOT_BITS) + 1) << SLOT_BITS;
+    }
+
+    for (uint32_t level=1; level<LEVELS; level++)
+    {
+        uint32_t shift = SLOT_BITS * level;
+
+        // The next time the level below wraps around, cascading a slot of
+        // this level
+        //
+        uint64_t wrap = ((nextTime_m >> shift) + 1) << shift;
+        uint32_t slot = (wrap >> shift) & SLOT_MASK;
+
+        uint32_t next = (slot == 0) ? SLOTS : findOccupied(levels_m[level],
+                                                           slot);
+        if (next != SLOTS)
+        {
+            return wrap + (static_cast<uint64_t>(next - slot) << shift);
+        }
+
+        // Nothing this rotation, but the next one of this level has
+        // timeouts; otherwise, look further up
+        //
+        if (!isEmpty(levels_m[level]))
+        {
+            return ((nextTime_m >> (shift + SLOT_BITS)) + 1)
+                       << (shift + SLOT_BITS);
         }
     }
+
+    return UINT64_MAX;
+}
+
+uint64_t
+TimeoutWheel::getNextExpiry(void) const
+{
+    if (size_m == 0) { return UINT64_MAX; }
+
+    // The cascade at a wrap around may move timeouts due right away
+    //
+    uint32_t slot = nextTime_m & SLOT_MASK;
+    if (slot == 0) { return nextTime_m; }
+
+    uint32_t next = findOccupied(levels_m[0], slot);
+    return (next != SLOTS) ? nextTime_m - slot + next : getNextCascade();
+}
+
+void
+TimeoutWheel::advance(uint64_t now)
+{
+    while (nextTime_m <= now)
+    {
+        if (size_m == 0)
+        {
+            nextTime_m = now + 1;
+            break;
+        }
+
+        uint32_t slot = nextTime_m & SLOT_MASK;
+
+        // Level 0 wraps around: move the timeouts of the next level 1 slot
+        // (and possibly higher levels) down
+        //
+        if (slot == 0) { cascade(1); }
+
+        // Skip empty slots, and past the rotations of level 0 which nothing
+        // cascades into, so large jumps in time cost no more than the
+        // timeouts they expire
+        //
+        uint32_t next = findOccupied(levels_m[0], slot);
+        if (next != slot)
+        {
+            uint64_t nextTime = (next != SLOTS) ? nextTime_m - slot + next
+                                                : getNextCascade();
+            if (nextTime > now)
+            {
+                nextTime_m = now + 1;
+                break;
+            }
+
+            nextTime_m = nextTime;
+            continue;
+        }
+
+        // Move on before expiring, so timeouts added by the handler are never
+        // inserted in the slot being expired
+        //
+        nextTime_m++;
+        expire(slot, now);
+    }
 }
 
 void
@@ -128,15 +441,26 @@ TimeoutWheel::dumpState(void)
 {
     std::ostringstream oss;
 
-    for (uint32_t i=0; i<wheel_m.max_size(); i++)
+    oss << "time=" << getTime() << ", size=" << size_m;
+    for (uint32_t level=0; level<LEVELS; level++)
     {
-        oss << i << ":{";
-        TimeoutInfoList& list = wheel_m[i];
-        for (TimeoutInfo& info : list)
+        oss << ", level " << level << ":{";
+        for (uint32_t slot=0; slot<SLOTS; slot++)
         {
-            oss << info.getTopic() << ",";
+            const TimeoutLink& list = levels_m[level].slots[slot];
+            if (list.empty()) { continue; }
+
+            oss << slot << ":{";
+            for (const TimeoutLink* link_p = list.next_mp;
+                 link_p != &list;
+                 link_p = link_p->next_mp)
+            {
+                oss << static_cast<const TimeoutInfo*>(link_p)->getTopicId()
+                    << ",";
+            }
+            oss << "}, ";
         }
-        oss << "}, ";
+        oss << "}";
     }
 
     LOG(ERROR, oss.str());
@@ -29,69 +29,340 @@
 #ifndef _TOPIC_MONITOR_TIMEOUT_WHEEL_HPP_
 #define _TOPIC_MONITOR_TIMEOUT_WHEEL_HPP_
 
-#include <array>
-#include <list>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 
 #include "common.hpp"
 
 namespace topicMonitor
 {
 
-class TimeoutInfo
+// Link of an intrusive, circular, doubly-linked list. Every wheel slot is the
+// sentinel of such a list, so a node can be unlinked in O(1) without knowing
+// which slot it is in.
+//
+struct TimeoutLink
+{
+    TimeoutLink(void) : next_mp(this), prev_mp(this) {}
+
+    TimeoutLink(const TimeoutLink&) = delete;
+    TimeoutLink& operator=(const TimeoutLink&) = delete;
+
+    bool empty(void) const { return next_mp == this; }
+
+    // Appends link_p to the list this is the sentinel of
+    //
+    void pushBack(TimeoutLink* link_p)
+    {
+        link_p->prev_mp = prev_mp;
+        link_p->next_mp = this;
+        prev_mp->next_mp = link_p;
+        prev_mp = link_p;
+    }
+
+    void unlink(void)
+    {
+        prev_mp->next_mp = next_mp;
+        next_mp->prev_mp = prev_mp;
+        next_mp = this;
+        prev_mp = this;
+    }
+
+    // Moves all links of the list this is the sentinel of to the empty list
+    // whose sentinel is other
+    //
+    void moveTo(TimeoutLink& other)
+    {
+        if (empty()) { return; }
+
+        other.next_mp = next_mp;
+        other.prev_mp = prev_mp;
+        next_mp->prev_mp = &other;
+        prev_mp->next_mp = &other;
+        next_mp = this;
+        prev_mp = this;
+    }
+
+    TimeoutLink* next_mp;
+    TimeoutLink* prev_mp;
+};
+
+// Refers to a timeout added to a TimeoutWheel, for cancelling or rescheduling
+// it. A handle is a pool index and a generation that changes every time the
+// TimeoutInfo is reused, so a handle to a timeout that has expired or been
+// cancelled is simply not found, even if its TimeoutInfo has been reused.
+//
+// A handle fits in the 53 bit mantissa of a Lua number, see toId().
+//
+struct TimeoutHandle
+{
+    static const uint32_t GENERATION_MASK = (1 << 20) - 1;
+
+    TimeoutHandle(void) : index(UINT32_MAX), generation(0) {}
+    TimeoutHandle(uint32_t index, uint32_t generation) :
+        index(index),
+        generation(generation) {}
+
+    uint64_t toId(void) const { return ((uint64_t)generation << 32) | index; }
+    static TimeoutHandle fromId(uint64_t id)
+    {
+        return TimeoutHandle(id & UINT32_MAX,
+                             (id >> 32) & GENERATION_MASK);
+    }
+
+    uint32_t index;
+    uint32_t generation;
+};
+
+// A timeout tracked by TimeoutWheel. TimeoutInfo objects are allocated from a
+// TimeoutInfoPool and linked directly into the wheel's slots.
+//
+class TimeoutInfo : public TimeoutLink
 {
 public:
-    TimeoutInfo(std::string topic, uint32_t timeout, uint32_t iterationsLeft) :
-        topic_m(topic),
-        timeout_m(timeout),
-        iterationsLeft_m(iterationsLeft) {};
+    TimeoutInfo(void) :
+        topicId_m(INVALID_TOPIC_ID),
+        timeout_m(0),
+        expiry_m(0),
+        kind_m(0),
+        data_m(0),
+        periodic_m(false),
+        index_m(0),
+        generation_m(0) {}
     ~TimeoutInfo(void) {}
 
-    void setTopic(std::string topic) { topic_m = topic; }
-    std::string getTopic(void) const { return topic_m; }
+    void setTopicId(topicId_t topicId) { topicId_m = topicId; }
+    topicId_t getTopicId(void) const { return topicId_m; }
 
+    // The timeout in milliseconds
+    //
     void setTimeout(uint32_t timeout) { timeout_m = timeout; }
     uint32_t getTimeout(void) const { return timeout_m; }
 
-    void setIterationsLeft(uint32_t iterationsLeft)
-        { iterationsLeft_m = iterationsLeft; }
-    uint32_t getIterationsLeft(void) const { return iterationsLeft_m; }
+    // The wheel time in milliseconds at which the timeout expires
+    //
+    void setExpiry(uint64_t expiry) { expiry_m = expiry; }
+    uint64_t getExpiry(void) const { return expiry_m; }
+
+    // What the timeout is for, and data that goes with it. Both are opaque
+    // to the wheel; they are passed back to the TimeoutHandler.
+    //
+    void setKind(uint32_t kind) { kind_m = kind; }
+    uint32_t getKind(void) const { return kind_m; }
+    void setData(int data) { data_m = data; }
+    int getData(void) const { return data_m; }
+
+    // A periodic timeout is re-armed every time it expires, until cancelled
+    //
+    void setPeriodic(bool periodic) { periodic_m = periodic; }
+    bool isPeriodic(void) const { return periodic_m; }
+
+    TimeoutHandle getHandle(void) const
+        { return TimeoutHandle(index_m, generation_m); }
 
 private:
-    std::string topic_m;
-    uint32_t    timeout_m;
-    uint32_t    iterationsLeft_m;
+    friend class TimeoutInfoPool;
+
+    topicId_t topicId_m;
+    uint32_t  timeout_m;
+    uint64_t  expiry_m;
+    uint32_t  kind_m;
+    int       data_m;
+    bool      periodic_m;
+
+    // Position in the pool and reuse count, which make up the handle. The
+    // generation is odd while the object is in use and even while it is free.
+    //
+    uint32_t  index_m;
+    uint32_t  generation_m;
 };
 
-// This class maintains a circular array of 60 lists of TimeoutInfo objects that
-// correspond to every second in a minute.
+// Allocates TimeoutInfo objects in chunks and recycles them through a free
+// list, so adding and expiring timeouts does not touch the heap once the pool
+// has grown to the number of active timeouts. Objects never move, which lets
+// handles refer to them by index.
 //
-// When this class is told to track a timeout through the add() method, a
-// TimeoutInfo object is created and added to the list of TimeoutInfo objects at
-// a calculated index relative to the current index.
+class TimeoutInfoPool
+{
+public:
+    static const size_t CHUNK_SIZE = 4096;
+
+    TimeoutInfoPool(void) : free_mp(nullptr) {}
+    ~TimeoutInfoPool(void);
+
+    TimeoutInfoPool(const TimeoutInfoPool&) = delete;
+    TimeoutInfoPool& operator=(const TimeoutInfoPool&) = delete;
+
+    TimeoutInfo* get(void);
+    void put(TimeoutInfo* info_p);
+
+    // Returns the in-use object the handle refers to, or nullptr
+    //
+    TimeoutInfo* find(const TimeoutHandle& handle) const;
+
+private:
+    void grow(void);
+
+    std::vector<TimeoutInfo*> chunks_m;
+    TimeoutInfo*              free_mp;
+};
+
+// An expired timeout, as passed to TimeoutHandler
+//
+struct TimeoutEvent
+{
+    TimeoutHandle handle;
+    topicId_t     topicId;
+    uint32_t      timeout;
+    uint32_t      kind;
+    int           data;
+    bool          periodic;
+
+    // Milliseconds between the expiry and the time the wheel was advanced to
+    //
+    uint64_t      lateness;
+};
+
+// Receives the timeouts expired by TimeoutWheel::advance()
+//
+class TimeoutHandler
+{
+public:
+    virtual ~TimeoutHandler(void) {}
+    virtual void handleTimeout(const TimeoutEvent& event) = 0;
+};
+
+// This class is a hierarchical timing wheel with millisecond resolution.
+//
+// It has LEVELS levels of SLOTS slots each. A slot of level 0 covers one
+// millisecond, a slot of level 1 covers SLOTS milliseconds, and so on, so the
+// wheel tracks timeouts up to SLOTS^LEVELS milliseconds (about 49 days) ahead;
+// longer timeouts are parked in the last slot and re-inserted when it comes
+// around.
+//
+// A timeout is added to the level whose range covers its expiry. Whenever the
+// level 0 wheel wraps around, the next slot of level 1 is cascaded: its
+// timeouts are re-inserted, which moves them down to level 0. Level 1 wrapping
+// cascades level 2, and so on. Every timeout is thus moved at most LEVELS
+// times, which makes cascading O(1) amortized, and advancing the wheel never
+// touches timeouts that are not due. Empty level 0 slots are skipped using a
+// bitmap of occupied slots.
+//
+// advance() calls the TimeoutHandler inline for every expired timeout; the
+// handler may add, cancel and reschedule timeouts. A one-shot timeout stays
+// valid while its handler runs, so the handler may cancel or reschedule it,
+// and is removed once the handler returns. A periodic timeout is re-armed
+// first, so its handle stays valid and the handler may cancel it; if the wheel
+// has fallen behind by several periods, they are coalesced into one expiry.
 //
-// Every second, MonitoringThread receives a TIMER event and calls the tick()
-// method of this class during the handling of the TIMER event. On each tick,
-// the current index is incremented and the list of TimeoutInfo objects at that
-// index is traversed. Any TimeoutInfo objects on that list that has expired is
-// removed and an event is sent to MonitoringThread with information about the
-// timeout.
+// This class is not thread-safe; it is owned and used by a single
+// MonitoringWorker.
 //
 class TimeoutWheel
 {
 public:
-    typedef std::list<TimeoutInfo>          TimeoutInfoList;
-    typedef std::array<TimeoutInfoList, 60> TimeoutInfoWheel;
+    static const uint32_t LEVELS    = 4;
+    static const uint32_t SLOT_BITS = 8;
+    static const uint32_t SLOTS     = 1 << SLOT_BITS;
 
-    TimeoutWheel(void) : ticks_m(0) {}
+    // now is the current time in milliseconds, from a monotonic clock
+    //
+    TimeoutWheel(TimeoutHandler* handler_p, uint64_t now) :
+        handler_mp(handler_p),
+        nextTime_m(now + 1),
+        size_m(0) {}
     ~TimeoutWheel(void) {}
 
-    void add(std::string topic, uint32_t timeout);
-    void tick(void);
+    TimeoutWheel(const TimeoutWheel&) = delete;
+    TimeoutWheel& operator=(const TimeoutWheel&) = delete;
+
+    // Adds a timeout expiring timeout milliseconds after the wheel's current
+    // time. A periodic timeout must be at least 1 millisecond.
+    //
+    TimeoutHandle add(topicId_t topicId,
+                      uint32_t timeout,
+                      bool periodic = false,
+                      uint32_t kind = 0,
+                      int data = 0);
+
+    // Returns the active timeout the handle refers to, or nullptr if it has
+    // expired or been cancelled
+    //
+    const TimeoutInfo* find(const TimeoutHandle& handle) const
+        { return pool_m.find(handle); }
+
+    // Both return false if the timeout has expired or been cancelled. O(1).
+    //
+    bool cancel(const TimeoutHandle& handle);
+
+    // Makes the timeout expire timeout milliseconds after the wheel's
+    // current time; a periodic timeout keeps this new period. A one-shot
+    // timeout is only released after its handler has run, so the handler
+    // may reschedule it to keep it, handle and all.
+    //
+    bool reschedule(const TimeoutHandle& handle, uint32_t timeout);
+
+    // Advances the wheel to now, expiring every timeout due at or before it
+    //
+    void advance(uint64_t now);
+
+    // Moves the wheel to now without expiring anything, moving every
+    // timeout along with it: a timeout that was due in 10 milliseconds is
+    // still due in 10 milliseconds. Starts a wheel whose clock had no
+    // meaningful time when it was created, such as a virtual clock before its
+    // first message.
+    //
+    void rebase(uint64_t now);
+
+    // The time the wheel has advanced to
+    //
+    uint64_t getTime(void) const { return nextTime_m - 1; }
+
+    // The earliest time at which advance() may have timeouts to expire, or
+    // UINT64_MAX if there are none. This is exact for timeouts due within the
+    // current rotation of level 0, and the next cascade that moves timeouts
+    // down otherwise.
+    //
+    uint64_t getNextExpiry(void) const;
+
+    // Number of active timeouts
+    //
+    size_t size(void) const { return size_m; }
+
     void dumpState(void);
 
 private:
-    TimeoutInfoWheel wheel_m;
-    uint32_t         ticks_m;
+    static const uint32_t SLOT_MASK = SLOTS - 1;
+    static const uint32_t WORDS     = SLOTS / 64;
+
+    struct Level
+    {
+        Level(void) : occupied() {}
+
+        TimeoutLink slots[SLOTS];
+        uint64_t    occupied[WORDS];
+    };
+
+    void insert(TimeoutInfo* info_p);
+    void cascade(uint32_t level);
+    void expire(uint32_t slot, uint64_t now);
+    uint32_t findOccupied(const Level& level, uint32_t from) const;
+    bool isEmpty(const Level& level) const;
+
+    // The next time past the current rotation of level 0 at which a cascade
+    // may move timeouts down, or UINT64_MAX if there are none
+    //
+    uint64_t getNextCascade(void) const;
+
+    TimeoutHandler* handler_mp;
+    TimeoutInfoPool pool_m;
+    Level           levels_m[LEVELS];
+
+    // The next millisecond whose level 0 slot has not been processed
+    //
+    uint64_t        nextTime_m;
+    size_t          size_m;
 };
 
 } /* namespace topicMonitor */
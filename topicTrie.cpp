@@ -0,0 +1,381 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "topicTrie.hpp"
+
+#include <algorithm>
+
+#include "log.hpp"
+
+namespace topicMonitor
+{
+
+// Maximum number of trie nodes pending a visit while matching. Each level
+// adds at most one exact, one '*' and one prefix branch per prefix length, so
+// this is far more than any realistic topic needs; a topic needing more is
+// logged, since some of its matches are then missed.
+//
+static const size_t MATCH_STACK_SIZE = 512;
+
+TopicTrie::Node::~Node(void)
+{
+    for (auto& it : children) { delete it.second; }
+    for (auto& it : prefixChildren) { delete it.second; }
+    delete anyChild_mp;
+}
+
+bool
+TopicTrie::Node::isEmpty(void) const
+{
+    return children.empty() && anyChild_mp == nullptr
+           && prefixChildren.empty() && ids.empty() && remainderIds.empty();
+}
+
+// Splits a topic into its levels. Returns MAX_LEVELS + 1 if the topic has too
+// many levels.
+//
+size_t
+TopicTrie::splitLevels(const char* topic_p, Level* levels_p)
+{
+    size_t count = 0;
+    const char* start_p = topic_p;
+
+    for (const char* c_p = topic_p; ; c_p++)
+    {
+        if (*c_p == '/' || *c_p == '\0')
+        {
+            if (count == MAX_LEVELS) { return MAX_LEVELS + 1; }
+
+            levels_p[count].data_p = start_p;
+            levels_p[count].length = c_p - start_p;
+            count++;
+
+            if (*c_p == '\0') { break; }
+            start_p = c_p + 1;
+        }
+    }
+
+    return count;
+}
+
+bool
+TopicTrie::isPrefixLevel(const Level& level)
+{
+    return level.length > 1 && level.data_p[level.length - 1] == '*';
+}
+
+TopicTrie::Node*
+TopicTrie::findPrefixChild(Node* node_p, const Level& level)
+{
+    Level key = { level.data_p, level.length - 1 };
+    auto it = node_p->prefixChildren.find(key);
+    return it != node_p->prefixChildren.end() ? it->second : nullptr;
+}
+
+bool
+TopicTrie::isValid(const char* pattern_p)
+{
+    Level levels[MAX_LEVELS];
+    return splitLevels(pattern_p, levels) <= MAX_LEVELS;
+}
+
+bool
+TopicTrie::isWildcard(const char* pattern_p)
+{
+    Level levels[MAX_LEVELS];
+    size_t count = splitLevels(pattern_p, levels);
+    if (count > MAX_LEVELS) { return false; }
+
+    for (size_t i=0; i<count; i++)
+    {
+        const Level& level = levels[i];
+        if (level.length > 0 && level.data_p[level.length - 1] == '*')
+        {
+            return true;
+        }
+    }
+
+    const Level& last = levels[count - 1];
+    return last.length == 1 && last.data_p[0] == '>';
+}
+
+bool
+TopicTrie::add(const char* pattern_p, topicId_t topicId)
+{
+    Level levels[MAX_LEVELS];
+    size_t count = splitLevels(pattern_p, levels);
+    if (count > MAX_LEVELS) { return false; }
+
+    Node* node_p = root_mp;
+    for (size_t i=0; i<count; i++)
+    {
+        const Level& level = levels[i];
+
+        // A trailing '>' matches one or more levels after the current node
+        //
+        if (i == count - 1 && level.length == 1 && level.data_p[0] == '>')
+        {
+            node_p->remainderIds.push_back(topicId);
+            size_m++;
+            return true;
+        }
+
+        Node* child_p = nullptr;
+        if (level.length == 1 && level.data_p[0] == '*')
+        {
+            if (node_p->anyChild_mp == nullptr)
+            {
+                node_p->anyChild_mp = new Node();
+                node_p->anyChild_mp->level = "*";
+            }
+            child_p = node_p->anyChild_mp;
+        }
+        else if (isPrefixLevel(level))
+        {
+            child_p = findPrefixChild(node_p, level);
+            if (child_p == nullptr)
+            {
+                child_p = new Node();
+                child_p->level.assign(level.data_p, level.length);
+                Level key = { child_p->level.data(), level.length - 1 };
+                node_p->prefixChildren[key] = child_p;
+
+                std::vector<size_t>& lengths = node_p->prefixLengths;
+                auto lengthIt = std::lower_bound(lengths.begin(),
+                                                 lengths.end(), key.length);
+                if (lengthIt == lengths.end() || *lengthIt != key.length)
+                {
+                    lengths.insert(lengthIt, key.length);
+                }
+            }
+        }
+        else
+        {
+            auto it = node_p->children.find(level);
+            if (it != node_p->children.end())
+            {
+                child_p = it->second;
+            }
+            else
+            {
+                child_p = new Node();
+                child_p->level.assign(level.data_p, level.length);
+                Level key = { child_p->level.data(), child_p->level.size() };
+                node_p->children[key] = child_p;
+            }
+        }
+
+        node_p = child_p;
+    }
+
+    node_p->ids.push_back(topicId);
+    size_m++;
+    return true;
+}
+
+bool
+TopicTrie::remove(const char* pattern_p, topicId_t topicId)
+{
+    Level levels[MAX_LEVELS];
+    size_t count = splitLevels(pattern_p, levels);
+    if (count > MAX_LEVELS) { return false; }
+
+    // Walk down the trie remembering the path so that nodes left empty can be
+    // pruned afterwards
+    //
+    Node* path[MAX_LEVELS + 1];
+    size_t depth = 0;
+    path[depth++] = root_mp;
+
+    bool remainder = false;
+    Node* node_p = root_mp;
+    for (size_t i=0; i<count; i++)
+    {
+        const Level& level = levels[i];
+
+        if (i == count - 1 && level.length == 1 && level.data_p[0] == '>')
+        {
+            remainder = true;
+            break;
+        }
+
+        Node* child_p = nullptr;
+        if (level.length == 1 && level.data_p[0] == '*')
+        {
+            child_p = node_p->anyChild_mp;
+        }
+        else if (isPrefixLevel(level))
+        {
+            child_p = findPrefixChild(node_p, level);
+        }
+        else
+        {
+            auto it = node_p->children.find(level);
+            if (it != node_p->children.end()) { child_p = it->second; }
+        }
+
+        if (child_p == nullptr) { return false; }
+
+        node_p = child_p;
+        path[depth++] = node_p;
+    }
+
+    std::vector<topicId_t>& ids = remainder?node_p->remainderIds:node_p->ids;
+    auto it = std::find(ids.begin(), ids.end(), topicId);
+    if (it == ids.end()) { return false; }
+    ids.erase(it);
+    size_m--;
+
+    // Prune empty nodes from the bottom up, never removing the root
+    //
+    while (depth > 1 && path[depth - 1]->isEmpty())
+    {
+        Node* child_p = path[depth - 1];
+        Node* parent_p = path[depth - 2];
+
+        if (parent_p->anyChild_mp == child_p)
+        {
+            parent_p->anyChild_mp = nullptr;
+        }
+        else if (isPrefixLevel({ child_p->level.data(),
+                                 child_p->level.size() }))
+        {
+            size_t length = child_p->level.size() - 1;
+            Level key = { child_p->level.data(), length };
+            parent_p->prefixChildren.erase(key);
+
+            // Keep the length while another prefix child has it
+            //
+            bool inUse = false;
+            for (const auto& it : parent_p->prefixChildren)
+            {
+                if (it.first.length == length) { inUse = true; break; }
+            }
+            if (!inUse)
+            {
+                std::vector<size_t>& lengths = parent_p->prefixLengths;
+                lengths.erase(std::lower_bound(lengths.begin(),
+                                               lengths.end(), length));
+            }
+        }
+        else
+        {
+            Level key = { child_p->level.data(), child_p->level.size() };
+            parent_p->children.erase(key);
+        }
+
+        delete child_p;
+        depth--;
+    }
+
+    return true;
+}
+
+size_t
+TopicTrie::match(const char* topic_p, topicId_t* ids_p, size_t max) const
+{
+    Level levels[MAX_LEVELS];
+    size_t levelCount = splitLevels(topic_p, levels);
+    if (levelCount > MAX_LEVELS) { return 0; }
+
+    struct Pending
+    {
+        const Node* node_p;
+        size_t      depth;
+    };
+    Pending stack[MATCH_STACK_SIZE];
+    size_t stackSize = 0;
+    size_t count = 0;
+    bool overflow = false;
+
+    stack[stackSize++] = { root_mp, 0 };
+
+    while (stackSize > 0)
+    {
+        Pending pending = stack[--stackSize];
+        const Node* node_p = pending.node_p;
+
+        // All levels consumed: subscriptions ending at this node match
+        //
+        if (pending.depth == levelCount)
+        {
+            for (topicId_t id : node_p->ids)
+            {
+                if (count < max) { ids_p[count++] = id; }
+            }
+            continue;
+        }
+
+        // At least one level remains, so a '>' after this node matches
+        //
+        for (topicId_t id : node_p->remainderIds)
+        {
+            if (count < max) { ids_p[count++] = id; }
+        }
+
+        const Level& level = levels[pending.depth];
+        size_t nextDepth = pending.depth + 1;
+
+        const Node* next[2] = { nullptr, node_p->anyChild_mp };
+        auto it = node_p->children.find(level);
+        if (it != node_p->children.end()) { next[0] = it->second; }
+
+        for (const Node* child_p : next)
+        {
+            if (child_p == nullptr) { continue; }
+            if (stackSize == MATCH_STACK_SIZE) { overflow = true; continue; }
+            stack[stackSize++] = { child_p, nextDepth };
+        }
+
+        // A 'prefix*' child matches if its prefix is one of the level's, of
+        // which only the lengths in use need looking up. The lengths are
+        // sorted, so the rest are longer than the level.
+        //
+        for (size_t length : node_p->prefixLengths)
+        {
+            if (length > level.length) { break; }
+
+            Level key = { level.data_p, length };
+            auto prefixIt = node_p->prefixChildren.find(key);
+            if (prefixIt == node_p->prefixChildren.end()) { continue; }
+            if (stackSize == MATCH_STACK_SIZE) { overflow = true; continue; }
+            stack[stackSize++] = { prefixIt->second, nextDepth };
+        }
+    }
+
+    if (overflow)
+    {
+        LOG(ERROR, "Topic '" << topic_p << "' matches more wildcard branches "
+                   << "than " << MATCH_STACK_SIZE << "; some matching "
+                   << "subscriptions were skipped");
+    }
+
+    return count;
+}
+
+} /* namespace topicMonitor */
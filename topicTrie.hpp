@@ -0,0 +1,157 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_TOPIC_TRIE_HPP_
+#define _TOPIC_MONITOR_TOPIC_TRIE_HPP_
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hpp"
+
+namespace topicMonitor
+{
+
+// This class matches topics against a set of Solace topic subscriptions, which
+// may contain wildcards:
+//
+// * A level consisting only of '*' matches exactly one level of any value.
+// * A level ending in '*' (e.g. "temp*") matches one level starting with the
+//   characters before the '*'.
+// * A last level of '>' matches one or more remaining levels.
+//
+// Subscriptions are stored in a trie with one node per topic level, so
+// matching a topic costs O(topic levels) hash lookups plus one step for every
+// wildcard branch that actually applies, independent of the total number of
+// subscriptions. Prefix levels are found by looking up each prefix length in
+// use at the node, so "temp*" next to thousands of other prefixes still costs
+// a few lookups.
+//
+// This class is not thread-safe, except that match() may run on several
+// threads at once while nothing modifies the trie. SubscriptionRegistry only
+// matches against tries it no longer modifies.
+//
+class TopicTrie
+{
+public:
+    static const size_t MAX_LEVELS = 128;
+
+    TopicTrie(void) : root_mp(new Node()), size_m(0) {}
+    ~TopicTrie(void) { delete root_mp; }
+
+    TopicTrie(const TopicTrie&) = delete;
+    TopicTrie& operator=(const TopicTrie&) = delete;
+
+    bool add(const char* pattern_p, topicId_t topicId);
+    bool remove(const char* pattern_p, topicId_t topicId);
+
+    // Writes the ids of up to max subscriptions matching topic_p to ids_p and
+    // returns the number of matches. Does not allocate.
+    //
+    size_t match(const char* topic_p, topicId_t* ids_p, size_t max) const;
+
+    size_t size(void) const { return size_m; }
+
+    static bool isWildcard(const char* pattern_p);
+
+    // Whether add() accepts the pattern
+    //
+    static bool isValid(const char* pattern_p);
+
+private:
+    // A non-owning view of one level of a topic
+    //
+    struct Level
+    {
+        const char* data_p;
+        size_t      length;
+    };
+
+    struct LevelHash
+    {
+        size_t operator()(const Level& level) const
+        {
+            uint32_t hash = 2166136261u;
+            for (size_t i=0; i<level.length; i++)
+            {
+                hash ^= (uint8_t)level.data_p[i];
+                hash *= 16777619u;
+            }
+            return hash;
+        }
+    };
+
+    struct LevelEqual
+    {
+        bool operator()(const Level& a, const Level& b) const
+        {
+            return a.length == b.length
+                   && memcmp(a.data_p, b.data_p, a.length) == 0;
+        }
+    };
+
+    struct Node
+    {
+        typedef std::unordered_map<Level, Node*, LevelHash, LevelEqual>
+            ChildMap;
+
+        Node(void) : anyChild_mp(nullptr) {}
+        ~Node(void);
+
+        bool isEmpty(void) const;
+
+        // The child maps' keys point into the child's own level string, which
+        // never moves since nodes are heap-allocated. A prefix child is keyed
+        // by its level without the trailing '*'.
+        //
+        std::string            level;
+        ChildMap               children;
+        Node*                  anyChild_mp;     // '*'
+        ChildMap               prefixChildren;  // 'prefix*'
+        std::vector<size_t>    prefixLengths;   // of prefixChildren, sorted
+        std::vector<topicId_t> ids;             // subscriptions ending here
+        std::vector<topicId_t> remainderIds;    // '>' following this node
+    };
+
+    static size_t splitLevels(const char* topic_p, Level* levels_p);
+    static bool isPrefixLevel(const Level& level);
+
+    // The prefix child of node_p for a level ending in '*', or nullptr
+    //
+    static Node* findPrefixChild(Node* node_p, const Level& level);
+
+    Node*  root_mp;
+    size_t size_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_TOPIC_TRIE_HPP_ */
@@ -0,0 +1,84 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "transport.hpp"
+
+#include "config.hpp"
+#include "log.hpp"
+#include "mockTransport.hpp"
+#include "replayTransport.hpp"
+#include "solClientThread.hpp"
+
+namespace topicMonitor
+{
+
+Transport* Transport::instance_mps = nullptr;
+
+Transport*
+Transport::instance(void)
+{
+    if (instance_mps == nullptr)
+    {
+        switch (Config::instance()->getTransport())
+        {
+        case transportType_t::MOCK:
+            instance_mps = new MockTransport();
+            break;
+        case transportType_t::REPLAY:
+            instance_mps = new ReplayTransport();
+            break;
+        case transportType_t::SOLCLIENT:
+        default:
+            instance_mps = new SolClientThread();
+            break;
+        }
+    }
+
+    return instance_mps;
+}
+
+size_t
+Transport::publishMultiple(solClient_opaqueMsg_pt* msgs_p, size_t count)
+{
+    size_t sent = 0;
+    for (size_t i=0; i<count; i++)
+    {
+        if (publish(msgs_p[i]) == returnCode_t::SUCCESS) { sent++; }
+    }
+
+    return sent;
+}
+
+returnCode_t
+Transport::queueBind(std::string queue, topicId_t topicId, uint32_t maxUnacked)
+{
+    LOG(ERROR, "Queue '" << queue << "' not supported by this transport");
+    return returnCode_t::FAILURE;
+}
+
+} /* namespace topicMonitor */
@@ -0,0 +1,119 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_TRANSPORT_HPP_
+#define _TOPIC_MONITOR_TRANSPORT_HPP_
+
+#include <solclient/solClient.h>
+#include <solclient/solClientMsg.h>
+#include <string>
+
+#include "common.hpp"
+
+namespace topicMonitor
+{
+
+// The connection to the message broker, selected by the transport key of
+// config.lua: SolClientThread for a Solace broker, MockTransport, which
+// generates messages in process, or ReplayTransport, which replays a capture
+// file.
+//
+// Received messages are handed to MonitoringThread::pushMessage(), which
+// takes ownership of those matching a subscription; the transport frees the
+// others. The timer pushes MonitoringThread::pushTimerTick() every second.
+//
+class Transport
+{
+public:
+    // Creates the transport selected by Config on first use
+    //
+    static Transport* instance(void);
+    virtual ~Transport(void) {}
+
+    virtual returnCode_t connect(void) = 0;
+    virtual returnCode_t disconnect(void) = 0;
+
+    virtual returnCode_t topicSubscribe(std::string topic) = 0;
+    virtual returnCode_t topicUnsubscribe(std::string topic) = 0;
+
+    // Sends the subscription request without waiting for the broker to
+    // confirm it. The outcome is reported later, possibly from another
+    // thread, through MonitoringThread::confirmSubscription(topicId).
+    //
+    virtual returnCode_t topicSubscribeAsync(std::string topic,
+                                             topicId_t topicId) = 0;
+
+    virtual returnCode_t startTimer(void) = 0;
+    virtual returnCode_t stopTimer(void) = 0;
+
+    // Publishes a message; the caller keeps ownership of it
+    //
+    virtual returnCode_t publish(solClient_opaqueMsg_pt msg_p) = 0;
+
+    // Publishes count messages in order, as few calls to the broker as the
+    // transport allows, and returns how many were sent. The caller keeps
+    // ownership of them. May block; only called by the Publisher thread.
+    //
+    virtual size_t publishMultiple(solClient_opaqueMsg_pt* msgs_p,
+                                   size_t count);
+
+    // Binds a guaranteed subscription to its queue, waiting for the broker.
+    // The flow's messages are handed to MonitoringThread::pushFlowMessage().
+    // Only solClient supports queues.
+    //
+    virtual returnCode_t queueBind(std::string queue,
+                                   topicId_t topicId,
+                                   uint32_t maxUnacked);
+
+    // Unbinds the flow of a guaranteed subscription without waiting for the
+    // broker. Messages it delivered that are not acknowledged yet stay in the
+    // queue, for the next bind.
+    //
+    virtual returnCode_t queueUnbind(topicId_t topicId)
+        { return returnCode_t::NOTHING_TO_DO; }
+
+    // Acknowledges messages received through queueBind(), which the
+    // workers pass in batches. May be called from any thread.
+    //
+    virtual void acknowledge(const AckEntry* acks_p, size_t count) {}
+
+    // Called by MonitoringThread every report interval to log the
+    // transport's own statistics
+    //
+    virtual void reportStatistics(void) {}
+
+protected:
+    Transport(void) {}
+
+private:
+    static Transport* instance_mps;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_TRANSPORT_HPP_ */
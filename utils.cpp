@@ -28,11 +28,66 @@
 //******************************************************************************
 #include "utils.hpp"
 
+#include <ctime>
+
 namespace topicMonitor
 {
 namespace utils
 {
 
+uint64_t
+getMonotonicTimeMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint32_t
+hashTopic(const char* topic_p)
+{
+    uint32_t hash = 2166136261u;
+    for (const char* c_p = topic_p; *c_p != '\0'; c_p++)
+    {
+        hash ^= (uint8_t)*c_p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+returnCode_t
+getPayload(solClient_opaqueMsg_pt msg_p, const char*& data_p, size_t& size)
+{
+    // A payload set with solClient_msg_setBinaryAttachmentString() is encoded
+    // as a structured string, whose raw bytes include an encoding header, so
+    // try it as a string first
+    //
+    const char* string_p;
+    if (solClient_msg_getBinaryAttachmentString(msg_p, &string_p)
+            == SOLCLIENT_OK)
+    {
+        data_p = string_p;
+        size = strlen(string_p);
+        return returnCode_t::SUCCESS;
+    }
+
+    void* ptr_p;
+    solClient_uint32_t length;
+    switch (solClient_msg_getBinaryAttachmentPtr(msg_p, &ptr_p, &length))
+    {
+    case SOLCLIENT_OK:
+        data_p = (const char*)ptr_p;
+        size = length;
+        return returnCode_t::SUCCESS;
+    case SOLCLIENT_NOT_FOUND:
+        data_p = "";
+        size = 0;
+        return returnCode_t::SUCCESS;
+    default:
+        return returnCode_t::FAILURE;
+    }
+}
+
 std::string
 lua::getStringValueFromSymbol(lua_State* L, std::string symbol)
 {
@@ -80,8 +135,11 @@ lua::loadFileInEnv(lua_State* L, std::string filename, std::string env)
     lua_setmetatable(L, -2); // T1 = T2, pops T2
     lua_setfield(L, LUA_REGISTRYINDEX, env.c_str()); // REGISTRY[env_p] = T1, pops T1
     lua_getfield(L, LUA_REGISTRYINDEX, env.c_str()); // Pushes T1
-    lua_setupvalue(L, 1, 1); // TODO (BTO): What the heck does this do????
-    lua_pcall(L, 0, LUA_MULTRET, 0); // Runs the file in the lua env
+    lua_setupvalue(L, -2, 1); // Sets T1 as the _ENV upvalue of the chunk, pops T1
+    if (lua_pcall(L, 0, 0, 0) != LUA_OK) // Runs the file in the lua env
+    {
+        return returnCode_t::FAILURE; // Error message is left on the stack
+    }
 
     return returnCode_t::SUCCESS;
 }
@@ -96,13 +154,66 @@ lua::isFuncInEnv(lua_State* L, std::string env, std::string func)
     return isFunction;
 }
 
-returnCode_t
-lua::callMessageFunc(lua_State* L, std::string env, std::string data)
+// Returns a reference to the env table created by loadFileInEnv(), which can
+// be pushed with lua_rawgeti(L, LUA_REGISTRYINDEX, ref) without a string
+// lookup
+//
+int
+lua::refEnv(lua_State* L, std::string env)
 {
     lua_getfield(L, LUA_REGISTRYINDEX, env.c_str());
-    lua_getfield(L, -1, LUA_MESSAGE_FUNC);
-    lua_pushstring(L, data.c_str());
-    if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+    if (!lua_istable(L, -1))
+    {
+        lua_pop(L, 1);
+        return LUA_NOREF;
+    }
+
+    return luaL_ref(L, LUA_REGISTRYINDEX); // Pops env table
+}
+
+// Returns a reference to function func_p in the env table referenced by
+// envRef, or LUA_NOREF if there is no such function or env table
+//
+int
+lua::refFuncInEnv(lua_State* L, int envRef, const char* func_p)
+{
+    if (envRef == LUA_NOREF) { return LUA_NOREF; }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, envRef);
+    lua_getfield(L, -1, func_p);
+    lua_remove(L, -2); // Pop env table
+
+    if (!lua_isfunction(L, -1))
+    {
+        lua_pop(L, 1);
+        return LUA_NOREF;
+    }
+
+    return luaL_ref(L, LUA_REGISTRYINDEX); // Pops function
+}
+
+void
+lua::unref(lua_State* L, int ref)
+{
+    luaL_unref(L, LUA_REGISTRYINDEX, ref);
+}
+
+// Calls onMessage() with the payload buffer, the (possibly wildcard)
+// subscription the message matched and the message object. On failure, the
+// error message is left on the top of the stack.
+//
+returnCode_t
+lua::callMessageFunc(lua_State* L,
+                     int funcRef,
+                     int payloadRef,
+                     int subscriptionRef,
+                     int messageRef)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, funcRef);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, payloadRef);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, subscriptionRef);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, messageRef);
+    if (lua_pcall(L, 3, 0, 0) != LUA_OK)
     {
         return returnCode_t::FAILURE;
     }
@@ -110,11 +221,50 @@ lua::callMessageFunc(lua_State* L, std::string env, std::string data)
     return returnCode_t::SUCCESS;
 }
 
+// Calls onBatch() with an array of the payload buffers of the messages, the
+// subscription they matched and an array of the message objects. On failure,
+// the error message is left on the top of the stack.
+//
 returnCode_t
-lua::callTimerFunc(lua_State* L, std::string env)
+lua::callBatchFunc(lua_State* L,
+                   int funcRef,
+                   const int* payloadRefs_p,
+                   const int* messageRefs_p,
+                   size_t count,
+                   int subscriptionRef)
 {
-    lua_getfield(L, LUA_REGISTRYINDEX, env.c_str());
-    lua_getfield(L, -1, LUA_TIMER_FUNC);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, funcRef);
+
+    lua_createtable(L, count, 0);
+    for (size_t i=0; i<count; i++)
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, payloadRefs_p[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, subscriptionRef);
+
+    lua_createtable(L, count, 0);
+    for (size_t i=0; i<count; i++)
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, messageRefs_p[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    if (lua_pcall(L, 3, 0, 0) != LUA_OK)
+    {
+        return returnCode_t::FAILURE;
+    }
+
+    return returnCode_t::SUCCESS;
+}
+
+// On failure, the error message is left on the top of the stack
+//
+returnCode_t
+lua::callTimerFunc(lua_State* L, int funcRef)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, funcRef);
     if (lua_pcall(L, 0, 0, 0) != LUA_OK)
     {
         return returnCode_t::FAILURE;
@@ -123,6 +273,59 @@ lua::callTimerFunc(lua_State* L, std::string env)
     return returnCode_t::SUCCESS;
 }
 
+// Calls a callback added with timer.after() or timer.every() with the id of
+// its timer. On failure, the error message is left on the top of the stack.
+//
+returnCode_t
+lua::callTimerCallback(lua_State* L, int funcRef, uint64_t timerId)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, funcRef);
+    lua_pushnumber(L, timerId);
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+    {
+        return returnCode_t::FAILURE;
+    }
+
+    return returnCode_t::SUCCESS;
+}
+
+// Calls onSessionDown() with the subscription whose session went down. On
+// failure, the error message is left on the top of the stack.
+//
+returnCode_t
+lua::callSessionDownFunc(lua_State* L, int funcRef, int subscriptionRef)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, funcRef);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, subscriptionRef);
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+    {
+        return returnCode_t::FAILURE;
+    }
+
+    return returnCode_t::SUCCESS;
+}
+
+// Calls onSessionUp() with the subscription and how long its session was
+// down, in milliseconds. On failure, the error message is left on the top of
+// the stack.
+//
+returnCode_t
+lua::callSessionUpFunc(lua_State* L,
+                       int funcRef,
+                       int subscriptionRef,
+                       uint64_t outage)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, funcRef);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, subscriptionRef);
+    lua_pushnumber(L, outage);
+    if (lua_pcall(L, 2, 0, 0) != LUA_OK)
+    {
+        return returnCode_t::FAILURE;
+    }
+
+    return returnCode_t::SUCCESS;
+}
+
 void
 lua::stackTrace(lua_State *L)
 {
@@ -29,6 +29,8 @@
 #ifndef _TOPIC_MONITOR_UTILS_HPP_
 #define _TOPIC_MONITOR_UTILS_HPP_
 
+#include <cstdint>
+#include <cstring>
 #include <lua5.2/lua.hpp>
 #include <string>
 
@@ -39,6 +41,37 @@ namespace topicMonitor
 namespace utils
 {
 
+// Milliseconds on CLOCK_MONOTONIC, which is not affected by changes to the
+// system time
+//
+uint64_t getMonotonicTimeMs(void);
+
+// Hashes a topic string (FNV-1a). Used to assign topics to workers.
+//
+uint32_t hashTopic(const char* topic_p);
+
+// Hash and equality functors for C-string keyed unordered containers, which
+// can be searched without constructing a std::string.
+//
+struct CStringHash
+{
+    size_t operator()(const char* s_p) const { return hashTopic(s_p); }
+};
+
+struct CStringEqual
+{
+    bool operator()(const char* a_p, const char* b_p) const
+        { return strcmp(a_p, b_p) == 0; }
+};
+
+// Gets a pointer to the payload of the message without copying it. String
+// payloads are returned without their terminating NUL and any other payload as
+// raw bytes; a message without a payload has an empty payload.
+//
+returnCode_t getPayload(solClient_opaqueMsg_pt msg_p,
+                        const char*& data_p,
+                        size_t& size);
+
 namespace lua
 {
     std::string getStringValueFromSymbol(lua_State* L,
@@ -52,12 +85,44 @@ namespace lua
                      std::string env,
                      std::string func);
 
+    int refEnv(lua_State* L,
+               std::string env);
+
+    int refFuncInEnv(lua_State* L,
+                     int envRef,
+                     const char* func_p);
+
+    void unref(lua_State* L,
+               int ref);
+
     returnCode_t callMessageFunc(lua_State* L,
-                                 std::string env,
-                                 std::string data);
+                                 int funcRef,
+                                 int payloadRef,
+                                 int subscriptionRef,
+                                 int messageRef);
+
+    returnCode_t callBatchFunc(lua_State* L,
+                               int funcRef,
+                               const int* payloadRefs_p,
+                               const int* messageRefs_p,
+                               size_t count,
+                               int subscriptionRef);
 
     returnCode_t callTimerFunc(lua_State* L,
-                               std::string env);
+                               int funcRef);
+
+    returnCode_t callTimerCallback(lua_State* L,
+                                   int funcRef,
+                                   uint64_t timerId);
+
+    returnCode_t callSessionDownFunc(lua_State* L,
+                                     int funcRef,
+                                     int subscriptionRef);
+
+    returnCode_t callSessionUpFunc(lua_State* L,
+                                   int funcRef,
+                                   int subscriptionRef,
+                                   uint64_t outage);
 
     void stackTrace(lua_State *L);
 } /* namespace lua */
@@ -0,0 +1,291 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "workLanes.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#include "log.hpp"
+#include "mpscRingBuffer.hpp"
+
+namespace topicMonitor
+{
+
+// Weights of the message lanes with weighted scheduling, by priority
+//
+static const size_t LANE_WEIGHTS[WORK_LANE_COUNT] = { 0, 4, 2, 1 };
+static const size_t LANE_WEIGHT_TOTAL = 7;
+
+static const char* const LANE_NAMES[WORK_LANE_COUNT] =
+    { "control", "high", "normal", "low" };
+
+// Minimum time between two QUEUE_STAMPs of a lane, in microseconds
+//
+static const uint64_t STAMP_INTERVAL_US = 1000;
+
+WorkLanes::WorkLanes(size_t controlCapacity,
+                     size_t messageCapacity,
+                     laneScheduling_t scheduling,
+                     bool singleLane) :
+    scheduling_m(scheduling),
+    singleLane_m(singleLane),
+    parked_m(false)
+{
+    uint32_t normalLane = getLane(priority_t::NORMAL);
+    for (uint32_t lane=0; lane<WORK_LANE_COUNT; lane++)
+    {
+        // A single lane takes the control entries too; the others stay
+        // unused
+        //
+        size_t capacity = (lane == CONTROL_LANE) ? controlCapacity
+                                                 : messageCapacity;
+        if (singleLane_m)
+        {
+            capacity = (lane == normalLane) ? controlCapacity + messageCapacity
+                                            : 0;
+        }
+        lanes_mp[lane] = new Lane(capacity);
+    }
+}
+
+WorkLanes::~WorkLanes(void)
+{
+    for (uint32_t lane=0; lane<WORK_LANE_COUNT; lane++)
+    {
+        delete lanes_mp[lane];
+    }
+}
+
+uint64_t
+WorkLanes::nowUs(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void
+WorkLanes::push(const WorkEntry& entry, uint32_t lane)
+{
+    if (singleLane_m) { lane = getLane(priority_t::NORMAL); }
+    Lane& target = *lanes_mp[lane];
+
+    if (target.stampArmed.load(std::memory_order_relaxed)
+            && target.stampArmed.exchange(false, std::memory_order_relaxed))
+    {
+        uint64_t now = nowUs();
+        target.stampTime.store(now, std::memory_order_relaxed);
+        target.queue.push(WorkEntry::queueStamp(now), false);
+    }
+    target.queue.push(entry, false);
+
+    wakeConsumer();
+}
+
+size_t
+WorkLanes::popLane(uint32_t lane,
+                   WorkEntry* entries_p,
+                   size_t max,
+                   uint64_t now)
+{
+    Lane& source = *lanes_mp[lane];
+    size_t count = source.queue.tryPopMany(entries_p, max);
+
+    // Takes the stamps out in place
+    //
+    size_t kept = 0;
+    for (size_t i=0; i<count; i++)
+    {
+        if (entries_p[i].getType() == workType_t::QUEUE_STAMP)
+        {
+            uint64_t time = entries_p[i].getTime();
+            source.lastDelay = now > time ? now - time : 0;
+            source.delay.record(source.lastDelay);
+            source.stampTime.store(0, std::memory_order_relaxed);
+            source.armAt = now + STAMP_INTERVAL_US;
+            continue;
+        }
+
+        entries_p[kept++] = entries_p[i];
+    }
+
+    // Nothing is left waiting behind the entries taken
+    //
+    if (count < max) { source.lastDelay = 0; }
+
+    return kept;
+}
+
+size_t
+WorkLanes::tryPopMany(WorkEntry* entries_p, size_t max)
+{
+    uint64_t now = nowUs();
+    for (uint32_t lane=0; lane<WORK_LANE_COUNT; lane++)
+    {
+        Lane& source = *lanes_mp[lane];
+        if (source.armAt != 0 && now >= source.armAt)
+        {
+            source.armAt = 0;
+            source.stampArmed.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    size_t count = popLane(CONTROL_LANE, entries_p, max, now);
+
+    if (scheduling_m == laneScheduling_t::WEIGHTED && count < max)
+    {
+        size_t share = max - count;
+        for (uint32_t lane=CONTROL_LANE+1; lane<WORK_LANE_COUNT; lane++)
+        {
+            size_t quota = std::max<size_t>(
+                               share * LANE_WEIGHTS[lane] / LANE_WEIGHT_TOTAL, 1);
+            count += popLane(lane, entries_p + count,
+                             std::min(quota, max - count), now);
+        }
+    }
+
+    // Whatever is left of the drain goes by priority
+    //
+    for (uint32_t lane=CONTROL_LANE+1; lane<WORK_LANE_COUNT && count<max; lane++)
+    {
+        count += popLane(lane, entries_p + count, max - count, now);
+    }
+
+    return count;
+}
+
+bool
+WorkLanes::empty(void) const
+{
+    for (uint32_t lane=0; lane<WORK_LANE_COUNT; lane++)
+    {
+        if (!lanes_mp[lane]->queue.empty()) { return false; }
+    }
+
+    return true;
+}
+
+size_t
+WorkLanes::popMany(WorkEntry* entries_p,
+                   size_t max,
+                   std::chrono::microseconds timeout)
+{
+    size_t count = tryPopMany(entries_p, max);
+    if (count != 0 || timeout.count() == 0) { return count; }
+
+    // Spins, then parks, as MpscRingBuffer::popMany() does, but across all
+    // lanes. An entry may turn out to be a stamp, in which case this returns
+    // 0 early.
+    //
+    for (uint32_t spins = 0; spins < WorkQueue::SPIN_COUNT; spins++)
+    {
+        cpuRelax();
+        if (!empty()) { return tryPopMany(entries_p, max); }
+    }
+
+    parked_m.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_m);
+        if (timeout == std::chrono::microseconds::max())
+        {
+            while (empty()) { cond_m.wait(lock); }
+        }
+        else
+        {
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            while (empty())
+            {
+                if (cond_m.wait_until(lock, deadline)
+                        == std::cv_status::timeout)
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    parked_m.store(false, std::memory_order_relaxed);
+
+    return tryPopMany(entries_p, max);
+}
+
+uint64_t
+WorkLanes::getMessageDelay(void) const
+{
+    uint64_t now = nowUs();
+    uint64_t delay = 0;
+    for (uint32_t lane=CONTROL_LANE+1; lane<WORK_LANE_COUNT; lane++)
+    {
+        const Lane& source = *lanes_mp[lane];
+        delay = std::max(delay, source.lastDelay);
+
+        uint64_t time = source.stampTime.load(std::memory_order_relaxed);
+        if (time != 0 && now > time) { delay = std::max(delay, now - time); }
+    }
+
+    return delay;
+}
+
+void
+WorkLanes::wakeConsumer(void)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parked_m.load(std::memory_order_relaxed))
+    {
+        { std::lock_guard<std::mutex> lock(mutex_m); }
+        cond_m.notify_one();
+    }
+}
+
+void
+WorkLanes::report(uint32_t worker)
+{
+    for (uint32_t lane=0; lane<WORK_LANE_COUNT; lane++)
+    {
+        Lane& source = *lanes_mp[lane];
+        uint64_t samples = source.delay.getCount()
+                           - source.lastReport.getCount();
+        if (samples == 0) { continue; }
+
+        LOG(INFO, "Worker " << worker << " " << LANE_NAMES[lane]
+                  << " lane queue delay p50 "
+                  << source.delay.getPercentile(50.0, &source.lastReport)
+                  << "us, p99 "
+                  << source.delay.getPercentile(99.0, &source.lastReport)
+                  << "us, max "
+                  << source.delay.getPercentile(100.0, &source.lastReport)
+                  << "us (" << samples << " samples), depth "
+                  << source.queue.size());
+
+        source.lastReport.copyFrom(source.delay);
+    }
+}
+
+} /* namespace topicMonitor */
@@ -0,0 +1,173 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef _TOPIC_MONITOR_WORK_LANES_HPP_
+#define _TOPIC_MONITOR_WORK_LANES_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "common.hpp"
+#include "config.hpp"
+#include "histogram.hpp"
+
+namespace topicMonitor
+{
+
+// The lanes of a worker, from the highest priority: control work, then the
+// messages of high, normal and low priority subscriptions
+//
+const uint32_t CONTROL_LANE    = 0;
+const uint32_t WORK_LANE_COUNT = 4;
+
+// This class is the work queue of a MonitoringWorker: one MpscRingBuffer
+// (lane) per priority, so a flood of messages on a low priority topic does
+// not hold up alerts on a high priority one, nor the worker's own control
+// work.
+//
+// Each drain takes whatever control work is queued first: SUBSCRIBE,
+// UNSUBSCRIBE, TIMER_TICK and session events. The message lanes follow either
+// strictly by priority or, with weighted scheduling, each with a share of the
+// drain in proportion to its weight (4, 2 and 1); a share a lane leaves unused
+// goes to the others by priority, so the worker never idles with work queued.
+// The messages of one subscription all go through the same lane and stay in
+// order.
+//
+// With the virtual clock, all entries go through the normal lane instead, so
+// ticks stay in place between the messages they were derived from and replays
+// remain deterministic.
+//
+// The queueing delay of each lane is sampled: about once a millisecond, the
+// next entry queued to a lane is preceded by a QUEUE_STAMP entry holding the
+// time it was queued, which popMany() records into the lane's histogram and
+// never returns. The delay of the latest stamps also tells a worker how far
+// behind it is; see getMessageDelay().
+//
+class WorkLanes
+{
+public:
+    // controlCapacity bounds the control lane, messageCapacity each message
+    // lane
+    //
+    WorkLanes(size_t controlCapacity,
+              size_t messageCapacity,
+              laneScheduling_t scheduling,
+              bool singleLane);
+    ~WorkLanes(void);
+
+    WorkLanes(const WorkLanes&) = delete;
+    WorkLanes& operator=(const WorkLanes&) = delete;
+
+    static uint32_t getLane(priority_t priority)
+        { return CONTROL_LANE + 1 + (uint32_t)priority; }
+
+    // Enqueues an entry to the lane, spinning while the lane is full. Must
+    // never be called from the consumer thread.
+    //
+    void push(const WorkEntry& entry, uint32_t lane);
+
+    // Dequeues up to max entries by the lanes' priorities, blocking until at
+    // least one is available or the timeout has passed. Returns 0 on timeout.
+    //
+    // Must only be called from the consumer thread.
+    //
+    size_t popMany(WorkEntry* entries_p,
+                   size_t max,
+                   std::chrono::microseconds timeout =
+                       std::chrono::microseconds::max());
+
+    // Returns how long, in microseconds, messages currently wait in the
+    // longest of the message lanes: the delay of the lane's last stamp, or
+    // the age of the stamp still queued if that is longer, and 0 once the
+    // lane has been found empty. Must only be called from the consumer
+    // thread.
+    //
+    uint64_t getMessageDelay(void) const;
+
+    // Logs the queueing delay of every lane sampled since the last call, and
+    // its approximate depth. May be called from any thread.
+    //
+    void report(uint32_t worker);
+
+private:
+    struct Lane
+    {
+        explicit Lane(size_t capacity) :
+            queue(capacity),
+            stampArmed(true),
+            stampTime(0),
+            armAt(0),
+            lastDelay(0) {}
+
+        WorkQueue             queue;
+
+        // Set by the consumer when the next entry queued should be preceded
+        // by a QUEUE_STAMP; taken by the producer that queues it
+        //
+        std::atomic<bool>     stampArmed;
+
+        // When the queued stamp was queued, 0 while none is
+        //
+        std::atomic<uint64_t> stampTime;
+
+        // When the consumer arms the stamp again, 0 while a stamp is queued
+        //
+        uint64_t              armAt;
+        Histogram             delay;
+
+        // The delay of the last stamp taken, 0 once the lane was drained
+        //
+        uint64_t              lastDelay;
+
+        // Only used by report()
+        //
+        Histogram             lastReport;
+    };
+
+    static uint64_t nowUs(void);
+
+    bool empty(void) const;
+    size_t popLane(uint32_t lane, WorkEntry* entries_p, size_t max, uint64_t now);
+    size_t tryPopMany(WorkEntry* entries_p, size_t max);
+    void wakeConsumer(void);
+
+    Lane*                   lanes_mp[WORK_LANE_COUNT];
+    laneScheduling_t        scheduling_m;
+    bool                    singleLane_m;
+    std::atomic<bool>       parked_m;
+    std::mutex              mutex_m;
+    std::condition_variable cond_m;
+};
+
+} /* namespace topicMonitor */
+
+#endif /* _TOPIC_MONITOR_WORK_LANES_HPP_ */